@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "can_messages.h"
+
+// IDs with per-byte value histograms
+#ifndef HISTOGRAM_IDS
+#define HISTOGRAM_IDS 4
+#endif
+
+// Byte pairs with a 2D histogram; each belongs to one of the selected IDs
+#ifndef HISTOGRAM_PAIRS
+#define HISTOGRAM_PAIRS 2
+#endif
+
+// Value histograms for reverse engineering a few selected IDs: 256 bins for
+// each payload byte, and for chosen byte pairs (read as a 16-bit value) a
+// 32 x 32 grid of 8 x 8 value cells. A full 65536-bin histogram per pair
+// would not fit. Counters are 16 bits and saturate. Every frame is counted,
+// sampled or not; IDs that are not selected cost one table lookup.
+// Storage is a fixed pool allocated in begin().
+class ByteHistogram
+{
+public:
+    static constexpr uint16_t BINS = 256;
+    static constexpr uint8_t PAIR_SHIFT = 3;                    // Each cell is 8 values of each byte
+    static constexpr uint16_t PAIR_BINS = 256 >> PAIR_SHIFT;    // Cells per axis
+    static constexpr uint8_t NOT_SELECTED = 0xFF;
+
+    enum class ExportStage : uint8_t
+    {
+        Prefix,
+        Values,
+        Suffix,
+        Done
+    };
+
+    // Streaming JSON export of one histogram as an array of rows: one row
+    // per payload byte, or one row per cell of the first byte of a pair
+    struct Export
+    {
+        ExportStage stage = ExportStage::Prefix;
+        uint32_t id = 0;
+        uint32_t frames = 0;
+        int8_t pairFirst = -1;          // -1 for the per-byte histogram
+        int8_t pairSecond = -1;
+        const uint16_t* counts = nullptr;
+        uint16_t rows = 0;
+        uint16_t columns = 0;
+        uint32_t next = 0;
+        char row[128];
+        size_t rowLength = 0;
+        size_t rowSent = 0;
+    };
+
+    static bool begin(uint16_t capacity);
+    // The slot now holds id; binds it to its histogram if the ID is selected
+    static void bindSlot(uint16_t slot, uint32_t id);
+
+    static void record(uint16_t slot, const CANMessage& msg)
+    {
+        uint8_t index = s_slotIndex[slot];
+        if (index != NOT_SELECTED)
+        {
+            recordSelected(index, msg);
+        }
+    }
+
+    // Selecting an ID that is already selected clears nothing and succeeds;
+    // false when all IDs or pairs of the pool are in use
+    static bool select(uint32_t id);
+    // Also removes the ID's pairs; false when it was not selected
+    static bool unselect(uint32_t id);
+    // Selects the ID as well when needed; bytes are 0 to 7 and distinct
+    static bool addPair(uint32_t id, uint8_t first, uint8_t second);
+    static bool removePair(uint32_t id, uint8_t first, uint8_t second);
+    static uint8_t selectedCount();
+    static uint32_t selectedId(uint8_t index);
+    static uint8_t pairCount();
+    // Pairs in pool order; index counts pairs in use only
+    static bool pairAt(uint8_t index, uint32_t& id, uint8_t& first, uint8_t& second);
+
+    // False when the ID (or pair) is not selected
+    static bool beginExport(Export& exp, uint32_t id);
+    static bool beginPairExport(Export& exp, uint32_t id, uint8_t first, uint8_t second);
+    static size_t fill(Export& exp, uint8_t* buffer, size_t maxLen);
+    static size_t memoryBytes();
+
+private:
+    struct Pair
+    {
+        uint32_t id;
+        uint8_t index;          // Selected ID it belongs to; NOT_SELECTED when unused
+        uint8_t first;
+        uint8_t second;
+        uint32_t frames;
+    };
+
+    static uint8_t* s_slotIndex;
+    static uint16_t s_capacity;
+    static uint16_t* s_counts;          // HISTOGRAM_IDS x 8 bytes x BINS
+    static uint16_t* s_pairCounts;      // HISTOGRAM_PAIRS x PAIR_BINS x PAIR_BINS
+    static uint32_t s_ids[HISTOGRAM_IDS];
+    static bool s_used[HISTOGRAM_IDS];
+    static uint32_t s_frames[HISTOGRAM_IDS];
+    static Pair s_pairs[HISTOGRAM_PAIRS];
+
+    static void recordSelected(uint8_t index, const CANMessage& msg);
+    static int8_t findId(uint32_t id);
+    static int8_t findPair(uint32_t id, uint8_t first, uint8_t second);
+    static void setSlotIndex(uint32_t id, uint8_t index);
+    static bool renderNext(Export& exp);
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include "can_messages.h"
+
+// Receive pipeline shared by the firmware and the host build: state table
+// lookup (with LRU eviction), exact statistics, view sampling, latest/previous
+// state, change tracking, rate history, the top-ID rankings, the table's sort
+// orders and byte histograms. Storage for all stages is allocated in begin().
+class CanIngest
+{
+public:
+    static bool begin(uint32_t bitrate, uint16_t maxIds);
+    // True when the frame passed view sampling; only those go on to the stream
+    static bool process(const CANMessage& msg, bool extended);
+    static void tick(uint32_t now);
+    static size_t memoryBytes();
+};
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <stdint.h>
+#include <string.h>
+#include "clock.h"
+#ifdef ARDUINO
 #include <Arduino.h>
-#include <map>
 #include "driver/twai.h"
+#endif
 
 //#define CAN_SENDER
 
@@ -13,15 +17,17 @@ struct CANMessage
     uint32_t id;
     uint8_t length;
     uint8_t data[8];
-    
+
+#ifdef ARDUINO
     // Constructor to convert from TWAI message
     CANMessage(const twai_message_t& msg)
     {
-        timestamp = millis();
+        timestamp = Clock::millis();
         id = msg.identifier;
         length = msg.data_length_code;
         memcpy(data, msg.data, length);
     }
-    
+#endif
+
     CANMessage() {} // Default constructor
 };
\ No newline at end of file
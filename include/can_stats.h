@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Exact bus statistics. Every received frame is counted here, even when the
+// view stages (change tracking, highlight, stream) only see a sample.
+// Per-ID counters are indexed by StateTable slot and sized at boot.
+class CanStatistics
+{
+public:
+    static constexpr uint32_t WINDOW_MS = 1000;
+
+    struct IdCounters
+    {
+        uint32_t frames = 0;          // Total frames seen for this ID
+        uint32_t windowFrames = 0;    // Frames in the current window
+        uint32_t rate = 0;            // Frames per second over the last full window
+        uint32_t lastSampledAt = 0;   // Last time the view stages processed this ID
+        bool everSampled = false;
+    };
+
+    static bool begin(uint32_t bitrate, uint16_t capacity);
+    // Bus load is computed against this from the next window on
+    static void setBitrate(uint32_t bitrate);
+    static void resetSlot(uint16_t slot);
+    static IdCounters& recordFrame(uint16_t slot, uint8_t length, bool extended);
+    // True when a window closed; lastWindowMs() is then its length
+    static bool tick(uint32_t now);
+
+    static uint32_t totalFrames();
+    static uint32_t frameRate();
+    static uint32_t busLoadPermille();
+    static uint32_t lastWindowMs();
+    static const IdCounters& counters(uint16_t slot);
+    static size_t memoryBytes();
+
+    // Nominal frame length on the wire, excluding stuff bits
+    static uint32_t frameBits(uint8_t length, bool extended);
+
+private:
+    static IdCounters* s_perSlot;
+    static uint16_t s_capacity;
+    static uint32_t s_bitrate;
+    static uint32_t s_totalFrames;
+    static uint32_t s_windowStart;
+    static uint32_t s_windowFrames;
+    static uint32_t s_windowBits;
+    static uint32_t s_frameRate;
+    static uint32_t s_busLoadPermille;
+    static uint32_t s_lastWindowMs;
+};
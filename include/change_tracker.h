@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "can_messages.h"
+
+// Per-byte change timestamps for each StateTable slot, used to highlight bytes
+// that changed within the last CHANGE_EXPIRATION_MS. Storage is fixed at boot.
+class ChangeTracker
+{
+public:
+    static constexpr uint32_t CHANGE_EXPIRATION_MS = 10000;
+
+    static bool begin(uint16_t capacity);
+    static void resetSlot(uint16_t slot);
+    // Returns the bytes that changed, bit i for byte i
+    static uint8_t recordChange(uint16_t slot, const CANMessage& current, const CANMessage* previous, uint32_t now);
+
+    // Receive task, once per statistics window: clears the bits of changes
+    // that have expired, so a timestamp is never old enough to wrap around
+    static void expire(uint32_t now);
+
+    // Bit i set when byte i changed within the expiration window.
+    // lastChangeTimestamp is 0 when nothing changed within the window.
+    // Only reads, so the render task can call it while frames arrive.
+    static uint8_t highlightMask(uint16_t slot, uint32_t now, uint32_t& lastChangeTimestamp);
+
+    static size_t memoryBytes();
+
+private:
+    struct Slot
+    {
+        uint32_t changedAt[8];
+        uint8_t changedMask;
+    };
+
+    static Slot* s_slots;
+    static uint16_t s_capacity;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Time source for everything time-dependent: frame timestamps, rate windows,
+// highlight expiry, age colouring, the stream and cyclic TX. It reads the
+// system clock unless another source is injected; the built-in simulated
+// clock makes tests deterministic and lets logs replay faster than real time.
+class Clock
+{
+public:
+    // Monotonic microseconds
+    typedef uint64_t (*Source)();
+
+    static uint64_t nowUs() { return s_source(); }
+    // Wrapping 32-bit views, like Arduino's millis() and micros()
+    static uint32_t millis() { return static_cast<uint32_t>(s_source() / 1000); }
+    static uint32_t micros() { return static_cast<uint32_t>(s_source()); }
+
+    // nullptr restores the system clock
+    static void setSource(Source source);
+    static bool isSystem();
+
+    // Switches to the simulated clock, which only moves when told to. Set
+    // and advance it from one task.
+    static void simulate(uint64_t startUs = 0);
+    static void setSimulated(uint64_t us);
+    static void advance(uint64_t us);
+
+private:
+    static Source s_source;
+    static uint64_t s_simulatedUs;
+
+    static uint64_t systemNowUs();
+    static uint64_t simulatedNowUs();
+};
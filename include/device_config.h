@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "view_sampler.h"
+#include "rate_history.h"
+#include "byte_histogram.h"
+#include "time_sync.h"
+
+// Settings that survive a reboot: CAN bit rate, controller mode and
+// acceptance filter, view sampling, the IDs with rate history, the byte
+// histogram selections and the time sync peer. The WiFi credentials stay
+// with SoftAPConfig.
+//
+// They are kept in NVS as one compact little-endian blob:
+//
+//   'V' 'C', version, payload length (2 bytes), CRC-16 of the payload (2 bytes)
+//   records of tag (1 byte), length (1 byte), fields
+//
+// Unknown tags are skipped, missing records keep their defaults and bytes a
+// record has beyond the fields the reader knows are ignored, so fields can be
+// added without a version change. A change to what a field means bumps
+// VERSION, and decode() then converts the older layouts; a blob of a newer
+// version than this firmware knows is rejected. Decoding is one pass over
+// under a hundred bytes.
+class DeviceConfig
+{
+public:
+    static constexpr uint8_t VERSION = 1;
+    static constexpr size_t HEADER_BYTES = 7;
+
+    enum class CanMode : uint8_t
+    {
+        Normal,
+        ListenOnly,     // Never acknowledges or transmits
+        NoAck           // Transmits without waiting for an acknowledge (self test)
+    };
+
+    struct Can
+    {
+        uint32_t bitrate = 125000;
+        CanMode mode = CanMode::Normal;
+        // A frame is accepted when (id & filterMask) == filterId; a zero
+        // mask accepts everything. filterExtended selects 29-bit IDs.
+        uint32_t filterId = 0;
+        uint32_t filterMask = 0;
+        bool filterExtended = false;
+    };
+
+    // Device whose clock this one follows (see TimeSync). IPv4 address with
+    // the first octet in the top byte; 0 makes this device the reference.
+    struct Sync
+    {
+        uint32_t peer = 0;
+        uint16_t port = TimeSync::PORT;
+    };
+
+    struct Pair
+    {
+        uint32_t id = 0;
+        uint8_t first = 0;
+        uint8_t second = 0;
+    };
+
+    struct Settings
+    {
+        Can can;
+        ViewSampler::Mode samplingMode = ViewSampler::Mode::Off;
+        uint32_t samplingValue = 1;
+        uint8_t historyCount = 0;
+        uint32_t historyIds[HISTORY_WATCH_IDS] = {};
+        uint8_t histogramCount = 0;
+        uint32_t histogramIds[HISTOGRAM_IDS] = {};
+        uint8_t pairCount = 0;
+        Pair pairs[HISTOGRAM_PAIRS] = {};
+        Sync sync;
+    };
+
+    // Largest blob encode() produces
+    static constexpr size_t MAX_BLOB_BYTES = HEADER_BYTES + 16 + 7 + (2 + 4 * HISTORY_WATCH_IDS) +
+                                             (2 + 4 * HISTOGRAM_IDS) + (2 + 6 * HISTOGRAM_PAIRS) + (2 + 6);
+    // Longest renderJson() output
+    static constexpr size_t MAX_JSON_BYTES = 304 + 14 * (HISTORY_WATCH_IDS + HISTOGRAM_IDS) + 40 * HISTOGRAM_PAIRS;
+
+    // Bytes written, 0 when the blob does not fit
+    static size_t encode(const Settings& settings, uint8_t* blob, size_t size);
+    // False on a bad header, CRC or record, or a version above VERSION;
+    // settings are then unchanged. Records added by newer firmware of the
+    // same version are read as far as they are understood.
+    static bool decode(const uint8_t* blob, size_t length, Settings& settings);
+    // Everything apply() needs to succeed: a supported bit rate, IDs in
+    // range, lists within their pools, distinct pair bytes 0 to 7
+    static bool validate(const Settings& settings);
+    static bool supportedBitrate(uint32_t bitrate);
+
+    // Validates settings as a whole, then publishes them for the tasks that
+    // use them; nothing can fail afterwards. The receive task installs the
+    // view settings (sampling, rate history and histograms) through
+    // installViews() and reinstalls the driver once canRevision() changes.
+    static bool apply(const Settings& settings);
+    // Receive task, between frames: applies the view settings published
+    // since the last call to the feature modules
+    static void installViews();
+    // Current settings; published settings that are not installed yet are
+    // returned as they will be
+    static void capture(Settings& settings);
+    // Edits behind POST /history_watch and /histogram_watch, made on
+    // captured settings that are then validated, saved and applied. False,
+    // with settings unchanged, when what is to be removed is not there or
+    // there is no room for what is added; adding what is there is a no-op.
+    static bool watchHistory(Settings& settings, uint32_t id, bool remove);
+    static bool selectHistogram(Settings& settings, uint32_t id, bool remove);
+    static bool selectPair(Settings& settings, const Pair& pair, bool remove);
+    static Can can();
+    static uint32_t canRevision();
+    // For the task running the time sync transport
+    static Sync sync();
+    // Acceptance filter as the controller applies it, for the host build
+    static bool accepts(const Can& can, uint32_t id, bool extended);
+
+    // JSON for GET /config; the length, 0 when out is too small
+    static size_t renderJson(const Settings& settings, char* out, size_t size);
+    static const char* canModeName(CanMode mode);
+    static bool parseCanMode(const char* name, size_t length, CanMode& mode);
+
+private:
+    static Can s_can[2];
+    static volatile uint8_t s_canPublished;
+    static volatile uint32_t s_canRevision;
+    static Sync s_sync[2];
+    static volatile uint8_t s_syncPublished;
+    static Settings s_views[2];
+    static volatile uint8_t s_viewsPublished;
+    static volatile uint32_t s_viewsRevision;
+    static volatile uint32_t s_viewsInstalled;     // Written by the receive task only
+};
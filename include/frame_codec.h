@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary message format of the /stream WebSocket, shared by the firmware,
+// the browser client and the host tools. All fields are little-endian.
+//
+// Header, 12 bytes:
+//   0  'C' 'M'     magic
+//   2  version
+//   3  type        MessageType
+//   4  count u16   records that follow
+//   6  reserved
+//   8  sentUs u32  sender's microsecond clock when the message was built
+//
+// Frames record, 24 bytes:
+//   0  sequence u32     assigned at reception; gaps mean dropped frames
+//   4  timestampUs u32  reception time
+//   8  id u32           bit 31 set for extended IDs
+//   12 length
+//   13 flags            FLAG_PROBE: echo back for latency measurement
+//   14 reserved
+//   16 data[8]
+//
+// LatencyEcho record (client to device), 12 bytes:
+//   0  sequence u32     of the probe frame
+//   4  sentUs u32       copied from the Frames header that carried it
+//   8  clientUs u32     from receiving the message to painting it
+//
+// ClockSync record (device to client, about once a second), 40 bytes:
+//   0  nowUs u64        sender's full clock; frame timestamps unwrap against it
+//   8  estimateUs u64   local time the estimate below refers to
+//   16 offsetUs i64     reference clock minus local clock at estimateUs
+//   24 driftPpb i32     how much faster the reference clock runs
+//   28 delayUs u32      round trip of the exchange the estimate rests on
+//   32 deviceId u32     tells the captures of several devices apart
+//   36 state            ClockState
+//   37 reserved
+//
+// Transmit record (client to device), 20 bytes:
+//   0  token u32        echoed in the acknowledgement
+//   4  id u32           bit 31 set for extended IDs
+//   8  length
+//   9  reserved
+//   12 data[8]
+//
+// TransmitAck record (device to the client that sent the frame), 20 bytes:
+//   0  token u32
+//   4  status           TransmitStatus
+//   5  reserved
+//   8  receivedUs u32   the Transmit record was handled
+//   12 queuedUs u32     the frame entered the driver's TX queue
+//   16 doneUs u32       the controller finished with it; the header's
+//                       sentUs tells how long the ack waited after that
+class FrameCodec
+{
+public:
+    static constexpr uint8_t VERSION = 1;
+    static constexpr size_t HEADER_BYTES = 12;
+    static constexpr size_t FRAME_RECORD_BYTES = 24;
+    static constexpr size_t ECHO_RECORD_BYTES = 12;
+    static constexpr size_t CLOCK_RECORD_BYTES = 40;
+    static constexpr size_t TRANSMIT_RECORD_BYTES = 20;
+    static constexpr size_t TRANSMIT_ACK_RECORD_BYTES = 20;
+    static constexpr uint32_t EXTENDED_ID_FLAG = 0x80000000u;
+    static constexpr uint8_t FLAG_PROBE = 0x01;
+
+    enum class MessageType : uint8_t
+    {
+        Frames = 1,
+        LatencyEcho = 2,
+        ClockSync = 3,
+        Transmit = 4,
+        TransmitAck = 5
+    };
+
+    enum class ClockState : uint8_t
+    {
+        Unsynced,       // No usable exchange with the reference yet
+        Synced,
+        Reference       // The sender's clock is the timebase
+    };
+
+    enum class TransmitStatus : uint8_t
+    {
+        Sent,           // Went out on the bus; the times are complete
+        Busy,           // The TX queue was full
+        Rejected,       // The driver refused it: listen-only, bus-off or stopped
+        Failed,         // Queued, but not acknowledged on the bus
+        Invalid         // Length over 8 or ID out of range
+    };
+
+    struct Header
+    {
+        MessageType type = MessageType::Frames;
+        uint16_t count = 0;
+        uint32_t sentUs = 0;
+    };
+
+    struct FrameRecord
+    {
+        uint32_t sequence = 0;
+        uint32_t timestampUs = 0;
+        uint32_t id = 0;
+        bool extended = false;
+        uint8_t flags = 0;
+        uint8_t length = 0;
+        uint8_t data[8] = {};
+    };
+
+    struct LatencyEcho
+    {
+        uint32_t sequence = 0;
+        uint32_t sentUs = 0;
+        uint32_t clientUs = 0;
+    };
+
+    struct ClockRecord
+    {
+        uint64_t nowUs = 0;
+        uint64_t estimateUs = 0;
+        int64_t offsetUs = 0;
+        int32_t driftPpb = 0;
+        uint32_t delayUs = 0;
+        uint32_t deviceId = 0;
+        ClockState state = ClockState::Unsynced;
+    };
+
+    struct TransmitRequest
+    {
+        uint32_t token = 0;
+        uint32_t id = 0;
+        bool extended = false;
+        uint8_t length = 0;
+        uint8_t data[8] = {};
+    };
+
+    struct TransmitAck
+    {
+        uint32_t token = 0;
+        TransmitStatus status = TransmitStatus::Sent;
+        uint32_t receivedUs = 0;
+        uint32_t queuedUs = 0;
+        uint32_t doneUs = 0;
+    };
+
+    static void encodeHeader(uint8_t* out, const Header& header);
+    static void encodeFrame(uint8_t* out, const FrameRecord& record);
+    static void encodeEcho(uint8_t* out, const LatencyEcho& echo);
+    static void encodeClock(uint8_t* out, const ClockRecord& clock);
+    static void encodeTransmit(uint8_t* out, const TransmitRequest& request);
+    static void encodeTransmitAck(uint8_t* out, const TransmitAck& ack);
+
+    // False when the input is not a complete message of a known type and version
+    static bool decodeHeader(const uint8_t* in, size_t length, Header& header);
+    static void decodeFrame(const uint8_t* in, FrameRecord& record);
+    static void decodeEcho(const uint8_t* in, LatencyEcho& echo);
+    static void decodeClock(const uint8_t* in, ClockRecord& clock);
+    // False when the frame could not go on the bus as given; the token is
+    // decoded either way so the rejection can be acknowledged
+    static bool decodeTransmit(const uint8_t* in, TransmitRequest& request);
+    static void decodeTransmitAck(const uint8_t* in, TransmitAck& ack);
+    // Full timestamp of a frame from its 32-bit one and a nearby full clock
+    // reading, such as ClockRecord::nowUs; good within 35 minutes either way
+    static uint64_t unwrapTimestamp(uint32_t timestampUs, uint64_t nearUs);
+
+    static size_t recordBytes(MessageType type);
+    static size_t messageBytes(const Header& header);
+    // Size of the message whose header starts at in, for splitting a
+    // recording or a byte stream into messages; 0 when the header is
+    // incomplete or not of a known type and version
+    static size_t peekMessageBytes(const uint8_t* in, size_t length);
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "can_messages.h"
+#include "frame_codec.h"
+
+// Queue between the CAN receive task and the /stream sender. Single producer
+// (push, from the receive path) and single consumer (encodeBatch/discard).
+// The ring is allocated in begin(); when it is full new frames are dropped
+// rather than blocking reception, and the sequence numbers show the gap.
+class FrameStream
+{
+public:
+    // One frame in this interval is flagged as a latency probe
+    static constexpr uint32_t PROBE_INTERVAL_US = 250000;
+
+    static bool begin(uint16_t capacity);
+    static void push(const CANMessage& msg, bool extended, uint32_t rxUs, uint32_t doneUs);
+
+    // Encodes up to maxRecords pending frames as one Frames message.
+    // Returns the message size, or 0 when nothing is pending.
+    static size_t encodeBatch(uint8_t* out, size_t capacity, uint16_t maxRecords, uint32_t nowUs);
+    // A ClockSync message with the current TimeSync estimate, so recordings
+    // of the stream can be put on the reference clock later. 0 when out is
+    // too small.
+    static size_t encodeClock(uint8_t* out, size_t capacity, uint32_t deviceId, uint64_t nowUs);
+    // Drops everything pending, e.g. while nobody is subscribed
+    static void discard();
+
+    static uint32_t pending();
+    static uint32_t sequence();
+    static uint32_t dropped();
+    static size_t memoryBytes();
+
+private:
+    struct Pending
+    {
+        FrameCodec::FrameRecord record;
+        uint32_t doneUs;
+    };
+
+    static Pending* s_ring;
+    static uint16_t s_capacity;
+    static std::atomic<uint32_t> s_head;     // Written by the producer
+    static std::atomic<uint32_t> s_tail;     // Written by the consumer
+    static uint32_t s_sequence;
+    static uint32_t s_dropped;
+    static uint32_t s_lastProbeUs;
+};
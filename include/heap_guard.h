@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Allocation hooks are linked in for the zero-heap and allocation tracking builds
+#if defined(ZERO_HEAP_AFTER_BOOT) || defined(ALLOC_TRACKING)
+#define HEAP_GUARD_HOOKS 1
+#endif
+
+// Attributes allocations to the innermost active scope (ALLOC_TRACKING builds)
+#ifdef ALLOC_TRACKING
+#define ALLOC_SCOPE(name) HeapGuard::ScopeGuard allocScope(HeapGuard::Scope::name)
+#else
+#define ALLOC_SCOPE(name) do {} while (0)
+#endif
+
+// Zero-heap-after-boot support and allocation tracking. When the allocator
+// hooks are linked in (see platformio.ini) every allocation made after arm()
+// is counted. Allocations made inside a HotPathScope (frame ingest) are counted
+// separately and can be made fatal with setTrap(true).
+class HeapGuard
+{
+public:
+    struct Counters
+    {
+        uint32_t allocations = 0;         // All allocations since arm()
+        uint32_t bytes = 0;
+        uint32_t hotPathAllocations = 0;  // Allocations inside a HotPathScope
+        uint32_t hotPathBytes = 0;
+        uintptr_t lastHotPathCaller = 0;  // Return address of the last one
+    };
+
+    enum class Scope : uint8_t
+    {
+        None,
+        CanRX,
+        RecordChange,
+        FormatByte,
+        HttpRoot,
+        HttpLatestMessages,
+        HttpFilteredIds,
+        HttpFilteredMessages,
+        HttpTransmit,
+        HttpMetrics,
+        HttpSampling,
+        HttpTrace,
+        HttpLatency,
+        HttpHistory,
+        HttpTop,
+        HttpSearch,
+        HttpHistogram,
+        HttpConfig,
+        HttpFuzz,
+        HttpSequence,
+        Stream,
+        Count
+    };
+
+    struct ScopeCounters
+    {
+        uint32_t entries = 0;       // Times the scope was entered (frames, requests, calls)
+        uint32_t allocations = 0;
+        uint32_t bytes = 0;
+    };
+
+    class HotPathScope
+    {
+    public:
+        HotPathScope();
+        ~HotPathScope();
+        HotPathScope(const HotPathScope&) = delete;
+        HotPathScope& operator=(const HotPathScope&) = delete;
+    };
+
+    class ScopeGuard
+    {
+    public:
+        // countEntry is false when resuming work for an entry already counted,
+        // such as a streamed response being filled in several calls
+        explicit ScopeGuard(Scope scope, bool countEntry = true);
+        ~ScopeGuard();
+        ScopeGuard(const ScopeGuard&) = delete;
+        ScopeGuard& operator=(const ScopeGuard&) = delete;
+
+    private:
+        Scope m_previous;
+    };
+
+    static void arm();
+    static bool armed();
+    static void setTrap(bool trap);
+    static Counters counters();
+
+    static const char* scopeName(Scope scope);
+    static ScopeCounters scopeCounters(Scope scope);
+    static void resetScopes();
+
+    // Called by the allocator hooks
+    static void onAllocate(size_t size, uintptr_t caller);
+
+private:
+    static volatile bool s_armed;
+    static volatile bool s_trap;
+    static volatile uint32_t s_allocations;
+    static volatile uint32_t s_bytes;
+    static volatile uint32_t s_hotPathAllocations;
+    static volatile uint32_t s_hotPathBytes;
+    static volatile uintptr_t s_lastHotPathCaller;
+    static ScopeCounters s_scopes[static_cast<size_t>(Scope::Count)];
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Latency histograms for each stage between CAN reception and the browser
+// painting a frame. Buckets are powers of two in microseconds, so recording
+// is a count-leading-zeros and an increment; percentiles are reported as the
+// upper edge of the bucket they fall in.
+//
+//   Rx             twai_receive returning to the start of ingest (the driver
+//                  does not timestamp frames, so queueing in it is not seen)
+//   StateUpdate    CanIngest::process for the frame
+//   Serialization  end of ingest until the frame is encoded for the stream
+//   Network        half the round trip of a probe echo, client time excluded
+//   Client         browser receiving the message to painting it
+//   Transmit       a transmit request reaching the device to the controller
+//                  finishing the frame (a separate path, not part of the above)
+class LatencyStats
+{
+public:
+    static constexpr size_t BUCKETS = 32;   // Bucket b holds [2^(b-1), 2^b) us; bucket 0 is 0 us
+
+    enum class Stage : uint8_t
+    {
+        Rx,
+        StateUpdate,
+        Serialization,
+        Network,
+        Client,
+        Transmit,
+        Count
+    };
+
+    static void record(Stage stage, uint32_t us);
+    static void reset();
+
+    static uint32_t count(Stage stage);
+    static uint32_t maxUs(Stage stage);
+    static uint32_t percentileUs(Stage stage, uint8_t percent);
+    static const uint32_t* buckets(Stage stage);
+    static uint32_t bucketUpperUs(size_t bucket);
+    static const char* stageName(Stage stage);
+
+private:
+    struct Histogram
+    {
+        uint32_t buckets[BUCKETS];
+        uint32_t count;
+        uint32_t maxUs;
+    };
+
+    static Histogram s_histograms[static_cast<size_t>(Stage::Count)];
+};
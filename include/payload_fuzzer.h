@@ -0,0 +1,186 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "can_messages.h"
+
+// Payload fuzzing of chosen IDs, for robustness testing of ECUs on a bench.
+// A plan is a comma-separated list of key=value settings, as traffic
+// profiles are:
+//
+//   ids=7E0+7DF        IDs to fuzz (hex, up to MAX_IDS), sent round robin
+//   ext=1              29-bit IDs
+//   mode=random        random payloads
+//   mode=bitwalk       one bit flipped at a time over all-zero, all-one,
+//                      then seeded random payloads
+//   mode=boundary      00 01 7F 80 FE FF in every byte, then in each byte
+//                      alone over 00 and over FF fillers
+//   len=8              payload length
+//   rate=2000          frames per second; 0 keeps the TX queue full
+//   count=100000       stop after this many frames; 0 runs until stopped
+//   seed=1
+//   responses=7E8+7E9  IDs logged as responses (hex); every received frame
+//                      when not given
+//
+// Frame n of a plan depends on nothing but the plan and n, so a run can be
+// reproduced frame for frame (the host tool's `payloads` command lists
+// them) whatever the bus did to its timing.
+//
+// The CAN task runs the plan: it asks for due frames, reports each one it
+// queued and hands over received frames and error state changes, which are
+// logged with the newest fuzz frame already on the wire. The log keeps the
+// most recent events. start() and stop() may come from any task and are
+// picked up by the CAN task's next service().
+class PayloadFuzzer
+{
+public:
+    static constexpr uint8_t MAX_IDS = 16;
+    static constexpr uint32_t TAIL_US = 500000;     // Logging goes on this long after the last frame
+    static constexpr size_t MAX_PLAN_LENGTH = 200;
+
+    enum class Mode : uint8_t
+    {
+        Random,
+        BitWalk,
+        Boundary
+    };
+
+    enum class State : uint8_t
+    {
+        Idle,
+        Running,
+        Draining,       // Every frame sent; still logging responses
+        Finished,
+        Stopped,
+        BusOff          // Stopped because this node went bus-off
+    };
+
+    enum class ErrorState : uint8_t
+    {
+        Active,
+        Warning,        // An error counter at 96 or above
+        Passive,        // An error counter above 127
+        BusOff,
+        Recovering
+    };
+
+    enum class EventKind : uint8_t
+    {
+        Response,
+        ErrorState,
+        BusErrors       // The bus error count went up
+    };
+
+    struct Plan
+    {
+        uint32_t ids[MAX_IDS];
+        uint8_t idCount;
+        bool extended;
+        Mode mode;
+        uint8_t length;
+        uint32_t rate;
+        uint32_t count;
+        uint32_t seed;
+        uint32_t responses[MAX_IDS];
+        uint8_t responseCount;
+    };
+
+    struct Frame
+    {
+        uint32_t index;
+        uint32_t id;
+        bool extended;
+        uint8_t length;
+        uint8_t data[8];
+    };
+
+    struct Event
+    {
+        uint32_t timeUs;
+        EventKind kind;
+        bool hasPreceding;          // False before the first fuzz frame went out
+        Frame preceding;
+        CANMessage received;        // Response
+        bool receivedExtended;
+        ErrorState state;           // ErrorState and BusErrors
+        uint8_t txErrors;
+        uint8_t rxErrors;
+        uint32_t busErrors;
+    };
+
+    // Storage for the event log, allocated once
+    static bool begin(uint16_t logCapacity);
+
+    // False for an invalid plan; lastError() says why
+    static bool parsePlan(const char* text, Plan& plan);
+    static const char* lastError();
+    static void generate(const Plan& plan, uint32_t index, Frame& frame);
+    static const char* modeName(Mode mode);
+    static const char* stateName(State state);
+    static const char* errorStateName(ErrorState state);
+
+    // Control, from any task
+    static void start(const Plan& plan);
+    static void stop();
+
+    // CAN task, once per wakeup before anything else: applies start/stop and
+    // ends the run once the last frame's responses had time to arrive
+    static void service(uint32_t nowUs);
+    // Running or draining; received frames and error states are logged
+    static bool active();
+    // The next due frame, which stays due until sent() confirms it was
+    // queued. inFlight below is how many queued frames the controller has
+    // not finished.
+    static bool poll(uint32_t nowUs, Frame& frame);
+    static void sent();
+    // Time until the next frame is due, for how long the CAN task may sleep;
+    // UINT32_MAX when nothing is due before the next alert
+    static uint32_t idleUs(uint32_t nowUs);
+    static void onReceive(const CANMessage& msg, bool extended, uint32_t nowUs, uint32_t inFlight);
+    static void onErrorState(ErrorState state, uint8_t txErrors, uint8_t rxErrors, uint32_t busErrors,
+                             uint32_t nowUs, uint32_t inFlight);
+
+    // Readers, from any task
+    static State state();
+    static Plan plan();
+    static uint32_t framesSent();
+    static uint32_t elapsedMs();
+    static uint32_t eventCount();     // Events logged since start
+    static uint32_t oldestEvent();    // The oldest event still in the log
+    // Copies event number (0 = first since start); false once it has been
+    // overwritten or not logged yet
+    static bool event(uint32_t number, Event& out);
+
+private:
+    struct Request
+    {
+        bool start;
+        Plan plan;
+    };
+
+    static Event* s_log;
+    static uint16_t s_logCapacity;
+    static std::atomic<uint32_t> s_eventCount;
+    static Request s_requests[2];
+    static volatile uint8_t s_requestPublished;
+    static volatile uint32_t s_requestRevision;
+    static uint32_t s_appliedRevision;
+    static Plan s_plans[2];             // Running plan, published for readers
+    static volatile uint8_t s_planPublished;
+    static volatile State s_state;
+    static volatile uint32_t s_sent;
+    static uint32_t s_lastPollUs;
+    static uint64_t s_elapsedUs;        // Since start, extended past the 32-bit clock's wrap
+    static volatile uint32_t s_elapsedMs;
+    static uint64_t s_lastSentUs;
+    static ErrorState s_errorState;
+    static uint32_t s_busErrors;
+    static bool s_busErrorsKnown;
+    static const char* s_error;
+
+    static bool applySetting(Plan& plan, const char* key, const char* value);
+    static bool parseIds(const char* text, uint32_t* ids, uint8_t& count);
+    static void advance(uint32_t nowUs);
+    static void log(Event& event, uint32_t nowUs, uint32_t inFlight);
+};
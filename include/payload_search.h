@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "can_messages.h"
+
+// Searches the latest payload of every tracked ID. A byte pattern such as
+// "?? 3C ?? ?? 0x?F" becomes one 64-bit mask and value, so each ID costs a
+// single masked compare; a value range is read out of the same 64-bit word
+// with a shift. A full-table search takes microseconds and can be repeated
+// every refresh as a live watch.
+class PayloadSearch
+{
+public:
+    static constexpr uint8_t ANY_POSITION = 0xFF;
+    static constexpr uint8_t MAX_RANGE_WIDTH = 4;
+
+    struct Query
+    {
+        // Byte i of the payload is bits 8i..8i+7
+        uint64_t mask = 0;
+        uint64_t value = 0;
+        uint8_t minLength = 0;          // Pattern length; shorter payloads never match
+
+        bool hasRange = false;
+        uint8_t rangeStart = ANY_POSITION;
+        uint8_t rangeWidth = 1;         // Bytes, 1 to MAX_RANGE_WIDTH
+        bool littleEndian = false;
+        uint32_t rangeMin = 0;
+        uint32_t rangeMax = 0;
+    };
+
+    // Space-separated bytes of two hex digits, each optionally prefixed by
+    // 0x; ? stands for any nibble and a lone ? or * for any byte. At most
+    // eight bytes. False on anything else; the query is then unchanged.
+    static bool parsePattern(const char* text, size_t length, Query& query);
+    // False when the width or start cannot fit in an 8-byte payload
+    static bool setRange(Query& query, uint8_t start, uint8_t width, bool littleEndian, uint32_t min, uint32_t max);
+
+    static bool matches(const Query& query, const CANMessage& msg);
+    // Matching slots in ascending ID order; returns their count
+    static uint16_t run(const Query& query, uint16_t* slots, uint16_t maxSlots);
+};
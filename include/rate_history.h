@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// IDs whose own frame rate history is kept, besides the bus totals
+#ifndef HISTORY_WATCH_IDS
+#define HISTORY_WATCH_IDS 4
+#endif
+
+// Frame rate and bus load history at three resolutions: 1 s for 10 minutes,
+// 10 s for 2 hours and 1 min for 24 hours. Every second closed by the
+// statistics window adds a point to the finest ring; every 10 (then 6)
+// points are averaged into the next ring as they arrive, so nothing is ever
+// recomputed from raw data. Bus totals are always kept; per-ID history only
+// for a few watched IDs, since every ID at every resolution would not fit.
+// Storage for all rings is allocated in begin().
+class RateHistory
+{
+public:
+    static constexpr uint8_t LEVELS = 3;
+    static constexpr uint32_t STEP_SECONDS[LEVELS] = { 1, 10, 60 };
+    static constexpr uint16_t POINTS[LEVELS] = { 600, 720, 1440 };
+    static constexpr uint32_t NO_ID = 0xFFFFFFFF;
+
+    enum class Series : uint8_t
+    {
+        FrameRate,      // Frames per second on the bus
+        BusLoad,        // Permille
+        IdRate          // Frames per second of one watched ID
+    };
+
+    enum class ExportStage : uint8_t
+    {
+        Prefix,
+        Values,
+        Suffix,
+        Done
+    };
+
+    // Streaming JSON export of one series. Points recorded while it streams
+    // shift the series by one; the response stays well-formed.
+    struct Export
+    {
+        ExportStage stage = ExportStage::Prefix;
+        Series series = Series::FrameRate;
+        uint8_t level = 0;
+        int8_t track = -1;
+        uint32_t id = NO_ID;
+        uint16_t first = 0;         // Ring position of the oldest point
+        uint16_t count = 0;
+        uint16_t next = 0;
+        uint32_t endSeconds = 0;
+        char row[128];
+        size_t rowLength = 0;
+        size_t rowSent = 0;
+    };
+
+    static bool begin(uint8_t watchCapacity);
+    // Called after each closed statistics window of windowMs milliseconds
+    static void record(uint32_t windowMs);
+
+    // Starts per-ID history for an ID; false when all watch slots are taken.
+    // Called from the web server: a change racing record() can misplace the
+    // point being recorded, nothing more.
+    static bool watch(uint32_t id);
+    static bool unwatch(uint32_t id);
+    static uint8_t watchedCount();
+    static uint32_t watchedId(uint8_t index);
+    static uint32_t recordedSeconds();
+
+    static const char* seriesName(Series series);
+    static bool parseSeries(const char* name, Series& series);
+    // Level of a step in seconds (1, 10 or 60); -1 for any other value
+    static int8_t levelForStep(uint32_t stepSeconds);
+
+    // False when an IdRate series is asked for an ID that is not watched
+    static bool beginExport(Export& exp, Series series, uint8_t level, uint32_t id);
+    static size_t fill(Export& exp, uint8_t* buffer, size_t maxLen);
+    static size_t memoryBytes();
+
+private:
+    struct Ring
+    {
+        uint16_t* values;
+        uint16_t head;          // Next position to write
+        uint16_t count;
+        uint32_t rollupSum;     // Points not yet averaged into the next level
+        uint8_t rollupCount;
+    };
+
+    struct Track
+    {
+        Ring rings[LEVELS];
+    };
+
+    static uint16_t* s_storage;
+    static Track* s_tracks;     // Frame rate, bus load, then the watched IDs
+    static uint32_t* s_watchedIds;
+    static uint8_t s_watchCapacity;
+    static uint32_t s_seconds;
+    static uint32_t s_carryMs;
+
+    static void resetTrack(Track& track);
+    static void push(Track& track, uint8_t level, uint32_t value);
+    static int8_t trackFor(Series series, uint32_t id);
+    static bool renderNext(Export& exp);
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Appends text into caller-owned storage. Never allocates; once the storage
+// is full further appends are dropped and overflowed() reports it.
+class RenderBuffer
+{
+public:
+    RenderBuffer(char* storage, size_t capacity);
+
+    void clear();
+    bool append(const char* text);
+    bool append(const char* text, size_t length);
+    bool appendChar(char c);
+    bool appendf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    // Table-driven number formatting for the render hot path; unlike appendf
+    // these never go through the printf machinery
+    bool appendHexByte(uint8_t value);      // Always two lowercase digits
+    bool appendHex(uint32_t value);         // Lowercase, no leading zeros
+    bool appendDec(uint32_t value);
+
+    const char* data() const { return m_storage; }
+    size_t length() const { return m_length; }
+    size_t capacity() const { return m_capacity; }
+    bool overflowed() const { return m_overflowed; }
+
+private:
+    char* m_storage;
+    size_t m_capacity;
+    size_t m_length;
+    bool m_overflowed;
+};
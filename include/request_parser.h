@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "payload_search.h"
+#include "device_config.h"
+
+// Parsers for request input of the web routes. They work on raw bytes
+// (neither input needs to be NUL-terminated) so the firmware's web server,
+// the host tool's server and fuzzers all run the same code.
+class RequestParser
+{
+public:
+    struct TransmitRequest
+    {
+        uint32_t id = 0;
+        uint8_t length = 0;
+        uint8_t data[8] = {};
+        uint8_t byteCount = 0;     // Entries given in "data"; at least length
+    };
+
+    // One decoded query parameter; data is nullptr when it is absent
+    struct Param
+    {
+        const char* data = nullptr;
+        size_t length = 0;
+    };
+
+    struct SearchParams
+    {
+        Param pattern;
+        Param at;
+        Param width;
+        Param min;
+        Param max;
+        Param endian;
+    };
+
+    // Fields of the POST /config form; all are optional
+    struct ConfigParams
+    {
+        Param bitrate;
+        Param mode;             // normal, listen or noack
+        Param filterId;         // Hex
+        Param filterMask;       // Hex; 0 accepts every frame
+        Param filterExtended;   // 0 or 1
+        Param sampling;         // As POST /sampling: off, ratio or interval
+        Param samplingValue;
+        Param history;          // Comma-separated hex IDs; empty clears the list
+        Param histograms;       // Likewise
+        Param pairs;            // "1A0:2,3;2B0:0,1"; empty clears the list
+        Param syncPeer;         // "192.168.4.1" or "192.168.4.1:3190"; empty makes this the reference
+    };
+
+    // Resolves a comma-separated list of hex IDs ("0x1A0, 7df") to state table
+    // slots in ID order, each once. Unknown IDs and unparsable tokens are skipped.
+    static uint16_t parseIdList(const char* text, size_t length, uint16_t* slots, uint16_t maxSlots);
+
+    // Parses the /transmit_message body, {"id":"1A0","length":2,"data":[18,52]}.
+    // The id is hex with an optional 0x prefix; data entries are decimal or 0x hex.
+    // False when a field is missing or malformed, length exceeds 8 or fewer
+    // data entries than length are given.
+    static bool parseTransmitBody(const char* body, size_t length, TransmitRequest& request);
+
+    // Builds a /search query: a byte pattern (see PayloadSearch), a value
+    // range, or both. A range is requested by min and/or max (decimal or 0x
+    // hex) with at (byte index or "any", default any), width (bytes, default
+    // 1) and endian ("be", the default, or "le"). False when neither is given
+    // or a parameter is malformed.
+    static bool parseSearchQuery(const SearchParams& params, PayloadSearch::Query& query);
+
+    // Parses a byte pair "2,3": two distinct payload byte indexes, 0 to 7
+    static bool parseBytePair(const char* text, size_t length, uint8_t& first, uint8_t& second);
+
+    // Applies the given /config fields onto settings; absent fields keep their
+    // value. Only the syntax and list sizes are checked here, the values by
+    // DeviceConfig::validate. False when a field is malformed; settings may
+    // then be partly changed, so parse into a copy.
+    static bool parseConfigForm(const ConfigParams& params, DeviceConfig::Settings& settings);
+
+    // Copies a configuration portal field (SSID, password) into out, NUL
+    // terminated; false when it does not fit or contains a NUL itself
+    static bool copyConfigField(const char* value, size_t length, char* out, size_t outSize);
+
+    // Leading digits of a parameter as strtoul() reads them, base 10 or 16
+    // (with an optional 0x); 0 when there are none, UINT32_MAX past 32 bits
+    static uint32_t leadingNumber(const Param& param, uint8_t base);
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "can_messages.h"
+
+// Scripted transmit sequences, run on the device so WiFi adds no jitter
+// between steps. A script is a list of steps separated by ';' or newlines:
+//
+//   send 7E0#0210030000000000      queue a frame (candump notation; IDs of
+//                                  more than 3 hex digits are 29-bit)
+//   wait 7E8 0=50 2=40/F0          wait for a frame of that ID whose byte 0
+//        timeout=100               is 0x50 and byte 2 masked with F0 is
+//                                  0x40; the run fails after the timeout
+//                                  (ms, 1000 when not given)
+//   delay 5                        the next step is due 5 ms after the
+//   delay 250us                    previous one completed
+//   repeat 100                     last: run the whole script 100 times;
+//                                  0 repeats until stopped
+//
+// A script needs at least one send or wait step.
+//
+// Every step is timed from when the previous one completed: a send when
+// its frame was queued, a wait when the frame it waited for was received.
+// "wait 7E8; delay 5; send 7E0#01" sends 5 ms after the response arrived,
+// however late the sequence task woke up for it. A wait right after a send
+// is armed before the frame is queued, so even an instant response counts.
+//
+// The sequence task drives the run through next(); the CAN task hands
+// every received frame to onReceive(), which completes an armed wait. The
+// first step that fails ends the run. Results are kept per step over every
+// iteration. start() and stop() may come from any task and are picked up
+// by the sequence task's next call to next().
+class SequenceRunner
+{
+public:
+    static constexpr uint8_t MAX_STEPS = 32;
+    static constexpr uint8_t MAX_CONDITIONS = 4;
+    static constexpr size_t MAX_SCRIPT_LENGTH = 1024;
+    static constexpr uint32_t DEFAULT_TIMEOUT_MS = 1000;
+    static constexpr uint32_t MAX_TIME_MS = 60000;      // Longest delay or timeout
+
+    enum class StepKind : uint8_t
+    {
+        Send,
+        Wait,
+        Delay
+    };
+
+    struct Condition
+    {
+        uint8_t index;
+        uint8_t value;
+        uint8_t mask;
+    };
+
+    struct Step
+    {
+        StepKind kind;
+        uint32_t id;                // Send and Wait
+        bool extended;
+        uint8_t length;             // Send
+        uint8_t data[8];
+        Condition conditions[MAX_CONDITIONS];   // Wait
+        uint8_t conditionCount;
+        uint32_t us;                // Delay, or the Wait timeout
+    };
+
+    struct Script
+    {
+        Step steps[MAX_STEPS];
+        uint8_t stepCount;
+        uint32_t repeat;            // 0 until stopped
+    };
+
+    enum class State : uint8_t
+    {
+        Idle,
+        Running,
+        Done,
+        Failed,
+        Stopped
+    };
+
+    enum class Failure : uint8_t
+    {
+        None,
+        Timeout,            // A wait saw no matching frame in time
+        TransmitFailed      // The TX queue stayed full, or the controller cannot send
+    };
+
+    // Per step over every iteration. The times are how late a send was
+    // queued or a delay ended, or how long a wait took.
+    struct StepResult
+    {
+        StepKind kind;
+        uint32_t id;                // Send and Wait
+        bool extended;
+        uint32_t runs;
+        uint32_t failures;
+        uint32_t minUs;
+        uint32_t maxUs;
+        uint64_t totalUs;           // Of the runs that succeeded
+        bool hasFrame;              // Wait: the frame last matched
+        CANMessage frame;
+        bool frameExtended;
+    };
+
+    struct Status
+    {
+        State state;
+        uint32_t iteration;         // Iterations completed
+        uint32_t repeat;
+        uint8_t step;               // Step running, or the one that failed
+        uint8_t stepCount;
+        Failure failure;
+        uint32_t elapsedMs;
+    };
+
+    enum class Action : uint8_t
+    {
+        Idle,       // Nothing to run; ask again shortly
+        Send,       // Queue the frame, then call sent()
+        Sleep,      // Ask again at untilUs; spin the last few tens of us for precision
+        Wait        // Ask again at untilUs or once onReceive() matched
+    };
+
+    // False for an invalid script; lastError() says why and errorStep()
+    // which step (0 based)
+    static bool parse(const char* text, Script& script);
+    static const char* lastError();
+    static uint8_t errorStep();
+    static const char* stateName(State state);
+    static const char* failureName(Failure failure);
+    static const char* kindName(StepKind kind);
+
+    // Control, from any task
+    static void start(const Script& script);
+    static void stop();
+
+    // Sequence task: what to do at nowUs
+    static Action next(uint32_t nowUs, Step& frame, uint32_t& untilUs);
+    static void sent(bool queued, uint32_t queuedUs);
+    // CAN task, for every received frame; true when it completed a wait,
+    // and the sequence task should be woken
+    static bool onReceive(const CANMessage& msg, bool extended, uint32_t rxUs);
+
+    // Readers, from any task
+    static Status status();
+    // Copies the results of the last script's steps, MAX_STEPS at most;
+    // false when they kept changing while being copied
+    static bool results(StepResult* out, uint8_t& count);
+
+private:
+    struct Request
+    {
+        bool start;
+        Script script;
+    };
+
+    // The armed wait, copied out of the script for the CAN task
+    struct Armed
+    {
+        uint32_t id;
+        bool extended;
+        Condition conditions[MAX_CONDITIONS];
+        uint8_t conditionCount;
+    };
+
+    static Request s_requests[2];
+    static volatile uint8_t s_requestPublished;
+    static volatile uint32_t s_requestRevision;
+    static uint32_t s_appliedRevision;
+    static Script s_script;
+    static volatile State s_state;
+    static volatile uint32_t s_iteration;
+    static volatile uint8_t s_step;
+    static volatile Failure s_failure;
+    static uint32_t s_lastUs;
+    static uint64_t s_elapsedUs;        // Since start, extended past the 32-bit clock's wrap
+    static volatile uint32_t s_elapsedMs;
+    static uint32_t s_anchorUs;         // When the previous step completed
+    static bool s_armedHere;            // The current or next step's wait is armed
+    static Armed s_armed;
+    static std::atomic<uint32_t> s_armedGeneration;     // 0 when nothing is armed
+    static uint32_t s_nextGeneration;
+    static std::atomic<bool> s_matched;
+    static uint32_t s_matchUs;
+    static CANMessage s_matchFrame;
+    static bool s_matchExtended;
+    static StepResult s_results[MAX_STEPS];
+    static std::atomic<uint32_t> s_resultRevision;      // Odd while results are written
+    static const char* s_error;
+    static uint8_t s_errorStep;
+
+    static bool parseStep(char* text, Step& step, uint32_t& repeat, bool& isRepeat);
+    static void apply(uint32_t nowUs);
+    static void arm(const Step& step);
+    static bool disarm();
+    static void record(uint32_t us, bool failed, const CANMessage* frame, bool extended);
+    static void advance();
+    static void fail(Failure failure);
+};
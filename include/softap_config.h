@@ -5,6 +5,7 @@
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 #include <Preferences.h>
+#include "device_config.h"
 
 class SoftAPConfig
 {
@@ -14,21 +15,68 @@ public:
     static const char* AP_PASSWORD;  // Will be set to "configure"
     static const char* PORTAL_HOSTNAME;  // For captive portal DNS
 
+    enum class NetworkMode : uint8_t
+    {
+        Station,            // Join the configured network
+        AccessPoint,        // Host the AP_SSID network and serve the monitor on it
+        AccessPointStation  // Both; the monitor answers on either network
+    };
+
     // Configuration structure
     struct Config {
         char ssid[33];        // 32 chars + null terminator
         char password[65];    // 64 chars + null terminator
+        NetworkMode mode = NetworkMode::Station;
         // Add other config items here as needed
     };
 
+    // What the CAN side saw while the last runtime switch was in progress.
+    // Frames are counted by the sequence numbers ingest hands out; missed
+    // is what the controller and its RX queue lost, so zero means every
+    // frame on the bus made it into the capture pipeline.
+    struct SwitchReport
+    {
+        uint32_t count = 0;             // Switches since boot
+        uint32_t durationMs = 0;
+        uint32_t frames = 0;            // Received, whether or not view sampling kept them
+        uint32_t missed = 0;
+        uint32_t streamDropped = 0;     // Frames the /stream queue could not hold
+    };
+
     static bool checkConfigMode();  // Returns true if button pressed at boot
     static bool startConfigPortal(); // Start SoftAP and captive portal
+    // SoftAP with captive DNS; pages are served by the caller. keepStation
+    // runs it next to the station interface instead of replacing it
+    static bool startAccessPoint(bool keepStation = false);
+    static void stopNetwork();       // DNS, access point and station, ahead of a switch
+    static void processDns();        // Answers pending DNS queries; call regularly while the AP runs
+    static const char* modeName(NetworkMode mode);
+    static bool parseMode(const char* name, NetworkMode& mode);
+    static bool needsStation(NetworkMode mode);
+
+    // Runtime switches: requested from a web handler, which cannot take its
+    // own server down, and carried out by loop() through takeSwitch()
+    static void requestSwitch(const Config& config);
+    static bool takeSwitch(Config& config);
+    static bool switching();
+    static void finishSwitch(const SwitchReport& report);
+    static SwitchReport lastSwitch();
     static bool loadConfig(Config& config);  // Load from NVS
     static bool saveConfig(const Config& config);  // Save to NVS
+    // Device settings blob (see DeviceConfig); false when there is none or
+    // it is unreadable, settings then keep their defaults
+    static bool loadDeviceConfig(DeviceConfig::Settings& settings);
+    static bool saveDeviceConfig(const DeviceConfig::Settings& settings);
 
 private:
     static AsyncWebServer server;
     static DNSServer dnsServer;
+    static bool dnsRunning;
+    static volatile bool portalSaved;
+    static Config pendingConfig;
+    static volatile bool switchPending;
+    static volatile bool switchRunning;
+    static SwitchReport report;
     static Preferences preferences;
     
     static void setupConfigPage();
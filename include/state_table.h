@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "can_messages.h"
+
+// Upper bound on the number of CAN IDs tracked at once. All per-ID storage
+// (state table, statistics, change tracking) is sized from this at boot.
+#ifndef MAX_TRACKED_IDS
+#define MAX_TRACKED_IDS 512
+#endif
+
+// Fixed-capacity latest/previous state per CAN ID.
+// Slots are allocated once in begin(). IDs are found through an open-addressed
+// hash index and linked into an intrusive LRU list so that the
+// least-recently-seen ID can be evicted in O(1) when full. The ID order for
+// rendering is rebuilt by the receive task a few times a second at most,
+// only when IDs came or went, and published by double buffer.
+class StateTable
+{
+public:
+    static constexpr uint16_t NO_SLOT = 0xFFFF;
+
+    struct Entry
+    {
+        CANMessage latest;
+        CANMessage previous;
+        bool hasLatest = false;
+        bool hasPrevious = false;
+        uint16_t lruPrev = NO_SLOT;   // Towards the most recently seen
+        uint16_t lruNext = NO_SLOT;   // Towards the least recently seen
+    };
+
+    struct TouchResult
+    {
+        uint16_t slot = NO_SLOT;
+        bool inserted = false;        // Slot was (re)initialised for this ID
+        bool evicted = false;         // An older ID was dropped to make room
+        uint32_t evictedId = 0;
+    };
+
+    static bool begin(uint16_t capacity);
+
+    // Finds or inserts the ID and marks it most recently seen
+    static TouchResult touch(uint32_t id);
+    // Stores a new latest message; returns the replaced one, if any
+    static const CANMessage* store(uint16_t slot, const CANMessage& msg);
+
+    static uint16_t find(uint32_t id);
+    static const Entry& entry(uint16_t slot);
+
+    static constexpr uint32_t ORDER_INTERVAL_MS = 250;
+
+    // Receive task: rebuilds and publishes the ID order if IDs came or went,
+    // at most once every ORDER_INTERVAL_MS (the first time at once)
+    static void publishOrder(uint32_t now);
+    // Slots in ascending ID order as last published, count of them. A slot
+    // evicted since shows the ID that replaced it; IDs inserted since are
+    // missing. Readers copy what they need rather than hold on to it.
+    static const uint16_t* slotsById(uint16_t& count);
+    // Most recently seen slot; Entry::lruNext leads to older ones
+    static uint16_t mostRecent();
+    static uint16_t size();
+    static uint16_t capacity();
+    static uint32_t evictions();
+    static size_t memoryBytes();
+
+private:
+    static Entry* s_entries;
+    static uint32_t* s_ids;
+    static uint16_t* s_buckets;
+    static uint16_t* s_order[2];
+    static uint16_t s_orderCount[2];
+    static volatile uint8_t s_orderPublished;
+    static uint32_t s_membership;           // Counts inserted IDs
+    static uint32_t s_orderedMembership;
+    static uint32_t s_orderMs;
+    static bool s_orderBuilt;
+    static uint16_t s_capacity;
+    static uint32_t s_bucketMask;
+    static uint8_t s_bucketShift;
+    static uint16_t s_size;
+    static uint16_t s_lruHead;
+    static uint16_t s_lruTail;
+    static uint16_t s_freeHead;
+    static uint32_t s_evictions;
+
+    static uint32_t bucketFor(uint32_t id);
+    static void indexInsert(uint32_t id, uint16_t slot);
+    static void indexRemove(uint32_t id);
+    static void lruUnlink(uint16_t slot);
+    static void lruPushFront(uint16_t slot);
+};
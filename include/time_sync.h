@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame_codec.h"
+
+// Clock synchronisation between monitors on different buses of one vehicle,
+// so their captures can be merged on one timeline. One device is the
+// reference; the others ask it for its time over UDP, NTP style:
+//
+//   t1  client sends a request          (client clock)
+//   t2  reference receives it           (reference clock)
+//   t3  reference sends the response    (reference clock)
+//   t4  client receives the response    (client clock)
+//
+//   offset = ((t2 - t1) + (t3 - t4)) / 2     reference minus client
+//   delay  = (t4 - t1) - (t3 - t2)           time spent on the network
+//
+// A sample is only as good as its two directions were equally fast, so the
+// offset comes from the sample with the shortest delay among the last
+// FILTER_SAMPLES, as in NTP's clock filter. Each full filter window leaves
+// its best sample as a point; drift is the least-squares slope through the
+// last DRIFT_POINTS of them. Every device answers requests, so any one can
+// be the reference. The transport (WiFiUDP on the device, a socket in the
+// host tool) only moves packets and reads the clock.
+//
+// Packet, 32 bytes, little-endian:
+//   0  'T' 'S'  magic
+//   2  version
+//   3  type     1 request, 2 response
+//   4  sequence u32
+//   8  t1 u64
+//   16 t2 u64   0 in a request
+//   24 t3 u64   0 in a request
+class TimeSync
+{
+public:
+    static constexpr uint16_t PORT = 3190;
+    static constexpr size_t PACKET_BYTES = 32;
+    static constexpr uint32_t INTERVAL_MS = 1000;       // Between requests to the reference
+    static constexpr uint8_t FILTER_SAMPLES = 8;
+    static constexpr uint8_t DRIFT_POINTS = 16;
+    static constexpr uint32_t MAX_DELAY_US = 200000;    // Slower exchanges are ignored
+
+    typedef FrameCodec::ClockState State;
+
+    struct Estimate
+    {
+        State state = State::Reference;
+        uint64_t localUs = 0;       // Local time the offset was measured at
+        int64_t offsetUs = 0;       // Reference minus local at localUs
+        int32_t driftPpb = 0;       // How much faster the reference runs
+        uint32_t delayUs = 0;
+        uint32_t samples = 0;       // Exchanges used since the last reset
+    };
+
+    // Reference time for a local time under an estimate
+    static int64_t referenceUs(const Estimate& estimate, uint64_t localUs);
+
+    // Client side; false when out is too small
+    static size_t makeRequest(uint8_t* out, size_t size, uint64_t nowUs);
+    // Takes the response to the last request; false for anything else,
+    // including responses that arrive after a newer request went out
+    static bool onResponse(const uint8_t* in, size_t length, uint64_t receivedUs);
+
+    // Reference side: the response to a request received at receivedUs,
+    // stamped with nowUs on the way out. 0 when in is not a request.
+    static size_t answer(const uint8_t* in, size_t length, uint64_t receivedUs, uint64_t nowUs, uint8_t* out,
+                         size_t size);
+
+    // Forgets all samples, e.g. for a new peer. Without a peer this device is
+    // the reference and its estimate is zero.
+    static void reset(bool reference);
+    // Latest estimate; may be read from another task than the one feeding
+    // samples
+    static Estimate estimate();
+
+private:
+    struct Sample
+    {
+        uint64_t localUs;
+        int64_t offsetUs;
+        uint32_t delayUs;
+    };
+
+    static Sample s_filter[FILTER_SAMPLES];
+    static uint8_t s_filterCount;
+    static Sample s_points[DRIFT_POINTS];
+    static uint8_t s_pointCount;
+    static uint8_t s_pointNext;
+    static uint32_t s_sequence;
+    static uint64_t s_requestUs;
+    static bool s_waiting;
+    static uint32_t s_samples;
+    static Estimate s_estimates[2];
+    static volatile uint8_t s_published;
+
+    static void addSample(const Sample& sample);
+    static int32_t fitDriftPpb();
+    static void publish(const Estimate& estimate);
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Length of each ranking
+#ifndef TOP_IDS_COUNT
+#define TOP_IDS_COUNT 20
+#endif
+
+// Busiest and most-changing IDs. Changes are counted per slot as frames
+// arrive; when a statistics window closes, one pass over the slots offers
+// every ID to a small min-heap per metric, so keeping the rankings costs
+// O(n log N) once a second and reading them costs nothing. Rankings are
+// double-buffered: readers always see the last complete window.
+// Changes are counted on the frames the view stages see, so with sampling
+// enabled the change metrics cover the sampled frames only.
+class TopIds
+{
+public:
+    enum class Metric : uint8_t
+    {
+        FrameRate,      // Frames per second
+        ChangeRate,     // Frames per second whose payload differed from the previous one
+        BytesChanged,   // Changed payload bytes per second
+        Count
+    };
+
+    static constexpr size_t METRIC_COUNT = static_cast<size_t>(Metric::Count);
+
+    struct Item
+    {
+        uint32_t id;
+        uint32_t value;
+    };
+
+    struct Ranking
+    {
+        Item items[TOP_IDS_COUNT];
+        uint8_t count;
+    };
+
+    enum class ExportStage : uint8_t
+    {
+        Prefix,
+        Metrics,
+        Suffix,
+        Done
+    };
+
+    // Streaming JSON export of a copy of the published rankings
+    struct Export
+    {
+        ExportStage stage = ExportStage::Prefix;
+        Ranking rankings[METRIC_COUNT];
+        uint32_t windowMs = 0;
+        uint8_t limit = TOP_IDS_COUNT;
+        uint8_t metric = 0;
+        uint8_t next = 0;
+        char row[96];
+        size_t rowLength = 0;
+        size_t rowSent = 0;
+    };
+
+    static bool begin(uint16_t capacity);
+    static void resetSlot(uint16_t slot);
+
+    // Called for each frame that replaced a previous payload; changedMask
+    // has bit i set when byte i changed
+    static void recordChange(uint16_t slot, uint8_t changedMask)
+    {
+        Counters& counters = s_slots[slot];
+        counters.changes += changedMask != 0;
+        counters.changedBytes += __builtin_popcount(changedMask);
+    }
+
+    // Called after each closed statistics window of windowMs milliseconds
+    static void update(uint32_t windowMs);
+
+    static const char* metricName(Metric metric);
+    static const Ranking& ranking(Metric metric);
+
+    // At most limit IDs per metric are exported
+    static void beginExport(Export& exp, uint8_t limit);
+    static size_t fill(Export& exp, uint8_t* buffer, size_t maxLen);
+    static size_t memoryBytes();
+
+private:
+    struct Counters
+    {
+        uint32_t changes;
+        uint32_t changedBytes;
+    };
+
+    static Counters* s_slots;
+    static uint16_t s_capacity;
+    static Ranking s_rankings[2][METRIC_COUNT];
+    static volatile uint8_t s_published;
+    static uint32_t s_windowMs;
+
+    static void offer(Ranking& ranking, uint32_t id, uint32_t value);
+    static bool renderNext(Export& exp);
+};
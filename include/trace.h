@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Ring size in events; each event is 16 bytes on the device
+#ifndef TRACE_EVENT_CAPACITY
+#define TRACE_EVENT_CAPACITY 1024
+#endif
+
+// Records a begin/end pair around the enclosing block (TRACE_EVENTS builds).
+// name must be a string with static storage.
+#ifdef TRACE_EVENTS
+#define TRACE_SCOPE(name) Trace::Span traceSpan(name)
+#else
+#define TRACE_SCOPE(name) do {} while (0)
+#endif
+
+// Begin/end trace points recorded into a ring allocated once in begin().
+// Timestamps are CPU cycle counts on the device and std::chrono microseconds
+// on the host. The ring is exported as Chrome trace_event JSON, which loads
+// in Perfetto or chrome://tracing.
+class Trace
+{
+public:
+    class Span
+    {
+    public:
+        explicit Span(const char* name) : m_name(name) { record(m_name, 'B'); }
+        ~Span() { record(m_name, 'E'); }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* m_name;
+    };
+
+    enum class ExportStage : uint8_t
+    {
+        Prefix,
+        Events,
+        Suffix,
+        Done
+    };
+
+    // Streaming export state; one export at a time
+    struct Export
+    {
+        bool busy = false;
+        ExportStage stage = ExportStage::Prefix;
+        uint32_t first = 0;         // Ring position of the oldest event
+        uint32_t count = 0;
+        uint32_t next = 0;
+        uint32_t lastTicks = 0;
+        int64_t elapsedNs = 0;      // Time of the current event since the oldest
+        char row[160];
+        size_t rowLength = 0;
+        size_t rowSent = 0;
+    };
+
+    static bool begin(uint32_t capacity);
+    static void record(const char* name, char phase);
+    static void clear();
+    static uint32_t recorded();
+    static uint32_t capacity();
+
+    // Recording is paused between beginExport() and endExport() so the ring
+    // is stable while it streams. beginExport() returns nullptr when tracing
+    // is not set up or another export is running.
+    static Export* beginExport();
+    static size_t fill(Export& exp, uint8_t* buffer, size_t maxLen);
+    static void endExport(Export* exp);
+
+private:
+    struct Event
+    {
+        const char* name;
+        uint32_t ticks;
+        uint32_t thread;
+        char phase;
+    };
+
+    static Event* s_events;
+    static uint32_t s_capacity;
+    static std::atomic<uint32_t> s_head;
+    static volatile bool s_paused;
+    static Export s_export;
+
+    static uint32_t ticks();
+    static uint32_t ticksPerMicrosecond();
+    static uint32_t threadId();
+    static bool renderNext(Export& exp);
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "can_messages.h"
+
+// Synthetic CAN traffic for load testing. A profile is a comma-separated
+// list of key=value settings, optionally starting from a preset:
+//
+//   preset=steady|churn|burst|extended|load
+//   groups=20x10+50x100    20 IDs every 10 ms and 50 IDs every 100 ms
+//   len=8                  payload length
+//   ext=1                  29-bit IDs
+//   base=0x100             first ID; IDs are consecutive across groups
+//   churn=50               frames per 1000 that change one payload byte
+//   burst=40,burstms=500   40 extra back-to-back frames every 500 ms
+//   load=60                scale the periods to reach 60% bus load
+//   seed=1                 payloads and churn are deterministic per seed
+//
+// The same profile drives the TX queue on the device (CAN_SENDER builds)
+// and the ingest path directly in the host tool.
+class TrafficGenerator
+{
+public:
+    static constexpr uint8_t MAX_GROUPS = 4;
+
+    struct Frame
+    {
+        CANMessage msg;
+        bool extended;
+        uint64_t dueUs;     // Scheduled time on the generator's timeline
+    };
+
+    // Payload storage for up to maxIds IDs, allocated once
+    static bool begin(uint16_t maxIds);
+    // False for an invalid profile; lastError() says why
+    static bool configure(const char* profile, uint32_t bitrate);
+    static const char* lastError();
+
+    // Emits up to max frames that are due at nowUs (a wrapping microsecond
+    // clock) in schedule order. Frames more than MAX_LAG_US late are skipped.
+    static uint16_t poll(uint32_t nowUs, Frame* out, uint16_t max);
+
+    static uint16_t idCount();
+    static uint64_t generated();
+    static uint64_t skipped();
+    // Bus load the profile produces, from the nominal frame length
+    static uint32_t expectedLoadPermille();
+
+private:
+    static constexpr uint32_t MAX_LAG_US = 1000000;
+
+    struct Group
+    {
+        uint16_t firstIndex;
+        uint16_t count;
+        uint32_t periodUs;
+        uint64_t stepQ8;    // Time between frames of the group, 1/256 us
+        uint64_t nextQ8;
+        uint16_t next;      // Next ID in the group, round robin
+    };
+
+    struct Settings
+    {
+        Group groups[MAX_GROUPS];
+        uint8_t groupCount;
+        uint8_t length;
+        bool extended;
+        uint32_t baseId;
+        uint16_t churnPermille;
+        uint16_t burstFrames;
+        uint32_t burstIntervalUs;
+        uint16_t loadPercent;
+        uint32_t seed;
+    };
+
+    static uint8_t (*s_payloads)[8];
+    static uint16_t s_capacity;
+    static Settings s_settings;
+    static uint16_t s_idCount;
+    static uint32_t s_random;
+    static uint64_t s_nowUs;
+    static uint32_t s_lastPollUs;
+    static bool s_started;
+    static uint64_t s_burstQ8;
+    static uint16_t s_burstLeft;
+    static uint16_t s_burstNext;
+    static uint64_t s_generated;
+    static uint64_t s_skipped;
+    static uint32_t s_expectedLoad;
+    static const char* s_error;
+
+    static bool applySetting(Settings& settings, const char* key, const char* value);
+    static bool applyPreset(Settings& settings, const char* name);
+    static bool parseGroups(Settings& settings, const char* value);
+    static void makeFrame(uint16_t index, uint64_t dueUs, Frame& frame);
+    static uint32_t nextRandom();
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "frame_codec.h"
+
+// Follows transmitted frames from the TX queue to the bus so the sender can
+// be told when its frame went out. The driver does not say which frame an
+// alert is about, only how many are still queued and how many have failed
+// in total; the driver's TX queue is FIFO, so the oldest pending frames are
+// the ones that finished.
+//
+// Two rings, each with one writer and one reader:
+//   pending  queued() under the caller's transmit lock; settle()/abandon()
+//            from the CAN task
+//   acks     settle()/abandon() from the CAN task; takeAck() from the
+//            stream task
+// Frames queued with client 0 are timed for LatencyStats but not
+// acknowledged.
+class TransmitTracker
+{
+public:
+    struct Ack
+    {
+        uint32_t client;
+        FrameCodec::TransmitAck ack;
+    };
+
+    static bool begin(uint8_t capacity);
+
+    // Right after the frame entered the driver's TX queue
+    static void queued(uint32_t token, uint32_t client, uint32_t receivedUs, uint32_t queuedUs);
+    // Frames queued() and not yet settled; read it before asking the driver
+    // for its status, so a frame queued in between is not taken for done
+    static uint32_t inFlight();
+    // trackedBefore from inFlight(); driverInFlight and failedTotal from
+    // twai_get_status_info (msgs_to_tx, tx_failed_count)
+    static void settle(uint32_t trackedBefore, uint32_t driverInFlight, uint32_t failedTotal, uint32_t doneUs);
+    // Everything pending is gone: the driver was reinstalled, when its
+    // failure count starts again from 0, or cleared its queue at bus-off
+    static void abandon(uint32_t doneUs, uint32_t failedTotal = 0);
+
+    static bool takeAck(Ack& ack);
+
+    static uint32_t completed();
+    static uint32_t failed();
+    static uint32_t untracked();
+    static size_t memoryBytes();
+
+private:
+    struct Pending
+    {
+        uint32_t token;
+        uint32_t client;
+        uint32_t receivedUs;
+        uint32_t queuedUs;
+    };
+
+    static Pending* s_pending;
+    static Ack* s_acks;
+    static uint8_t s_capacity;
+    static std::atomic<uint32_t> s_pendingHead;
+    static std::atomic<uint32_t> s_pendingTail;
+    static std::atomic<uint32_t> s_ackHead;
+    static std::atomic<uint32_t> s_ackTail;
+    static uint32_t s_lastFailedTotal;
+    static uint32_t s_completed;
+    static uint32_t s_failed;
+    static uint32_t s_untracked;
+
+    static void finish(FrameCodec::TransmitStatus status, uint32_t doneUs);
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Orders for paging through the latest-state table without sorting it per
+// request. ID order is the state table's own index and last update its LRU
+// list. Last change is an intrusive list kept here, moved to the front on
+// each payload change. The rate order is repaired once per statistics window
+// by an insertion pass over the previous window's order, which is close to
+// linear because rates change little from one window to the next. A pass
+// stops after RATE_REPAIR_MOVES moves and the next window carries on from
+// there, so a burst of new IDs cannot stall the receive task. DLC order
+// is a counting pass over the ID order. Reading a page costs at most
+// O(offset + limit) steps, or O(n) for DLC.
+class ViewOrder
+{
+public:
+    enum class Order : uint8_t
+    {
+        Id,             // Ascending
+        LastUpdate,     // Most recently received first
+        LastChange,     // Most recently changed first; never-changed IDs last
+        Rate,           // Highest frame rate first, then by ID
+        Length          // Shortest DLC first, then by ID
+    };
+
+    static constexpr uint16_t RATE_REPAIR_MOVES = 2048;
+
+    static bool begin(uint16_t capacity);
+    // The slot holds a new ID, which starts as the least recently changed
+    static void resetSlot(uint16_t slot);
+    // The slot's payload changed
+    static void recordChange(uint16_t slot);
+    // Called after each closed statistics window
+    static void update();
+
+    // Writes the slots of one page (up to limit) in the given order and
+    // returns their count. Lists changing while a page is read can repeat or
+    // skip a slot; the walk is bounded by the table size either way.
+    static uint16_t page(Order order, uint16_t offset, uint16_t limit, uint16_t* slots);
+
+    static const char* orderName(Order order);
+    static bool parseOrder(const char* name, Order& order);
+    static size_t memoryBytes();
+
+private:
+    static uint16_t* s_changePrev;
+    static uint16_t* s_changeNext;
+    static uint16_t s_changeHead;
+    static uint16_t s_changeTail;
+    static uint16_t* s_rateOrder[2];
+    static uint16_t s_rateCount[2];
+    static volatile uint8_t s_ratePublished;
+    static uint16_t s_rateResume;       // Where the next repair pass carries on
+    static uint16_t s_capacity;
+
+    static void changeUnlink(uint16_t slot);
+    static void changeLink(uint16_t slot, bool front);
+};
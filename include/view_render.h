@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "render_buffer.h"
+#include "heap_guard.h"
+
+// Renders the web views from the state table. Shared by the firmware's web
+// server and the host tool. Responses are streamed from a fixed pool of
+// contexts allocated in begin(): one row at a time is rendered into the
+// context's scratch buffer and copied out as the transport has room.
+class ViewRenderer
+{
+public:
+    static constexpr size_t CONTEXT_COUNT = 4;
+    static constexpr size_t ROW_BUFFER_BYTES = 512;
+
+    enum class View : uint8_t
+    {
+        Page,
+        LatestRows,
+        FilteredRows,
+        IdListJson,
+        LatestPage,         // Latest rows for the slots in ctx.slots, in that order
+        SlotListJson        // JSON ID list of the slots in ctx.slots
+    };
+
+    enum class Stage : uint8_t
+    {
+        Prefix,
+        Rows,
+        Suffix,
+        Done
+    };
+
+    struct Context
+    {
+        bool busy = false;
+        View view = View::LatestRows;
+        HeapGuard::Scope scope = HeapGuard::Scope::None;
+        Stage stage = Stage::Prefix;
+        uint16_t next = 0;              // Next position in the row source
+        uint16_t rowsEmitted = 0;
+        bool idsRequested = false;      // Filtered view: request named at least one ID
+        uint16_t slotCount = 0;         // Filtered view: resolved slots, in ID order; others: slots to render
+        uint16_t* slots = nullptr;
+        uint32_t now = 0;
+        const char* chunk = nullptr;    // Text currently being sent
+        size_t chunkLength = 0;
+        size_t chunkSent = 0;
+        char* row = nullptr;            // Scratch space for one rendered row
+    };
+
+    // pageTemplate must contain %LATEST_MESSAGES% where the rows go
+    static bool begin(const char* pageTemplate, uint16_t maxIds);
+    static Context* claim(View view, HeapGuard::Scope scope, uint32_t now);
+    static void release(Context* ctx);
+    // Copies up to maxLen bytes of the view; 0 once it is complete
+    static size_t fill(Context& ctx, uint8_t* buffer, size_t maxLen);
+
+    // Row renderers; false when the slot produces no row
+    static void formatByte(RenderBuffer& out, uint8_t byte, bool highlight);
+    static bool renderLatestRow(RenderBuffer& out, uint16_t slot, uint32_t now);
+    static bool renderFilteredRow(RenderBuffer& out, uint16_t slot, uint32_t now);
+    static bool renderIdListItem(RenderBuffer& out, uint16_t slot, bool first);
+
+private:
+    static Context* s_contexts;
+    static const char* s_pageTemplate;
+    static size_t s_placeholderOffset;
+    static size_t s_templateLength;
+
+    static void renderBytes(RenderBuffer& out, uint16_t slot, uint8_t highlightMask);
+    static bool renderRow(Context& ctx, RenderBuffer& out);
+    static bool renderNext(Context& ctx);
+    static void setChunk(Context& ctx, const char* text, size_t length);
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include "can_stats.h"
+
+// Decides which frames reach the view stages (previous/latest state, change
+// tracking, highlight, stream). Statistics are always exact and are not affected.
+// Sampling is applied per ID so that low-rate IDs still show up in the views.
+class ViewSampler
+{
+public:
+    enum class Mode : uint8_t
+    {
+        Off,        // Every frame is processed
+        OneInN,     // Every Nth frame of each ID is processed
+        Interval    // At most one frame per ID every N milliseconds
+    };
+
+    static void configure(Mode mode, uint32_t value);
+    static bool accept(CanStatistics::IdCounters& counters, uint32_t now);
+
+    static Mode mode();
+    static uint32_t value();
+    static uint32_t sampledFrames();
+    static uint32_t skippedFrames();
+
+    static const char* modeName(Mode mode);
+    static bool parseMode(const char* name, Mode& mode);
+
+private:
+    static Mode s_mode;
+    static uint32_t s_value;
+    static uint32_t s_sampled;
+    static uint32_t s_skipped;
+};
@@ -3,33 +3,61 @@
 #include <WiFi.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
-#include <map>
-#include <vector>
 #include "can_messages.h"  // Forward declaration of CANMessage type
+#include "device_config.h"
+#include "frame_codec.h"
 
 class WebInterface
 {
 public:
-    static bool initialize(const char* ssid, const char* password);
-    static void setMessageMaps(
-        const std::map<uint32_t, CANMessage>* latest,
-        const std::map<uint32_t, CANMessage>* previous);
-    static void recordChange(const CANMessage& current, const CANMessage* previous);
+    // Joins the configured network; false when it cannot be reached
+    static bool connectStation(const char* ssid, const char* password);
+    // Routes, the stream task and the server, on whichever network is up
+    static bool initialize();
+    // Around a runtime network switch: stop() closes the stream clients and
+    // the listening server, start() listens again on the new network. The
+    // routes and the stream task stay in place.
+    static void stop();
+    static void start();
     static void setTransmitCallback(bool (*callback)(uint32_t id, uint8_t length, const uint8_t* data));
+    // Transmit records from /stream clients. Returns Sent once the frame is
+    // queued, the acknowledgement then follows through TransmitTracker;
+    // any other status is acknowledged straight away.
+    static void setStreamTransmitCallback(FrameCodec::TransmitStatus (*callback)(
+        const FrameCodec::TransmitRequest& request, uint32_t client, uint32_t receivedUs));
 
 private:
     static AsyncWebServer server;
-    static const std::map<uint32_t, CANMessage>* latestMessages;
-    static const std::map<uint32_t, CANMessage>* previousMessages;
+    static AsyncWebSocket stream;
     static bool (*transmitCallback)(uint32_t id, uint8_t length, const uint8_t* data);
+    static FrameCodec::TransmitStatus (*streamTransmitCallback)(const FrameCodec::TransmitRequest& request,
+                                                                uint32_t client, uint32_t receivedUs);
 
-    static String formatByte(uint8_t byte, bool highlight);
-    static String generateHtml();
-    static String generateLatestRows();
-    static String generateFilteredPage();
-    static String generateIdListJson();
-    static std::vector<uint32_t> parseIdList(const String& rawIds);
-    static String generateFilteredRows(const std::vector<uint32_t>& ids);
+    static String generateMetricsJson();
+    static void handleLatestMessages(AsyncWebServerRequest* request);
+    static void handleSampling(AsyncWebServerRequest* request);
+    static void handleTrace(AsyncWebServerRequest* request);
+    static String generateLatencyJson();
+    static void handleHistory(AsyncWebServerRequest* request);
+    static void handleHistoryWatch(AsyncWebServerRequest* request);
+    static void handleTop(AsyncWebServerRequest* request);
+    static void handleSearch(AsyncWebServerRequest* request);
+    static void handleHistogram(AsyncWebServerRequest* request);
+    static void handleHistogramWatch(AsyncWebServerRequest* request);
+    static void handleConfig(AsyncWebServerRequest* request);
+    static void handleConfigSave(AsyncWebServerRequest* request);
+    static void handleNetwork(AsyncWebServerRequest* request);
+    static void handleFuzz(AsyncWebServerRequest* request);
+    static void handleFuzzControl(AsyncWebServerRequest* request);
+    static String generateFuzzJson(uint32_t since, bool withLog);
+    static void handleSequence(AsyncWebServerRequest* request);
+    static void handleSequenceControl(AsyncWebServerRequest* request);
+    static String generateSequenceJson();
+    static void onStreamEvent(AsyncWebSocket* socket, AsyncWebSocketClient* client, AwsEventType type,
+                              void* arg, uint8_t* data, size_t len);
+    static void onLatencyEcho(const uint8_t* records, uint16_t count);
+    static void onTransmit(AsyncWebSocketClient* client, const uint8_t* records, uint16_t count);
+    static void streamTask(void* parameter);
     
     static const char* HTML_TEMPLATE;
     static const char* FILTERED_TEMPLATE;
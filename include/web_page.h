@@ -0,0 +1,5 @@
+#pragma once
+
+// The monitor's single page, served by the firmware and the host tool.
+// %LATEST_MESSAGES% marks where ViewRenderer inserts the latest rows.
+extern const char* const WEB_PAGE_HTML;
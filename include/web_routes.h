@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "request_parser.h"
+#include "device_config.h"
+#include "view_render.h"
+#include "rate_history.h"
+#include "top_ids.h"
+#include "byte_histogram.h"
+#include "heap_guard.h"
+
+// Request handling shared by the firmware's web server and the host tool's
+// serve command. A route reads its parameters through Request and answers
+// with a Reply, or, for the views and exports, with the context or export
+// state the transport then streams. Getting parameters off the wire and
+// the bytes back onto it is all that stays with each transport.
+//
+// Routes that need the device itself stay in WebInterface: /metrics,
+// /trace, /latency, /network, /fuzz, /sequence and the /stream socket.
+class WebRoutes
+{
+public:
+    // View stages that only see the frames accepted by ViewSampler
+    static constexpr const char* SAMPLED_STAGES_JSON = "[\"latest state\",\"change tracking\",\"highlight\",\"stream\"]";
+    static constexpr size_t MAX_BODY_BYTES = DeviceConfig::MAX_JSON_BYTES;
+
+    // The transport's parameter lookup: the query of a GET, the form body of
+    // a POST. Values stay valid until the route returns.
+    struct Request
+    {
+        bool (*lookup)(void* source, const char* name, RequestParser::Param& value) = nullptr;
+        void* source = nullptr;
+
+        // data is nullptr when the parameter is absent
+        RequestParser::Param param(const char* name) const;
+    };
+
+    // A short answer sent as it is
+    struct Reply
+    {
+        uint16_t status = 200;
+        const char* contentType = "application/json";
+        char body[MAX_BODY_BYTES];
+        size_t length = 0;
+
+        void set(uint16_t code, const char* text);
+    };
+
+    // Where the settings survive a reboot: NVS on the device, the --config
+    // file for serve. Without one they are applied but not saved.
+    static void setSaveCallback(bool (*save)(const DeviceConfig::Settings& settings));
+
+    // The views: true with the context to stream, nullptr when every context
+    // is busy; false when the request was rejected, with reply set
+    static bool latest(const Request& request, HeapGuard::Scope scope, uint32_t now, ViewRenderer::Context*& ctx,
+                       Reply& reply);
+    static bool filtered(const Request& request, HeapGuard::Scope scope, uint32_t now, ViewRenderer::Context*& ctx,
+                         Reply& reply);
+    static bool search(const Request& request, HeapGuard::Scope scope, uint32_t now, ViewRenderer::Context*& ctx,
+                       Reply& reply);
+
+    // The exports: true with exp ready to fill; false with reply set
+    static bool history(const Request& request, RateHistory::Export& exp, Reply& reply);
+    static void top(const Request& request, TopIds::Export& exp);
+    static bool histogram(const Request& request, ByteHistogram::Export& exp, Reply& reply);
+
+    // The settings routes. Every change is made on captured settings,
+    // validated as a whole, saved and only then applied, so a rejected
+    // request changes nothing.
+    static void sampling(const Request& request, Reply& reply);
+    static void historyWatch(const Request& request, Reply& reply);
+    static void histogramWatch(const Request& request, Reply& reply);
+    static void config(Reply& reply);
+    static void configSave(const Request& request, Reply& reply);
+
+private:
+    static bool (*s_save)(const DeviceConfig::Settings& settings);
+
+    static bool commit(DeviceConfig::Settings& settings, Reply& reply);
+    static void renderIds(Reply& reply, const char* name, const uint32_t* ids, uint8_t count);
+};
@@ -0,0 +1,373 @@
+#include "byte_histogram.h"
+#include "state_table.h"
+#include "render_buffer.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+namespace
+{
+    constexpr uint8_t VALUES_PER_ROW = 16;
+    constexpr size_t ID_COUNTS = 8 * ByteHistogram::BINS;
+    constexpr size_t PAIR_COUNTS = ByteHistogram::PAIR_BINS * ByteHistogram::PAIR_BINS;
+
+    // Saturating increment without a branch
+    inline void bump(uint16_t& counter)
+    {
+        counter += counter != 0xFFFF;
+    }
+}
+
+uint8_t* ByteHistogram::s_slotIndex = nullptr;
+uint16_t ByteHistogram::s_capacity = 0;
+uint16_t* ByteHistogram::s_counts = nullptr;
+uint16_t* ByteHistogram::s_pairCounts = nullptr;
+uint32_t ByteHistogram::s_ids[HISTOGRAM_IDS] = {};
+bool ByteHistogram::s_used[HISTOGRAM_IDS] = {};
+uint32_t ByteHistogram::s_frames[HISTOGRAM_IDS] = {};
+ByteHistogram::Pair ByteHistogram::s_pairs[HISTOGRAM_PAIRS] = {};
+
+bool ByteHistogram::begin(uint16_t capacity)
+{
+    if (s_slotIndex)
+    {
+        return true;
+    }
+
+    s_slotIndex = new (std::nothrow) uint8_t[capacity];
+    s_counts = new (std::nothrow) uint16_t[HISTOGRAM_IDS * ID_COUNTS];
+    s_pairCounts = new (std::nothrow) uint16_t[HISTOGRAM_PAIRS * PAIR_COUNTS];
+    if (!s_slotIndex || !s_counts || !s_pairCounts)
+    {
+        return false;
+    }
+    memset(s_slotIndex, NOT_SELECTED, capacity);
+    for (Pair& pair : s_pairs)
+    {
+        pair.index = NOT_SELECTED;
+    }
+    s_capacity = capacity;
+    return true;
+}
+
+void ByteHistogram::bindSlot(uint16_t slot, uint32_t id)
+{
+    if (slot < s_capacity)
+    {
+        int8_t index = findId(id);
+        s_slotIndex[slot] = index >= 0 ? static_cast<uint8_t>(index) : NOT_SELECTED;
+    }
+}
+
+void ByteHistogram::recordSelected(uint8_t index, const CANMessage& msg)
+{
+    uint8_t length = msg.length < 8 ? msg.length : 8;
+    uint16_t* counts = s_counts + index * ID_COUNTS;
+    for (uint8_t i = 0; i < length; ++i)
+    {
+        bump(counts[i * BINS + msg.data[i]]);
+    }
+    ++s_frames[index];
+
+    for (uint8_t p = 0; p < HISTOGRAM_PAIRS; ++p)
+    {
+        Pair& pair = s_pairs[p];
+        if (pair.index == index && pair.first < length && pair.second < length)
+        {
+            uint16_t cell = (msg.data[pair.first] >> PAIR_SHIFT) * PAIR_BINS + (msg.data[pair.second] >> PAIR_SHIFT);
+            bump(s_pairCounts[p * PAIR_COUNTS + cell]);
+            ++pair.frames;
+        }
+    }
+}
+
+int8_t ByteHistogram::findId(uint32_t id)
+{
+    for (uint8_t i = 0; i < HISTOGRAM_IDS; ++i)
+    {
+        if (s_used[i] && s_ids[i] == id)
+        {
+            return static_cast<int8_t>(i);
+        }
+    }
+    return -1;
+}
+
+int8_t ByteHistogram::findPair(uint32_t id, uint8_t first, uint8_t second)
+{
+    for (uint8_t p = 0; p < HISTOGRAM_PAIRS; ++p)
+    {
+        const Pair& pair = s_pairs[p];
+        if (pair.index != NOT_SELECTED && pair.id == id && pair.first == first && pair.second == second)
+        {
+            return static_cast<int8_t>(p);
+        }
+    }
+    return -1;
+}
+
+// Counting starts or stops with this store; the CAN task reads the index
+// per frame, so the counters are cleared before an index is published
+void ByteHistogram::setSlotIndex(uint32_t id, uint8_t index)
+{
+    uint16_t slot = StateTable::find(id);
+    if (slot != StateTable::NO_SLOT && slot < s_capacity)
+    {
+        s_slotIndex[slot] = index;
+    }
+}
+
+bool ByteHistogram::select(uint32_t id)
+{
+    if (!s_slotIndex)
+    {
+        return false;
+    }
+    if (findId(id) >= 0)
+    {
+        return true;
+    }
+    for (uint8_t i = 0; i < HISTOGRAM_IDS; ++i)
+    {
+        if (!s_used[i])
+        {
+            memset(s_counts + i * ID_COUNTS, 0, ID_COUNTS * sizeof(uint16_t));
+            s_frames[i] = 0;
+            s_ids[i] = id;
+            s_used[i] = true;
+            setSlotIndex(id, i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ByteHistogram::unselect(uint32_t id)
+{
+    int8_t index = findId(id);
+    if (index < 0)
+    {
+        return false;
+    }
+    setSlotIndex(id, NOT_SELECTED);
+    for (Pair& pair : s_pairs)
+    {
+        if (pair.index == index)
+        {
+            pair.index = NOT_SELECTED;
+        }
+    }
+    s_used[index] = false;
+    return true;
+}
+
+bool ByteHistogram::addPair(uint32_t id, uint8_t first, uint8_t second)
+{
+    if (first > 7 || second > 7 || first == second)
+    {
+        return false;
+    }
+    if (findPair(id, first, second) >= 0)
+    {
+        return true;
+    }
+    for (uint8_t p = 0; p < HISTOGRAM_PAIRS; ++p)
+    {
+        Pair& pair = s_pairs[p];
+        if (pair.index == NOT_SELECTED)
+        {
+            if (!select(id))
+            {
+                return false;
+            }
+            memset(s_pairCounts + p * PAIR_COUNTS, 0, PAIR_COUNTS * sizeof(uint16_t));
+            pair.id = id;
+            pair.first = first;
+            pair.second = second;
+            pair.frames = 0;
+            pair.index = static_cast<uint8_t>(findId(id));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ByteHistogram::removePair(uint32_t id, uint8_t first, uint8_t second)
+{
+    int8_t p = findPair(id, first, second);
+    if (p < 0)
+    {
+        return false;
+    }
+    s_pairs[p].index = NOT_SELECTED;
+    return true;
+}
+
+uint8_t ByteHistogram::selectedCount()
+{
+    return static_cast<uint8_t>(std::count(s_used, s_used + HISTOGRAM_IDS, true));
+}
+
+// Selected IDs in pool order; index counts selected IDs only
+uint32_t ByteHistogram::selectedId(uint8_t index)
+{
+    for (uint8_t i = 0; i < HISTOGRAM_IDS; ++i)
+    {
+        if (s_used[i] && index-- == 0)
+        {
+            return s_ids[i];
+        }
+    }
+    return 0;
+}
+
+uint8_t ByteHistogram::pairCount()
+{
+    return static_cast<uint8_t>(std::count_if(s_pairs, s_pairs + HISTOGRAM_PAIRS, [](const Pair& pair)
+    {
+        return pair.index != NOT_SELECTED;
+    }));
+}
+
+bool ByteHistogram::pairAt(uint8_t index, uint32_t& id, uint8_t& first, uint8_t& second)
+{
+    for (const Pair& pair : s_pairs)
+    {
+        if (pair.index != NOT_SELECTED && index-- == 0)
+        {
+            id = pair.id;
+            first = pair.first;
+            second = pair.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ByteHistogram::beginExport(Export& exp, uint32_t id)
+{
+    int8_t index = s_slotIndex ? findId(id) : -1;
+    if (index < 0)
+    {
+        return false;
+    }
+    exp = Export();
+    exp.id = id;
+    exp.frames = s_frames[index];
+    exp.counts = s_counts + index * ID_COUNTS;
+    exp.rows = 8;
+    exp.columns = BINS;
+    return true;
+}
+
+bool ByteHistogram::beginPairExport(Export& exp, uint32_t id, uint8_t first, uint8_t second)
+{
+    int8_t p = s_slotIndex ? findPair(id, first, second) : -1;
+    if (p < 0)
+    {
+        return false;
+    }
+    exp = Export();
+    exp.id = id;
+    exp.frames = s_pairs[p].frames;
+    exp.pairFirst = static_cast<int8_t>(first);
+    exp.pairSecond = static_cast<int8_t>(second);
+    exp.counts = s_pairCounts + p * PAIR_COUNTS;
+    exp.rows = PAIR_BINS;
+    exp.columns = PAIR_BINS;
+    return true;
+}
+
+size_t ByteHistogram::fill(Export& exp, uint8_t* buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (exp.rowSent == exp.rowLength)
+        {
+            if (!renderNext(exp))
+            {
+                break;
+            }
+            continue;
+        }
+        size_t count = std::min(maxLen - written, exp.rowLength - exp.rowSent);
+        memcpy(buffer + written, exp.row + exp.rowSent, count);
+        exp.rowSent += count;
+        written += count;
+    }
+    return written;
+}
+
+// Renders the next piece of JSON into exp.row; false once finished.
+// {"id":"0x1a0","frames":N,"counts":[[...],...]} for bytes, with
+// "bytes":[2,3],"cellWidth":8 added for a pair
+bool ByteHistogram::renderNext(Export& exp)
+{
+    RenderBuffer out(exp.row, sizeof(exp.row));
+    switch (exp.stage)
+    {
+    case ExportStage::Prefix:
+        out.append("{\"id\":\"0x");
+        out.appendHex(exp.id);
+        out.append("\",");
+        if (exp.pairFirst >= 0)
+        {
+            out.append("\"bytes\":[");
+            out.appendDec(static_cast<uint32_t>(exp.pairFirst));
+            out.appendChar(',');
+            out.appendDec(static_cast<uint32_t>(exp.pairSecond));
+            out.append("],\"cellWidth\":");
+            out.appendDec(1u << PAIR_SHIFT);
+            out.appendChar(',');
+        }
+        out.append("\"frames\":");
+        out.appendDec(exp.frames);
+        out.append(",\"counts\":[");
+        exp.stage = ExportStage::Values;
+        break;
+    case ExportStage::Values:
+    {
+        uint32_t total = static_cast<uint32_t>(exp.rows) * exp.columns;
+        if (exp.next == total)
+        {
+            exp.stage = ExportStage::Suffix;
+            return renderNext(exp);
+        }
+        // Counters are read live and may move on while the response streams
+        for (uint8_t i = 0; i < VALUES_PER_ROW && exp.next < total; ++i, ++exp.next)
+        {
+            uint32_t column = exp.next % exp.columns;
+            if (column == 0)
+            {
+                out.append(exp.next > 0 ? ",[" : "[");
+            }
+            else
+            {
+                out.appendChar(',');
+            }
+            out.appendDec(exp.counts[exp.next]);
+            if (column + 1 == exp.columns)
+            {
+                out.appendChar(']');
+            }
+        }
+        break;
+    }
+    case ExportStage::Suffix:
+        out.append("]}");
+        exp.stage = ExportStage::Done;
+        break;
+    case ExportStage::Done:
+        return false;
+    }
+    exp.rowLength = out.length();
+    exp.rowSent = 0;
+    return true;
+}
+
+size_t ByteHistogram::memoryBytes()
+{
+    return s_slotIndex ? s_capacity + (HISTOGRAM_IDS * ID_COUNTS + HISTOGRAM_PAIRS * PAIR_COUNTS) * sizeof(uint16_t)
+                       : 0;
+}
@@ -0,0 +1,85 @@
+#include "can_ingest.h"
+#include "state_table.h"
+#include "change_tracker.h"
+#include "can_stats.h"
+#include "view_sampler.h"
+#include "rate_history.h"
+#include "top_ids.h"
+#include "view_order.h"
+#include "byte_histogram.h"
+#include "heap_guard.h"
+#include "trace.h"
+
+bool CanIngest::begin(uint32_t bitrate, uint16_t maxIds)
+{
+    return StateTable::begin(maxIds) &&
+           ChangeTracker::begin(maxIds) &&
+           CanStatistics::begin(bitrate, maxIds) &&
+           RateHistory::begin(HISTORY_WATCH_IDS) &&
+           TopIds::begin(maxIds) &&
+           ViewOrder::begin(maxIds) &&
+           ByteHistogram::begin(maxIds);
+}
+
+bool CanIngest::process(const CANMessage& msg, bool extended)
+{
+    HeapGuard::HotPathScope hotPath;
+    ALLOC_SCOPE(CanRX);
+    TRACE_SCOPE("CanRX");
+
+    // Find or insert the ID; when the table is full the least recently
+    // seen ID is evicted and its slot reused
+    StateTable::TouchResult touched = StateTable::touch(msg.id);
+    if (touched.slot == StateTable::NO_SLOT)
+    {
+        return false;
+    }
+    if (touched.inserted)
+    {
+        CanStatistics::resetSlot(touched.slot);
+        ChangeTracker::resetSlot(touched.slot);
+        TopIds::resetSlot(touched.slot);
+        ViewOrder::resetSlot(touched.slot);
+        ByteHistogram::bindSlot(touched.slot, msg.id);
+    }
+
+    // Statistics and histograms see every frame; the view stages below may be sampled
+    CanStatistics::IdCounters& counters = CanStatistics::recordFrame(touched.slot, msg.length, extended);
+    ByteHistogram::record(touched.slot, msg);
+    if (!ViewSampler::accept(counters, msg.timestamp))
+    {
+        return false;
+    }
+
+    // Update latest/previous state and change tracking
+    const CANMessage* previousMessage = StateTable::store(touched.slot, msg);
+    uint8_t changed = ChangeTracker::recordChange(touched.slot, msg, previousMessage, msg.timestamp);
+    if (previousMessage)
+    {
+        TopIds::recordChange(touched.slot, changed);
+        if (changed)
+        {
+            ViewOrder::recordChange(touched.slot);
+        }
+    }
+    return true;
+}
+
+void CanIngest::tick(uint32_t now)
+{
+    StateTable::publishOrder(now);
+    if (CanStatistics::tick(now))
+    {
+        RateHistory::record(CanStatistics::lastWindowMs());
+        TopIds::update(CanStatistics::lastWindowMs());
+        ViewOrder::update();
+        ChangeTracker::expire(now);
+    }
+}
+
+size_t CanIngest::memoryBytes()
+{
+    return StateTable::memoryBytes() + ChangeTracker::memoryBytes() + CanStatistics::memoryBytes() +
+           RateHistory::memoryBytes() + TopIds::memoryBytes() + ViewOrder::memoryBytes() +
+           ByteHistogram::memoryBytes();
+}
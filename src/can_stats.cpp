@@ -0,0 +1,119 @@
+#include "can_stats.h"
+#include <new>
+
+CanStatistics::IdCounters* CanStatistics::s_perSlot = nullptr;
+uint16_t CanStatistics::s_capacity = 0;
+uint32_t CanStatistics::s_bitrate = 125000;
+uint32_t CanStatistics::s_totalFrames = 0;
+uint32_t CanStatistics::s_windowStart = 0;
+uint32_t CanStatistics::s_windowFrames = 0;
+uint32_t CanStatistics::s_windowBits = 0;
+uint32_t CanStatistics::s_frameRate = 0;
+uint32_t CanStatistics::s_busLoadPermille = 0;
+uint32_t CanStatistics::s_lastWindowMs = 0;
+
+bool CanStatistics::begin(uint32_t bitrate, uint16_t capacity)
+{
+    s_bitrate = bitrate ? bitrate : 1;
+    s_totalFrames = 0;
+    s_windowFrames = 0;
+    s_windowBits = 0;
+    s_frameRate = 0;
+    s_busLoadPermille = 0;
+
+    delete[] s_perSlot;
+    s_perSlot = new (std::nothrow) IdCounters[capacity];
+    s_capacity = s_perSlot ? capacity : 0;
+    return s_perSlot != nullptr;
+}
+
+void CanStatistics::setBitrate(uint32_t bitrate)
+{
+    s_bitrate = bitrate ? bitrate : 1;
+}
+
+void CanStatistics::resetSlot(uint16_t slot)
+{
+    if (slot < s_capacity)
+    {
+        s_perSlot[slot] = IdCounters();
+    }
+}
+
+uint32_t CanStatistics::frameBits(uint8_t length, bool extended)
+{
+    // SOF, arbitration, control, CRC, ACK, EOF and intermission fields
+    return (extended ? 67u : 47u) + 8u * length;
+}
+
+CanStatistics::IdCounters& CanStatistics::recordFrame(uint16_t slot, uint8_t length, bool extended)
+{
+    ++s_totalFrames;
+    ++s_windowFrames;
+    s_windowBits += frameBits(length, extended);
+
+    IdCounters& counters = s_perSlot[slot];
+    ++counters.frames;
+    ++counters.windowFrames;
+    return counters;
+}
+
+bool CanStatistics::tick(uint32_t now)
+{
+    uint32_t elapsed = now - s_windowStart;
+    if (elapsed < WINDOW_MS)
+    {
+        return false;
+    }
+
+    s_frameRate = static_cast<uint32_t>((static_cast<uint64_t>(s_windowFrames) * 1000) / elapsed);
+    s_busLoadPermille = static_cast<uint32_t>((static_cast<uint64_t>(s_windowBits) * 1000 * 1000) /
+                                              (static_cast<uint64_t>(s_bitrate) * elapsed));
+    if (s_busLoadPermille > 1000)
+    {
+        s_busLoadPermille = 1000;
+    }
+
+    for (uint16_t slot = 0; slot < s_capacity; ++slot)
+    {
+        IdCounters& counters = s_perSlot[slot];
+        counters.rate = static_cast<uint32_t>((static_cast<uint64_t>(counters.windowFrames) * 1000) / elapsed);
+        counters.windowFrames = 0;
+    }
+
+    s_windowStart = now;
+    s_windowFrames = 0;
+    s_windowBits = 0;
+    s_lastWindowMs = elapsed;
+    return true;
+}
+
+uint32_t CanStatistics::totalFrames()
+{
+    return s_totalFrames;
+}
+
+uint32_t CanStatistics::frameRate()
+{
+    return s_frameRate;
+}
+
+uint32_t CanStatistics::busLoadPermille()
+{
+    return s_busLoadPermille;
+}
+
+uint32_t CanStatistics::lastWindowMs()
+{
+    return s_lastWindowMs;
+}
+
+const CanStatistics::IdCounters& CanStatistics::counters(uint16_t slot)
+{
+    return s_perSlot[slot];
+}
+
+size_t CanStatistics::memoryBytes()
+{
+    return s_capacity * sizeof(IdCounters);
+}
@@ -0,0 +1,104 @@
+#include "change_tracker.h"
+#include "heap_guard.h"
+#include "trace.h"
+#include <new>
+#include <string.h>
+
+ChangeTracker::Slot* ChangeTracker::s_slots = nullptr;
+uint16_t ChangeTracker::s_capacity = 0;
+
+bool ChangeTracker::begin(uint16_t capacity)
+{
+    delete[] s_slots;
+    s_slots = new (std::nothrow) Slot[capacity];
+    if (!s_slots)
+    {
+        s_capacity = 0;
+        return false;
+    }
+    s_capacity = capacity;
+    memset(s_slots, 0, sizeof(Slot) * capacity);
+    return true;
+}
+
+void ChangeTracker::resetSlot(uint16_t slot)
+{
+    if (slot < s_capacity)
+    {
+        s_slots[slot].changedMask = 0;
+    }
+}
+
+uint8_t ChangeTracker::recordChange(uint16_t slot, const CANMessage& current, const CANMessage* previous, uint32_t now)
+{
+    ALLOC_SCOPE(RecordChange);
+    TRACE_SCOPE("recordChange");
+    if (slot >= s_capacity)
+    {
+        return 0;
+    }
+
+    Slot& s = s_slots[slot];
+    bool lengthChanged = !previous || previous->length != current.length;
+    uint8_t changed = 0;
+
+    for (uint8_t i = 0; i < current.length && i < 8; ++i)
+    {
+        bool valueChanged = !previous || i >= previous->length || current.data[i] != previous->data[i];
+        if (lengthChanged || valueChanged)
+        {
+            s.changedAt[i] = now;
+            changed |= static_cast<uint8_t>(1u << i);
+        }
+    }
+    s.changedMask |= changed;
+    return changed;
+}
+
+// Ages are compared signed: a frame stamped after now is not expired
+void ChangeTracker::expire(uint32_t now)
+{
+    for (uint16_t slot = 0; slot < s_capacity; ++slot)
+    {
+        Slot& s = s_slots[slot];
+        for (uint8_t i = 0; s.changedMask && i < 8; ++i)
+        {
+            if (static_cast<int32_t>(now - s.changedAt[i]) > static_cast<int32_t>(CHANGE_EXPIRATION_MS))
+            {
+                s.changedMask &= static_cast<uint8_t>(~(1u << i));
+            }
+        }
+    }
+}
+
+uint8_t ChangeTracker::highlightMask(uint16_t slot, uint32_t now, uint32_t& lastChangeTimestamp)
+{
+    lastChangeTimestamp = 0;
+    if (slot >= s_capacity)
+    {
+        return 0;
+    }
+
+    const Slot& s = s_slots[slot];
+    uint8_t changed = s.changedMask;
+    uint8_t mask = 0;
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+        uint8_t bit = static_cast<uint8_t>(1u << i);
+        if (!(changed & bit) || now - s.changedAt[i] > CHANGE_EXPIRATION_MS)
+        {
+            continue;
+        }
+        mask |= bit;
+        if (s.changedAt[i] > lastChangeTimestamp)
+        {
+            lastChangeTimestamp = s.changedAt[i];
+        }
+    }
+    return mask;
+}
+
+size_t ChangeTracker::memoryBytes()
+{
+    return s_capacity * sizeof(Slot);
+}
@@ -0,0 +1,50 @@
+#include "clock.h"
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+Clock::Source Clock::s_source = Clock::systemNowUs;
+uint64_t Clock::s_simulatedUs = 0;
+
+void Clock::setSource(Source source)
+{
+    s_source = source ? source : systemNowUs;
+}
+
+bool Clock::isSystem()
+{
+    return s_source == systemNowUs;
+}
+
+void Clock::simulate(uint64_t startUs)
+{
+    s_simulatedUs = startUs;
+    s_source = simulatedNowUs;
+}
+
+void Clock::setSimulated(uint64_t us)
+{
+    s_simulatedUs = us;
+}
+
+void Clock::advance(uint64_t us)
+{
+    s_simulatedUs += us;
+}
+
+uint64_t Clock::systemNowUs()
+{
+#ifdef ARDUINO
+    return static_cast<uint64_t>(esp_timer_get_time());
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+uint64_t Clock::simulatedNowUs()
+{
+    return s_simulatedUs;
+}
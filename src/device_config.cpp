@@ -0,0 +1,685 @@
+#include "device_config.h"
+#include "can_stats.h"
+#include "render_buffer.h"
+#include <string.h>
+
+namespace
+{
+    constexpr uint8_t MAGIC_0 = 'V';
+    constexpr uint8_t MAGIC_1 = 'C';
+    constexpr uint32_t MAX_STANDARD_ID = 0x7FF;
+    constexpr uint32_t MAX_EXTENDED_ID = 0x1FFFFFFF;
+
+    enum Tag : uint8_t
+    {
+        TAG_CAN = 1,            // bitrate, mode, filter id, filter mask, filter flags
+        TAG_SAMPLING = 2,       // mode, value
+        TAG_HISTORY = 3,        // watched IDs
+        TAG_HISTOGRAMS = 4,     // selected IDs
+        TAG_PAIRS = 5,          // ID, first byte, second byte per pair
+        TAG_SYNC = 6            // peer address, peer port
+    };
+
+    constexpr uint8_t CAN_RECORD_BYTES = 14;
+    constexpr uint8_t SAMPLING_RECORD_BYTES = 5;
+    constexpr uint8_t PAIR_BYTES = 6;
+    constexpr uint8_t SYNC_RECORD_BYTES = 6;
+    static_assert(4 * HISTORY_WATCH_IDS <= 0xFF && 4 * HISTOGRAM_IDS <= 0xFF && PAIR_BYTES * HISTOGRAM_PAIRS <= 0xFF,
+                  "Record lengths are one byte");
+
+    const uint32_t BITRATES[] = { 25000, 50000, 100000, 125000, 250000, 500000, 800000, 1000000 };
+    const char* const CAN_MODE_NAMES[] = { "normal", "listen", "noack" };
+
+    // CRC-16/CCITT-FALSE
+    uint16_t crc16(const uint8_t* data, size_t length)
+    {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; ++i)
+        {
+            crc ^= static_cast<uint16_t>(data[i]) << 8;
+            for (uint8_t bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    uint32_t readU32(const uint8_t* p)
+    {
+        return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+               static_cast<uint32_t>(p[3]) << 24;
+    }
+
+    // Appends into a blob; once the blob is full everything else is dropped
+    struct BlobWriter
+    {
+        uint8_t* blob;
+        size_t size;
+        size_t length;
+        bool overflowed;
+
+        BlobWriter(uint8_t* out, size_t capacity) : blob(out), size(capacity), length(0), overflowed(false)
+        {
+        }
+
+        void u8(uint8_t value)
+        {
+            if (length < size)
+            {
+                blob[length++] = value;
+            }
+            else
+            {
+                overflowed = true;
+            }
+        }
+
+        void u32(uint32_t value)
+        {
+            for (uint8_t i = 0; i < 4; ++i)
+            {
+                u8(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        void record(Tag tag, size_t bytes)
+        {
+            u8(tag);
+            u8(static_cast<uint8_t>(bytes));
+        }
+    };
+
+    bool contains(const uint32_t* ids, uint8_t count, uint32_t id)
+    {
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            if (ids[i] == id)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool containsPair(const DeviceConfig::Settings& settings, uint32_t id, uint8_t first, uint8_t second)
+    {
+        for (uint8_t i = 0; i < settings.pairCount; ++i)
+        {
+            const DeviceConfig::Pair& pair = settings.pairs[i];
+            if (pair.id == id && pair.first == first && pair.second == second)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Selected IDs plus the IDs of pairs, which select their ID as well
+    uint8_t histogramIdsNeeded(const DeviceConfig::Settings& settings)
+    {
+        uint32_t ids[HISTOGRAM_IDS + HISTOGRAM_PAIRS];
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < settings.histogramCount; ++i)
+        {
+            if (!contains(ids, count, settings.histogramIds[i]))
+            {
+                ids[count++] = settings.histogramIds[i];
+            }
+        }
+        for (uint8_t i = 0; i < settings.pairCount; ++i)
+        {
+            if (!contains(ids, count, settings.pairs[i].id))
+            {
+                ids[count++] = settings.pairs[i].id;
+            }
+        }
+        return count;
+    }
+
+    // Reads an ID list record, keeping as many IDs as the pool holds
+    uint8_t readIds(const uint8_t* p, uint8_t length, uint32_t* ids, uint8_t capacity)
+    {
+        uint8_t count = 0;
+        for (uint8_t offset = 0; offset + 4 <= length && count < capacity; offset += 4)
+        {
+            ids[count++] = readU32(p + offset);
+        }
+        return count;
+    }
+}
+
+DeviceConfig::Can DeviceConfig::s_can[2];
+volatile uint8_t DeviceConfig::s_canPublished = 0;
+volatile uint32_t DeviceConfig::s_canRevision = 0;
+DeviceConfig::Sync DeviceConfig::s_sync[2];
+volatile uint8_t DeviceConfig::s_syncPublished = 0;
+DeviceConfig::Settings DeviceConfig::s_views[2];
+volatile uint8_t DeviceConfig::s_viewsPublished = 0;
+volatile uint32_t DeviceConfig::s_viewsRevision = 0;
+volatile uint32_t DeviceConfig::s_viewsInstalled = 0;
+
+size_t DeviceConfig::encode(const Settings& settings, uint8_t* blob, size_t size)
+{
+    BlobWriter out(blob, size);
+    out.u8(MAGIC_0);
+    out.u8(MAGIC_1);
+    out.u8(VERSION);
+    out.u32(0);     // Payload length and CRC, filled in below
+
+    out.record(TAG_CAN, CAN_RECORD_BYTES);
+    out.u32(settings.can.bitrate);
+    out.u8(static_cast<uint8_t>(settings.can.mode));
+    out.u32(settings.can.filterId);
+    out.u32(settings.can.filterMask);
+    out.u8(settings.can.filterExtended ? 1 : 0);
+
+    out.record(TAG_SAMPLING, SAMPLING_RECORD_BYTES);
+    out.u8(static_cast<uint8_t>(settings.samplingMode));
+    out.u32(settings.samplingValue);
+
+    out.record(TAG_HISTORY, 4 * settings.historyCount);
+    for (uint8_t i = 0; i < settings.historyCount; ++i)
+    {
+        out.u32(settings.historyIds[i]);
+    }
+
+    out.record(TAG_HISTOGRAMS, 4 * settings.histogramCount);
+    for (uint8_t i = 0; i < settings.histogramCount; ++i)
+    {
+        out.u32(settings.histogramIds[i]);
+    }
+
+    out.record(TAG_PAIRS, PAIR_BYTES * settings.pairCount);
+    for (uint8_t i = 0; i < settings.pairCount; ++i)
+    {
+        out.u32(settings.pairs[i].id);
+        out.u8(settings.pairs[i].first);
+        out.u8(settings.pairs[i].second);
+    }
+
+    out.record(TAG_SYNC, SYNC_RECORD_BYTES);
+    out.u32(settings.sync.peer);
+    out.u8(static_cast<uint8_t>(settings.sync.port));
+    out.u8(static_cast<uint8_t>(settings.sync.port >> 8));
+
+    if (out.overflowed)
+    {
+        return 0;
+    }
+    size_t payload = out.length - HEADER_BYTES;
+    uint16_t crc = crc16(blob + HEADER_BYTES, payload);
+    blob[3] = static_cast<uint8_t>(payload);
+    blob[4] = static_cast<uint8_t>(payload >> 8);
+    blob[5] = static_cast<uint8_t>(crc);
+    blob[6] = static_cast<uint8_t>(crc >> 8);
+    return out.length;
+}
+
+bool DeviceConfig::decode(const uint8_t* blob, size_t length, Settings& settings)
+{
+    // Version 1 is the only layout so far; a newer one may mean something
+    // else by the same records
+    if (length < HEADER_BYTES || blob[0] != MAGIC_0 || blob[1] != MAGIC_1 || blob[2] == 0 || blob[2] > VERSION)
+    {
+        return false;
+    }
+    size_t payload = blob[3] | static_cast<size_t>(blob[4]) << 8;
+    uint16_t crc = static_cast<uint16_t>(blob[5] | blob[6] << 8);
+    if (HEADER_BYTES + payload > length || crc16(blob + HEADER_BYTES, payload) != crc)
+    {
+        return false;
+    }
+
+    Settings decoded;
+    const uint8_t* p = blob + HEADER_BYTES;
+    const uint8_t* end = p + payload;
+    while (p < end)
+    {
+        if (end - p < 2 || end - p - 2 < p[1])
+        {
+            return false;
+        }
+        uint8_t tag = p[0];
+        uint8_t recordLength = p[1];
+        const uint8_t* field = p + 2;
+        p += 2 + recordLength;
+
+        switch (tag)
+        {
+        case TAG_CAN:
+            if (recordLength < CAN_RECORD_BYTES)
+            {
+                return false;
+            }
+            decoded.can.bitrate = readU32(field);
+            decoded.can.mode = static_cast<CanMode>(field[4]);
+            decoded.can.filterId = readU32(field + 5);
+            decoded.can.filterMask = readU32(field + 9);
+            decoded.can.filterExtended = (field[13] & 1) != 0;
+            break;
+        case TAG_SAMPLING:
+            if (recordLength < SAMPLING_RECORD_BYTES)
+            {
+                return false;
+            }
+            decoded.samplingMode = static_cast<ViewSampler::Mode>(field[0]);
+            decoded.samplingValue = readU32(field + 1);
+            break;
+        case TAG_HISTORY:
+            decoded.historyCount = readIds(field, recordLength, decoded.historyIds, HISTORY_WATCH_IDS);
+            break;
+        case TAG_HISTOGRAMS:
+            decoded.histogramCount = readIds(field, recordLength, decoded.histogramIds, HISTOGRAM_IDS);
+            break;
+        case TAG_PAIRS:
+            decoded.pairCount = 0;
+            for (uint8_t offset = 0; offset + PAIR_BYTES <= recordLength && decoded.pairCount < HISTOGRAM_PAIRS;
+                 offset += PAIR_BYTES)
+            {
+                Pair& pair = decoded.pairs[decoded.pairCount++];
+                pair.id = readU32(field + offset);
+                pair.first = field[offset + 4];
+                pair.second = field[offset + 5];
+            }
+            break;
+        case TAG_SYNC:
+            if (recordLength < SYNC_RECORD_BYTES)
+            {
+                return false;
+            }
+            decoded.sync.peer = readU32(field);
+            decoded.sync.port = static_cast<uint16_t>(field[4] | field[5] << 8);
+            break;
+        default:
+            break;      // Written by newer firmware
+        }
+    }
+
+    if (!validate(decoded))
+    {
+        return false;
+    }
+    settings = decoded;
+    return true;
+}
+
+bool DeviceConfig::supportedBitrate(uint32_t bitrate)
+{
+    for (uint32_t supported : BITRATES)
+    {
+        if (bitrate == supported)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DeviceConfig::validate(const Settings& settings)
+{
+    const Can& can = settings.can;
+    uint32_t maxId = can.filterExtended ? MAX_EXTENDED_ID : MAX_STANDARD_ID;
+    if (!supportedBitrate(can.bitrate) || static_cast<uint8_t>(can.mode) > static_cast<uint8_t>(CanMode::NoAck) ||
+        can.filterId > maxId || can.filterMask > maxId || (can.filterId & ~can.filterMask) != 0)
+    {
+        return false;
+    }
+    if (static_cast<uint8_t>(settings.samplingMode) > static_cast<uint8_t>(ViewSampler::Mode::Interval) ||
+        (settings.samplingMode != ViewSampler::Mode::Off && settings.samplingValue == 0))
+    {
+        return false;
+    }
+    if (settings.historyCount > HISTORY_WATCH_IDS || settings.histogramCount > HISTOGRAM_IDS ||
+        settings.pairCount > HISTOGRAM_PAIRS)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < settings.historyCount; ++i)
+    {
+        if (settings.historyIds[i] > MAX_EXTENDED_ID || contains(settings.historyIds, i, settings.historyIds[i]))
+        {
+            return false;
+        }
+    }
+    for (uint8_t i = 0; i < settings.histogramCount; ++i)
+    {
+        if (settings.histogramIds[i] > MAX_EXTENDED_ID || contains(settings.histogramIds, i, settings.histogramIds[i]))
+        {
+            return false;
+        }
+    }
+    for (uint8_t i = 0; i < settings.pairCount; ++i)
+    {
+        const Pair& pair = settings.pairs[i];
+        if (pair.id > MAX_EXTENDED_ID || pair.first > 7 || pair.second > 7 || pair.first == pair.second)
+        {
+            return false;
+        }
+    }
+    if (settings.sync.peer != 0 && settings.sync.port == 0)
+    {
+        return false;
+    }
+    return histogramIdsNeeded(settings) <= HISTOGRAM_IDS;
+}
+
+bool DeviceConfig::apply(const Settings& settings)
+{
+    if (!validate(settings))
+    {
+        return false;
+    }
+
+    // The receive task installs the view settings between frames; pairs
+    // select their ID as well, so capture() shows them that way meanwhile
+    uint8_t next = s_viewsPublished ^ 1;
+    Settings& views = s_views[next];
+    views = settings;
+    for (uint8_t i = 0; i < views.pairCount; ++i)
+    {
+        if (!contains(views.histogramIds, views.histogramCount, views.pairs[i].id))
+        {
+            views.histogramIds[views.histogramCount++] = views.pairs[i].id;
+        }
+    }
+    s_viewsPublished = next;
+    s_viewsRevision = s_viewsRevision + 1;
+
+    // The receive task picks the CAN settings up between frames
+    CanStatistics::setBitrate(settings.can.bitrate);
+    next = s_canPublished ^ 1;
+    s_can[next] = settings.can;
+    s_canPublished = next;
+    s_canRevision = s_canRevision + 1;
+
+    next = s_syncPublished ^ 1;
+    s_sync[next] = settings.sync;
+    s_syncPublished = next;
+    return true;
+}
+
+void DeviceConfig::installViews()
+{
+    uint32_t revision = s_viewsRevision;
+    if (revision == s_viewsInstalled)
+    {
+        return;
+    }
+    const Settings& settings = s_views[s_viewsPublished];
+
+    ViewSampler::configure(settings.samplingMode, settings.samplingValue);
+
+    // Removals first so the pools have room for what is added; watches and
+    // selections that stay keep their data
+    for (uint8_t i = RateHistory::watchedCount(); i-- > 0;)
+    {
+        uint32_t id = RateHistory::watchedId(i);
+        if (!contains(settings.historyIds, settings.historyCount, id))
+        {
+            RateHistory::unwatch(id);
+        }
+    }
+    for (uint8_t i = 0; i < settings.historyCount; ++i)
+    {
+        RateHistory::watch(settings.historyIds[i]);
+    }
+
+    for (uint8_t i = ByteHistogram::pairCount(); i-- > 0;)
+    {
+        Pair pair;
+        ByteHistogram::pairAt(i, pair.id, pair.first, pair.second);
+        if (!containsPair(settings, pair.id, pair.first, pair.second))
+        {
+            ByteHistogram::removePair(pair.id, pair.first, pair.second);
+        }
+    }
+    for (uint8_t i = ByteHistogram::selectedCount(); i-- > 0;)
+    {
+        uint32_t id = ByteHistogram::selectedId(i);
+        if (!contains(settings.histogramIds, settings.histogramCount, id))
+        {
+            ByteHistogram::unselect(id);
+        }
+    }
+    for (uint8_t i = 0; i < settings.histogramCount; ++i)
+    {
+        ByteHistogram::select(settings.histogramIds[i]);
+    }
+    for (uint8_t i = 0; i < settings.pairCount; ++i)
+    {
+        ByteHistogram::addPair(settings.pairs[i].id, settings.pairs[i].first, settings.pairs[i].second);
+    }
+    s_viewsInstalled = revision;
+}
+
+void DeviceConfig::capture(Settings& settings)
+{
+    if (s_viewsInstalled != s_viewsRevision)
+    {
+        settings = s_views[s_viewsPublished];
+        settings.can = can();
+        settings.sync = sync();
+        return;
+    }
+    settings = Settings();
+    settings.can = can();
+    settings.samplingMode = ViewSampler::mode();
+    settings.samplingValue = ViewSampler::value();
+    for (uint8_t i = 0; i < RateHistory::watchedCount() && settings.historyCount < HISTORY_WATCH_IDS; ++i)
+    {
+        settings.historyIds[settings.historyCount++] = RateHistory::watchedId(i);
+    }
+    for (uint8_t i = 0; i < ByteHistogram::selectedCount() && settings.histogramCount < HISTOGRAM_IDS; ++i)
+    {
+        settings.histogramIds[settings.histogramCount++] = ByteHistogram::selectedId(i);
+    }
+    for (uint8_t i = 0; i < ByteHistogram::pairCount() && settings.pairCount < HISTOGRAM_PAIRS; ++i)
+    {
+        Pair& pair = settings.pairs[settings.pairCount++];
+        ByteHistogram::pairAt(i, pair.id, pair.first, pair.second);
+    }
+    settings.sync = sync();
+}
+
+bool DeviceConfig::watchHistory(Settings& settings, uint32_t id, bool remove)
+{
+    for (uint8_t i = 0; i < settings.historyCount; ++i)
+    {
+        if (settings.historyIds[i] == id)
+        {
+            if (remove)
+            {
+                settings.historyIds[i] = settings.historyIds[--settings.historyCount];
+            }
+            return true;
+        }
+    }
+    if (remove || settings.historyCount == HISTORY_WATCH_IDS)
+    {
+        return false;
+    }
+    settings.historyIds[settings.historyCount++] = id;
+    return true;
+}
+
+// Dropping an ID drops its pairs as well, as ByteHistogram::unselect() does
+bool DeviceConfig::selectHistogram(Settings& settings, uint32_t id, bool remove)
+{
+    Settings edited = settings;
+    bool selected = contains(edited.histogramIds, edited.histogramCount, id);
+    if (remove)
+    {
+        if (!selected)
+        {
+            return false;
+        }
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < edited.histogramCount; ++i)
+        {
+            if (edited.histogramIds[i] != id)
+            {
+                edited.histogramIds[kept++] = edited.histogramIds[i];
+            }
+        }
+        edited.histogramCount = kept;
+        kept = 0;
+        for (uint8_t i = 0; i < edited.pairCount; ++i)
+        {
+            if (edited.pairs[i].id != id)
+            {
+                edited.pairs[kept++] = edited.pairs[i];
+            }
+        }
+        edited.pairCount = kept;
+    }
+    else if (!selected)
+    {
+        if (edited.histogramCount == HISTOGRAM_IDS)
+        {
+            return false;
+        }
+        edited.histogramIds[edited.histogramCount++] = id;
+        if (histogramIdsNeeded(edited) > HISTOGRAM_IDS)
+        {
+            return false;
+        }
+    }
+    settings = edited;
+    return true;
+}
+
+bool DeviceConfig::selectPair(Settings& settings, const Pair& pair, bool remove)
+{
+    for (uint8_t i = 0; i < settings.pairCount; ++i)
+    {
+        const Pair& existing = settings.pairs[i];
+        if (existing.id == pair.id && existing.first == pair.first && existing.second == pair.second)
+        {
+            if (remove)
+            {
+                settings.pairs[i] = settings.pairs[--settings.pairCount];
+            }
+            return true;
+        }
+    }
+    if (remove || settings.pairCount == HISTOGRAM_PAIRS)
+    {
+        return false;
+    }
+    settings.pairs[settings.pairCount++] = pair;
+    if (histogramIdsNeeded(settings) > HISTOGRAM_IDS)
+    {
+        --settings.pairCount;
+        return false;
+    }
+    return true;
+}
+
+DeviceConfig::Can DeviceConfig::can()
+{
+    return s_can[s_canPublished];
+}
+
+uint32_t DeviceConfig::canRevision()
+{
+    return s_canRevision;
+}
+
+DeviceConfig::Sync DeviceConfig::sync()
+{
+    return s_sync[s_syncPublished];
+}
+
+// The controller compares the filter against the frame's ID bits only, so
+// frames of the other ID format are dropped here as well
+bool DeviceConfig::accepts(const Can& can, uint32_t id, bool extended)
+{
+    return can.filterMask == 0 || (extended == can.filterExtended && (id & can.filterMask) == can.filterId);
+}
+
+// {"version":1,"can":{"bitrate":125000,"mode":"normal","filter":{"id":"0x0",
+// "mask":"0x0","extended":false}},"sampling":{"mode":"off","value":1},
+// "history":["0x1a0"],"histograms":[],"pairs":[{"id":"0x1a0","bytes":[2,3]}],
+// "sync":{"peer":"192.168.4.1:3190"}}
+size_t DeviceConfig::renderJson(const Settings& settings, char* out, size_t size)
+{
+    RenderBuffer json(out, size);
+    json.append("{\"version\":");
+    json.appendDec(VERSION);
+    json.append(",\"can\":{\"bitrate\":");
+    json.appendDec(settings.can.bitrate);
+    json.append(",\"mode\":\"");
+    json.append(canModeName(settings.can.mode));
+    json.append("\",\"filter\":{\"id\":\"0x");
+    json.appendHex(settings.can.filterId);
+    json.append("\",\"mask\":\"0x");
+    json.appendHex(settings.can.filterMask);
+    json.append("\",\"extended\":");
+    json.append(settings.can.filterExtended ? "true" : "false");
+    json.append("}},\"sampling\":{\"mode\":\"");
+    json.append(ViewSampler::modeName(settings.samplingMode));
+    json.append("\",\"value\":");
+    json.appendDec(settings.samplingValue);
+    json.append("},\"history\":[");
+    for (uint8_t i = 0; i < settings.historyCount; ++i)
+    {
+        json.append(i > 0 ? ",\"0x" : "\"0x");
+        json.appendHex(settings.historyIds[i]);
+        json.appendChar('"');
+    }
+    json.append("],\"histograms\":[");
+    for (uint8_t i = 0; i < settings.histogramCount; ++i)
+    {
+        json.append(i > 0 ? ",\"0x" : "\"0x");
+        json.appendHex(settings.histogramIds[i]);
+        json.appendChar('"');
+    }
+    json.append("],\"pairs\":[");
+    for (uint8_t i = 0; i < settings.pairCount; ++i)
+    {
+        json.append(i > 0 ? ",{\"id\":\"0x" : "{\"id\":\"0x");
+        json.appendHex(settings.pairs[i].id);
+        json.append("\",\"bytes\":[");
+        json.appendDec(settings.pairs[i].first);
+        json.appendChar(',');
+        json.appendDec(settings.pairs[i].second);
+        json.append("]}");
+    }
+    json.append("],\"sync\":{\"peer\":\"");
+    if (settings.sync.peer != 0)
+    {
+        for (uint8_t shift = 24;; shift -= 8)
+        {
+            json.appendDec((settings.sync.peer >> shift) & 0xFF);
+            if (shift == 0)
+            {
+                break;
+            }
+            json.appendChar('.');
+        }
+        json.appendChar(':');
+        json.appendDec(settings.sync.port);
+    }
+    json.append("\"}}");
+    return json.overflowed() ? 0 : json.length();
+}
+
+const char* DeviceConfig::canModeName(CanMode mode)
+{
+    uint8_t index = static_cast<uint8_t>(mode);
+    return index < sizeof(CAN_MODE_NAMES) / sizeof(CAN_MODE_NAMES[0]) ? CAN_MODE_NAMES[index] : "unknown";
+}
+
+bool DeviceConfig::parseCanMode(const char* name, size_t length, CanMode& mode)
+{
+    for (size_t i = 0; i < sizeof(CAN_MODE_NAMES) / sizeof(CAN_MODE_NAMES[0]); ++i)
+    {
+        if (length == strlen(CAN_MODE_NAMES[i]) && memcmp(name, CAN_MODE_NAMES[i], length) == 0)
+        {
+            mode = static_cast<CanMode>(i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,209 @@
+#include "frame_codec.h"
+#include <string.h>
+
+namespace
+{
+    void putU16(uint8_t* out, uint16_t value)
+    {
+        out[0] = static_cast<uint8_t>(value);
+        out[1] = static_cast<uint8_t>(value >> 8);
+    }
+
+    void putU32(uint8_t* out, uint32_t value)
+    {
+        out[0] = static_cast<uint8_t>(value);
+        out[1] = static_cast<uint8_t>(value >> 8);
+        out[2] = static_cast<uint8_t>(value >> 16);
+        out[3] = static_cast<uint8_t>(value >> 24);
+    }
+
+    void putU64(uint8_t* out, uint64_t value)
+    {
+        putU32(out, static_cast<uint32_t>(value));
+        putU32(out + 4, static_cast<uint32_t>(value >> 32));
+    }
+
+    uint16_t getU16(const uint8_t* in)
+    {
+        return static_cast<uint16_t>(in[0] | (in[1] << 8));
+    }
+
+    uint32_t getU32(const uint8_t* in)
+    {
+        return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+               (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    }
+
+    uint64_t getU64(const uint8_t* in)
+    {
+        return static_cast<uint64_t>(getU32(in)) | (static_cast<uint64_t>(getU32(in + 4)) << 32);
+    }
+}
+
+void FrameCodec::encodeHeader(uint8_t* out, const Header& header)
+{
+    out[0] = 'C';
+    out[1] = 'M';
+    out[2] = VERSION;
+    out[3] = static_cast<uint8_t>(header.type);
+    putU16(out + 4, header.count);
+    putU16(out + 6, 0);
+    putU32(out + 8, header.sentUs);
+}
+
+void FrameCodec::encodeFrame(uint8_t* out, const FrameRecord& record)
+{
+    putU32(out, record.sequence);
+    putU32(out + 4, record.timestampUs);
+    putU32(out + 8, record.id | (record.extended ? EXTENDED_ID_FLAG : 0));
+    out[12] = record.length;
+    out[13] = record.flags;
+    putU16(out + 14, 0);
+    memcpy(out + 16, record.data, 8);
+}
+
+void FrameCodec::encodeEcho(uint8_t* out, const LatencyEcho& echo)
+{
+    putU32(out, echo.sequence);
+    putU32(out + 4, echo.sentUs);
+    putU32(out + 8, echo.clientUs);
+}
+
+void FrameCodec::encodeClock(uint8_t* out, const ClockRecord& clock)
+{
+    putU64(out, clock.nowUs);
+    putU64(out + 8, clock.estimateUs);
+    putU64(out + 16, static_cast<uint64_t>(clock.offsetUs));
+    putU32(out + 24, static_cast<uint32_t>(clock.driftPpb));
+    putU32(out + 28, clock.delayUs);
+    putU32(out + 32, clock.deviceId);
+    out[36] = static_cast<uint8_t>(clock.state);
+    out[37] = 0;
+    putU16(out + 38, 0);
+}
+
+void FrameCodec::encodeTransmit(uint8_t* out, const TransmitRequest& request)
+{
+    putU32(out, request.token);
+    putU32(out + 4, request.id | (request.extended ? EXTENDED_ID_FLAG : 0));
+    out[8] = request.length;
+    memset(out + 9, 0, 3);
+    memcpy(out + 12, request.data, 8);
+}
+
+void FrameCodec::encodeTransmitAck(uint8_t* out, const TransmitAck& ack)
+{
+    putU32(out, ack.token);
+    out[4] = static_cast<uint8_t>(ack.status);
+    memset(out + 5, 0, 3);
+    putU32(out + 8, ack.receivedUs);
+    putU32(out + 12, ack.queuedUs);
+    putU32(out + 16, ack.doneUs);
+}
+
+bool FrameCodec::decodeHeader(const uint8_t* in, size_t length, Header& header)
+{
+    if (length < HEADER_BYTES || in[0] != 'C' || in[1] != 'M' || in[2] != VERSION)
+    {
+        return false;
+    }
+    header.type = static_cast<MessageType>(in[3]);
+    header.count = getU16(in + 4);
+    header.sentUs = getU32(in + 8);
+    size_t expected = messageBytes(header);
+    return expected != 0 && length >= expected;
+}
+
+void FrameCodec::decodeFrame(const uint8_t* in, FrameRecord& record)
+{
+    uint32_t id = getU32(in + 8);
+    record.sequence = getU32(in);
+    record.timestampUs = getU32(in + 4);
+    record.id = id & ~EXTENDED_ID_FLAG;
+    record.extended = (id & EXTENDED_ID_FLAG) != 0;
+    record.length = in[12] <= 8 ? in[12] : 8;
+    record.flags = in[13];
+    memcpy(record.data, in + 16, 8);
+}
+
+void FrameCodec::decodeEcho(const uint8_t* in, LatencyEcho& echo)
+{
+    echo.sequence = getU32(in);
+    echo.sentUs = getU32(in + 4);
+    echo.clientUs = getU32(in + 8);
+}
+
+void FrameCodec::decodeClock(const uint8_t* in, ClockRecord& clock)
+{
+    clock.nowUs = getU64(in);
+    clock.estimateUs = getU64(in + 8);
+    clock.offsetUs = static_cast<int64_t>(getU64(in + 16));
+    clock.driftPpb = static_cast<int32_t>(getU32(in + 24));
+    clock.delayUs = getU32(in + 28);
+    clock.deviceId = getU32(in + 32);
+    clock.state = in[36] <= static_cast<uint8_t>(ClockState::Reference) ? static_cast<ClockState>(in[36])
+                                                                         : ClockState::Unsynced;
+}
+
+uint64_t FrameCodec::unwrapTimestamp(uint32_t timestampUs, uint64_t nearUs)
+{
+    int32_t delta = static_cast<int32_t>(timestampUs - static_cast<uint32_t>(nearUs));
+    return nearUs + static_cast<int64_t>(delta);
+}
+
+bool FrameCodec::decodeTransmit(const uint8_t* in, TransmitRequest& request)
+{
+    uint32_t id = getU32(in + 4);
+    request.token = getU32(in);
+    request.id = id & ~EXTENDED_ID_FLAG;
+    request.extended = (id & EXTENDED_ID_FLAG) != 0;
+    request.length = in[8];
+    memcpy(request.data, in + 12, 8);
+    uint32_t maxId = request.extended ? 0x1FFFFFFFu : 0x7FFu;
+    return request.length <= 8 && request.id <= maxId;
+}
+
+void FrameCodec::decodeTransmitAck(const uint8_t* in, TransmitAck& ack)
+{
+    ack.token = getU32(in);
+    ack.status = static_cast<TransmitStatus>(in[4]);
+    ack.receivedUs = getU32(in + 8);
+    ack.queuedUs = getU32(in + 12);
+    ack.doneUs = getU32(in + 16);
+}
+
+size_t FrameCodec::recordBytes(MessageType type)
+{
+    switch (type)
+    {
+    case MessageType::Frames:
+        return FRAME_RECORD_BYTES;
+    case MessageType::LatencyEcho:
+        return ECHO_RECORD_BYTES;
+    case MessageType::ClockSync:
+        return CLOCK_RECORD_BYTES;
+    case MessageType::Transmit:
+        return TRANSMIT_RECORD_BYTES;
+    case MessageType::TransmitAck:
+        return TRANSMIT_ACK_RECORD_BYTES;
+    }
+    return 0;
+}
+
+size_t FrameCodec::peekMessageBytes(const uint8_t* in, size_t length)
+{
+    if (length < HEADER_BYTES || in[0] != 'C' || in[1] != 'M' || in[2] != VERSION)
+    {
+        return 0;
+    }
+    Header header;
+    header.type = static_cast<MessageType>(in[3]);
+    header.count = getU16(in + 4);
+    return messageBytes(header);
+}
+
+size_t FrameCodec::messageBytes(const Header& header)
+{
+    size_t record = recordBytes(header.type);
+    return record ? HEADER_BYTES + record * header.count : 0;
+}
@@ -0,0 +1,150 @@
+#include "frame_stream.h"
+#include "latency_stats.h"
+#include "time_sync.h"
+#include <new>
+#include <string.h>
+
+FrameStream::Pending* FrameStream::s_ring = nullptr;
+uint16_t FrameStream::s_capacity = 0;
+std::atomic<uint32_t> FrameStream::s_head(0);
+std::atomic<uint32_t> FrameStream::s_tail(0);
+uint32_t FrameStream::s_sequence = 0;
+uint32_t FrameStream::s_dropped = 0;
+uint32_t FrameStream::s_lastProbeUs = 0;
+
+bool FrameStream::begin(uint16_t capacity)
+{
+    delete[] s_ring;
+    s_ring = new (std::nothrow) Pending[capacity];
+    s_capacity = s_ring ? capacity : 0;
+    s_head = 0;
+    s_tail = 0;
+    return s_ring != nullptr;
+}
+
+void FrameStream::push(const CANMessage& msg, bool extended, uint32_t rxUs, uint32_t doneUs)
+{
+    uint32_t sequence = s_sequence++;
+    if (!s_ring)
+    {
+        return;
+    }
+
+    uint32_t head = s_head.load(std::memory_order_relaxed);
+    if (head - s_tail.load(std::memory_order_acquire) >= s_capacity)
+    {
+        ++s_dropped;
+        return;
+    }
+
+    Pending& slot = s_ring[head % s_capacity];
+    slot.record.sequence = sequence;
+    slot.record.timestampUs = rxUs;
+    slot.record.id = msg.id;
+    slot.record.extended = extended;
+    slot.record.length = msg.length <= 8 ? msg.length : 8;
+    memcpy(slot.record.data, msg.data, slot.record.length);
+    memset(slot.record.data + slot.record.length, 0, 8 - slot.record.length);
+    slot.record.flags = 0;
+    if (rxUs - s_lastProbeUs >= PROBE_INTERVAL_US)
+    {
+        slot.record.flags = FrameCodec::FLAG_PROBE;
+        s_lastProbeUs = rxUs;
+    }
+    slot.doneUs = doneUs;
+    s_head.store(head + 1, std::memory_order_release);
+}
+
+size_t FrameStream::encodeBatch(uint8_t* out, size_t capacity, uint16_t maxRecords, uint32_t nowUs)
+{
+    if (capacity < FrameCodec::HEADER_BYTES + FrameCodec::FRAME_RECORD_BYTES)
+    {
+        return 0;
+    }
+    size_t fit = (capacity - FrameCodec::HEADER_BYTES) / FrameCodec::FRAME_RECORD_BYTES;
+    uint32_t tail = s_tail.load(std::memory_order_relaxed);
+    uint32_t available = s_head.load(std::memory_order_acquire) - tail;
+    uint32_t count = available;
+    if (count > maxRecords)
+    {
+        count = maxRecords;
+    }
+    if (count > fit)
+    {
+        count = static_cast<uint32_t>(fit);
+    }
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint8_t* record = out + FrameCodec::HEADER_BYTES;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const Pending& pending = s_ring[(tail + i) % s_capacity];
+        FrameCodec::encodeFrame(record, pending.record);
+        record += FrameCodec::FRAME_RECORD_BYTES;
+        if (pending.record.flags & FrameCodec::FLAG_PROBE)
+        {
+            LatencyStats::record(LatencyStats::Stage::Serialization, nowUs - pending.doneUs);
+        }
+    }
+    s_tail.store(tail + count, std::memory_order_release);
+
+    FrameCodec::Header header;
+    header.type = FrameCodec::MessageType::Frames;
+    header.count = static_cast<uint16_t>(count);
+    header.sentUs = nowUs;
+    FrameCodec::encodeHeader(out, header);
+    return record - out;
+}
+
+size_t FrameStream::encodeClock(uint8_t* out, size_t capacity, uint32_t deviceId, uint64_t nowUs)
+{
+    if (capacity < FrameCodec::HEADER_BYTES + FrameCodec::CLOCK_RECORD_BYTES)
+    {
+        return 0;
+    }
+    TimeSync::Estimate estimate = TimeSync::estimate();
+    FrameCodec::ClockRecord clock;
+    clock.nowUs = nowUs;
+    clock.estimateUs = estimate.localUs;
+    clock.offsetUs = estimate.offsetUs;
+    clock.driftPpb = estimate.driftPpb;
+    clock.delayUs = estimate.delayUs;
+    clock.deviceId = deviceId;
+    clock.state = estimate.state;
+    FrameCodec::encodeClock(out + FrameCodec::HEADER_BYTES, clock);
+
+    FrameCodec::Header header;
+    header.type = FrameCodec::MessageType::ClockSync;
+    header.count = 1;
+    header.sentUs = static_cast<uint32_t>(nowUs);
+    FrameCodec::encodeHeader(out, header);
+    return FrameCodec::HEADER_BYTES + FrameCodec::CLOCK_RECORD_BYTES;
+}
+
+void FrameStream::discard()
+{
+    s_tail.store(s_head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+uint32_t FrameStream::pending()
+{
+    return s_head.load(std::memory_order_acquire) - s_tail.load(std::memory_order_acquire);
+}
+
+uint32_t FrameStream::sequence()
+{
+    return s_sequence;
+}
+
+uint32_t FrameStream::dropped()
+{
+    return s_dropped;
+}
+
+size_t FrameStream::memoryBytes()
+{
+    return s_capacity * sizeof(Pending);
+}
@@ -0,0 +1,218 @@
+#include "heap_guard.h"
+#include <stdlib.h>
+#include <new>
+
+namespace
+{
+    thread_local uint8_t t_hotPathDepth = 0;
+    thread_local HeapGuard::Scope t_scope = HeapGuard::Scope::None;
+
+    const char* const SCOPE_NAMES[] =
+    {
+        "none",
+        "CanRX",
+        "recordChange",
+        "formatByte",
+        "GET /",
+        "GET /latest_messages",
+        "GET /filtered_ids",
+        "GET /filtered_messages",
+        "POST /transmit_message",
+        "GET /metrics",
+        "POST /sampling",
+        "GET /trace",
+        "GET /latency",
+        "/history",
+        "GET /top",
+        "GET /search",
+        "/histogram",
+        "/config",
+        "/fuzz",
+        "/sequence",
+        "/stream"
+    };
+    static_assert(sizeof(SCOPE_NAMES) / sizeof(SCOPE_NAMES[0]) == static_cast<size_t>(HeapGuard::Scope::Count),
+                  "SCOPE_NAMES must match HeapGuard::Scope");
+}
+
+volatile bool HeapGuard::s_armed = false;
+volatile bool HeapGuard::s_trap = false;
+volatile uint32_t HeapGuard::s_allocations = 0;
+volatile uint32_t HeapGuard::s_bytes = 0;
+volatile uint32_t HeapGuard::s_hotPathAllocations = 0;
+volatile uint32_t HeapGuard::s_hotPathBytes = 0;
+volatile uintptr_t HeapGuard::s_lastHotPathCaller = 0;
+HeapGuard::ScopeCounters HeapGuard::s_scopes[static_cast<size_t>(HeapGuard::Scope::Count)];
+
+HeapGuard::HotPathScope::HotPathScope()
+{
+    ++t_hotPathDepth;
+}
+
+HeapGuard::HotPathScope::~HotPathScope()
+{
+    --t_hotPathDepth;
+}
+
+HeapGuard::ScopeGuard::ScopeGuard(Scope scope, bool countEntry)
+    : m_previous(t_scope)
+{
+    t_scope = scope;
+    if (countEntry)
+    {
+        ++s_scopes[static_cast<size_t>(scope)].entries;
+    }
+}
+
+HeapGuard::ScopeGuard::~ScopeGuard()
+{
+    t_scope = m_previous;
+}
+
+void HeapGuard::arm()
+{
+    s_allocations = 0;
+    s_bytes = 0;
+    s_hotPathAllocations = 0;
+    s_hotPathBytes = 0;
+    s_lastHotPathCaller = 0;
+    s_armed = true;
+}
+
+bool HeapGuard::armed()
+{
+    return s_armed;
+}
+
+void HeapGuard::setTrap(bool trap)
+{
+    s_trap = trap;
+}
+
+HeapGuard::Counters HeapGuard::counters()
+{
+    Counters c;
+    c.allocations = s_allocations;
+    c.bytes = s_bytes;
+    c.hotPathAllocations = s_hotPathAllocations;
+    c.hotPathBytes = s_hotPathBytes;
+    c.lastHotPathCaller = s_lastHotPathCaller;
+    return c;
+}
+
+const char* HeapGuard::scopeName(Scope scope)
+{
+    return SCOPE_NAMES[static_cast<size_t>(scope) < static_cast<size_t>(Scope::Count) ? static_cast<size_t>(scope) : 0];
+}
+
+HeapGuard::ScopeCounters HeapGuard::scopeCounters(Scope scope)
+{
+    return s_scopes[static_cast<size_t>(scope)];
+}
+
+void HeapGuard::resetScopes()
+{
+    for (auto& scope : s_scopes)
+    {
+        scope = ScopeCounters();
+    }
+}
+
+void HeapGuard::onAllocate(size_t size, uintptr_t caller)
+{
+    if (t_scope != Scope::None)
+    {
+        ScopeCounters& scope = s_scopes[static_cast<size_t>(t_scope)];
+        ++scope.allocations;
+        scope.bytes += size;
+    }
+
+    if (!s_armed)
+    {
+        return;
+    }
+
+    s_allocations = s_allocations + 1;
+    s_bytes = s_bytes + size;
+    if (t_hotPathDepth == 0)
+    {
+        return;
+    }
+
+    s_hotPathAllocations = s_hotPathAllocations + 1;
+    s_hotPathBytes = s_hotPathBytes + size;
+    s_lastHotPathCaller = caller;
+    if (s_trap)
+    {
+        // The panic handler prints a backtrace pointing at the allocation
+        abort();
+    }
+}
+
+#ifdef HEAP_GUARD_HOOKS
+// Linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc so that every
+// allocation, including those from operator new and library code, passes here.
+extern "C"
+{
+    void* __real_malloc(size_t size);
+    void* __real_calloc(size_t count, size_t size);
+    void* __real_realloc(void* ptr, size_t size);
+
+    void* __wrap_malloc(size_t size)
+    {
+        HeapGuard::onAllocate(size, reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+        return __real_malloc(size);
+    }
+
+    void* __wrap_calloc(size_t count, size_t size)
+    {
+        HeapGuard::onAllocate(count * size, reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+        return __real_calloc(count, size);
+    }
+
+    void* __wrap_realloc(void* ptr, size_t size)
+    {
+        HeapGuard::onAllocate(size, reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+        return __real_realloc(ptr, size);
+    }
+}
+
+#ifndef ARDUINO
+// On the host libstdc++ is a shared library whose internal malloc calls are
+// not wrapped, so route operator new through the wrapped malloc explicitly
+void* operator new(size_t size)
+{
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+#endif
+#endif
@@ -0,0 +1,83 @@
+#include "latency_stats.h"
+#include <string.h>
+
+namespace
+{
+    const char* const STAGE_NAMES[] =
+    {
+        "rx",
+        "stateUpdate",
+        "serialization",
+        "network",
+        "client",
+        "transmit"
+    };
+    static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == static_cast<size_t>(LatencyStats::Stage::Count),
+                  "STAGE_NAMES must match LatencyStats::Stage");
+}
+
+LatencyStats::Histogram LatencyStats::s_histograms[static_cast<size_t>(LatencyStats::Stage::Count)];
+
+void LatencyStats::record(Stage stage, uint32_t us)
+{
+    Histogram& h = s_histograms[static_cast<size_t>(stage)];
+    size_t bucket = us ? 32 - __builtin_clz(us) : 0;
+    ++h.buckets[bucket < BUCKETS ? bucket : BUCKETS - 1];
+    ++h.count;
+    if (us > h.maxUs)
+    {
+        h.maxUs = us;
+    }
+}
+
+void LatencyStats::reset()
+{
+    memset(s_histograms, 0, sizeof(s_histograms));
+}
+
+uint32_t LatencyStats::count(Stage stage)
+{
+    return s_histograms[static_cast<size_t>(stage)].count;
+}
+
+uint32_t LatencyStats::maxUs(Stage stage)
+{
+    return s_histograms[static_cast<size_t>(stage)].maxUs;
+}
+
+uint32_t LatencyStats::percentileUs(Stage stage, uint8_t percent)
+{
+    const Histogram& h = s_histograms[static_cast<size_t>(stage)];
+    if (h.count == 0)
+    {
+        return 0;
+    }
+    // Rank of the requested sample, rounded up so p100 is the last one
+    uint32_t rank = static_cast<uint32_t>((static_cast<uint64_t>(h.count) * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; ++b)
+    {
+        seen += h.buckets[b];
+        if (seen >= rank && seen > 0)
+        {
+            uint32_t upper = bucketUpperUs(b);
+            return upper < h.maxUs ? upper : h.maxUs;
+        }
+    }
+    return h.maxUs;
+}
+
+const uint32_t* LatencyStats::buckets(Stage stage)
+{
+    return s_histograms[static_cast<size_t>(stage)].buckets;
+}
+
+uint32_t LatencyStats::bucketUpperUs(size_t bucket)
+{
+    return bucket == 0 ? 0 : static_cast<uint32_t>((1ull << bucket) - 1);
+}
+
+const char* LatencyStats::stageName(Stage stage)
+{
+    return STAGE_NAMES[static_cast<size_t>(stage) < static_cast<size_t>(Stage::Count) ? static_cast<size_t>(stage) : 0];
+}
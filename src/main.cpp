@@ -1,18 +1,45 @@
 #include <Arduino.h>
 #include "driver/twai.h"
+#include "esp_timer.h"
 #include "can_messages.h"
 #include "web_interface.h"
 #include "softap_config.h"
-#include <map>
+#include "can_ingest.h"
+#include "can_stats.h"
+#include "state_table.h"
+#include "heap_guard.h"
+#include "trace.h"
+#include "frame_stream.h"
+#include "latency_stats.h"
+#include "traffic_generator.h"
+#include "clock.h"
+#include "device_config.h"
+#include "time_sync.h"
+#include "transmit_tracker.h"
+#include "payload_fuzzer.h"
+#include "sequence_runner.h"
+#include <WiFiUdp.h>
 
 // WiFi credentials will be loaded from NVS
 SoftAPConfig::Config wifiConfig;
 
-// TWAI (CAN) settings
+// TWAI (CAN) settings; bit rate, mode and filter come from DeviceConfig
 const gpio_num_t TX_PIN = GPIO_NUM_3;  // GPIO4 for CAN TX
 const gpio_num_t RX_PIN = GPIO_NUM_4;  // GPIO5 for CAN RX
-const twai_timing_config_t t_config = TWAI_TIMING_CONFIG_125KBITS();
-const twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+const uint16_t STREAM_QUEUE_FRAMES = 256;  // Frames buffered for /stream between sends
+const uint16_t GENERATOR_MAX_IDS = 512;    // Payload storage for TRAFFIC_PROFILE builds
+const uint32_t CAN_TASK_STACK = 4096;
+const UBaseType_t CAN_TASK_PRIORITY = 12;  // Above async_tcp (10) and loop() (1), below lwIP and WiFi
+const uint8_t TX_TRACK_FRAMES = 16;        // The TX queue plus the frame in the controller, with room to spare
+const uint16_t FUZZ_LOG_EVENTS = 64;       // Responses and error states kept for GET /fuzz
+const uint32_t SEQUENCE_TASK_STACK = 3072;
+const UBaseType_t SEQUENCE_TASK_PRIORITY = 11;  // Below reception, above async_tcp
+const uint32_t SEQUENCE_SPIN_US = 50;      // Sleeps end busy-waiting this long at most
+const uint32_t SEQUENCE_TIMER_MAX_US = 10000;  // Longest timer wait, so start and stop are picked up
+const TickType_t SEQUENCE_SEND_WAIT = pdMS_TO_TICKS(10);   // For room in the TX queue
+const uint32_t ERROR_ALERTS = TWAI_ALERT_ERR_ACTIVE | TWAI_ALERT_ABOVE_ERR_WARN | TWAI_ALERT_BELOW_ERR_WARN |
+                              TWAI_ALERT_ERR_PASS | TWAI_ALERT_BUS_ERROR | TWAI_ALERT_BUS_OFF |
+                              TWAI_ALERT_BUS_RECOVERED;
 const twai_general_config_t g_config = 
 {
     .mode = TWAI_MODE_NORMAL,
@@ -20,27 +47,49 @@ const twai_general_config_t g_config =
     .rx_io = RX_PIN,
     .clkout_io = TWAI_IO_UNUSED,
     .bus_off_io = TWAI_IO_UNUSED,
-    .tx_queue_len = 0,  // Size of TX queue (0 for RX only)
+    .tx_queue_len = 8,  // Size of TX queue, allocated once at driver install
     .rx_queue_len = 32, // Size of RX queue
-    .alerts_enabled = TWAI_ALERT_NONE,
+    .alerts_enabled = TWAI_ALERT_RX_DATA | TWAI_ALERT_TX_SUCCESS | TWAI_ALERT_TX_FAILED | ERROR_ALERTS,
     .clkout_divider = 0,
     .intr_flags = ESP_INTR_FLAG_LEVEL1
 };
 
+// Settings loaded from NVS at boot; POST /config changes them at runtime
+DeviceConfig::Settings deviceSettings;
+DeviceConfig::Can activeCan;           // What the driver is installed with
+uint32_t installedCanRevision = 0;
+
+// Time sync exchanges with other monitors (see TimeSync)
+WiFiUDP syncSocket;
+bool syncSocketOpen = false;
+DeviceConfig::Sync syncPeer;           // What the estimate is kept against
+uint32_t lastSyncRequestMs = 0;
+
 // Web server on port 80
 AsyncWebServer server(80);
 
-// Message storage
-std::map<uint32_t, CANMessage> latestMessages;  // Latest state per CAN ID
-std::map<uint32_t, CANMessage> previousMessages;  // Previous state per CAN ID
-bool transmitCanMessage(uint32_t nId, uint8_t nBytes, const uint8_t* pData)
+// Held from twai_transmit until TransmitTracker has the frame, so the
+// tracker sees frames in the driver's queue order whichever task sends them
+SemaphoreHandle_t txLock = nullptr;
+
+// Woken by the CAN task when a frame completes its wait
+TaskHandle_t sequenceTaskHandle = nullptr;
+esp_timer_handle_t sequenceTimer = nullptr;   // Wakes the sequence task between ticks
+
+// Who asked for a frame, for the acknowledgement once it is on the bus
+struct TransmitOrigin
 {
-    if (nBytes > 8 || pData == nullptr)
-    {
-        Serial.println("Invalid CAN message parameters");
-        return false;
-    }
+    uint32_t client;        // /stream client, 0 for none
+    uint32_t token;
+    uint32_t receivedUs;
+};
 
+esp_err_t queueFrame(uint32_t nId, bool extended, uint8_t nBytes, const uint8_t* pData, TickType_t wait,
+                     const TransmitOrigin* origin = nullptr)
+{
+#ifndef CAN_SENDER
+    uint32_t receivedUs = origin ? origin->receivedUs : Clock::micros();
+#endif
     twai_message_t message;
     message.identifier = nId;
     message.data_length_code = nBytes;
@@ -48,13 +97,109 @@ bool transmitCanMessage(uint32_t nId, uint8_t nBytes, const uint8_t* pData)
     message.ss = 1;
     message.self = 0;
     message.dlc_non_comp = 0;
-    message.extd = 0;  // Standard frame format (11-bit ID)
-    
+    message.extd = extended ? 1 : 0;
+
     // Copy data
     memcpy(message.data, pData, nBytes);
-    
-    // Transmit message
-    esp_err_t result = twai_transmit(&message, pdMS_TO_TICKS(100));
+
+    TRACE_SCOPE("twai_transmit");
+    xSemaphoreTake(txLock, portMAX_DELAY);
+    esp_err_t result = twai_transmit(&message, wait);
+#ifndef CAN_SENDER
+    if (result == ESP_OK)
+    {
+        TransmitTracker::queued(origin ? origin->token : 0, origin ? origin->client : 0, receivedUs, Clock::micros());
+    }
+#endif
+    xSemaphoreGive(txLock);
+    return result;
+}
+
+bool timingFor(uint32_t bitrate, twai_timing_config_t& timing)
+{
+    switch (bitrate)
+    {
+    case 25000:   timing = TWAI_TIMING_CONFIG_25KBITS();  return true;
+    case 50000:   timing = TWAI_TIMING_CONFIG_50KBITS();  return true;
+    case 100000:  timing = TWAI_TIMING_CONFIG_100KBITS(); return true;
+    case 125000:  timing = TWAI_TIMING_CONFIG_125KBITS(); return true;
+    case 250000:  timing = TWAI_TIMING_CONFIG_250KBITS(); return true;
+    case 500000:  timing = TWAI_TIMING_CONFIG_500KBITS(); return true;
+    case 800000:  timing = TWAI_TIMING_CONFIG_800KBITS(); return true;
+    case 1000000: timing = TWAI_TIMING_CONFIG_1MBITS();   return true;
+    default:      return false;
+    }
+}
+
+// Installs and starts the driver; the single acceptance filter holds the ID
+// bits (mask bits set to 1 are ignored by the controller)
+bool installCan(const DeviceConfig::Can& can)
+{
+    twai_timing_config_t t_config;
+    if (!timingFor(can.bitrate, t_config))
+    {
+        return false;
+    }
+    twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    if (can.filterMask != 0)
+    {
+        uint8_t shift = can.filterExtended ? 3 : 21;
+        f_config.acceptance_code = can.filterId << shift;
+        f_config.acceptance_mask = ~(can.filterMask << shift);
+    }
+    twai_general_config_t config = g_config;
+    config.mode = can.mode == DeviceConfig::CanMode::ListenOnly ? TWAI_MODE_LISTEN_ONLY
+                : can.mode == DeviceConfig::CanMode::NoAck      ? TWAI_MODE_NO_ACK
+                                                                : TWAI_MODE_NORMAL;
+    if (twai_driver_install(&config, &t_config, &f_config) != ESP_OK)
+    {
+        return false;
+    }
+    if (twai_start() != ESP_OK)
+    {
+        twai_driver_uninstall();
+        return false;
+    }
+    activeCan = can;
+    return true;
+}
+
+// Called between frames once POST /config published new CAN settings.
+// Frames arriving while the driver is down are lost, as on any bit rate
+// change, and the zero-heap build counts the driver's new queues.
+void reinstallCan()
+{
+    installedCanRevision = DeviceConfig::canRevision();
+    DeviceConfig::Can can = DeviceConfig::can();
+    xSemaphoreTake(txLock, portMAX_DELAY);
+    twai_stop();
+    twai_driver_uninstall();
+    TransmitTracker::abandon(Clock::micros());
+    xSemaphoreGive(txLock);
+    if (installCan(can))
+    {
+        Serial.printf("TWAI reinstalled: %u bit/s, %s\n", can.bitrate, DeviceConfig::canModeName(can.mode));
+    }
+    else if (installCan(activeCan))
+    {
+        Serial.println("Failed to install new TWAI settings, previous ones restored");
+    }
+    else
+    {
+        Serial.println("Failed to reinstall TWAI driver");
+    }
+}
+
+bool transmitCanMessage(uint32_t nId, uint8_t nBytes, const uint8_t* pData)
+{
+    if (nBytes > 8 || pData == nullptr)
+    {
+        Serial.println("Invalid CAN message parameters");
+        return false;
+    }
+
+    // Transmit message (standard 11-bit ID)
+    esp_err_t result = queueFrame(nId, false, nBytes, pData, pdMS_TO_TICKS(100));
     if (result != ESP_OK)
     {
         Serial.printf("Failed to transmit message, error: %d\n", result);
@@ -65,12 +210,234 @@ bool transmitCanMessage(uint32_t nId, uint8_t nBytes, const uint8_t* pData)
 }
 
 
+#ifndef CAN_SENDER
+// Transmit records from the page's edit-and-resend. They never wait for room
+// in the TX queue; the page is told it was full instead.
+FrameCodec::TransmitStatus transmitStreamFrame(const FrameCodec::TransmitRequest& request, uint32_t client,
+                                               uint32_t receivedUs)
+{
+    TransmitOrigin origin = { client, request.token, receivedUs };
+    esp_err_t result = queueFrame(request.id, request.extended, request.length, request.data, 0, &origin);
+    return result == ESP_OK              ? FrameCodec::TransmitStatus::Sent
+           : result == ESP_ERR_TIMEOUT   ? FrameCodec::TransmitStatus::Busy
+                                         : FrameCodec::TransmitStatus::Rejected;
+}
+
+// Joins the configured network, or hosts the access point when standalone
+// mode is set, no credentials are saved or the network cannot be reached.
+// Both at once when asked for; a failed join then leaves the access point.
+void bringUpNetwork(const SoftAPConfig::Config& config, bool configured)
+{
+    SoftAPConfig::NetworkMode mode = configured ? config.mode : SoftAPConfig::NetworkMode::AccessPoint;
+    bool accessPoint = mode != SoftAPConfig::NetworkMode::Station;
+    if (accessPoint && !SoftAPConfig::startAccessPoint(mode == SoftAPConfig::NetworkMode::AccessPointStation))
+    {
+        accessPoint = false;
+    }
+    if (SoftAPConfig::needsStation(mode) && WebInterface::connectStation(config.ssid, config.password))
+    {
+        Serial.printf("Serving the monitor on the configured network%s\n", accessPoint ? " and the access point" : "");
+        return;
+    }
+
+    if (!accessPoint)
+    {
+        Serial.println(!configured ? "No WiFi configuration found, starting standalone access point"
+                       : mode == SoftAPConfig::NetworkMode::Station
+                           ? "WiFi unavailable, starting standalone access point"
+                           : "Starting standalone access point");
+        accessPoint = SoftAPConfig::startAccessPoint();
+    }
+    Serial.println(accessPoint ? "Serving the monitor on the access point"
+                               : "Monitor is unreachable, CAN reception continues");
+}
+
+// The monitor is served and CAN starts whichever network came up
+void startNetwork()
+{
+    bool configured = SoftAPConfig::loadConfig(wifiConfig);
+    bringUpNetwork(wifiConfig, configured);
+
+    // Initialize web interface on whichever network is up
+    if (!WebInterface::initialize())
+    {
+        Serial.println("Web interface initialization failed!");
+        while (1);
+    }
+    WebInterface::setTransmitCallback(transmitCanMessage);
+    WebInterface::setStreamTransmitCallback(transmitStreamFrame);
+}
+
+uint32_t framesLost()
+{
+    twai_status_info_t status;
+    return twai_get_status_info(&status) == ESP_OK ? status.rx_missed_count + status.rx_overrun_count : 0;
+}
+
+// Runtime switch requested through POST /network. Only the network side is
+// rebuilt: canTask keeps receiving at its higher priority throughout. Frames
+// are counted at ingest, sampled or not; the controller's counters tell
+// whether any went missing.
+void switchNetwork(const SoftAPConfig::Config& config)
+{
+    Serial.printf("Switching network to %s\n", SoftAPConfig::modeName(config.mode));
+    uint32_t startMs = millis();
+    uint32_t startFrames = CanStatistics::totalFrames();
+    uint32_t startDropped = FrameStream::dropped();
+    uint32_t startLost = framesLost();
+
+    WebInterface::stop();
+    syncSocket.stop();
+    syncSocketOpen = false;
+    SoftAPConfig::stopNetwork();
+    wifiConfig = config;
+    bringUpNetwork(wifiConfig, true);
+    WebInterface::start();
+
+    SoftAPConfig::SwitchReport report;
+    report.durationMs = millis() - startMs;
+    report.frames = CanStatistics::totalFrames() - startFrames;
+    // A driver reinstall during the switch restarts the controller's counters
+    uint32_t endLost = framesLost();
+    report.missed = endLost >= startLost ? endLost - startLost : endLost;
+    report.streamDropped = FrameStream::dropped() - startDropped;
+    SoftAPConfig::finishSwitch(report);
+    Serial.printf("Network switched in %u ms: %u frames received, %u missed, %u not streamed\n",
+                  report.durationMs, report.frames, report.missed, report.streamDropped);
+}
+
+// Answers other monitors' time requests and keeps this device's estimate
+// against its sync peer. A late poll only makes an exchange look slower,
+// and the delay filter passes over slow ones.
+void serviceTimeSync()
+{
+    if (!syncSocketOpen && !(syncSocketOpen = syncSocket.begin(TimeSync::PORT) != 0))
+    {
+        return;
+    }
+    DeviceConfig::Sync sync = DeviceConfig::sync();
+    if (sync.peer != syncPeer.peer || sync.port != syncPeer.port)
+    {
+        syncPeer = sync;
+        TimeSync::reset(sync.peer == 0);
+    }
+
+    uint8_t packet[TimeSync::PACKET_BYTES];
+    uint8_t reply[TimeSync::PACKET_BYTES];
+    while (syncSocket.parsePacket() > 0)
+    {
+        uint64_t receivedUs = Clock::nowUs();
+        int length = syncSocket.read(packet, sizeof(packet));
+        if (length <= 0)
+        {
+            continue;
+        }
+        size_t replyLength = TimeSync::answer(packet, length, receivedUs, Clock::nowUs(), reply, sizeof(reply));
+        if (replyLength > 0)
+        {
+            syncSocket.beginPacket(syncSocket.remoteIP(), syncSocket.remotePort());
+            syncSocket.write(reply, replyLength);
+            syncSocket.endPacket();
+        }
+        else
+        {
+            TimeSync::onResponse(packet, length, receivedUs);
+        }
+    }
+
+    if (syncPeer.peer != 0 && millis() - lastSyncRequestMs >= TimeSync::INTERVAL_MS)
+    {
+        lastSyncRequestMs = millis();
+        IPAddress peer(syncPeer.peer >> 24, (syncPeer.peer >> 16) & 0xFF, (syncPeer.peer >> 8) & 0xFF,
+                       syncPeer.peer & 0xFF);
+        size_t length = TimeSync::makeRequest(packet, sizeof(packet), Clock::nowUs());
+        syncSocket.beginPacket(peer, syncPeer.port);
+        syncSocket.write(packet, length);
+        syncSocket.endPacket();
+    }
+}
+
+void CanRX();
+
+void canTask(void* parameter)
+{
+    while (true)
+    {
+        CanRX();
+    }
+}
+
+// Whole ticks to block for, at least one and at most 10 ms so start and
+// stop requests are picked up
+TickType_t sequenceTicks(uint32_t us)
+{
+    TickType_t ticks = pdMS_TO_TICKS(us / 1000);
+    return ticks < 1 ? 1 : ticks > pdMS_TO_TICKS(10) ? pdMS_TO_TICKS(10) : ticks;
+}
+
+// Wakes the sequence task at the end of a timer wait
+void sequenceTimerExpired(void* parameter)
+{
+    xTaskNotifyGive(sequenceTaskHandle);
+}
+
+// Runs scripted sequences. A sleep blocks on a one-shot timer that fires
+// SEQUENCE_SPIN_US before the step is due, then busy-waits the rest, so a
+// step starts within microseconds of its time rather than on the next tick
+// while the other tasks keep running. The parser only accepts scripts with
+// a send or wait step, which block, so a repeating script always yields.
+void sequenceTask(void* parameter)
+{
+    SequenceRunner::Step frame;
+    uint32_t untilUs = 0;
+    while (true)
+    {
+        switch (SequenceRunner::next(Clock::micros(), frame, untilUs))
+        {
+        case SequenceRunner::Action::Send:
+        {
+            esp_err_t result = queueFrame(frame.id, frame.extended, frame.length, frame.data, SEQUENCE_SEND_WAIT);
+            SequenceRunner::sent(result == ESP_OK, Clock::micros());
+            break;
+        }
+        case SequenceRunner::Action::Sleep:
+        {
+            int32_t remainingUs = static_cast<int32_t>(untilUs - Clock::micros());
+            if (remainingUs > static_cast<int32_t>(SEQUENCE_SPIN_US))
+            {
+                uint32_t timerUs = remainingUs - SEQUENCE_SPIN_US;
+                esp_timer_start_once(sequenceTimer, timerUs < SEQUENCE_TIMER_MAX_US ? timerUs : SEQUENCE_TIMER_MAX_US);
+                // The timeout only guards against a lost notification
+                ulTaskNotifyTake(pdTRUE, sequenceTicks(SEQUENCE_TIMER_MAX_US) + 1);
+                esp_timer_stop(sequenceTimer);
+                break;
+            }
+            while (static_cast<int32_t>(untilUs - Clock::micros()) > 0)
+            {
+            }
+            break;
+        }
+        case SequenceRunner::Action::Wait:
+        {
+            int32_t remainingUs = static_cast<int32_t>(untilUs - Clock::micros());
+            ulTaskNotifyTake(pdTRUE, sequenceTicks(remainingUs > 0 ? remainingUs + 999 : 0));
+            break;
+        }
+        case SequenceRunner::Action::Idle:
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            break;
+        }
+    }
+}
+#endif
+
 void setup()
 {
     // Initialize serial communication
     Serial.begin(115200);
     delay(1000); // Wait for serial to initialize
     Serial.println("TWAI (CAN) Receiver with Web Server");
+    txLock = xSemaphoreCreateMutex();
 
     pinMode(GPIO_NUM_8, OUTPUT);
     pinMode(GPIO_NUM_9, INPUT);
@@ -79,46 +446,119 @@ void setup()
     if (SoftAPConfig::checkConfigMode())
     {
         Serial.println("Entering configuration mode...");
-        SoftAPConfig::startConfigPortal();
-        // If we get here, something went wrong
-        ESP.restart();
+        // Returns once a configuration is saved; boot then continues with it
+        if (!SoftAPConfig::startConfigPortal())
+        {
+            ESP.restart();
+        }
     }
 
-    // Load WiFi configuration
-    if (!SoftAPConfig::loadConfig(wifiConfig))
+    // Device settings fall back to their defaults when none were saved yet
+    if (!SoftAPConfig::loadDeviceConfig(deviceSettings))
     {
-        Serial.println("No WiFi configuration found! Please enter config mode.");
-        while (1) 
-        {
-            digitalWrite(GPIO_NUM_8, !digitalRead(GPIO_NUM_8));
-            delay(100); // Fast blink to indicate no config
-        }
+        Serial.println("No saved device settings, using defaults");
     }
 
 #ifndef CAN_SENDER
-    // Initialize web interface with loaded credentials
-    if (!WebInterface::initialize(wifiConfig.ssid, wifiConfig.password))
+    startNetwork();
+#endif
+
+    // Per-ID storage is sized once here; the oldest IDs are evicted when full
+    if (!CanIngest::begin(deviceSettings.can.bitrate, MAX_TRACKED_IDS))
     {
-        Serial.println("Web interface initialization failed!");
+        Serial.println("Failed to allocate message storage");
+        while (1);
+    }
+    Serial.printf("Tracking up to %u IDs (%u bytes)\n", MAX_TRACKED_IDS, (unsigned)CanIngest::memoryBytes());
+
+    // Watches and histogram selections need the ingest storage
+    DeviceConfig::apply(deviceSettings);
+
+    if (!FrameStream::begin(STREAM_QUEUE_FRAMES))
+    {
+        Serial.println("Failed to allocate stream queue");
+        while (1);
+    }
+#ifndef CAN_SENDER
+    if (!TransmitTracker::begin(TX_TRACK_FRAMES))
+    {
+        Serial.println("Failed to allocate transmit tracking");
+        while (1);
+    }
+    if (!PayloadFuzzer::begin(FUZZ_LOG_EVENTS))
+    {
+        Serial.println("Failed to allocate the fuzz log");
         while (1);
     }
-    WebInterface::setMessageMaps(&latestMessages, &previousMessages);
-    WebInterface::setTransmitCallback(transmitCanMessage);
 #endif
 
-    // Install TWAI driver
-    if (twai_driver_install(&g_config, &t_config, &f_config) != ESP_OK) {
-        Serial.println("Failed to install TWAI driver");
+#ifdef TRACE_EVENTS
+    if (!Trace::begin(TRACE_EVENT_CAPACITY))
+    {
+        Serial.println("Failed to allocate trace ring");
         while (1);
     }
+    Serial.printf("Tracing %u events, download from /trace\n", TRACE_EVENT_CAPACITY);
+#endif
 
-    // Start TWAI driver
-    if (twai_start() != ESP_OK) {
+    // Install and start TWAI driver
+    installedCanRevision = DeviceConfig::canRevision();
+    if (!installCan(DeviceConfig::can()))
+    {
         Serial.println("Failed to start TWAI driver");
         while (1);
     }
 
-    Serial.println("TWAI Initialized");
+    Serial.printf("TWAI Initialized: %u bit/s, %s\n", activeCan.bitrate, DeviceConfig::canModeName(activeCan.mode));
+
+#ifndef CAN_SENDER
+    // Reception runs in its own task above the web server's, so DNS and HTTP
+    // work only gets the CPU while it waits for the next frame
+    if (xTaskCreate(canTask, "can", CAN_TASK_STACK, nullptr, CAN_TASK_PRIORITY, nullptr) != pdPASS)
+    {
+        Serial.println("Failed to start CAN task");
+        while (1);
+    }
+    const esp_timer_create_args_t timerArgs =
+    {
+        .callback = sequenceTimerExpired,
+        .arg = nullptr,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sequence",
+        .skip_unhandled_events = false
+    };
+    if (esp_timer_create(&timerArgs, &sequenceTimer) != ESP_OK)
+    {
+        Serial.println("Failed to create sequence timer");
+        while (1);
+    }
+    if (xTaskCreate(sequenceTask, "sequence", SEQUENCE_TASK_STACK, nullptr, SEQUENCE_TASK_PRIORITY,
+                    &sequenceTaskHandle) != pdPASS)
+    {
+        Serial.println("Failed to start sequence task");
+        while (1);
+    }
+#endif
+
+#if defined(CAN_SENDER) && defined(TRAFFIC_PROFILE)
+    if (!TrafficGenerator::begin(GENERATOR_MAX_IDS) || !TrafficGenerator::configure(TRAFFIC_PROFILE, activeCan.bitrate))
+    {
+        Serial.printf("Invalid traffic profile \"%s\": %s\n", TRAFFIC_PROFILE, TrafficGenerator::lastError());
+        while (1);
+    }
+    Serial.printf("Generating \"%s\": %u IDs, expected bus load %u.%u%%\n", TRAFFIC_PROFILE,
+                  TrafficGenerator::idCount(), TrafficGenerator::expectedLoadPermille() / 10,
+                  TrafficGenerator::expectedLoadPermille() % 10);
+#endif
+
+#ifdef HEAP_GUARD_HOOKS
+    // Everything the steady state needs exists now; count anything after this
+#ifdef ZERO_HEAP_TRAP
+    HeapGuard::setTrap(true);
+#endif
+    HeapGuard::arm();
+    Serial.printf("Heap guard armed, %u bytes free\n", (unsigned)ESP.getFreeHeap());
+#endif
 
 #ifndef CAN_SENDER
     // Web server is now initialized in WebInterface::initialize()
@@ -136,33 +576,160 @@ void IndicateMessage(const CANMessage& msg)
     }
 }
 
+// The alerts say that frames finished, not which; TransmitTracker matches
+// them to what was queued. Also run while frames are in flight without an
+// alert, which covers a frame finishing before its sender had it tracked.
+void settleTransmits()
+{
+    uint32_t tracked = TransmitTracker::inFlight();
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) == ESP_OK)
+    {
+        TransmitTracker::settle(tracked, status.msgs_to_tx, status.tx_failed_count, Clock::micros());
+    }
+}
+
+// The TX counter goes past 255 on the way to bus-off
+uint8_t errorCounter(uint32_t count)
+{
+    return count > 255 ? 255 : static_cast<uint8_t>(count);
+}
+
+PayloadFuzzer::ErrorState errorStateOf(const twai_status_info_t& status)
+{
+    uint32_t worst = status.tx_error_counter > status.rx_error_counter ? status.tx_error_counter
+                                                                       : status.rx_error_counter;
+    return status.state == TWAI_STATE_BUS_OFF    ? PayloadFuzzer::ErrorState::BusOff
+           : status.state == TWAI_STATE_RECOVERING ? PayloadFuzzer::ErrorState::Recovering
+           : worst > 127                          ? PayloadFuzzer::ErrorState::Passive
+           : worst >= 96                          ? PayloadFuzzer::ErrorState::Warning
+                                                  : PayloadFuzzer::ErrorState::Active;
+}
+
+// Error states for the fuzz log, and recovery from bus-off: the driver
+// clears its TX queue and keeps off the bus until told to recover, then
+// stays stopped until started again
+void serviceBusState(uint32_t alerts)
+{
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) != ESP_OK)
+    {
+        return;
+    }
+    uint32_t nowUs = Clock::micros();
+    PayloadFuzzer::onErrorState(errorStateOf(status), errorCounter(status.tx_error_counter),
+                                errorCounter(status.rx_error_counter), status.bus_error_count, nowUs,
+                                TransmitTracker::inFlight());
+    if (alerts & TWAI_ALERT_BUS_OFF)
+    {
+        Serial.println("TWAI bus-off, recovering");
+        xSemaphoreTake(txLock, portMAX_DELAY);
+        TransmitTracker::abandon(nowUs, status.tx_failed_count);
+        twai_initiate_recovery();
+        xSemaphoreGive(txLock);
+    }
+    if ((alerts & TWAI_ALERT_BUS_RECOVERED) && twai_start() == ESP_OK)
+    {
+        Serial.println("TWAI recovered from bus-off");
+    }
+}
+
+// Queues the fuzz frames that are due without blocking; one that does not
+// fit is asked for again after the next wakeup
+void feedFuzzer()
+{
+    PayloadFuzzer::Frame frame;
+    while (PayloadFuzzer::poll(Clock::micros(), frame))
+    {
+        esp_err_t result = queueFrame(frame.id, frame.extended, frame.length, frame.data, 0);
+        if (result == ESP_ERR_TIMEOUT)
+        {
+            break;  // Queue full
+        }
+        if (result != ESP_OK)
+        {
+            // Listen-only, or off the bus
+            Serial.printf("Payload fuzzing stopped, transmit error %d\n", result);
+            PayloadFuzzer::stop();
+            break;
+        }
+        PayloadFuzzer::sent();
+    }
+}
+
+// Up to 10 ms, or until the next fuzz frame is due. Frames due within the
+// same tick go out together; a full queue wakes the task as it drains.
+TickType_t alertWait()
+{
+    uint32_t idleUs = PayloadFuzzer::idleUs(Clock::micros());
+    if (idleUs >= 10000)
+    {
+        return pdMS_TO_TICKS(10);
+    }
+    TickType_t ticks = pdMS_TO_TICKS((idleUs + 999) / 1000);
+    return ticks > 0 ? ticks : 1;
+}
+
 void CanRX()
 {
+    if (DeviceConfig::canRevision() != installedCanRevision)
+    {
+        reinstallCan();
+    }
+    DeviceConfig::installViews();
+    CanIngest::tick(Clock::millis());
+    PayloadFuzzer::service(Clock::micros());
+
+    // Woken by a received frame, a finished transmission or an error state
+    // change, whichever comes first
+    uint32_t alerts = 0;
+    {
+        TRACE_SCOPE("twai_read_alerts");
+        twai_read_alerts(&alerts, alertWait());
+    }
+    if ((alerts & (TWAI_ALERT_TX_SUCCESS | TWAI_ALERT_TX_FAILED)) || TransmitTracker::inFlight() > 0)
+    {
+        settleTransmits();
+    }
+    if ((alerts & ERROR_ALERTS) || PayloadFuzzer::active())
+    {
+        serviceBusState(alerts);
+    }
+
     twai_message_t twai_msg;
-    if (twai_receive(&twai_msg, pdMS_TO_TICKS(10)) == ESP_OK) 
+    while (twai_receive(&twai_msg, 0) == ESP_OK)
     {
+        // The controller's filter also lets through frames of the other ID
+        // format whose leading bits match
+        if (!DeviceConfig::accepts(activeCan, twai_msg.identifier, twai_msg.extd))
+        {
+            continue;
+        }
+        uint32_t rxUs = Clock::micros();
+
         // Convert TWAI message to our format
         CANMessage msg(twai_msg);
 
         IndicateMessage(msg);
+        uint32_t ingestUs = Clock::micros();
+        bool sampled = CanIngest::process(msg, twai_msg.extd);
+        uint32_t doneUs = Clock::micros();
 
-        // Update latest/previous messages maps
-        const CANMessage* previousMessage = nullptr;
-        auto latestIt = latestMessages.find(msg.id);
-        if (latestIt != latestMessages.end())
+        // Device-side latency stages for every frame; the stream carries the
+        // sampled frames and flags probes among them for the network and
+        // client stages
+        LatencyStats::record(LatencyStats::Stage::Rx, ingestUs - rxUs);
+        LatencyStats::record(LatencyStats::Stage::StateUpdate, doneUs - ingestUs);
+        if (sampled)
         {
-            // Move current to previous
-            previousMessages[msg.id] = latestIt->second;
-            previousMessage = &latestIt->second;
+            FrameStream::push(msg, twai_msg.extd, rxUs, doneUs);
         }
-        else
+        PayloadFuzzer::onReceive(msg, twai_msg.extd, rxUs, TransmitTracker::inFlight());
+        if (SequenceRunner::onReceive(msg, twai_msg.extd, rxUs))
         {
-            previousMessages.erase(msg.id);
+            xTaskNotifyGive(sequenceTaskHandle);
         }
 
-        WebInterface::recordChange(msg, previousMessage);
-        latestMessages[msg.id] = msg;
-
         // Debug output to serial
         /*
         Serial.printf("Received packet at %lu ms - ID: 0x%lX, Length: %d, Data: ",
@@ -174,29 +741,69 @@ void CanRX()
         Serial.println();
         */
     }
+    feedFuzzer();
 }
 
+#ifdef TRAFFIC_PROFILE
+// Keeps the TX queue fed from the traffic generator without blocking; frames
+// that do not fit wait here for the next call
+void GenerateTraffic()
+{
+    static TrafficGenerator::Frame frames[8];
+    static uint16_t count = 0;
+    static uint16_t next = 0;
+    static uint32_t nextReport = 0;
+
+    if (next == count)
+    {
+        count = TrafficGenerator::poll(Clock::micros(), frames, 8);
+        next = 0;
+    }
+    while (next < count)
+    {
+        const TrafficGenerator::Frame& frame = frames[next];
+        if (queueFrame(frame.msg.id, frame.extended, frame.msg.length, frame.msg.data, 0) != ESP_OK)
+        {
+            break;  // Queue full
+        }
+        ++next;
+    }
+
+    if (Clock::millis() > nextReport)
+    {
+        nextReport = Clock::millis() + 10000;
+        Serial.printf("Generated %llu frames, %llu skipped behind schedule\n",
+                      static_cast<unsigned long long>(TrafficGenerator::generated()),
+                      static_cast<unsigned long long>(TrafficGenerator::skipped()));
+    }
+}
+#endif
+
 void CanTX()
 {
+#ifdef TRAFFIC_PROFILE
+    GenerateTraffic();
+#else
     static uint32_t nNextSchedTX = 0;
 
-    if (millis() > nNextSchedTX)
+    if (Clock::millis() > nNextSchedTX)
     {
-        nNextSchedTX = millis() + 1000;
+        nNextSchedTX = Clock::millis() + 1000;
 
         static uint32_t nNextUpdateTime = 0;
         // Example CAN message to send
         static uint32_t exampleId = 0x123;
         static uint8_t exampleData[8] = {0x01, 0x02, 0xFF, 0x04, 0x05, 0x06, 0x07, 0x08};
 
-        if (nNextUpdateTime < millis())
+        if (nNextUpdateTime < Clock::millis())
         {
-            nNextUpdateTime = millis() + 5000; // Update every 5 second
+            nNextUpdateTime = Clock::millis() + 5000; // Update every 5 second
             exampleData[1]++;
         }
 
         transmitCanMessage(exampleId, 8, exampleData);
     }
+#endif
     static int nLastBtn = HIGH;
     if (digitalRead(GPIO_NUM_9) != nLastBtn)
     {
@@ -217,7 +824,17 @@ void loop()
     #ifdef CAN_SENDER
         CanTX();
     #else
-        // Continuously receive CAN messages    
-        CanRX();
+        // CAN messages are received in canTask; the loop answers the access
+        // point's DNS queries, carries out network switches and keeps the
+        // clocks in sync. The short delay keeps time requests from waiting
+        // long, which would only widen the exchange's delay.
+        SoftAPConfig::Config config;
+        if (SoftAPConfig::takeSwitch(config))
+        {
+            switchNetwork(config);
+        }
+        SoftAPConfig::processDns();
+        serviceTimeSync();
+        delay(1);
     #endif
 }
\ No newline at end of file
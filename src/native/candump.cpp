@@ -0,0 +1,166 @@
+#include "candump.h"
+#include <stdio.h>
+
+namespace
+{
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+}
+
+bool parseCandumpLine(const char* line, size_t length, CandumpFrame& frame)
+{
+    const char* p = line;
+    const char* end = line + length;
+    while (p < end && isSpace(*p)) ++p;
+
+    // (seconds.fraction)
+    if (p == end || *p++ != '(')
+    {
+        return false;
+    }
+    uint64_t seconds = 0;
+    int digits = 0;
+    while (p < end && *p >= '0' && *p <= '9' && digits < 12)
+    {
+        seconds = seconds * 10 + static_cast<uint64_t>(*p++ - '0');
+        ++digits;
+    }
+    if (digits == 0 || p == end || *p++ != '.')
+    {
+        return false;
+    }
+    uint64_t micros = 0;
+    int fraction = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        if (fraction < 6)
+        {
+            micros = micros * 10 + static_cast<uint64_t>(*p - '0');
+        }
+        ++fraction;
+        ++p;
+    }
+    if (fraction == 0 || p == end || *p++ != ')')
+    {
+        return false;
+    }
+    for (int i = fraction; i < 6; ++i)
+    {
+        micros *= 10;
+    }
+    frame.timestampUs = seconds * 1000000 + micros;
+
+    // Interface name
+    if (p == end || !isSpace(*p))
+    {
+        return false;
+    }
+    while (p < end && isSpace(*p)) ++p;
+    const char* interfaceStart = p;
+    while (p < end && !isSpace(*p)) ++p;
+    if (p == interfaceStart)
+    {
+        return false;
+    }
+    while (p < end && isSpace(*p)) ++p;
+
+    // ID#
+    uint32_t id = 0;
+    int idDigits = 0;
+    int value;
+    while (p < end && idDigits < 9 && (value = hexValue(*p)) >= 0)
+    {
+        id = (id << 4) | static_cast<uint32_t>(value);
+        ++idDigits;
+        ++p;
+    }
+    if ((idDigits != 3 && idDigits != 8) || p == end || *p++ != '#')
+    {
+        return false;
+    }
+    frame.extended = idDigits == 8;
+    if ((frame.extended && id > 0x1FFFFFFF) || (!frame.extended && id > 0x7FF))
+    {
+        return false;
+    }
+    frame.id = id;
+    frame.remote = false;
+    frame.length = 0;
+
+    if (p < end && (*p == 'R' || *p == 'r'))
+    {
+        // Remote frame, optionally with its requested length
+        ++p;
+        frame.remote = true;
+        if (p < end && *p >= '0' && *p <= '8')
+        {
+            frame.length = static_cast<uint8_t>(*p++ - '0');
+        }
+    }
+    else
+    {
+        while (p + 1 < end && hexValue(p[0]) >= 0 && hexValue(p[1]) >= 0)
+        {
+            if (frame.length == 8)
+            {
+                return false;
+            }
+            frame.data[frame.length++] = static_cast<uint8_t>((hexValue(p[0]) << 4) | hexValue(p[1]));
+            p += 2;
+        }
+    }
+
+    // Only trailing whitespace may follow
+    while (p < end && (isSpace(*p) || *p == '\r' || *p == '\n')) ++p;
+    return p == end;
+}
+
+size_t formatCandumpLine(char* out, size_t size, const CandumpFrame& frame, const char* interface)
+{
+    int written = snprintf(out, size, frame.extended ? "(%llu.%06llu) %s %08X#" : "(%llu.%06llu) %s %03X#",
+                           static_cast<unsigned long long>(frame.timestampUs / 1000000),
+                           static_cast<unsigned long long>(frame.timestampUs % 1000000), interface,
+                           static_cast<unsigned>(frame.id));
+    if (written < 0 || static_cast<size_t>(written) >= size)
+    {
+        return 0;
+    }
+    size_t length = static_cast<size_t>(written);
+    if (frame.remote)
+    {
+        if (length + 2 >= size)
+        {
+            return 0;
+        }
+        out[length++] = 'R';
+        if (frame.length)
+        {
+            out[length++] = static_cast<char>('0' + frame.length);
+        }
+    }
+    else
+    {
+        static const char HEX[] = "0123456789ABCDEF";
+        if (length + frame.length * 2u >= size)
+        {
+            return 0;
+        }
+        for (uint8_t i = 0; i < frame.length && i < 8; ++i)
+        {
+            out[length++] = HEX[frame.data[i] >> 4];
+            out[length++] = HEX[frame.data[i] & 0xF];
+        }
+    }
+    out[length] = '\0';
+    return length;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Lines of a "candump -l" log, e.g. "(1699999999.123456) can0 123#DEADBEEF".
+// Three hex digits are a standard ID and eight an extended one; "123#R" is a
+// remote frame. CAN FD lines ("##") are rejected.
+struct CandumpFrame
+{
+    uint64_t timestampUs = 0;
+    uint32_t id = 0;
+    bool extended = false;
+    bool remote = false;
+    uint8_t length = 0;
+    uint8_t data[8] = {};
+};
+
+bool parseCandumpLine(const char* line, size_t length, CandumpFrame& frame);
+// Returns the line length without the terminator, or 0 when out is too small
+size_t formatCandumpLine(char* out, size_t size, const CandumpFrame& frame, const char* interface);
@@ -0,0 +1,90 @@
+#include "host_commands.h"
+#include "host_options.h"
+#include "can_ingest.h"
+#include "heap_guard.h"
+#include "state_table.h"
+#include <stdio.h>
+
+namespace
+{
+    // Small deterministic generator so runs are comparable between builds
+    uint32_t nextRandom(uint32_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    void runFrames(uint32_t frames, uint32_t ids, uint32_t& seed, uint32_t& clockUs)
+    {
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            uint32_t r = nextRandom(seed);
+            CANMessage msg;
+            clockUs += 100;
+            msg.timestamp = clockUs / 1000;
+            msg.id = 0x100 + (r % ids);
+            msg.length = 8;
+            for (uint8_t b = 0; b < 8; ++b)
+            {
+                // Mostly stable payloads with occasional byte changes
+                msg.data[b] = (r >> 24) % 16 == b ? static_cast<uint8_t>(r) : static_cast<uint8_t>(msg.id + b);
+            }
+            CanIngest::process(msg, false);
+            if (clockUs % 1000 == 0)
+            {
+                CanIngest::tick(msg.timestamp);
+            }
+        }
+    }
+}
+
+int runAllocCommand(int argc, char** argv)
+{
+    uint32_t frames = optionU32(argc, argv, "--frames", 1000000);
+    uint32_t ids = optionU32(argc, argv, "--ids", 400);
+    uint32_t seed = optionU32(argc, argv, "--seed", 1);
+    uint32_t maxIds = optionU32(argc, argv, "--max-ids", MAX_TRACKED_IDS);
+    if (ids == 0 || seed == 0)
+    {
+        fprintf(stderr, "--ids and --seed must be non-zero\n");
+        return 2;
+    }
+
+    if (!CanIngest::begin(500000, static_cast<uint16_t>(maxIds)))
+    {
+        fprintf(stderr, "Failed to allocate ingest storage for %u IDs\n", maxIds);
+        return 1;
+    }
+
+    // Warm up so every ID has been seen once, then measure the steady state
+    uint32_t clockUs = 0;
+    runFrames(ids * 4, ids, seed, clockUs);
+    HeapGuard::resetScopes();
+    HeapGuard::arm();
+    runFrames(frames, ids, seed, clockUs);
+    HeapGuard::Counters counters = HeapGuard::counters();
+
+#ifndef HEAP_GUARD_HOOKS
+    printf("Built without allocator hooks; counts below are always zero\n");
+#endif
+    printf("%u frames, %u IDs (max %u), %u evictions\n\n", frames, ids, maxIds, StateTable::evictions());
+    printf("%-26s %10s %12s %12s %10s\n", "scope", "entries", "allocations", "bytes", "per entry");
+    for (size_t i = 1; i < static_cast<size_t>(HeapGuard::Scope::Count); ++i)
+    {
+        HeapGuard::Scope scope = static_cast<HeapGuard::Scope>(i);
+        HeapGuard::ScopeCounters scopeCounters = HeapGuard::scopeCounters(scope);
+        if (scopeCounters.entries == 0)
+        {
+            continue;
+        }
+        printf("%-26s %10u %12u %12u %10.3f\n", HeapGuard::scopeName(scope), scopeCounters.entries,
+               scopeCounters.allocations, scopeCounters.bytes,
+               static_cast<double>(scopeCounters.allocations) / scopeCounters.entries);
+    }
+    printf("\nhot path: %u allocations, %u bytes\n", counters.hotPathAllocations, counters.hotPathBytes);
+
+    // Non-zero exit lets CI fail on any steady-state allocation per frame
+    return counters.hotPathAllocations == 0 ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+#include "host_commands.h"
+#include "host_options.h"
+#include "can_ingest.h"
+#include "state_table.h"
+#include "view_render.h"
+#include "payload_search.h"
+#include "device_config.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    // Stands in for HTML_TEMPLATE; the page text is copied, not rendered
+    constexpr const char* BENCH_TEMPLATE = "<table>%LATEST_MESSAGES%</table>";
+
+    // FNV-1a over the rendered output, so formatter changes can be checked
+    // for identical output as well as speed
+    uint32_t hashBytes(uint32_t hash, const uint8_t* data, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    bool writeTrace(const char* path)
+    {
+        FILE* file = fopen(path, "w");
+        Trace::Export* exp = file ? Trace::beginExport() : nullptr;
+        if (!exp)
+        {
+            if (file)
+            {
+                fclose(file);
+            }
+            return false;
+        }
+        uint8_t buffer[1024];
+        size_t written;
+        while ((written = Trace::fill(*exp, buffer, sizeof(buffer))) > 0)
+        {
+            fwrite(buffer, 1, written, file);
+        }
+        Trace::endExport(exp);
+        return fclose(file) == 0;
+    }
+
+    void populate(uint32_t ids, uint32_t now)
+    {
+        for (uint32_t round = 0; round < 2; ++round)
+        {
+            for (uint32_t i = 0; i < ids; ++i)
+            {
+                CANMessage msg;
+                msg.timestamp = now - 3000 + round * 1000 + i % 1000;
+                msg.id = (i & 1) ? 0x18000000u + i * 7 : 0x100 + i;
+                msg.length = 8;
+                for (uint8_t b = 0; b < 8; ++b)
+                {
+                    // Second round changes a few bytes so highlights are rendered
+                    msg.data[b] = static_cast<uint8_t>(i * 31 + b + (round && b == i % 8 ? 1 : 0));
+                }
+                CanIngest::process(msg, (i & 1) != 0);
+            }
+        }
+        CanIngest::tick(now);
+    }
+}
+
+int runBenchCommand(int argc, char** argv)
+{
+    uint32_t ids = optionU32(argc, argv, "--ids", MAX_TRACKED_IDS);
+    uint32_t iterations = optionU32(argc, argv, "--iterations", 200);
+    uint32_t chunk = optionU32(argc, argv, "--chunk", 1436);
+    const char* tracePath = optionString(argc, argv, "--trace", nullptr);
+    const char* pattern = optionString(argc, argv, "--pattern", "?? ?? ?? 4?");
+    if (ids == 0 || ids > MAX_TRACKED_IDS || iterations == 0 || chunk == 0 || chunk > 65536)
+    {
+        fprintf(stderr, "--ids must be 1..%u; --iterations and --chunk (max 65536) must be non-zero\n",
+                MAX_TRACKED_IDS);
+        return 2;
+    }
+
+    if (!CanIngest::begin(500000, static_cast<uint16_t>(ids)) ||
+        !ViewRenderer::begin(BENCH_TEMPLATE, static_cast<uint16_t>(ids)))
+    {
+        fprintf(stderr, "Failed to allocate storage for %u IDs\n", ids);
+        return 1;
+    }
+
+#ifdef TRACE_EVENTS
+    if (tracePath && !Trace::begin(TRACE_EVENT_CAPACITY))
+    {
+        fprintf(stderr, "Failed to allocate trace ring\n");
+        return 1;
+    }
+#else
+    if (tracePath)
+    {
+        fprintf(stderr, "Built without TRACE_EVENTS; --trace is unavailable\n");
+        return 2;
+    }
+#endif
+
+    const uint32_t now = 100000;
+    populate(ids, now);
+
+    // Chunk size defaults to a typical TCP segment, as the web server fills
+    static uint8_t buffer[65536];
+    size_t bytes = 0;
+    uint32_t hash = 2166136261u;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        TRACE_SCOPE("GET /latest_messages");
+        ViewRenderer::Context* ctx = ViewRenderer::claim(ViewRenderer::View::LatestRows, HeapGuard::Scope::None, now);
+        while (true)
+        {
+            size_t written;
+            {
+                TRACE_SCOPE("fill");
+                written = ViewRenderer::fill(*ctx, buffer, chunk);
+            }
+            if (written == 0)
+            {
+                break;
+            }
+            bytes += written;
+            if (i == 0)
+            {
+                hash = hashBytes(hash, buffer, written);
+            }
+        }
+        ViewRenderer::release(ctx);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double us = std::chrono::duration<double, std::micro>(elapsed).count();
+
+    printf("/latest_messages over %u IDs, %u iterations, %u-byte chunks\n", ids, iterations, chunk);
+    printf("  %zu bytes per render, output hash %08x\n", bytes / iterations, hash);
+    printf("  %.1f us per render, %.1f ns per row, %.1f MB/s\n",
+           us / iterations, us * 1000.0 / (static_cast<double>(iterations) * ids), bytes / us);
+
+    // Full-table payload search, as /search runs it
+    PayloadSearch::Query query;
+    if (!PayloadSearch::parsePattern(pattern, strlen(pattern), query))
+    {
+        fprintf(stderr, "Invalid --pattern \"%s\"\n", pattern);
+        return 2;
+    }
+    static uint16_t matches[MAX_TRACKED_IDS];
+    uint16_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        found = PayloadSearch::run(query, matches, static_cast<uint16_t>(ids));
+    }
+    us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    printf("/search \"%s\": %u matches, %.2f us per search, %.1f ns per ID\n",
+           pattern, found, us / iterations, us * 1000.0 / (static_cast<double>(iterations) * ids));
+
+    // Boot-time settings load with every list full, as setup() decodes it
+    DeviceConfig::Settings settings;
+    settings.historyCount = HISTORY_WATCH_IDS;
+    settings.histogramCount = HISTOGRAM_IDS - HISTOGRAM_PAIRS;
+    settings.pairCount = HISTOGRAM_PAIRS;
+    for (uint8_t i = 0; i < HISTORY_WATCH_IDS; ++i)
+    {
+        settings.historyIds[i] = 0x100 + i;
+    }
+    for (uint8_t i = 0; i < settings.histogramCount; ++i)
+    {
+        settings.histogramIds[i] = 0x200 + i;
+    }
+    for (uint8_t i = 0; i < HISTOGRAM_PAIRS; ++i)
+    {
+        settings.pairs[i] = { 0x300u + i, 0, 1 };
+    }
+    uint8_t blob[DeviceConfig::MAX_BLOB_BYTES];
+    size_t blobLength = DeviceConfig::encode(settings, blob, sizeof(blob));
+    uint32_t decoded = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        decoded += DeviceConfig::decode(blob, blobLength, settings);
+    }
+    us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    printf("Settings blob: %zu bytes, %.0f ns per decode (%u decoded)\n", blobLength, us * 1000.0 / iterations,
+           decoded);
+
+    if (tracePath)
+    {
+        if (!writeTrace(tracePath))
+        {
+            fprintf(stderr, "Failed to write %s\n", tracePath);
+            return 1;
+        }
+        printf("  trace: last %u of %u events written to %s\n",
+               std::min(Trace::recorded(), Trace::capacity()), Trace::recorded(), tracePath);
+    }
+    return 0;
+}
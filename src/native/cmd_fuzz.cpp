@@ -0,0 +1,231 @@
+#include "host_commands.h"
+#include "host_options.h"
+#include "fuzz_targets.h"
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+    constexpr size_t POOL_SIZE = 64;
+
+    using Input = std::vector<uint8_t>;
+
+    uint32_t g_random = 1;
+
+    uint32_t nextRandom()
+    {
+        // xorshift32; the same seed always produces the same inputs
+        g_random ^= g_random << 13;
+        g_random ^= g_random >> 17;
+        g_random ^= g_random << 5;
+        return g_random;
+    }
+
+    uint32_t below(uint32_t limit)
+    {
+        return limit ? nextRandom() % limit : 0;
+    }
+
+    size_t countList(const char* const* list)
+    {
+        size_t count = 0;
+        while (list[count])
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    Input fromText(const char* text)
+    {
+        return Input(text, text + strlen(text));
+    }
+
+    // One random edit: bit flip, random or boundary byte, dictionary token,
+    // deletion or duplication of a range
+    void mutate(Input& input, const FuzzTarget& target, size_t maxLength)
+    {
+        static const uint8_t INTERESTING[] = { 0, 0x7F, 0x80, 0xFF, '0', '9', 'f', 'x', ' ', '"', ',', '%' };
+        size_t size = input.size();
+        switch (below(6))
+        {
+        case 0:
+            if (size)
+            {
+                input[below(size)] ^= static_cast<uint8_t>(1u << below(8));
+            }
+            break;
+        case 1:
+            if (size)
+            {
+                input[below(size)] = static_cast<uint8_t>(nextRandom());
+            }
+            break;
+        case 2:
+            input.insert(input.begin() + below(size + 1), INTERESTING[below(sizeof(INTERESTING))]);
+            break;
+        case 3:
+        {
+            const char* token = target.dictionary[below(countList(target.dictionary))];
+            input.insert(input.begin() + below(size + 1), token, token + strlen(token));
+            break;
+        }
+        case 4:
+            if (size)
+            {
+                size_t start = below(size);
+                input.erase(input.begin() + start, input.begin() + start + 1 + below(size - start));
+            }
+            break;
+        case 5:
+            if (size)
+            {
+                size_t start = below(size);
+                Input range(input.begin() + start, input.begin() + start + 1 + below(size - start));
+                input.insert(input.begin() + below(size + 1), range.begin(), range.end());
+            }
+            break;
+        }
+        if (input.size() > maxLength)
+        {
+            input.resize(maxLength);
+        }
+    }
+
+    struct Result
+    {
+        uint64_t execs = 0;
+        uint64_t accepted = 0;
+        uint64_t bytes = 0;
+        double parseSeconds = 0;
+    };
+
+    // Each input is copied into an allocation of exactly its size so the
+    // sanitizers catch reads past the end
+    bool runOnce(const FuzzTarget& target, const Input& input, Result& result)
+    {
+        std::unique_ptr<uint8_t[]> exact(new uint8_t[input.size() ? input.size() : 1]);
+        if (!input.empty())
+        {
+            memcpy(exact.get(), input.data(), input.size());
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool accepted = target.run(exact.get(), input.size());
+        result.parseSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ++result.execs;
+        result.accepted += accepted;
+        result.bytes += input.size();
+        return accepted;
+    }
+
+    // Mutates seeds and inputs found to be accepted; the pool of accepted
+    // inputs lets edits build on each other without coverage feedback
+    Result fuzz(const FuzzTarget& target, uint32_t iterations, size_t maxLength)
+    {
+        Result result;
+        std::vector<Input> pool;
+        for (size_t i = 0; target.seeds[i]; ++i)
+        {
+            pool.push_back(fromText(target.seeds[i]));
+            runOnce(target, pool.back(), result);
+        }
+        size_t seedCount = pool.size();
+
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            Input input = pool[below(pool.size())];
+            for (uint32_t edits = 1 + below(4); edits > 0; --edits)
+            {
+                mutate(input, target, maxLength);
+            }
+            if (runOnce(target, input, result))
+            {
+                if (pool.size() < seedCount + POOL_SIZE)
+                {
+                    pool.push_back(input);
+                }
+                else
+                {
+                    pool[seedCount + below(POOL_SIZE)] = input;
+                }
+            }
+        }
+        return result;
+    }
+
+    int runInputFile(const FuzzTarget& target, const char* path)
+    {
+        FILE* file = fopen(path, "rb");
+        if (!file)
+        {
+            fprintf(stderr, "Cannot open %s\n", path);
+            return 1;
+        }
+        Input input;
+        uint8_t buffer[4096];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            input.insert(input.end(), buffer, buffer + read);
+        }
+        fclose(file);
+
+        Result result;
+        bool accepted = runOnce(target, input, result);
+        printf("%s: %zu bytes %s\n", target.name, input.size(), accepted ? "accepted" : "rejected");
+        return 0;
+    }
+}
+
+// Runs the parser fuzz targets with a simple mutation engine and reports
+// parser throughput. Build the native_asan environment to have memory
+// errors caught; any violated invariant aborts with the target's name.
+int runFuzzCommand(int argc, char** argv)
+{
+    const char* name = optionString(argc, argv, "--target", "all");
+    uint32_t iterations = optionU32(argc, argv, "--iterations", 100000);
+    uint32_t seed = optionU32(argc, argv, "--seed", 1);
+    uint32_t maxLength = optionU32(argc, argv, "--max-len", 1024);
+    const char* inputPath = optionString(argc, argv, "--input", nullptr);
+
+    size_t count;
+    const FuzzTarget* targets = fuzzTargets(count);
+    const FuzzTarget* selected = strcmp(name, "all") == 0 ? nullptr : findFuzzTarget(name);
+    if ((!selected && strcmp(name, "all") != 0) || (inputPath && !selected) || maxLength == 0)
+    {
+        fprintf(stderr, "usage: fuzz [--target NAME|all] [--iterations N] [--seed S] [--max-len BYTES]\n"
+                        "       fuzz --target NAME --input FILE\n\ntargets:\n");
+        for (size_t i = 0; i < count; ++i)
+        {
+            fprintf(stderr, "  %-10s %s\n", targets[i].name, targets[i].description);
+        }
+        return 2;
+    }
+    if (!setupFuzzTargets())
+    {
+        fprintf(stderr, "Failed to allocate storage\n");
+        return 1;
+    }
+    if (inputPath)
+    {
+        return runInputFile(*selected, inputPath);
+    }
+
+    printf("%-10s %10s %10s %10s %12s\n", "target", "execs", "accepted", "ns/exec", "parser MB/s");
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (selected && selected != &targets[i])
+        {
+            continue;
+        }
+        g_random = seed ? seed : 1;
+        Result result = fuzz(targets[i], iterations, maxLength);
+        printf("%-10s %10llu %10llu %10.1f %12.1f\n", targets[i].name, static_cast<unsigned long long>(result.execs),
+               static_cast<unsigned long long>(result.accepted), result.parseSeconds * 1e9 / result.execs,
+               result.parseSeconds > 0 ? result.bytes / result.parseSeconds / 1e6 : 0.0);
+    }
+    return 0;
+}
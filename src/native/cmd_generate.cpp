@@ -0,0 +1,162 @@
+#include "host_commands.h"
+#include "host_options.h"
+#include "can_ingest.h"
+#include "can_stats.h"
+#include "state_table.h"
+#include "view_render.h"
+#include "frame_stream.h"
+#include "traffic_generator.h"
+#include "clock.h"
+#include "candump.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    constexpr const char* GENERATE_TEMPLATE = "%LATEST_MESSAGES%";
+    constexpr uint16_t POLL_BATCH = 256;
+    constexpr uint32_t STREAM_INTERVAL_US = 50000;   // As the firmware's stream task
+    constexpr uint64_t CANDUMP_EPOCH_US = 1700000000ull * 1000000;
+
+    void writeCandump(FILE* file, const TrafficGenerator::Frame& generated)
+    {
+        CandumpFrame frame;
+        frame.timestampUs = CANDUMP_EPOCH_US + generated.dueUs;
+        frame.id = generated.msg.id;
+        frame.extended = generated.extended;
+        frame.length = generated.msg.length;
+        memcpy(frame.data, generated.msg.data, 8);
+        char line[64];
+        size_t length = formatCandumpLine(line, sizeof(line), frame, "vcan0");
+        line[length] = '\n';
+        fwrite(line, 1, length + 1, file);
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+// Feeds generated traffic straight into the ingest path on a simulated
+// clock, as fast as the host allows. The latest view is rendered at a fixed
+// simulated interval like the web UI polls it, and the stream queue is
+// drained as often as the firmware's sender does.
+int runGenerateCommand(int argc, char** argv)
+{
+    const char* profile = optionString(argc, argv, "--profile", "preset=steady");
+    uint32_t seconds = optionU32(argc, argv, "--seconds", 60);
+    uint32_t bitrate = optionU32(argc, argv, "--bitrate", 500000);
+    uint32_t renderMs = optionU32(argc, argv, "--render-ms", 1000);
+    uint32_t maxIds = optionU32(argc, argv, "--max-ids", MAX_TRACKED_IDS);
+    const char* candumpPath = optionString(argc, argv, "--candump", nullptr);
+    if (seconds == 0 || maxIds == 0 || maxIds > 0xFFFF)
+    {
+        fprintf(stderr, "--seconds and --max-ids must be non-zero\n");
+        return 2;
+    }
+
+    if (!CanIngest::begin(bitrate, static_cast<uint16_t>(maxIds)) ||
+        !ViewRenderer::begin(GENERATE_TEMPLATE, static_cast<uint16_t>(maxIds)) ||
+        !FrameStream::begin(4096) || !TrafficGenerator::begin(0xFFFF))
+    {
+        fprintf(stderr, "Failed to allocate storage\n");
+        return 1;
+    }
+    if (!TrafficGenerator::configure(profile, bitrate))
+    {
+        fprintf(stderr, "Invalid profile \"%s\": %s\n", profile, TrafficGenerator::lastError());
+        return 2;
+    }
+    FILE* candump = nullptr;
+    if (candumpPath && !(candump = fopen(candumpPath, "w")))
+    {
+        fprintf(stderr, "Cannot create %s\n", candumpPath);
+        return 1;
+    }
+
+    static TrafficGenerator::Frame frames[POLL_BATCH];
+    static uint8_t chunk[4096];
+    uint64_t renderBytes = 0;
+    uint64_t streamBytes = 0;
+    uint32_t renders = 0;
+    double renderSeconds = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    const uint64_t endUs = static_cast<uint64_t>(seconds) * 1000000;
+    uint64_t nextRenderUs = static_cast<uint64_t>(renderMs) * 1000;
+    uint64_t nextStreamUs = STREAM_INTERVAL_US;
+    Clock::simulate(0);
+    for (uint64_t nowUs = 0; nowUs <= endUs; nowUs += 1000)
+    {
+        Clock::setSimulated(nowUs);
+        uint16_t count;
+        do
+        {
+            count = TrafficGenerator::poll(Clock::micros(), frames, POLL_BATCH);
+            for (uint16_t i = 0; i < count; ++i)
+            {
+                uint32_t dueUs = static_cast<uint32_t>(frames[i].dueUs);
+                if (CanIngest::process(frames[i].msg, frames[i].extended))
+                {
+                    FrameStream::push(frames[i].msg, frames[i].extended, dueUs, dueUs);
+                }
+                if (candump)
+                {
+                    writeCandump(candump, frames[i]);
+                }
+            }
+        } while (count == POLL_BATCH);
+        CanIngest::tick(Clock::millis());
+
+        if (nowUs >= nextStreamUs)
+        {
+            nextStreamUs += STREAM_INTERVAL_US;
+            size_t length;
+            while ((length = FrameStream::encodeBatch(chunk, sizeof(chunk), 64, Clock::micros())) > 0)
+            {
+                streamBytes += length;
+            }
+        }
+
+        if (renderMs && nowUs >= nextRenderUs)
+        {
+            nextRenderUs += static_cast<uint64_t>(renderMs) * 1000;
+            auto renderStart = std::chrono::steady_clock::now();
+            ViewRenderer::Context* ctx = ViewRenderer::claim(ViewRenderer::View::LatestRows, HeapGuard::Scope::None,
+                                                             Clock::millis());
+            size_t written;
+            while ((written = ViewRenderer::fill(*ctx, chunk, sizeof(chunk))) > 0)
+            {
+                renderBytes += written;
+            }
+            ViewRenderer::release(ctx);
+            renderSeconds += secondsSince(renderStart);
+            ++renders;
+        }
+    }
+    double wall = secondsSince(start);
+    if (candump)
+    {
+        fclose(candump);
+    }
+    uint64_t generated = TrafficGenerator::generated();
+
+    printf("profile: %s\n", profile);
+    printf("%u simulated s at %u bit/s, %u IDs, expected load %.1f%%\n", seconds, bitrate,
+           TrafficGenerator::idCount(), TrafficGenerator::expectedLoadPermille() / 10.0);
+    printf("  %llu frames (%llu skipped), %.0f frames/s simulated\n", static_cast<unsigned long long>(generated),
+           static_cast<unsigned long long>(TrafficGenerator::skipped()), generated / static_cast<double>(seconds));
+    printf("  wall %.3f s: %.0f frames/s, %.0fx real time\n", wall, generated / wall, seconds / wall);
+    printf("  state table %u/%u IDs, %u evictions, last window load %.1f%%\n", StateTable::size(),
+           StateTable::capacity(), StateTable::evictions(), CanStatistics::busLoadPermille() / 10.0);
+    if (renders)
+    {
+        printf("  %u renders: %.1f us each, %llu bytes rendered\n", renders, renderSeconds * 1e6 / renders,
+               static_cast<unsigned long long>(renderBytes));
+    }
+    printf("  stream: %llu bytes, %u frames dropped\n", static_cast<unsigned long long>(streamBytes),
+           FrameStream::dropped());
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "host_commands.h"
+#include "host_options.h"
+#include "stream_source.h"
+#include "frame_writer.h"
+#include "frame_codec.h"
+#include <chrono>
+#include <memory>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr uint32_t DEFAULT_RING_FRAMES = 65536;
+    constexpr uint32_t DEFAULT_HOLD_MS = 200;
+    constexpr auto IDLE_WAIT = std::chrono::microseconds(200);
+
+    volatile sig_atomic_t g_stop = 0;
+
+    void onSignal(int)
+    {
+        g_stop = 1;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void printSummary(StreamSource& source, const std::string& interface)
+    {
+        const StreamTimeline& timeline = source.timeline();
+        fprintf(stderr, "%s -> %s: %llu frames, %llu lost", source.location(), interface.c_str(),
+                static_cast<unsigned long long>(timeline.frames()), static_cast<unsigned long long>(timeline.lost()));
+        if (!timeline.hasClock())
+        {
+            fprintf(stderr, ", no clock messages, left on its own clock\n");
+            return;
+        }
+        const FrameCodec::ClockRecord& clock = timeline.clock();
+        fprintf(stderr, ", device %u, ", clock.deviceId);
+        switch (clock.state)
+        {
+        case FrameCodec::ClockState::Reference:
+            fprintf(stderr, "reference clock\n");
+            break;
+        case FrameCodec::ClockState::Unsynced:
+            fprintf(stderr, "never synced, left on its own clock\n");
+            break;
+        case FrameCodec::ClockState::Synced:
+            fprintf(stderr, "offset %lld us, drift %.3f ppm, delay %u us\n", static_cast<long long>(clock.offsetUs),
+                    clock.driftPpb / 1000.0, clock.delayUs);
+            break;
+        }
+    }
+}
+
+// Merges the streams of several monitors into one log on the reference
+// clock. An input is a recorded stream (serve --capture, or the binary
+// /stream messages of one WebSocket connection written back to back) or a
+// live monitor, ws://host[:port][/path]; their ClockSync messages carry each
+// device's offset and drift. Every input has a reader thread and a ring of
+// its own; this thread only picks the earliest head frame and writes it.
+// Each device sends its frames in time order, so the heads are enough. A
+// live input with nothing queued holds the others back for up to --hold-ms,
+// then frames go out without it.
+int runMergeCommand(int argc, char** argv)
+{
+    const char* outputPath = optionString(argc, argv, "--out", nullptr);
+    const char* interfaces = optionString(argc, argv, "--interfaces", nullptr);
+    const char* formatName = optionString(argc, argv, "--format", "candump");
+    uint32_t ringFrames = optionU32(argc, argv, "--ring", DEFAULT_RING_FRAMES);
+    uint32_t holdMs = optionU32(argc, argv, "--hold-ms", DEFAULT_HOLD_MS);
+
+    std::vector<const char*> locations;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--", 2) == 0)
+        {
+            ++i;    // Every option takes a value
+            continue;
+        }
+        locations.push_back(argv[i]);
+    }
+    FrameWriter::Format format;
+    if (locations.empty() || locations.size() > 255 || !FrameWriter::parseFormat(formatName, format) ||
+        ringFrames == 0 || ringFrames > (1u << 24))
+    {
+        fprintf(stderr, "usage: merge [--out FILE] [--format candump|pcapng|columnar] [--interfaces can0,can1,...]\n"
+                        "       [--ring FRAMES] [--hold-ms MS] INPUT...\n"
+                        "  INPUT is a recorded stream file or ws://host[:port][/path]\n");
+        return 2;
+    }
+
+    std::vector<std::string> names;
+    const char* next = interfaces ? interfaces : "";
+    for (size_t i = 0; i < locations.size(); ++i)
+    {
+        const char* comma = strchr(next, ',');
+        size_t length = comma ? static_cast<size_t>(comma - next) : strlen(next);
+        names.push_back(length > 0 ? std::string(next, length) : "can" + std::to_string(i));
+        next += comma ? length + 1 : length;
+    }
+
+    std::vector<std::unique_ptr<StreamSource>> sources;
+    for (const char* location : locations)
+    {
+        sources.emplace_back(new StreamSource());
+        if (!sources.back()->open(location, ringFrames))
+        {
+            return 1;
+        }
+    }
+    FrameWriter writer;
+    if (!writer.open(outputPath, format, names))
+    {
+        return 1;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    auto start = std::chrono::steady_clock::now();
+    for (std::unique_ptr<StreamSource>& source : sources)
+    {
+        source->start();
+    }
+
+    const size_t count = sources.size();
+    std::vector<bool> ended(count, false);
+    std::vector<bool> empty(count, false);
+    std::vector<std::chrono::steady_clock::time_point> emptySince(count);
+    size_t remaining = count;
+    bool stopping = false;
+    uint64_t written = 0;
+    uint64_t outOfOrder = 0;
+    int64_t lastUs = INT64_MIN;
+    while (remaining > 0)
+    {
+        if (g_stop && !stopping)
+        {
+            stopping = true;
+            for (std::unique_ptr<StreamSource>& source : sources)
+            {
+                source->stop();
+            }
+        }
+
+        int pick = -1;
+        const StreamTimeline::Frame* best = nullptr;
+        bool blocked = false;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (ended[i])
+            {
+                continue;
+            }
+            const StreamTimeline::Frame* head = sources[i]->front();
+            if (!head)
+            {
+                if (sources[i]->finished())
+                {
+                    ended[i] = true;
+                    --remaining;
+                    continue;
+                }
+                if (!empty[i])
+                {
+                    empty[i] = true;
+                    emptySince[i] = std::chrono::steady_clock::now();
+                }
+                if (!sources[i]->live() || secondsSince(emptySince[i]) * 1000 < holdMs)
+                {
+                    blocked = true;
+                }
+                continue;
+            }
+            empty[i] = false;
+            if (!best || head->referenceUs < best->referenceUs)
+            {
+                best = head;
+                pick = static_cast<int>(i);
+            }
+        }
+        if (blocked || !best)
+        {
+            std::this_thread::sleep_for(IDLE_WAIT);
+            continue;
+        }
+
+        outOfOrder += best->referenceUs < lastUs;
+        lastUs = best->referenceUs;
+        writer.write(static_cast<uint8_t>(pick), *best);
+        sources[pick]->pop();
+        ++written;
+    }
+    double seconds = secondsSince(start);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    uint64_t bytes = 0;
+    bool failed = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        sources[i]->join();
+        printSummary(*sources[i], names[i]);
+        bytes += sources[i]->bytes();
+        failed = failed || sources[i]->failed();
+    }
+    if (!writer.close())
+    {
+        fprintf(stderr, "Failed to write %s\n", outputPath ? outputPath : "the output");
+        return 1;
+    }
+    // A clock correction can move a device's next frames back a little;
+    // they are written as they come rather than held back for reordering
+    fprintf(stderr, "%llu frames merged in %.3f s (%.0f frames/s, %.1f MB/s of stream)",
+            static_cast<unsigned long long>(written), seconds, seconds > 0 ? written / seconds : 0.0,
+            seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+    if (outOfOrder > 0)
+    {
+        fprintf(stderr, ", %llu out of order", static_cast<unsigned long long>(outOfOrder));
+    }
+    fprintf(stderr, "\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,76 @@
+#include "host_commands.h"
+#include "host_options.h"
+#include "payload_fuzzer.h"
+#include "candump.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    constexpr uint32_t DEFAULT_FRAMES = 100;
+    constexpr size_t MAX_INTERFACE_LENGTH = 15;      // IFNAMSIZ less the terminator
+    constexpr uint64_t CANDUMP_EPOCH_US = 1700000000ull * 1000000;
+}
+
+// Lists the frames of a payload fuzzing plan as a candump log, from any
+// index on: the index an event of GET /fuzz names comes out exactly as the
+// device sent it. Timestamps follow the plan's rate; with rate=0 the bus set
+// the pace and the frames are 1 us apart.
+int runPayloadsCommand(int argc, char** argv)
+{
+    const char* planText = optionString(argc, argv, "--plan", nullptr);
+    uint32_t from = optionU32(argc, argv, "--from", 0);
+    const char* outputPath = optionString(argc, argv, "--out", nullptr);
+    const char* interface = optionString(argc, argv, "--interface", "vcan0");
+    if (!planText || strlen(interface) > MAX_INTERFACE_LENGTH)
+    {
+        fprintf(stderr, "usage: payloads --plan PLAN [--from INDEX] [--frames N] [--out FILE] [--interface NAME]\n");
+        return 2;
+    }
+    PayloadFuzzer::Plan plan;
+    if (!PayloadFuzzer::parsePlan(planText, plan))
+    {
+        fprintf(stderr, "Invalid plan \"%s\": %s\n", planText, PayloadFuzzer::lastError());
+        return 2;
+    }
+    // By default the rest of a bounded run, or the next 100 frames
+    uint32_t remaining = plan.count > from ? plan.count - from : 0;
+    uint32_t frames = optionU32(argc, argv, "--frames", plan.count != 0 ? remaining : DEFAULT_FRAMES);
+    if (plan.count != 0 && frames > remaining)
+    {
+        frames = remaining;
+    }
+
+    FILE* out = stdout;
+    if (outputPath && !(out = fopen(outputPath, "w")))
+    {
+        fprintf(stderr, "Cannot create %s\n", outputPath);
+        return 1;
+    }
+    char line[128];
+    for (uint32_t i = 0; i < frames; ++i)
+    {
+        uint64_t index = static_cast<uint64_t>(from) + i;
+        if (index > UINT32_MAX)
+        {
+            break;
+        }
+        PayloadFuzzer::Frame generated;
+        PayloadFuzzer::generate(plan, static_cast<uint32_t>(index), generated);
+        CandumpFrame frame;
+        frame.timestampUs = CANDUMP_EPOCH_US + (plan.rate != 0 ? index * 1000000 / plan.rate : index);
+        frame.id = generated.id;
+        frame.extended = generated.extended;
+        frame.length = generated.length;
+        memcpy(frame.data, generated.data, 8);
+        size_t length = formatCandumpLine(line, sizeof(line), frame, interface);
+        line[length] = '\n';
+        fwrite(line, 1, length + 1, out);
+    }
+    if (out != stdout && fclose(out) != 0)
+    {
+        fprintf(stderr, "Failed to write %s\n", outputPath);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include "host_commands.h"
+#include "host_options.h"
+#include "candump.h"
+#include "can_ingest.h"
+#include "state_table.h"
+#include "view_render.h"
+#include "clock.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+namespace
+{
+    constexpr const char* REPLAY_TEMPLATE = "%LATEST_MESSAGES%";
+
+    struct Snapshots
+    {
+        FILE* output = nullptr;
+        uint32_t count = 0;
+        uint64_t bytes = 0;
+        uint32_t hash = 2166136261u;
+    };
+
+    // Renders the latest view at the current simulated time into the hash
+    // (and the output file), as a browser polling the device would see it
+    void snapshot(Snapshots& snapshots)
+    {
+        static uint8_t chunk[4096];
+        if (snapshots.output)
+        {
+            fprintf(snapshots.output, "# t=%lu ms\n", static_cast<unsigned long>(Clock::millis()));
+        }
+        ViewRenderer::Context* ctx = ViewRenderer::claim(ViewRenderer::View::LatestRows, HeapGuard::Scope::None,
+                                                         Clock::millis());
+        size_t written;
+        while ((written = ViewRenderer::fill(*ctx, chunk, sizeof(chunk))) > 0)
+        {
+            for (size_t i = 0; i < written; ++i)
+            {
+                snapshots.hash = (snapshots.hash ^ chunk[i]) * 16777619u;
+            }
+            if (snapshots.output)
+            {
+                fwrite(chunk, 1, written, snapshots.output);
+            }
+            snapshots.bytes += written;
+        }
+        ViewRenderer::release(ctx);
+        ++snapshots.count;
+    }
+}
+
+// Replays a candump log through the full ingest and render pipeline on the
+// simulated clock. Log time starts at 0, so output only depends on the log.
+int runReplayCommand(int argc, char** argv)
+{
+    const char* logPath = optionString(argc, argv, "--log", nullptr);
+    const char* outputPath = optionString(argc, argv, "--output", nullptr);
+    uint32_t speed = optionU32(argc, argv, "--speed", 0);
+    uint32_t snapshotMs = optionU32(argc, argv, "--snapshot-ms", 1000);
+    uint32_t bitrate = optionU32(argc, argv, "--bitrate", 500000);
+    uint32_t maxIds = optionU32(argc, argv, "--max-ids", MAX_TRACKED_IDS);
+    if (!logPath || snapshotMs == 0 || maxIds == 0 || maxIds > MAX_TRACKED_IDS)
+    {
+        fprintf(stderr, "usage: replay --log FILE [--speed N (0 = unpaced)] [--snapshot-ms MS] [--output FILE]\n"
+                        "       [--bitrate BPS] [--max-ids N (max %u)]\n", MAX_TRACKED_IDS);
+        return 2;
+    }
+
+    FILE* log = strcmp(logPath, "-") == 0 ? stdin : fopen(logPath, "r");
+    if (!log)
+    {
+        fprintf(stderr, "Cannot open %s\n", logPath);
+        return 1;
+    }
+    Snapshots snapshots;
+    if (outputPath && !(snapshots.output = fopen(outputPath, "w")))
+    {
+        fprintf(stderr, "Cannot create %s\n", outputPath);
+        return 1;
+    }
+    if (!CanIngest::begin(bitrate, static_cast<uint16_t>(maxIds)) ||
+        !ViewRenderer::begin(REPLAY_TEMPLATE, static_cast<uint16_t>(maxIds)))
+    {
+        fprintf(stderr, "Failed to allocate storage\n");
+        return 1;
+    }
+
+    Clock::simulate(0);
+    const uint64_t snapshotUs = static_cast<uint64_t>(snapshotMs) * 1000;
+    uint64_t nextSnapshotUs = snapshotUs;
+    uint64_t firstUs = 0;
+    uint64_t frames = 0;
+    uint64_t rejected = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    char line[512];
+    while (fgets(line, sizeof(line), log))
+    {
+        CandumpFrame frame;
+        if (!parseCandumpLine(line, strlen(line), frame))
+        {
+            ++rejected;
+            continue;
+        }
+        if (frames == 0)
+        {
+            firstUs = frame.timestampUs;
+        }
+        // Logs merged from several interfaces can step back slightly
+        uint64_t t = frame.timestampUs > firstUs ? frame.timestampUs - firstUs : 0;
+        if (t < Clock::nowUs())
+        {
+            t = Clock::nowUs();
+        }
+
+        while (nextSnapshotUs <= t)
+        {
+            Clock::setSimulated(nextSnapshotUs);
+            CanIngest::tick(Clock::millis());
+            snapshot(snapshots);
+            nextSnapshotUs += snapshotUs;
+        }
+        Clock::setSimulated(t);
+        if (speed)
+        {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(t / speed));
+        }
+
+        CANMessage msg;
+        msg.timestamp = Clock::millis();
+        msg.id = frame.id;
+        msg.length = frame.remote ? 0 : frame.length;
+        memcpy(msg.data, frame.data, 8);
+        CanIngest::tick(msg.timestamp);
+        CanIngest::process(msg, frame.extended);
+        ++frames;
+    }
+    snapshot(snapshots);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double simulated = Clock::nowUs() / 1e6;
+
+    if (log != stdin)
+    {
+        fclose(log);
+    }
+    if (snapshots.output)
+    {
+        fclose(snapshots.output);
+    }
+
+    printf("%llu frames (%llu lines rejected) over %.1f s of log time\n", static_cast<unsigned long long>(frames),
+           static_cast<unsigned long long>(rejected), simulated);
+    printf("  wall %.3f s, %.0fx real time\n", wall, wall > 0 ? simulated / wall : 0.0);
+    printf("  %u IDs, %u evictions\n", StateTable::size(), StateTable::evictions());
+    printf("  %u snapshots, %llu bytes, hash %08x\n", snapshots.count,
+           static_cast<unsigned long long>(snapshots.bytes), snapshots.hash);
+    return 0;
+}
@@ -0,0 +1,649 @@
+#include "host_commands.h"
+#include "host_options.h"
+#include "http_server.h"
+#include "sync_socket.h"
+#include "can_ingest.h"
+#include "state_table.h"
+#include "view_render.h"
+#include "request_parser.h"
+#include "traffic_generator.h"
+#include "rate_history.h"
+#include "top_ids.h"
+#include "view_order.h"
+#include "byte_histogram.h"
+#include "device_config.h"
+#include "web_routes.h"
+#include "web_page.h"
+#include "heap_guard.h"
+#include "trace.h"
+#include "clock.h"
+#include "frame_stream.h"
+#include "time_sync.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr uint16_t POLL_BATCH = 256;
+    constexpr int IDLE_MS = 1;
+    constexpr uint32_t HISTOGRAM_MAX_US = 100000;    // Slower requests share the last bucket
+    constexpr size_t FILL_CHUNK = 1436;              // About what the device's TCP stack offers per call
+    constexpr uint16_t CAPTURE_QUEUE_FRAMES = 8192;
+    constexpr uint64_t CAPTURE_CLOCK_INTERVAL_US = 1000000;
+
+    struct RouteStats
+    {
+        uint64_t requests = 0;
+        uint64_t errors = 0;         // Status 400 and above
+        uint64_t bytes = 0;
+        uint64_t totalUs = 0;
+        std::vector<uint32_t> histogram = std::vector<uint32_t>(HISTOGRAM_MAX_US + 1);
+
+        uint32_t percentileUs(uint32_t percentile) const
+        {
+            uint64_t target = (requests * percentile + 99) / 100;
+            uint64_t seen = 0;
+            for (uint32_t us = 0; us <= HISTOGRAM_MAX_US; ++us)
+            {
+                seen += histogram[us];
+                if (seen >= target && seen > 0)
+                {
+                    return us;
+                }
+            }
+            return HISTOGRAM_MAX_US;
+        }
+    };
+
+    struct Route
+    {
+        const char* method;
+        const char* path;
+        HeapGuard::Scope scope;
+        void (*handle)(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope);
+        RouteStats stats;
+    };
+
+    volatile sig_atomic_t g_stop = 0;
+    TrafficGenerator::Frame g_frames[POLL_BATCH];
+    uint64_t g_transmitted = 0;
+    uint32_t g_reportSeconds = 0;
+    const char* g_configPath = nullptr;     // Stands in for NVS; nullptr keeps settings in memory only
+    std::chrono::steady_clock::time_point g_lastReport;
+    SyncSocket g_sync;
+    FILE* g_capture = nullptr;              // The /stream messages a client would have recorded
+    uint32_t g_deviceId = 0;
+    uint64_t g_lastClockUs = 0;
+    bool g_clockWritten = false;
+
+    // A clock that is off by a fixed offset and runs fast or slow, as a
+    // second device's would; --clock-offset-us and --clock-drift-ppm
+    int64_t g_clockOffsetUs = 0;
+    double g_clockRate = 1.0;
+    uint64_t g_clockStartUs = 0;
+
+    uint64_t steadyNowUs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    uint64_t skewedNowUs()
+    {
+        uint64_t elapsed = steadyNowUs() - g_clockStartUs;
+        return g_clockStartUs + static_cast<uint64_t>(elapsed * g_clockRate) + g_clockOffsetUs;
+    }
+
+    // With a sync peer the capture starts once the clock is synced, so every
+    // frame in it can be put on the reference clock
+    bool capturing()
+    {
+        return g_capture && TimeSync::estimate().state != TimeSync::State::Unsynced;
+    }
+
+    // Streams a view into the response in pieces of the size the device's
+    // server would ask for, so per-fill overhead is measured as well
+    void sendView(HttpResponse& response, ViewRenderer::Context* ctx, const char* contentType)
+    {
+        if (!ctx)
+        {
+            response.begin(503, "text/plain");
+            response.append("Busy, try again");
+            return;
+        }
+        response.begin(200, contentType);
+        uint8_t chunk[FILL_CHUNK];
+        size_t written;
+        while ((written = ViewRenderer::fill(*ctx, chunk, sizeof(chunk))) > 0)
+        {
+            response.append(chunk, written);
+        }
+        ViewRenderer::release(ctx);
+    }
+
+    // WebRoutes reads the query of a GET and the form body of a POST, as the
+    // device's server does. Decoded values stay with the source until the
+    // route returns.
+    struct RouteSource
+    {
+        HttpRequest params;
+        std::deque<std::string> values;
+
+        explicit RouteSource(const HttpRequest& request) : params(request)
+        {
+            if (request.methodLength == 4 && memcmp(request.method, "POST", 4) == 0)
+            {
+                params.query = request.body;
+                params.queryLength = request.bodyLength;
+            }
+        }
+    };
+
+    bool lookupParam(void* source, const char* name, RequestParser::Param& value)
+    {
+        RouteSource& route = *static_cast<RouteSource*>(source);
+        std::string text;
+        if (!route.params.queryParam(name, text))
+        {
+            return false;
+        }
+        route.values.push_back(std::move(text));
+        value.data = route.values.back().data();
+        value.length = route.values.back().size();
+        return true;
+    }
+
+    WebRoutes::Request routeRequest(RouteSource& source)
+    {
+        WebRoutes::Request routed;
+        routed.lookup = lookupParam;
+        routed.source = &source;
+        return routed;
+    }
+
+    void sendReply(HttpResponse& response, const WebRoutes::Reply& reply)
+    {
+        response.begin(reply.status, reply.contentType);
+        response.append(reply.body, reply.length);
+    }
+
+    template <typename Export, size_t (*Fill)(Export&, uint8_t*, size_t)>
+    void sendExport(HttpResponse& response, Export& exp)
+    {
+        response.begin(200, "application/json");
+        uint8_t chunk[FILL_CHUNK];
+        size_t written;
+        while ((written = Fill(exp, chunk, sizeof(chunk))) > 0)
+        {
+            response.append(chunk, written);
+        }
+    }
+
+    void handlePage(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        sendView(response, ViewRenderer::claim(ViewRenderer::View::Page, scope, Clock::millis()), "text/html");
+    }
+
+    void handleIdList(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        sendView(response, ViewRenderer::claim(ViewRenderer::View::IdListJson, scope, Clock::millis()),
+                 "application/json");
+    }
+
+    // The views, exports and settings routes are the device's own, in WebRoutes
+    template <bool (*Route)(const WebRoutes::Request&, HeapGuard::Scope, uint32_t, ViewRenderer::Context*&,
+                            WebRoutes::Reply&)>
+    void handleView(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope,
+                    const char* contentType)
+    {
+        RouteSource source(request);
+        ViewRenderer::Context* ctx = nullptr;
+        WebRoutes::Reply reply;
+        if (Route(routeRequest(source), scope, Clock::millis(), ctx, reply))
+        {
+            sendView(response, ctx, contentType);
+        }
+        else
+        {
+            sendReply(response, reply);
+        }
+    }
+
+    void handleLatest(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        handleView<WebRoutes::latest>(request, response, scope, "text/html");
+    }
+
+    void handleFiltered(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        handleView<WebRoutes::filtered>(request, response, scope, "text/html");
+    }
+
+    void handleSearch(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        handleView<WebRoutes::search>(request, response, scope, "application/json");
+    }
+
+    void handleHistory(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        RouteSource source(request);
+        RateHistory::Export exp;
+        WebRoutes::Reply reply;
+        if (WebRoutes::history(routeRequest(source), exp, reply))
+        {
+            sendExport<RateHistory::Export, RateHistory::fill>(response, exp);
+        }
+        else
+        {
+            sendReply(response, reply);
+        }
+    }
+
+    void handleTop(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        RouteSource source(request);
+        TopIds::Export exp;
+        WebRoutes::top(routeRequest(source), exp);
+        sendExport<TopIds::Export, TopIds::fill>(response, exp);
+    }
+
+    void handleHistogram(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        RouteSource source(request);
+        ByteHistogram::Export exp;
+        WebRoutes::Reply reply;
+        if (WebRoutes::histogram(routeRequest(source), exp, reply))
+        {
+            sendExport<ByteHistogram::Export, ByteHistogram::fill>(response, exp);
+        }
+        else
+        {
+            sendReply(response, reply);
+        }
+    }
+
+    template <void (*Route)(const WebRoutes::Request&, WebRoutes::Reply&)>
+    void handleSettings(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        RouteSource source(request);
+        WebRoutes::Reply reply;
+        Route(routeRequest(source), reply);
+        sendReply(response, reply);
+    }
+
+    void handleConfig(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        WebRoutes::Reply reply;
+        WebRoutes::config(reply);
+        sendReply(response, reply);
+    }
+
+    // Transmitted frames are looped back into ingest, as if another node had
+    // acknowledged and echoed them
+    void handleTransmit(const HttpRequest& request, HttpResponse& response, HeapGuard::Scope scope)
+    {
+        RequestParser::TransmitRequest tx;
+        if (!RequestParser::parseTransmitBody(request.body, request.bodyLength, tx))
+        {
+            response.begin(400, "application/json");
+            response.append("{\"error\":\"Invalid parameters\"}");
+            return;
+        }
+        if (DeviceConfig::can().mode == DeviceConfig::CanMode::ListenOnly)
+        {
+            response.begin(500, "application/json");
+            response.append("{\"error\":\"Transmit failed\"}");
+            return;
+        }
+        CANMessage msg;
+        msg.timestamp = Clock::millis();
+        msg.id = tx.id;
+        msg.length = tx.length;
+        memcpy(msg.data, tx.data, sizeof(msg.data));
+        CanIngest::process(msg, tx.id > 0x7FF);
+        ++g_transmitted;
+        response.begin(200, "application/json");
+        response.append("{\"status\":\"transmitted\"}");
+    }
+
+    bool loadSettings(const char* path, DeviceConfig::Settings& settings)
+    {
+        FILE* file = fopen(path, "rb");
+        if (!file)
+        {
+            return false;
+        }
+        uint8_t blob[DeviceConfig::MAX_BLOB_BYTES * 2];
+        size_t length = fread(blob, 1, sizeof(blob), file);
+        fclose(file);
+        return DeviceConfig::decode(blob, length, settings);
+    }
+
+    // Written next to the file and renamed over it, so the file always holds
+    // a whole blob, as NVS does
+    bool saveSettings(const char* path, const DeviceConfig::Settings& settings)
+    {
+        uint8_t blob[DeviceConfig::MAX_BLOB_BYTES];
+        size_t length = DeviceConfig::encode(settings, blob, sizeof(blob));
+        std::string temporary = std::string(path) + ".tmp";
+        FILE* file = length ? fopen(temporary.c_str(), "wb") : nullptr;
+        if (!file)
+        {
+            return false;
+        }
+        bool written = fwrite(blob, 1, length, file) == length;
+        written = fclose(file) == 0 && written;
+        return written && rename(temporary.c_str(), path) == 0;
+    }
+
+    // WebRoutes' save callback with --config; without it the settings routes
+    // only apply
+    bool saveConfigFile(const DeviceConfig::Settings& settings)
+    {
+        return saveSettings(g_configPath, settings);
+    }
+
+    Route g_routes[] =
+    {
+        { "GET", "/", HeapGuard::Scope::HttpRoot, handlePage, {} },
+        { "GET", "/filtered", HeapGuard::Scope::HttpRoot, handlePage, {} },
+        { "GET", "/latest_messages", HeapGuard::Scope::HttpLatestMessages, handleLatest, {} },
+        { "GET", "/filtered_ids", HeapGuard::Scope::HttpFilteredIds, handleIdList, {} },
+        { "GET", "/filtered_messages", HeapGuard::Scope::HttpFilteredMessages, handleFiltered, {} },
+        { "POST", "/sampling", HeapGuard::Scope::HttpSampling, handleSettings<WebRoutes::sampling>, {} },
+        { "GET", "/history", HeapGuard::Scope::HttpHistory, handleHistory, {} },
+        { "POST", "/history_watch", HeapGuard::Scope::HttpHistory, handleSettings<WebRoutes::historyWatch>, {} },
+        { "GET", "/top", HeapGuard::Scope::HttpTop, handleTop, {} },
+        { "GET", "/search", HeapGuard::Scope::HttpSearch, handleSearch, {} },
+        { "GET", "/histogram", HeapGuard::Scope::HttpHistogram, handleHistogram, {} },
+        { "POST", "/histogram_watch", HeapGuard::Scope::HttpHistogram, handleSettings<WebRoutes::histogramWatch>, {} },
+        { "GET", "/config", HeapGuard::Scope::HttpConfig, handleConfig, {} },
+        { "POST", "/config", HeapGuard::Scope::HttpConfig, handleSettings<WebRoutes::configSave>, {} },
+        { "POST", "/transmit_message", HeapGuard::Scope::HttpTransmit, handleTransmit, {} },
+    };
+
+    void handleRequest(const HttpRequest& request, HttpResponse& response)
+    {
+        for (Route& route : g_routes)
+        {
+            if (!request.is(route.method, route.path))
+            {
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            {
+                HeapGuard::ScopeGuard allocScope(route.scope);
+                TRACE_SCOPE(route.path);
+                route.handle(request, response, route.scope);
+            }
+            uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+            RouteStats& stats = route.stats;
+            ++stats.requests;
+            stats.errors += response.status() >= 400;
+            stats.bytes += response.length();
+            stats.totalUs += us;
+            ++stats.histogram[us < HISTOGRAM_MAX_US ? us : HISTOGRAM_MAX_US];
+            return;
+        }
+        response.begin(404, "text/plain");
+        response.append("Not found\n");
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Keeps the state table moving on the real clock between requests; the
+    // acceptance filter of /config drops frames as the controller would, and
+    // its view settings are installed here as the receive task does
+    void runTraffic()
+    {
+        DeviceConfig::installViews();
+        DeviceConfig::Can can = DeviceConfig::can();
+        bool capture = capturing();
+        uint16_t count;
+        do
+        {
+            uint32_t rxUs = Clock::micros();
+            count = TrafficGenerator::poll(rxUs, g_frames, POLL_BATCH);
+            for (uint16_t i = 0; i < count; ++i)
+            {
+                if (DeviceConfig::accepts(can, g_frames[i].msg.id, g_frames[i].extended))
+                {
+                    if (CanIngest::process(g_frames[i].msg, g_frames[i].extended) && capture)
+                    {
+                        FrameStream::push(g_frames[i].msg, g_frames[i].extended, rxUs, Clock::micros());
+                    }
+                }
+            }
+        } while (count == POLL_BATCH);
+        CanIngest::tick(Clock::millis());
+    }
+
+    // Writes what the stream sender would send: the queued frames, and the
+    // clock estimate when a capture starts and once a second after that
+    void writeCapture()
+    {
+        static uint8_t message[FrameCodec::HEADER_BYTES + POLL_BATCH * FrameCodec::FRAME_RECORD_BYTES];
+        uint64_t nowUs = Clock::nowUs();
+        if (!g_clockWritten || nowUs - g_lastClockUs >= CAPTURE_CLOCK_INTERVAL_US)
+        {
+            fwrite(message, 1, FrameStream::encodeClock(message, sizeof(message), g_deviceId, nowUs), g_capture);
+            g_lastClockUs = nowUs;
+            g_clockWritten = true;
+        }
+        size_t length;
+        while ((length = FrameStream::encodeBatch(message, sizeof(message), POLL_BATCH, Clock::micros())) > 0)
+        {
+            fwrite(message, 1, length, g_capture);
+        }
+    }
+
+    // The estimate against the peer; with an injected skew also how far the
+    // estimated reference time is from the true one
+    void reportSync()
+    {
+        TimeSync::Estimate estimate = TimeSync::estimate();
+        if (estimate.state == TimeSync::State::Reference)
+        {
+            return;
+        }
+        if (estimate.state == TimeSync::State::Unsynced)
+        {
+            printf("  time sync: waiting for the reference\n");
+            return;
+        }
+        uint64_t localUs = Clock::nowUs();
+        int64_t errorUs = TimeSync::referenceUs(estimate, localUs) - static_cast<int64_t>(steadyNowUs());
+        printf("  time sync: offset %lld us, drift %.3f ppm, delay %u us, %u samples", 
+               static_cast<long long>(estimate.offsetUs), estimate.driftPpb / 1000.0, estimate.delayUs,
+               estimate.samples);
+        if (!Clock::isSystem())
+        {
+            printf(", error %lld us against the true clock", static_cast<long long>(errorUs));
+        }
+        printf("\n");
+    }
+
+    // Prints and resets the per-route counters covering the last interval
+    void report(double seconds)
+    {
+        printf("%.1f s, %u IDs, %llu frames generated, %llu transmitted\n", seconds, StateTable::size(),
+               static_cast<unsigned long long>(TrafficGenerator::generated()),
+               static_cast<unsigned long long>(g_transmitted));
+        reportSync();
+        printf("  %-24s %9s %9s %7s %9s %8s %8s %8s %8s %8s\n", "endpoint", "requests", "req/s", "errors",
+               "avg B", "avg us", "p50 us", "p90 us", "p99 us", "max us");
+        for (Route& route : g_routes)
+        {
+            RouteStats& stats = route.stats;
+            if (stats.requests == 0)
+            {
+                continue;
+            }
+            char name[40];
+            snprintf(name, sizeof(name), "%s %s", route.method, route.path);
+            printf("  %-24s %9llu %9.0f %7llu %9llu %8.1f %8u %8u %8u %8u\n", name,
+                   static_cast<unsigned long long>(stats.requests), stats.requests / seconds,
+                   static_cast<unsigned long long>(stats.errors),
+                   static_cast<unsigned long long>(stats.bytes / stats.requests),
+                   static_cast<double>(stats.totalUs) / stats.requests, stats.percentileUs(50),
+                   stats.percentileUs(90), stats.percentileUs(99), stats.percentileUs(100));
+            std::fill(stats.histogram.begin(), stats.histogram.end(), 0);
+            stats.requests = stats.errors = stats.bytes = stats.totalUs = 0;
+        }
+        fflush(stdout);
+    }
+
+    void onIdle()
+    {
+        // The sync state first, so a capture waiting for it takes no frames
+        g_sync.poll();
+        runTraffic();
+        if (capturing())
+        {
+            writeCapture();
+        }
+        double seconds = secondsSince(g_lastReport);
+        if (g_reportSeconds && seconds >= g_reportSeconds)
+        {
+            // Quiet intervals are not worth a table, unless the clock is syncing
+            if (std::any_of(std::begin(g_routes), std::end(g_routes), [](const Route& route)
+                {
+                    return route.stats.requests > 0;
+                }) || TimeSync::estimate().state != TimeSync::State::Reference)
+            {
+                report(seconds);
+            }
+            g_lastReport = std::chrono::steady_clock::now();
+        }
+    }
+
+    void onSignal(int)
+    {
+        g_stop = 1;
+    }
+}
+
+// Serves the web routes from a live state table so load generators such as
+// wrk can be pointed at the same rendering code the firmware runs. Server-side
+// service time per endpoint is reported every interval and on exit. The
+// routes that need the device (/metrics, /trace, /latency, /network, /fuzz,
+// /sequence and the /stream socket) are not served.
+int runServeCommand(int argc, char** argv)
+{
+    const char* address = optionString(argc, argv, "--address", "127.0.0.1");
+    uint32_t port = optionU32(argc, argv, "--port", 8080);
+    const char* profile = optionString(argc, argv, "--profile", "preset=steady");
+    uint32_t bitrate = optionU32(argc, argv, "--bitrate", 500000);
+    uint32_t maxIds = optionU32(argc, argv, "--max-ids", MAX_TRACKED_IDS);
+    g_reportSeconds = optionU32(argc, argv, "--report-s", 10);
+    g_configPath = optionString(argc, argv, "--config", nullptr);
+    uint32_t syncPort = optionU32(argc, argv, "--sync-port", TimeSync::PORT);
+    const char* capturePath = optionString(argc, argv, "--capture", nullptr);
+    const char* syncPeer = optionString(argc, argv, "--sync-peer", nullptr);
+    g_deviceId = optionU32(argc, argv, "--device-id", port);
+    g_clockOffsetUs = strtoll(optionString(argc, argv, "--clock-offset-us", "0"), nullptr, 0);
+    g_clockRate = 1.0 + strtod(optionString(argc, argv, "--clock-drift-ppm", "0"), nullptr) / 1e6;
+    if (port == 0 || port > 0xFFFF || maxIds == 0 || maxIds > MAX_TRACKED_IDS || !DeviceConfig::supportedBitrate(bitrate) ||
+        syncPort > 0xFFFF || g_clockRate <= 0)
+    {
+        fprintf(stderr, "usage: serve [--address ADDR] [--port N] [--profile PROFILE] [--bitrate BPS]\n"
+                        "       [--max-ids N (max %u)] [--report-s S (0 = on exit only)] [--config FILE]\n"
+                        "       [--sync-port N (0 = off)] [--sync-peer ADDR[:PORT]] [--capture FILE] [--device-id N]\n"
+                        "       [--clock-offset-us N] [--clock-drift-ppm N]\n"
+                        "Serves the device's routes except /metrics, /trace, /latency, /network, /fuzz,\n"
+                        "/sequence and /stream, which need the device itself.\n",
+                MAX_TRACKED_IDS);
+        return 2;
+    }
+
+    // A second instance on the same host stands in for a second device
+    // with a clock of its own
+    if (g_clockOffsetUs != 0 || g_clockRate != 1.0)
+    {
+        g_clockStartUs = steadyNowUs();
+        Clock::setSource(skewedNowUs);
+    }
+
+    // Saved settings win over --bitrate, as NVS does over the default;
+    // --sync-peer wins over both
+    DeviceConfig::Settings settings;
+    settings.can.bitrate = bitrate;
+    if (g_configPath && !loadSettings(g_configPath, settings))
+    {
+        printf("No usable settings in %s, using defaults\n", g_configPath);
+    }
+    if (syncPeer)
+    {
+        RequestParser::ConfigParams params;
+        params.syncPeer.data = syncPeer;
+        params.syncPeer.length = strlen(syncPeer);
+        if (!RequestParser::parseConfigForm(params, settings))
+        {
+            fprintf(stderr, "Invalid sync peer \"%s\"\n", syncPeer);
+            return 2;
+        }
+    }
+    if (!CanIngest::begin(settings.can.bitrate, static_cast<uint16_t>(maxIds)) ||
+        !ViewRenderer::begin(WEB_PAGE_HTML, static_cast<uint16_t>(maxIds)) || !TrafficGenerator::begin(0xFFFF))
+    {
+        fprintf(stderr, "Failed to allocate storage\n");
+        return 1;
+    }
+    DeviceConfig::apply(settings);
+    if (g_configPath)
+    {
+        WebRoutes::setSaveCallback(saveConfigFile);
+    }
+    bitrate = settings.can.bitrate;
+    if (!TrafficGenerator::configure(profile, bitrate))
+    {
+        fprintf(stderr, "Invalid profile \"%s\": %s\n", profile, TrafficGenerator::lastError());
+        return 2;
+    }
+
+    if (capturePath)
+    {
+        g_capture = fopen(capturePath, "wb");
+        if (!g_capture || !FrameStream::begin(CAPTURE_QUEUE_FRAMES))
+        {
+            fprintf(stderr, "Cannot capture to %s\n", capturePath);
+            return 1;
+        }
+    }
+
+    HttpServer server;
+    if (!server.listen(address, static_cast<uint16_t>(port)) ||
+        (syncPort != 0 && !g_sync.open(address, static_cast<uint16_t>(syncPort))))
+    {
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    printf("Serving http://%s:%u/ with %u IDs of traffic (%s); Ctrl-C stops\n", address, port,
+           TrafficGenerator::idCount(), profile);
+    fflush(stdout);
+
+    g_lastReport = std::chrono::steady_clock::now();
+    server.run(handleRequest, onIdle, g_stop, IDLE_MS);
+    printf("\n");
+    report(secondsSince(g_lastReport));
+    if (g_capture)
+    {
+        writeCapture();
+        fclose(g_capture);
+        printf("Captured %u frames, %u dropped\n", FrameStream::sequence(), FrameStream::dropped());
+    }
+    return 0;
+}
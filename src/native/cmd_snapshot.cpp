@@ -0,0 +1,388 @@
+#include "host_commands.h"
+#include "host_options.h"
+#include "can_ingest.h"
+#include "state_table.h"
+#include "view_render.h"
+#include "request_parser.h"
+#include "clock.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr const char* SNAPSHOT_TEMPLATE = "%LATEST_MESSAGES%";
+    constexpr const char* FORMAT_LINE = "# canmon view snapshots v1";
+    constexpr uint32_t STANDARD_IDS = 1024;
+    constexpr uint32_t EXTENDED_IDS = 1024;
+    constexpr uint32_t CHURN_IDS = 64;                 // Beyond the table capacity, so evictions happen
+    constexpr uint32_t PERIODS_MS[] = { 10, 20, 50, 100, 500, 1000 };
+    constexpr size_t LARGE_CHUNK = 1436;
+    constexpr size_t SMALL_CHUNK = 97;                 // Odd size, splits rows at arbitrary points
+
+    // The frame sequence is part of the golden output: changing anything
+    // here invalidates recorded snapshots
+    struct Sequence
+    {
+        uint32_t random = 0x2545F491u;
+        uint8_t counters[STANDARD_IDS + EXTENDED_IDS + CHURN_IDS] = {};
+
+        uint32_t next()
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            return random;
+        }
+
+        static uint32_t idOf(uint32_t index, bool& extended)
+        {
+            extended = index >= STANDARD_IDS;
+            if (index < STANDARD_IDS)
+            {
+                return 0x100 + index;
+            }
+            if (index < STANDARD_IDS + EXTENDED_IDS)
+            {
+                return 0x18DA0000u + (index - STANDARD_IDS);
+            }
+            return 0x1F000000u + (index - STANDARD_IDS - EXTENDED_IDS);
+        }
+
+        // Feeds every frame due at this millisecond into ingest
+        void emit(uint32_t ms)
+        {
+            for (uint32_t index = 0; index < STANDARD_IDS + EXTENDED_IDS; ++index)
+            {
+                uint32_t period = PERIODS_MS[index % (sizeof(PERIODS_MS) / sizeof(PERIODS_MS[0]))];
+                if ((ms + index) % period == 0)
+                {
+                    send(index, ms);
+                }
+            }
+            // Churn IDs show up one at a time, pushing older IDs out of the table
+            if (ms % 16 == 0)
+            {
+                send(STANDARD_IDS + EXTENDED_IDS + (ms / 16) % CHURN_IDS, ms);
+            }
+        }
+
+        void send(uint32_t index, uint32_t ms)
+        {
+            bool extended;
+            CANMessage msg;
+            msg.timestamp = ms;
+            msg.id = idOf(index, extended);
+            // A few IDs alternate their length to cover length changes
+            msg.length = static_cast<uint8_t>(index % 37 == 0 ? 1 + (counters[index] & 7) : 1 + index % 8);
+            msg.data[0] = counters[index]++;
+            uint32_t bits = next();
+            for (uint8_t i = 1; i < 8; ++i)
+            {
+                // Higher bytes change less often
+                msg.data[i] = (bits >> (i * 4)) % (i + 1) == 0 ? static_cast<uint8_t>(next()) : static_cast<uint8_t>(index * i);
+            }
+            CanIngest::process(msg, extended);
+        }
+    };
+
+    struct Golden
+    {
+        std::string name;
+        uint32_t ms = 0;
+        uint32_t bytes = 0;
+        uint64_t hash = 0;
+    };
+
+    uint64_t fnv1a(const std::string& text)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : text)
+        {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string render(ViewRenderer::View view, const char* ids, size_t chunkSize)
+    {
+        static uint8_t chunk[LARGE_CHUNK];
+        ViewRenderer::Context* ctx = ViewRenderer::claim(view, HeapGuard::Scope::None, Clock::millis());
+        if (ids)
+        {
+            ctx->idsRequested = ids[0] != '\0';
+            ctx->slotCount = RequestParser::parseIdList(ids, strlen(ids), ctx->slots, StateTable::capacity());
+        }
+        std::string out;
+        size_t written;
+        while ((written = ViewRenderer::fill(*ctx, chunk, chunkSize)) > 0)
+        {
+            out.append(reinterpret_cast<const char*>(chunk), written);
+        }
+        ViewRenderer::release(ctx);
+        return out;
+    }
+
+    // The ID list is compared as JSON: whitespace and the case or leading
+    // zeros of the hex digits do not matter, order and content do.
+    // Returns false when the text is not an array of hex strings.
+    bool canonicalIdList(const std::string& json, std::string& out)
+    {
+        size_t p = 0;
+        auto skipSpace = [&]()
+        {
+            while (p < json.size() && strchr(" \t\r\n", json[p]))
+            {
+                ++p;
+            }
+        };
+        out = "[";
+        skipSpace();
+        if (p == json.size() || json[p++] != '[')
+        {
+            return false;
+        }
+        skipSpace();
+        bool first = true;
+        while (p < json.size() && json[p] != ']')
+        {
+            if (!first)
+            {
+                if (json[p++] != ',')
+                {
+                    return false;
+                }
+                skipSpace();
+            }
+            size_t close = json.find('"', p + 1);
+            if (json[p] != '"' || close == std::string::npos)
+            {
+                return false;
+            }
+            uint32_t id;
+            char* end = nullptr;
+            std::string item = json.substr(p + 1, close - p - 1);
+            id = static_cast<uint32_t>(strtoul(item.c_str(), &end, 16));
+            if (item.empty() || *end != '\0')
+            {
+                return false;
+            }
+            char canonical[16];
+            snprintf(canonical, sizeof(canonical), "%s\"0x%x\"", first ? "" : ",", id);
+            out += canonical;
+            first = false;
+            p = close + 1;
+            skipSpace();
+        }
+        if (p == json.size())
+        {
+            return false;
+        }
+        out += "]";
+        return true;
+    }
+
+    bool readGolden(const char* path, std::string& header, std::vector<Golden>& golden)
+    {
+        FILE* file = fopen(path, "r");
+        if (!file)
+        {
+            return false;
+        }
+        char line[256];
+        while (fgets(line, sizeof(line), file))
+        {
+            line[strcspn(line, "\n")] = '\0';
+            if (line[0] == '#')
+            {
+                header = line;
+                continue;
+            }
+            char name[32];
+            unsigned ms;
+            unsigned bytes;
+            unsigned long long hash;
+            if (sscanf(line, "%31s %u %u %llx", name, &ms, &bytes, &hash) == 4)
+            {
+                golden.push_back({ name, ms, bytes, hash });
+            }
+        }
+        fclose(file);
+        return true;
+    }
+
+    void writeDump(const char* directory, const Golden& snapshot, const std::string& text)
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s-%06u.txt", directory, snapshot.name.c_str(), snapshot.ms);
+        FILE* file = fopen(path, "w");
+        if (file)
+        {
+            fwrite(text.data(), 1, text.size(), file);
+            fclose(file);
+        }
+    }
+}
+
+// Renders the latest, filtered and ID list views of a fixed frame sequence
+// at fixed simulated times and records or checks their hashes. Record before
+// a rendering change and check after it: any byte of difference in the HTML
+// views, or any semantic difference in the JSON view, fails the check.
+int runSnapshotCommand(int argc, char** argv)
+{
+    const char* recordPath = optionString(argc, argv, "--record", nullptr);
+    const char* checkPath = optionString(argc, argv, "--check", nullptr);
+    const char* dumpDirectory = optionString(argc, argv, "--dump", nullptr);
+    uint32_t seconds = optionU32(argc, argv, "--seconds", 10);
+    uint32_t intervalMs = optionU32(argc, argv, "--interval-ms", 250);
+    uint32_t maxIds = optionU32(argc, argv, "--max-ids", 2048);
+    if (!recordPath == !checkPath || seconds == 0 || intervalMs == 0 || maxIds == 0 || maxIds > MAX_TRACKED_IDS)
+    {
+        fprintf(stderr, "usage: snapshot --record FILE | --check FILE [--dump DIR] [--seconds S] [--interval-ms MS]\n"
+                        "       [--max-ids N (max %u)]\n", MAX_TRACKED_IDS);
+        return 2;
+    }
+
+    char header[128];
+    snprintf(header, sizeof(header), "%s ids=%u seconds=%u interval-ms=%u", FORMAT_LINE, maxIds, seconds, intervalMs);
+    std::vector<Golden> expected;
+    if (checkPath)
+    {
+        std::string recordedHeader;
+        if (!readGolden(checkPath, recordedHeader, expected))
+        {
+            fprintf(stderr, "Cannot open %s\n", checkPath);
+            return 1;
+        }
+        if (recordedHeader != header)
+        {
+            fprintf(stderr, "%s was recorded with different settings:\n  %s\n", checkPath, recordedHeader.c_str());
+            return 1;
+        }
+    }
+    if (!CanIngest::begin(500000, static_cast<uint16_t>(maxIds)) ||
+        !ViewRenderer::begin(SNAPSHOT_TEMPLATE, static_cast<uint16_t>(maxIds)))
+    {
+        fprintf(stderr, "Failed to allocate storage\n");
+        return 1;
+    }
+
+    // Every fifth standard ID, every ninth extended one and a few that never appear
+    std::string filterIds;
+    for (uint32_t index = 0; index < STANDARD_IDS + EXTENDED_IDS; index += index < STANDARD_IDS ? 5 : 9)
+    {
+        bool extended;
+        char id[16];
+        snprintf(id, sizeof(id), "0x%X,", Sequence::idOf(index, extended));
+        filterIds += id;
+    }
+    filterIds += "0x7FF, 1FFFFFFF,bogus";
+
+    static Sequence sequence;
+    std::vector<Golden> actual;
+    uint32_t failures = 0;
+    uint32_t chunkMismatches = 0;
+    Clock::simulate(0);
+    for (uint32_t ms = 1; ms <= seconds * 1000; ++ms)
+    {
+        Clock::setSimulated(static_cast<uint64_t>(ms) * 1000);
+        sequence.emit(ms);
+        CanIngest::tick(ms);
+        if (ms % intervalMs != 0)
+        {
+            continue;
+        }
+
+        struct
+        {
+            const char* name;
+            ViewRenderer::View view;
+            const char* ids;
+        } const views[] =
+        {
+            { "latest", ViewRenderer::View::LatestRows, nullptr },
+            { "filtered", ViewRenderer::View::FilteredRows, filterIds.c_str() },
+            { "idlist", ViewRenderer::View::IdListJson, nullptr },
+        };
+        for (const auto& view : views)
+        {
+            std::string text = render(view.view, view.ids, LARGE_CHUNK);
+            // Output must not depend on how the transport splits it
+            if (render(view.view, view.ids, SMALL_CHUNK) != text)
+            {
+                ++chunkMismatches;
+            }
+            std::string hashed = text;
+            if (view.view == ViewRenderer::View::IdListJson && !canonicalIdList(text, hashed))
+            {
+                fprintf(stderr, "%s at %u ms is not a JSON array of IDs\n", view.name, ms);
+                ++failures;
+            }
+            Golden snapshot = { view.name, ms, static_cast<uint32_t>(text.size()), fnv1a(hashed) };
+            if (dumpDirectory)
+            {
+                writeDump(dumpDirectory, snapshot, text);
+            }
+            actual.push_back(snapshot);
+        }
+    }
+
+    if (recordPath)
+    {
+        FILE* file = fopen(recordPath, "w");
+        if (!file)
+        {
+            fprintf(stderr, "Cannot create %s\n", recordPath);
+            return 1;
+        }
+        fprintf(file, "%s\n", header);
+        for (const Golden& snapshot : actual)
+        {
+            fprintf(file, "%s %u %u %016llx\n", snapshot.name.c_str(), snapshot.ms, snapshot.bytes,
+                    static_cast<unsigned long long>(snapshot.hash));
+        }
+        fclose(file);
+    }
+    else
+    {
+        if (expected.size() != actual.size())
+        {
+            fprintf(stderr, "Expected %zu snapshots, rendered %zu\n", expected.size(), actual.size());
+            ++failures;
+        }
+        for (size_t i = 0; i < expected.size() && i < actual.size(); ++i)
+        {
+            const Golden& want = expected[i];
+            const Golden& got = actual[i];
+            if (want.name != got.name || want.ms != got.ms || want.hash != got.hash)
+            {
+                if (failures < 10)
+                {
+                    fprintf(stderr, "MISMATCH %s at %u ms: %u bytes, expected %u\n", got.name.c_str(), got.ms,
+                            got.bytes, want.bytes);
+                }
+                ++failures;
+            }
+        }
+    }
+
+    uint64_t totalBytes = 0;
+    for (const Golden& snapshot : actual)
+    {
+        totalBytes += snapshot.bytes;
+    }
+    printf("%zu snapshots of %u IDs (%u evictions), %llu bytes rendered\n", actual.size(), StateTable::size(),
+           StateTable::evictions(), static_cast<unsigned long long>(totalBytes));
+    if (chunkMismatches)
+    {
+        printf("  %u snapshots differ between %zu- and %zu-byte fills\n", chunkMismatches, LARGE_CHUNK, SMALL_CHUNK);
+    }
+    if (recordPath)
+    {
+        printf("  recorded to %s\n", recordPath);
+        return chunkMismatches ? 1 : 0;
+    }
+    printf("  %s: %u mismatches\n", failures || chunkMismatches ? "FAILED" : "passed", failures);
+    return failures || chunkMismatches ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+#include "frame_writer.h"
+#include "candump.h"
+#include "frame_codec.h"
+#include <string.h>
+
+namespace
+{
+    constexpr size_t OUTPUT_BUFFER_BYTES = 1024 * 1024;
+    constexpr uint8_t COLUMNAR_VERSION = 1;
+
+    constexpr uint32_t PCAPNG_SECTION_HEADER = 0x0A0D0D0A;
+    constexpr uint32_t PCAPNG_INTERFACE = 0x00000001;
+    constexpr uint32_t PCAPNG_ENHANCED_PACKET = 0x00000006;
+    constexpr uint32_t PCAPNG_BYTE_ORDER = 0x1A2B3C4D;
+    constexpr uint16_t PCAPNG_OPTION_END = 0;
+    constexpr uint16_t PCAPNG_OPTION_IF_NAME = 2;
+    constexpr uint16_t LINKTYPE_CAN_SOCKETCAN = 227;
+    constexpr uint32_t SOCKETCAN_FRAME_BYTES = 16;
+    constexpr uint32_t SOCKETCAN_EXTENDED = 0x80000000u;
+
+    uint64_t clampedUs(int64_t referenceUs)
+    {
+        return referenceUs > 0 ? static_cast<uint64_t>(referenceUs) : 0;
+    }
+
+    // pcapng is written in host byte order; readers go by the byte-order magic
+    template <typename T>
+    void put(std::vector<uint8_t>& block, T value)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        block.insert(block.end(), bytes, bytes + sizeof(value));
+    }
+
+    uint32_t padded(size_t length)
+    {
+        return static_cast<uint32_t>((length + 3) & ~static_cast<size_t>(3));
+    }
+}
+
+bool FrameWriter::parseFormat(const char* name, Format& format)
+{
+    if (strcmp(name, "candump") == 0)
+    {
+        format = Format::Candump;
+    }
+    else if (strcmp(name, "pcapng") == 0)
+    {
+        format = Format::Pcapng;
+    }
+    else if (strcmp(name, "columnar") == 0)
+    {
+        format = Format::Columnar;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+FrameWriter::~FrameWriter()
+{
+    close();
+}
+
+bool FrameWriter::open(const char* path, Format format, const std::vector<std::string>& interfaces)
+{
+    m_file = path ? fopen(path, "wb") : stdout;
+    if (!m_file)
+    {
+        fprintf(stderr, "Cannot write %s\n", path);
+        return false;
+    }
+    m_ownsFile = path != nullptr;
+    m_buffer.resize(OUTPUT_BUFFER_BYTES);
+    setvbuf(m_file, m_buffer.data(), _IOFBF, m_buffer.size());
+    m_format = format;
+    m_interfaces = interfaces;
+    m_blockCount = 0;
+    if (format == Format::Columnar)
+    {
+        m_times.resize(COLUMNAR_BLOCK_FRAMES);
+        m_ids.resize(COLUMNAR_BLOCK_FRAMES);
+        m_inputs.resize(COLUMNAR_BLOCK_FRAMES);
+        m_lengths.resize(COLUMNAR_BLOCK_FRAMES);
+        m_data.resize(COLUMNAR_BLOCK_FRAMES * 8);
+    }
+    writeHeader();
+    return true;
+}
+
+void FrameWriter::write(uint8_t input, const StreamTimeline::Frame& frame)
+{
+    switch (m_format)
+    {
+    case Format::Candump:
+        writeCandump(input, frame);
+        break;
+    case Format::Pcapng:
+        writePcapng(input, frame);
+        break;
+    case Format::Columnar:
+        writeColumnar(input, frame);
+        break;
+    }
+}
+
+bool FrameWriter::close()
+{
+    if (!m_file)
+    {
+        return true;
+    }
+    if (m_format == Format::Columnar)
+    {
+        flushBlock();
+    }
+    bool ok = fflush(m_file) == 0 && !ferror(m_file);
+    if (m_ownsFile)
+    {
+        ok = fclose(m_file) == 0 && ok;
+    }
+    else
+    {
+        setvbuf(m_file, nullptr, _IOLBF, 0);
+    }
+    m_file = nullptr;
+    return ok;
+}
+
+void FrameWriter::writeHeader()
+{
+    std::vector<uint8_t> header;
+    switch (m_format)
+    {
+    case Format::Candump:
+        return;
+    case Format::Pcapng:
+        put(header, PCAPNG_SECTION_HEADER);
+        put(header, static_cast<uint32_t>(28));
+        put(header, PCAPNG_BYTE_ORDER);
+        put(header, static_cast<uint16_t>(1));
+        put(header, static_cast<uint16_t>(0));
+        put(header, static_cast<int64_t>(-1));      // Section length not given
+        put(header, static_cast<uint32_t>(28));
+        // Timestamps are in microseconds, the default resolution
+        for (const std::string& name : m_interfaces)
+        {
+            uint32_t blockLength = 20 + 4 + padded(name.size()) + 4;
+            put(header, PCAPNG_INTERFACE);
+            put(header, blockLength);
+            put(header, LINKTYPE_CAN_SOCKETCAN);
+            put(header, static_cast<uint16_t>(0));
+            put(header, SOCKETCAN_FRAME_BYTES);
+            put(header, PCAPNG_OPTION_IF_NAME);
+            put(header, static_cast<uint16_t>(name.size()));
+            header.insert(header.end(), name.begin(), name.end());
+            header.resize(header.size() + padded(name.size()) - name.size());
+            put(header, PCAPNG_OPTION_END);
+            put(header, static_cast<uint16_t>(0));
+            put(header, blockLength);
+        }
+        break;
+    case Format::Columnar:
+        header.insert(header.end(), { 'C', 'M', 'C', 'L', COLUMNAR_VERSION, static_cast<uint8_t>(m_interfaces.size()),
+                                      0, 0 });
+        for (const std::string& name : m_interfaces)
+        {
+            header.push_back(static_cast<uint8_t>(name.size()));
+            header.insert(header.end(), name.begin(), name.end());
+        }
+        break;
+    }
+    fwrite(header.data(), 1, header.size(), m_file);
+}
+
+void FrameWriter::writeCandump(uint8_t input, const StreamTimeline::Frame& frame)
+{
+    CandumpFrame line;
+    line.timestampUs = clampedUs(frame.referenceUs);
+    line.id = frame.record.id;
+    line.extended = frame.record.extended;
+    line.length = frame.record.length;
+    memcpy(line.data, frame.record.data, sizeof(line.data));
+    char text[128];
+    size_t length = formatCandumpLine(text, sizeof(text), line, m_interfaces[input].c_str());
+    text[length] = '\n';
+    fwrite(text, 1, length + 1, m_file);
+}
+
+// Enhanced packet block around a 16-byte SocketCAN frame, whose ID is in
+// network byte order
+void FrameWriter::writePcapng(uint8_t input, const StreamTimeline::Frame& frame)
+{
+    constexpr uint32_t BLOCK_BYTES = 28 + SOCKETCAN_FRAME_BYTES + 4;
+    uint64_t us = clampedUs(frame.referenceUs);
+    uint32_t block[BLOCK_BYTES / 4] =
+    {
+        PCAPNG_ENHANCED_PACKET, BLOCK_BYTES, input, static_cast<uint32_t>(us >> 32), static_cast<uint32_t>(us),
+        SOCKETCAN_FRAME_BYTES, SOCKETCAN_FRAME_BYTES
+    };
+    uint8_t* can = reinterpret_cast<uint8_t*>(block + 7);
+    uint32_t id = frame.record.id | (frame.record.extended ? SOCKETCAN_EXTENDED : 0);
+    can[0] = static_cast<uint8_t>(id >> 24);
+    can[1] = static_cast<uint8_t>(id >> 16);
+    can[2] = static_cast<uint8_t>(id >> 8);
+    can[3] = static_cast<uint8_t>(id);
+    can[4] = frame.record.length;
+    memcpy(can + 8, frame.record.data, 8);
+    block[BLOCK_BYTES / 4 - 1] = BLOCK_BYTES;
+    fwrite(block, 1, sizeof(block), m_file);
+}
+
+void FrameWriter::writeColumnar(uint8_t input, const StreamTimeline::Frame& frame)
+{
+    uint32_t i = m_blockCount++;
+    m_times[i] = frame.referenceUs;
+    m_ids[i] = frame.record.id | (frame.record.extended ? FrameCodec::EXTENDED_ID_FLAG : 0);
+    m_inputs[i] = input;
+    m_lengths[i] = frame.record.length;
+    memcpy(&m_data[i * 8], frame.record.data, 8);
+    if (m_blockCount == COLUMNAR_BLOCK_FRAMES)
+    {
+        flushBlock();
+    }
+}
+
+// The host tool runs on little-endian machines, so the columns go out as
+// they are in memory
+void FrameWriter::flushBlock()
+{
+    if (m_blockCount == 0)
+    {
+        return;
+    }
+    fwrite(&m_blockCount, sizeof(m_blockCount), 1, m_file);
+    fwrite(m_times.data(), sizeof(int64_t), m_blockCount, m_file);
+    fwrite(m_ids.data(), sizeof(uint32_t), m_blockCount, m_file);
+    fwrite(m_inputs.data(), 1, m_blockCount, m_file);
+    fwrite(m_lengths.data(), 1, m_blockCount, m_file);
+    fwrite(m_data.data(), 8, m_blockCount, m_file);
+    m_blockCount = 0;
+}
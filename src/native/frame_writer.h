@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "stream_timeline.h"
+
+// Output of the merge pipeline. Every frame carries the index of its input,
+// which each format keeps:
+//
+//   candump   "(sec.usec) <interface> ID#DATA" lines, as candump -l writes
+//   pcapng    one SocketCAN interface (LINKTYPE_CAN_SOCKETCAN) per input,
+//             named after it, so Wireshark shows the bus of each frame
+//   columnar  blocks of up to COLUMNAR_BLOCK_FRAMES frames, one array per
+//             field, for loading straight into numpy or pandas
+//
+// Columnar file, little-endian:
+//   0  "CMCL"  magic
+//   4  version
+//   5  inputs
+//   6  reserved u16
+//   8  per input: name length, name
+//   then blocks:
+//      count u32
+//      timeUs i64[count]   reference clock; negative before the reference started
+//      id u32[count]       bit 31 set for extended IDs, as in the stream
+//      input u8[count]
+//      length u8[count]
+//      data u8[count][8]
+class FrameWriter
+{
+public:
+    static constexpr uint32_t COLUMNAR_BLOCK_FRAMES = 4096;
+
+    enum class Format : uint8_t
+    {
+        Candump,
+        Pcapng,
+        Columnar
+    };
+
+    static bool parseFormat(const char* name, Format& format);
+
+    ~FrameWriter();
+    // nullptr writes to stdout
+    bool open(const char* path, Format format, const std::vector<std::string>& interfaces);
+    void write(uint8_t input, const StreamTimeline::Frame& frame);
+    // Flushes; false when anything failed to write
+    bool close();
+
+private:
+    FILE* m_file = nullptr;
+    bool m_ownsFile = false;
+    Format m_format = Format::Candump;
+    std::vector<std::string> m_interfaces;
+    std::vector<char> m_buffer;
+    uint32_t m_blockCount = 0;
+    std::vector<int64_t> m_times;
+    std::vector<uint32_t> m_ids;
+    std::vector<uint8_t> m_inputs;
+    std::vector<uint8_t> m_lengths;
+    std::vector<uint8_t> m_data;
+
+    void writeHeader();
+    void writeCandump(uint8_t input, const StreamTimeline::Frame& frame);
+    void writePcapng(uint8_t input, const StreamTimeline::Frame& frame);
+    void writeColumnar(uint8_t input, const StreamTimeline::Frame& frame);
+    void flushBlock();
+};
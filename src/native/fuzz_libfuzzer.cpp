@@ -0,0 +1,29 @@
+// libFuzzer entry point. Built only with -D FUZZ_TARGET=\"name\", which also
+// leaves out the host tool's main(); see "Fuzzing" in the README.
+#ifdef FUZZ_TARGET
+#include "fuzz_targets.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace
+{
+    const FuzzTarget* s_target = nullptr;
+}
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    s_target = findFuzzTarget(FUZZ_TARGET);
+    if (!s_target || !setupFuzzTargets())
+    {
+        fprintf(stderr, "Cannot set up fuzz target %s\n", FUZZ_TARGET);
+        abort();
+    }
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    s_target->run(data, size);
+    return 0;
+}
+#endif
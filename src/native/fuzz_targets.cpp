@@ -0,0 +1,410 @@
+#include "fuzz_targets.h"
+#include "candump.h"
+#include "http_server.h"
+#include "request_parser.h"
+#include "can_ingest.h"
+#include "state_table.h"
+#include "device_config.h"
+#include "payload_fuzzer.h"
+#include "sequence_runner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace
+{
+    constexpr uint16_t FUZZ_IDS = 256;
+    constexpr size_t SSID_BYTES = 33;         // As SoftAPConfig::Config
+    constexpr size_t PASSWORD_BYTES = 65;
+
+    void check(bool condition, const char* target, const char* what)
+    {
+        if (!condition)
+        {
+            fprintf(stderr, "%s: %s\n", target, what);
+            abort();
+        }
+    }
+
+    // Inputs are raw bytes; nothing is NUL terminated
+    const char* text(const uint8_t* data)
+    {
+        return reinterpret_cast<const char*>(data);
+    }
+
+    bool runIdList(const uint8_t* data, size_t size)
+    {
+        static uint16_t slots[FUZZ_IDS];
+        uint16_t count = RequestParser::parseIdList(text(data), size, slots, FUZZ_IDS);
+        check(count <= FUZZ_IDS, "idlist", "more slots than room");
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            check(slots[i] < StateTable::capacity() && StateTable::entry(slots[i]).hasLatest, "idlist", "invalid slot");
+            check(i == 0 || StateTable::entry(slots[i - 1]).latest.id < StateTable::entry(slots[i]).latest.id,
+                  "idlist", "slots not in strict ID order");
+        }
+        return count > 0;
+    }
+
+    bool runTransmit(const uint8_t* data, size_t size)
+    {
+        RequestParser::TransmitRequest request;
+        if (!RequestParser::parseTransmitBody(text(data), size, request))
+        {
+            return false;
+        }
+        check(request.length <= 8, "transmit", "length above 8");
+        check(request.byteCount >= request.length && request.byteCount <= 8, "transmit", "data count out of range");
+        return true;
+    }
+
+    // The portal's form body, decoded as the web server would and then
+    // validated by the same code as SoftAPConfig::handleConfigSave
+    bool runConfig(const uint8_t* data, size_t size)
+    {
+        HttpRequest request;
+        request.query = text(data);
+        request.queryLength = size;
+        std::string ssid;
+        std::string password;
+        if (!request.queryParam("ssid", ssid) || !request.queryParam("password", password))
+        {
+            return false;
+        }
+        char ssidOut[SSID_BYTES];
+        char passwordOut[PASSWORD_BYTES];
+        if (!RequestParser::copyConfigField(ssid.data(), ssid.size(), ssidOut, sizeof(ssidOut)) ||
+            !RequestParser::copyConfigField(password.data(), password.size(), passwordOut, sizeof(passwordOut)))
+        {
+            return false;
+        }
+        check(strlen(ssidOut) == ssid.size() && memcmp(ssidOut, ssid.data(), ssid.size()) == 0,
+              "config", "SSID altered");
+        check(strlen(passwordOut) == password.size(), "config", "password altered");
+        return true;
+    }
+
+    // The /search parameters, decoded as the web server would; an accepted
+    // query must be consistent and only find IDs it matches, in ID order
+    bool runSearch(const uint8_t* data, size_t size)
+    {
+        HttpRequest request;
+        request.query = text(data);
+        request.queryLength = size;
+        std::string values[6];
+        RequestParser::SearchParams params;
+        RequestParser::Param* fields[] = { &params.pattern, &params.at, &params.width, &params.min, &params.max,
+                                           &params.endian };
+        const char* const names[] = { "pattern", "at", "width", "min", "max", "endian" };
+        for (size_t i = 0; i < 6; ++i)
+        {
+            if (request.queryParam(names[i], values[i]))
+            {
+                fields[i]->data = values[i].data();
+                fields[i]->length = values[i].size();
+            }
+        }
+
+        PayloadSearch::Query query;
+        if (!RequestParser::parseSearchQuery(params, query))
+        {
+            return false;
+        }
+        check((query.value & ~query.mask) == 0, "search", "value bits outside the mask");
+        check(query.minLength <= 8, "search", "pattern longer than a payload");
+        check(!query.hasRange || (query.rangeWidth >= 1 && query.rangeWidth <= PayloadSearch::MAX_RANGE_WIDTH &&
+                                  (query.rangeStart == PayloadSearch::ANY_POSITION ||
+                                   query.rangeStart + query.rangeWidth <= 8)), "search", "range outside a payload");
+
+        static uint16_t slots[FUZZ_IDS];
+        uint16_t count = PayloadSearch::run(query, slots, FUZZ_IDS);
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            check(PayloadSearch::matches(query, StateTable::entry(slots[i]).latest), "search", "non-matching ID found");
+            check(i == 0 || StateTable::entry(slots[i - 1]).latest.id < StateTable::entry(slots[i]).latest.id,
+                  "search", "results not in ID order");
+        }
+        return true;
+    }
+
+    // The POST /config form, decoded as the web server would. Accepted
+    // settings must survive the NVS blob unchanged; the same bytes are also
+    // fed to the blob decoder, which must only accept valid settings.
+    bool runSettings(const uint8_t* data, size_t size)
+    {
+        DeviceConfig::Settings fromBlob;
+        check(!DeviceConfig::decode(data, size, fromBlob) || DeviceConfig::validate(fromBlob),
+              "settings", "decoded blob fails validation");
+
+        HttpRequest request;
+        request.query = text(data);
+        request.queryLength = size;
+        std::string values[11];
+        RequestParser::ConfigParams params;
+        RequestParser::Param* fields[] = { &params.bitrate, &params.mode, &params.filterId, &params.filterMask,
+                                           &params.filterExtended, &params.sampling, &params.samplingValue,
+                                           &params.history, &params.histograms, &params.pairs,
+                                           &params.syncPeer };
+        const char* const names[] = { "bitrate", "mode", "filter_id", "filter_mask", "filter_ext", "sampling",
+                                      "sampling_value", "history", "histograms", "pairs", "sync_peer" };
+        for (size_t i = 0; i < 11; ++i)
+        {
+            if (request.queryParam(names[i], values[i]))
+            {
+                fields[i]->data = values[i].data();
+                fields[i]->length = values[i].size();
+            }
+        }
+
+        DeviceConfig::Settings settings;
+        if (!RequestParser::parseConfigForm(params, settings) || !DeviceConfig::validate(settings))
+        {
+            return false;
+        }
+        uint8_t blob[DeviceConfig::MAX_BLOB_BYTES];
+        size_t length = DeviceConfig::encode(settings, blob, sizeof(blob));
+        check(length > 0, "settings", "valid settings do not fit the blob");
+        DeviceConfig::Settings again;
+        check(DeviceConfig::decode(blob, length, again), "settings", "encoded blob rejected");
+
+        char before[DeviceConfig::MAX_JSON_BYTES];
+        char after[DeviceConfig::MAX_JSON_BYTES];
+        size_t beforeLength = DeviceConfig::renderJson(settings, before, sizeof(before));
+        size_t afterLength = DeviceConfig::renderJson(again, after, sizeof(after));
+        check(beforeLength > 0 && beforeLength == afterLength && memcmp(before, after, beforeLength) == 0,
+              "settings", "round trip changed the settings");
+        return true;
+    }
+
+    // Accepted lines must survive formatting and parsing again unchanged
+    bool runCandump(const uint8_t* data, size_t size)
+    {
+        CandumpFrame frame;
+        if (!parseCandumpLine(text(data), size, frame))
+        {
+            return false;
+        }
+        check(frame.length <= 8, "candump", "length above 8");
+        check(frame.id <= (frame.extended ? 0x1FFFFFFFu : 0x7FFu), "candump", "ID out of range");
+
+        char line[128];
+        size_t length = formatCandumpLine(line, sizeof(line), frame, "can0");
+        check(length > 0, "candump", "accepted frame cannot be formatted");
+        CandumpFrame again;
+        check(parseCandumpLine(line, length, again), "candump", "formatted line rejected");
+        check(again.timestampUs == frame.timestampUs && again.id == frame.id && again.extended == frame.extended &&
+              again.remote == frame.remote && again.length == frame.length &&
+              memcmp(again.data, frame.data, frame.length) == 0, "candump", "round trip changed the frame");
+        return true;
+    }
+
+    // Plans are C strings on the device; bytes after a NUL are never seen
+    bool runPlan(const uint8_t* data, size_t size)
+    {
+        std::string plan(text(data), size);
+        PayloadFuzzer::Plan parsed;
+        if (!PayloadFuzzer::parsePlan(plan.c_str(), parsed))
+        {
+            return false;
+        }
+        check(parsed.idCount >= 1 && parsed.idCount <= PayloadFuzzer::MAX_IDS, "plan", "ID count out of range");
+        check(parsed.responseCount <= PayloadFuzzer::MAX_IDS, "plan", "response count out of range");
+        check(parsed.length <= 8, "plan", "length above 8");
+        for (uint8_t i = 0; i < parsed.idCount; ++i)
+        {
+            check(parsed.ids[i] <= (parsed.extended ? 0x1FFFFFFFu : 0x7FFu), "plan", "ID out of range");
+        }
+        const uint32_t indexes[] = { 0, 1, parsed.idCount * 64u + 3, 0xFFFFFFFFu };
+        for (uint32_t index : indexes)
+        {
+            PayloadFuzzer::Frame frame;
+            PayloadFuzzer::Frame again;
+            PayloadFuzzer::generate(parsed, index, frame);
+            PayloadFuzzer::generate(parsed, index, again);
+            check(frame.length == parsed.length && frame.id == parsed.ids[index % parsed.idCount], "plan",
+                  "frame does not follow the plan");
+            check(memcmp(frame.data, again.data, 8) == 0, "plan", "frame not reproducible");
+            for (uint8_t i = frame.length; i < 8; ++i)
+            {
+                check(frame.data[i] == 0, "plan", "bytes past the length not cleared");
+            }
+        }
+        return true;
+    }
+
+    bool runScript(const uint8_t* data, size_t size)
+    {
+        static SequenceRunner::Script script;
+        std::string input(text(data), size);
+        if (!SequenceRunner::parse(input.c_str(), script))
+        {
+            check(SequenceRunner::errorStep() <= SequenceRunner::MAX_STEPS, "script", "error step out of range");
+            return false;
+        }
+        check(script.stepCount >= 1 && script.stepCount <= SequenceRunner::MAX_STEPS, "script",
+              "step count out of range");
+        for (uint8_t i = 0; i < script.stepCount; ++i)
+        {
+            const SequenceRunner::Step& step = script.steps[i];
+            check(step.kind != SequenceRunner::StepKind::Delay ||
+                  step.us <= SequenceRunner::MAX_TIME_MS * 1000, "script", "delay too long");
+            if (step.kind == SequenceRunner::StepKind::Delay)
+            {
+                continue;
+            }
+            check(step.id <= (step.extended ? 0x1FFFFFFFu : 0x7FFu), "script", "ID out of range");
+            check(step.length <= 8, "script", "length above 8");
+            check(step.conditionCount <= SequenceRunner::MAX_CONDITIONS, "script", "too many conditions");
+            for (uint8_t c = 0; c < step.conditionCount; ++c)
+            {
+                const SequenceRunner::Condition& condition = step.conditions[c];
+                check(condition.index < 8 && (condition.value & ~condition.mask) == 0, "script",
+                      "condition can never match");
+            }
+            check(step.kind != SequenceRunner::StepKind::Wait ||
+                  (step.us > 0 && step.us <= SequenceRunner::MAX_TIME_MS * 1000), "script", "timeout out of range");
+        }
+        return true;
+    }
+
+    const char* const ID_LIST_SEEDS[] =
+    {
+        "0x100,0x101,0x1ff",
+        "100, 7DF ,0x18DA00F1",
+        "0X1a0,,zz,0x",
+        nullptr
+    };
+    const char* const ID_LIST_TOKENS[] = { ",", "0x", "0X", " ", "7DF", "18DA00F1", "FFFFFFFF", nullptr };
+
+    const char* const TRANSMIT_SEEDS[] =
+    {
+        "{\"id\":\"7DF\",\"length\":2,\"data\":[18,52]}",
+        "{\"id\": \"0x18DA00F1\", \"length\": 8, \"data\": [0x02, 1, 0, 0, 0, 0, 0, 255]}",
+        "{\"id\":\"100\",\"length\":0,\"data\":[]}",
+        nullptr
+    };
+    const char* const TRANSMIT_TOKENS[] =
+    {
+        "\"id\":", "\"length\":", "\"data\":", "[", "]", ",", "\"", "0x", "255", "256", "{", "}", nullptr
+    };
+
+    const char* const CONFIG_SEEDS[] =
+    {
+        "ssid=HomeNetwork&password=correct+horse",
+        "ssid=caf%C3%A9&password=p%40ss%26word",
+        "password=&ssid=0123456789abcdef0123456789abcdef",
+        nullptr
+    };
+    const char* const CONFIG_TOKENS[] = { "ssid=", "password=", "&", "%00", "%", "+", "=", nullptr };
+
+    const char* const SEARCH_SEEDS[] =
+    {
+        "pattern=%3F%3F+3C+%3F%3F+%3F%3F+0x%3FF",
+        "min=0x100&max=0x1ff&width=2&at=any&endian=le",
+        "pattern=05+*&min=3&max=200&at=2",
+        nullptr
+    };
+    const char* const SEARCH_TOKENS[] =
+    {
+        "pattern=", "min=", "max=", "at=", "width=", "endian=", "&", "+", "%3F", "*", "0x", "le", "any", "4", nullptr
+    };
+
+    const char* const SETTINGS_SEEDS[] =
+    {
+        "bitrate=500000&mode=listen&filter_id=100&filter_mask=700",
+        "sampling=interval&sampling_value=250&history=1a0%2C0x18DA00F1",
+        "histograms=100&pairs=100%3A2%2C3%3B7df%3A0%2C1&filter_ext=1&filter_id=0x18da0000&filter_mask=1fff0000",
+        nullptr
+    };
+    const char* const SETTINGS_TOKENS[] =
+    {
+        "bitrate=", "mode=", "filter_id=", "filter_mask=", "filter_ext=", "sampling=", "sampling_value=",
+        "history=", "histograms=", "pairs=", "&", "%2C", "%3A", "%3B", "noack", "ratio", "VC\x01", nullptr
+    };
+
+    const char* const CANDUMP_SEEDS[] =
+    {
+        "(1699999999.123456) can0 123#DEADBEEF",
+        "(1700000000.000001) vcan0 18DA00F1#0201000000000000\n",
+        "(0.000000) can1 7DF#R",
+        nullptr
+    };
+    const char* const CANDUMP_TOKENS[] = { "(", ")", ".", "#", "##", "#R", " ", "can0", "FFFFFFFF", nullptr };
+
+    const char* const PLAN_SEEDS[] =
+    {
+        "ids=7E0+7DF,mode=random,len=8,rate=2000,seed=42",
+        "ids=18DA00F1,ext=1,mode=bitwalk,len=3,count=24,responses=18DAF100",
+        "mode=boundary,ids=100,len=0,rate=0",
+        nullptr
+    };
+    const char* const PLAN_TOKENS[] =
+    {
+        "ids=", "ext=", "mode=", "len=", "rate=", "count=", "seed=", "responses=", ",", "+", "=", "random",
+        "bitwalk", "boundary", "1FFFFFFF", "0x", "100000", nullptr
+    };
+
+    const char* const SCRIPT_SEEDS[] =
+    {
+        "send 7E0#0210030000000000\nwait 7E8 0=50 timeout=100\ndelay 5\nsend 7E0#0211\nrepeat 100",
+        "send 18DA00F1#0322F190; wait 18DAF100 1=62/FF 2=F1; delay 250us; repeat 0",
+        "wait 100 0=1; delay 10ms; send 101#",
+        nullptr
+    };
+    const char* const SCRIPT_TOKENS[] =
+    {
+        "send ", "wait ", "delay ", "repeat ", "#", ";", "\n", " ", "=", "/", "timeout=", "us", "ms", "7E8",
+        "18DAF100", "60000", nullptr
+    };
+
+    const FuzzTarget TARGETS[] =
+    {
+        { "idlist", "ID list of /filtered_messages", runIdList, ID_LIST_SEEDS, ID_LIST_TOKENS },
+        { "transmit", "JSON body of /transmit_message", runTransmit, TRANSMIT_SEEDS, TRANSMIT_TOKENS },
+        { "config", "Configuration portal form", runConfig, CONFIG_SEEDS, CONFIG_TOKENS },
+        { "search", "Pattern and range of /search", runSearch, SEARCH_SEEDS, SEARCH_TOKENS },
+        { "settings", "POST /config form and settings blob", runSettings, SETTINGS_SEEDS, SETTINGS_TOKENS },
+        { "candump", "candump -l log lines", runCandump, CANDUMP_SEEDS, CANDUMP_TOKENS },
+        { "plan", "Payload fuzzing plan of POST /fuzz", runPlan, PLAN_SEEDS, PLAN_TOKENS },
+        { "script", "Transmit sequence of POST /sequence", runScript, SCRIPT_SEEDS, SCRIPT_TOKENS },
+    };
+}
+
+bool setupFuzzTargets()
+{
+    if (!CanIngest::begin(500000, FUZZ_IDS))
+    {
+        return false;
+    }
+    // Half standard IDs from 0x100, half extended from 0x18DA0000
+    for (uint16_t i = 0; i < FUZZ_IDS; ++i)
+    {
+        CANMessage msg;
+        msg.timestamp = i;
+        msg.id = i < FUZZ_IDS / 2 ? 0x100u + i : 0x18DA0000u + i;
+        msg.length = 8;
+        memset(msg.data, i & 0xFF, sizeof(msg.data));
+        CanIngest::process(msg, i >= FUZZ_IDS / 2);
+    }
+    CanIngest::tick(FUZZ_IDS);
+    return true;
+}
+
+const FuzzTarget* fuzzTargets(size_t& count)
+{
+    count = sizeof(TARGETS) / sizeof(TARGETS[0]);
+    return TARGETS;
+}
+
+const FuzzTarget* findFuzzTarget(const char* name)
+{
+    for (const FuzzTarget& target : TARGETS)
+    {
+        if (strcmp(target.name, name) == 0)
+        {
+            return &target;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fuzz targets for everything that parses untrusted input. Each one checks
+// the parser's guarantees on what it accepted and aborts on a violation, so
+// the same targets run under the host tool's `fuzz` command and under
+// libFuzzer (FUZZ_TARGET builds, see fuzz_libfuzzer.cpp).
+struct FuzzTarget
+{
+    const char* name;
+    const char* description;
+    bool (*run)(const uint8_t* data, size_t size);   // True when the input was accepted
+    const char* const* seeds;                        // Valid inputs, nullptr terminated
+    const char* const* dictionary;                   // Tokens worth splicing in
+};
+
+// Prepares the state the targets rely on, e.g. a populated state table
+bool setupFuzzTargets();
+const FuzzTarget* fuzzTargets(size_t& count);
+const FuzzTarget* findFuzzTarget(const char* name);
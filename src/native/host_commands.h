@@ -0,0 +1,12 @@
+#pragma once
+
+// Subcommands of the host tool (native build). Each returns the process exit code.
+int runAllocCommand(int argc, char** argv);
+int runBenchCommand(int argc, char** argv);
+int runFuzzCommand(int argc, char** argv);
+int runGenerateCommand(int argc, char** argv);
+int runMergeCommand(int argc, char** argv);
+int runPayloadsCommand(int argc, char** argv);
+int runReplayCommand(int argc, char** argv);
+int runServeCommand(int argc, char** argv);
+int runSnapshotCommand(int argc, char** argv);
@@ -0,0 +1,62 @@
+// Host tool for the native build: drives the same ingest and rendering code
+// as the firmware so behaviour and cost can be measured on a PC or in CI.
+#include "host_commands.h"
+#include <stdio.h>
+#include <string.h>
+
+// libFuzzer builds (FUZZ_TARGET) and the test suites under test/ bring their
+// own main()
+#if !defined(FUZZ_TARGET) && !defined(PIO_UNIT_TESTING)
+namespace
+{
+    struct Command
+    {
+        const char* name;
+        const char* help;
+        int (*run)(int argc, char** argv);
+    };
+
+    const Command COMMANDS[] =
+    {
+        { "alloc", "Run a synthetic workload and report allocations per scope", runAllocCommand },
+        { "bench", "Time rendering of /latest_messages from a full state table", runBenchCommand },
+        { "fuzz", "Fuzz the request and log parsers and report their throughput", runFuzzCommand },
+        { "generate", "Feed a synthetic traffic profile through ingest at full speed", runGenerateCommand },
+        { "merge", "Merge live or recorded streams of several devices into one log on the reference clock", runMergeCommand },
+        { "payloads", "List the frames of a payload fuzzing plan as a candump log", runPayloadsCommand },
+        { "replay", "Replay a candump log on the simulated clock, snapshotting the view", runReplayCommand },
+        { "snapshot", "Record or check golden hashes of the rendered views at scale", runSnapshotCommand },
+        { "serve", "Serve the web routes over HTTP for load testing with live traffic", runServeCommand },
+    };
+
+    void printUsage(const char* program)
+    {
+        printf("usage: %s <command> [options]\n\ncommands:\n", program);
+        for (const Command& command : COMMANDS)
+        {
+            printf("  %-12s %s\n", command.name, command.help);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    for (const Command& command : COMMANDS)
+    {
+        if (strcmp(argv[1], command.name) == 0)
+        {
+            return command.run(argc - 1, argv + 1);
+        }
+    }
+
+    fprintf(stderr, "Unknown command: %s\n", argv[1]);
+    printUsage(argv[0]);
+    return 2;
+}
+#endif
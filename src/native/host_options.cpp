@@ -0,0 +1,33 @@
+#include "host_options.h"
+#include <stdlib.h>
+#include <string.h>
+
+const char* optionString(int argc, char** argv, const char* name, const char* fallback)
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (strcmp(argv[i], name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return fallback;
+}
+
+uint32_t optionU32(int argc, char** argv, const char* name, uint32_t fallback)
+{
+    const char* value = optionString(argc, argv, name, nullptr);
+    return value ? static_cast<uint32_t>(strtoul(value, nullptr, 0)) : fallback;
+}
+
+bool optionFlag(int argc, char** argv, const char* name)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+// Minimal "--name value" option lookup for the host tool subcommands
+const char* optionString(int argc, char** argv, const char* name, const char* fallback);
+uint32_t optionU32(int argc, char** argv, const char* name, uint32_t fallback);
+bool optionFlag(int argc, char** argv, const char* name);
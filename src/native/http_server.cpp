@@ -0,0 +1,387 @@
+#include "http_server.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t MAX_HEADER_BYTES = 16 * 1024;
+    constexpr size_t MAX_BODY_BYTES = 64 * 1024;
+    constexpr size_t RECEIVE_CHUNK = 16 * 1024;
+    constexpr int LISTEN_BACKLOG = 256;
+
+    const char* reasonPhrase(int status)
+    {
+        switch (status)
+        {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+        }
+    }
+
+    bool equals(const char* text, size_t length, const char* literal)
+    {
+        return strlen(literal) == length && memcmp(text, literal, length) == 0;
+    }
+
+    bool equalsIgnoreCase(const char* text, size_t length, const char* literal)
+    {
+        return strlen(literal) == length && strncasecmp(text, literal, length) == 0;
+    }
+
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    void urlDecode(const char* text, size_t length, std::string& out)
+    {
+        out.clear();
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (text[i] == '+')
+            {
+                out += ' ';
+            }
+            else if (text[i] == '%' && i + 2 < length && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0)
+            {
+                out += static_cast<char>(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+                i += 2;
+            }
+            else
+            {
+                out += text[i];
+            }
+        }
+    }
+
+    // Value of a header in [headers, end), or nullptr; name is matched without case
+    const char* findHeader(const char* headers, const char* end, const char* name, size_t& valueLength)
+    {
+        size_t nameLength = strlen(name);
+        const char* line = headers;
+        while (line < end)
+        {
+            const char* lineEnd = static_cast<const char*>(memmem(line, end - line, "\r\n", 2));
+            if (!lineEnd)
+            {
+                lineEnd = end;
+            }
+            if (static_cast<size_t>(lineEnd - line) > nameLength && line[nameLength] == ':' &&
+                strncasecmp(line, name, nameLength) == 0)
+            {
+                const char* value = line + nameLength + 1;
+                while (value < lineEnd && (*value == ' ' || *value == '\t'))
+                {
+                    ++value;
+                }
+                valueLength = lineEnd - value;
+                return value;
+            }
+            line = lineEnd + 2;
+        }
+        return nullptr;
+    }
+}
+
+bool HttpRequest::is(const char* expectedMethod, const char* expectedPath) const
+{
+    return equals(method, methodLength, expectedMethod) && equals(path, pathLength, expectedPath);
+}
+
+bool HttpRequest::queryParam(const char* name, std::string& value) const
+{
+    size_t nameLength = strlen(name);
+    const char* p = query;
+    const char* end = query + queryLength;
+    while (p && p < end)
+    {
+        const char* pairEnd = static_cast<const char*>(memchr(p, '&', end - p));
+        if (!pairEnd)
+        {
+            pairEnd = end;
+        }
+        const char* equalsSign = static_cast<const char*>(memchr(p, '=', pairEnd - p));
+        const char* nameEnd = equalsSign ? equalsSign : pairEnd;
+        if (static_cast<size_t>(nameEnd - p) == nameLength && memcmp(p, name, nameLength) == 0)
+        {
+            const char* valueStart = equalsSign ? equalsSign + 1 : pairEnd;
+            urlDecode(valueStart, pairEnd - valueStart, value);
+            return true;
+        }
+        p = pairEnd + 1;
+    }
+    return false;
+}
+
+void HttpResponse::begin(int status, const char* contentType)
+{
+    m_status = status;
+    m_contentType = contentType;
+    m_body.clear();
+}
+
+void HttpResponse::append(const void* data, size_t length)
+{
+    m_body.append(static_cast<const char*>(data), length);
+}
+
+void HttpResponse::append(const char* text)
+{
+    m_body.append(text);
+}
+
+HttpServer::~HttpServer()
+{
+    for (Connection& connection : m_connections)
+    {
+        close(connection.fd);
+    }
+    if (m_listenFd >= 0)
+    {
+        close(m_listenFd);
+    }
+}
+
+bool HttpServer::listen(const char* address, uint16_t port)
+{
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid address %s\n", address);
+        return false;
+    }
+
+    m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    if (m_listenFd < 0 || setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(m_listenFd, LISTEN_BACKLOG) != 0)
+    {
+        fprintf(stderr, "Cannot listen on %s:%u: %s\n", address, port, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void HttpServer::run(Handler handler, void (*idle)(), const volatile sig_atomic_t& stop, int idleMs)
+{
+    std::vector<pollfd> fds;
+    while (!stop)
+    {
+        fds.clear();
+        fds.push_back({ m_listenFd, POLLIN, 0 });
+        for (const Connection& connection : m_connections)
+        {
+            short events = connection.outSent < connection.out.size() ? POLLOUT : POLLIN;
+            fds.push_back({ connection.fd, events, 0 });
+        }
+
+        int ready = poll(fds.data(), fds.size(), idleMs);
+        if (idle)
+        {
+            idle();
+        }
+        if (ready <= 0)
+        {
+            continue;
+        }
+
+        // fds[i + 1] belongs to m_connections[i]; closed connections are
+        // compacted out afterwards so the indices stay valid meanwhile
+        for (size_t i = 0; i < m_connections.size(); ++i)
+        {
+            Connection& connection = m_connections[i];
+            short revents = fds[i + 1].revents;
+            bool open = true;
+            if (revents & (POLLERR | POLLNVAL))
+            {
+                open = false;
+            }
+            else if (revents & POLLOUT)
+            {
+                open = flush(connection) && (connection.outSent < connection.out.size() || serveBuffered(connection, handler));
+            }
+            else if (revents & (POLLIN | POLLHUP))
+            {
+                open = receive(connection, handler);
+            }
+            if (!open)
+            {
+                close(connection.fd);
+                connection.fd = -1;
+            }
+        }
+        size_t kept = 0;
+        for (Connection& connection : m_connections)
+        {
+            if (connection.fd >= 0)
+            {
+                if (&m_connections[kept] != &connection)
+                {
+                    m_connections[kept] = std::move(connection);
+                }
+                ++kept;
+            }
+        }
+        m_connections.resize(kept);
+
+        if (fds[0].revents & POLLIN)
+        {
+            acceptConnections();
+        }
+    }
+}
+
+void HttpServer::acceptConnections()
+{
+    while (true)
+    {
+        int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (fd < 0)
+        {
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Connection connection;
+        connection.fd = fd;
+        m_connections.push_back(std::move(connection));
+    }
+}
+
+// Reads what is available and serves every complete request; false to close
+bool HttpServer::receive(Connection& connection, Handler handler)
+{
+    char buffer[RECEIVE_CHUNK];
+    ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+    if (received <= 0)
+    {
+        return received < 0 && (errno == EAGAIN || errno == EINTR);
+    }
+    connection.in.append(buffer, received);
+    return serveBuffered(connection, handler);
+}
+
+// Serves complete requests from the input buffer until a response cannot be
+// sent right away; false to close
+bool HttpServer::serveBuffered(Connection& connection, Handler handler)
+{
+    while (connection.outSent == connection.out.size() && !connection.closeAfterSend)
+    {
+        const std::string& in = connection.in;
+        size_t headerEnd = in.find("\r\n\r\n");
+        if (headerEnd == std::string::npos)
+        {
+            return in.size() <= MAX_HEADER_BYTES;
+        }
+
+        // Request line: METHOD SP target SP HTTP/1.x
+        const char* start = in.data();
+        const char* headersEnd = start + headerEnd;
+        const char* lineEnd = static_cast<const char*>(memmem(start, headersEnd - start + 2, "\r\n", 2));
+        const char* methodEnd = static_cast<const char*>(memchr(start, ' ', lineEnd - start));
+        const char* targetEnd = methodEnd ? static_cast<const char*>(memchr(methodEnd + 1, ' ', lineEnd - methodEnd - 1)) : nullptr;
+        if (!targetEnd || lineEnd - targetEnd < 9 || memcmp(targetEnd + 1, "HTTP/1.", 7) != 0)
+        {
+            m_response.begin(400, "text/plain");
+            m_response.append("Malformed request line\n");
+            queueResponse(connection, false);
+            break;
+        }
+        bool http10 = targetEnd[8] == '0';
+
+        size_t valueLength = 0;
+        const char* value = findHeader(lineEnd + 2, headersEnd, "Content-Length", valueLength);
+        size_t bodyLength = value ? strtoul(std::string(value, valueLength).c_str(), nullptr, 10) : 0;
+        if (bodyLength > MAX_BODY_BYTES)
+        {
+            m_response.begin(413, "text/plain");
+            m_response.append("Body too large\n");
+            queueResponse(connection, false);
+            break;
+        }
+        size_t requestLength = headerEnd + 4 + bodyLength;
+        if (in.size() < requestLength)
+        {
+            return true;
+        }
+
+        value = findHeader(lineEnd + 2, headersEnd, "Connection", valueLength);
+        bool keepAlive = http10 ? value && equalsIgnoreCase(value, valueLength, "keep-alive")
+                                : !value || !equalsIgnoreCase(value, valueLength, "close");
+
+        HttpRequest request;
+        request.method = start;
+        request.methodLength = methodEnd - start;
+        request.path = methodEnd + 1;
+        const char* queryStart = static_cast<const char*>(memchr(request.path, '?', targetEnd - request.path));
+        request.pathLength = (queryStart ? queryStart : targetEnd) - request.path;
+        if (queryStart)
+        {
+            request.query = queryStart + 1;
+            request.queryLength = targetEnd - request.query;
+        }
+        request.body = start + headerEnd + 4;
+        request.bodyLength = bodyLength;
+
+        m_response.begin(200, "text/plain");
+        handler(request, m_response);
+        queueResponse(connection, keepAlive);
+        connection.in.erase(0, requestLength);
+        if (!flush(connection))
+        {
+            return false;
+        }
+    }
+    return flush(connection);
+}
+
+// Sends as much pending output as the socket takes; false to close
+bool HttpServer::flush(Connection& connection)
+{
+    while (connection.outSent < connection.out.size())
+    {
+        ssize_t sent = send(connection.fd, connection.out.data() + connection.outSent,
+                            connection.out.size() - connection.outSent, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            return errno == EAGAIN || errno == EINTR;
+        }
+        connection.outSent += sent;
+    }
+    connection.out.clear();
+    connection.outSent = 0;
+    return !connection.closeAfterSend;
+}
+
+void HttpServer::queueResponse(Connection& connection, bool keepAlive)
+{
+    char header[256];
+    int length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+                          m_response.m_status, reasonPhrase(m_response.m_status), m_response.m_contentType,
+                          m_response.m_body.size(), keepAlive ? "keep-alive" : "close");
+    connection.out.append(header, length);
+    connection.out.append(m_response.m_body);
+    connection.closeAfterSend = !keepAlive;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Minimal HTTP/1.1 server for the host tool: one thread and poll(), with
+// keep-alive, pipelining and Content-Length bodies. Enough for a browser and
+// load generators such as wrk; it is not meant to face a network.
+struct HttpRequest
+{
+    const char* method = nullptr;
+    size_t methodLength = 0;
+    const char* path = nullptr;        // Without the query string
+    size_t pathLength = 0;
+    const char* query = nullptr;
+    size_t queryLength = 0;
+    const char* body = nullptr;
+    size_t bodyLength = 0;
+
+    bool is(const char* method, const char* path) const;
+    // URL-decoded value of a query parameter; false when it is absent
+    bool queryParam(const char* name, std::string& value) const;
+};
+
+class HttpResponse
+{
+public:
+    void begin(int status, const char* contentType);
+    void append(const void* data, size_t length);
+    void append(const char* text);
+
+    int status() const { return m_status; }
+    size_t length() const { return m_body.size(); }
+
+private:
+    friend class HttpServer;
+    int m_status = 200;
+    const char* m_contentType = "text/plain";
+    std::string m_body;
+};
+
+class HttpServer
+{
+public:
+    using Handler = void (*)(const HttpRequest& request, HttpResponse& response);
+
+    ~HttpServer();
+    bool listen(const char* address, uint16_t port);
+    // Serves until stop is set; idle runs between polls, at least every idleMs
+    void run(Handler handler, void (*idle)(), const volatile sig_atomic_t& stop, int idleMs);
+
+private:
+    struct Connection
+    {
+        int fd = -1;
+        std::string in;
+        std::string out;
+        size_t outSent = 0;
+        bool closeAfterSend = false;
+    };
+
+    int m_listenFd = -1;
+    std::vector<Connection> m_connections;
+    HttpResponse m_response;
+
+    void acceptConnections();
+    bool receive(Connection& connection, Handler handler);
+    bool serveBuffered(Connection& connection, Handler handler);
+    bool flush(Connection& connection);
+    void queueResponse(Connection& connection, bool keepAlive);
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// Single-producer, single-consumer ring for the host tool's pipelines; the
+// same acquire/release hand-off as FrameStream, with each side caching the
+// other's index so the shared cache lines are only touched when the cached
+// value runs out. The capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing
+{
+public:
+    void begin(uint32_t capacity)
+    {
+        uint32_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        m_slots.assign(size, T());
+        m_mask = size - 1;
+    }
+
+    // Producer side; false when full
+    bool push(const T& value)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tailCache > m_mask)
+        {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head - m_tailCache > m_mask)
+            {
+                return false;
+            }
+        }
+        m_slots[head & m_mask] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: the oldest value, or nullptr when empty. It stays
+    // valid until pop().
+    const T* front()
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_headCache)
+        {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail == m_headCache)
+            {
+                return nullptr;
+            }
+        }
+        return &m_slots[tail & m_mask];
+    }
+
+    void pop()
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::vector<T> m_slots;
+    uint32_t m_mask = 0;
+    alignas(64) std::atomic<uint32_t> m_head{0};    // Written by the producer
+    uint32_t m_tailCache = 0;
+    alignas(64) std::atomic<uint32_t> m_tail{0};    // Written by the consumer
+    uint32_t m_headCache = 0;
+};
@@ -0,0 +1,433 @@
+#include "stream_source.h"
+#include "frame_codec.h"
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t READ_CHUNK = 1024 * 1024;
+    constexpr size_t MAX_HANDSHAKE_BYTES = 4096;
+    constexpr size_t MAX_MESSAGE_BYTES = 1024 * 1024;     // Far above any message a monitor sends
+    constexpr int RECEIVE_TIMEOUT_MS = 200;               // How soon a live reader notices stop()
+    constexpr int HANDSHAKE_TIMEOUTS = 25;
+
+    constexpr uint8_t OPCODE_CONTINUATION = 0x0;
+    constexpr uint8_t OPCODE_TEXT = 0x1;
+    constexpr uint8_t OPCODE_BINARY = 0x2;
+    constexpr uint8_t OPCODE_CLOSE = 0x8;
+    constexpr uint8_t OPCODE_PING = 0x9;
+
+    void base64(const uint8_t* in, size_t length, std::string& out)
+    {
+        static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        out.clear();
+        for (size_t i = 0; i < length; i += 3)
+        {
+            uint32_t group = static_cast<uint32_t>(in[i]) << 16;
+            group |= i + 1 < length ? static_cast<uint32_t>(in[i + 1]) << 8 : 0;
+            group |= i + 2 < length ? in[i + 2] : 0;
+            out += ALPHABET[(group >> 18) & 0x3F];
+            out += ALPHABET[(group >> 12) & 0x3F];
+            out += i + 1 < length ? ALPHABET[(group >> 6) & 0x3F] : '=';
+            out += i + 2 < length ? ALPHABET[group & 0x3F] : '=';
+        }
+    }
+
+    bool sendAll(int fd, const void* data, size_t length)
+    {
+        const char* next = static_cast<const char*>(data);
+        while (length > 0)
+        {
+            ssize_t sent = send(fd, next, length, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            next += sent;
+            length -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+}
+
+StreamSource::~StreamSource()
+{
+    stop();
+    join();
+    if (m_file)
+    {
+        fclose(m_file);
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+bool StreamSource::open(const char* location, uint32_t ringFrames)
+{
+    m_location = location;
+    m_ring.begin(ringFrames);
+    if (strncmp(location, "ws://", 5) == 0)
+    {
+        return connect(location + 5);
+    }
+    m_file = fopen(location, "rb");
+    if (!m_file)
+    {
+        fprintf(stderr, "Cannot read %s\n", location);
+        return false;
+    }
+    return true;
+}
+
+void StreamSource::start()
+{
+    m_thread = std::thread(&StreamSource::run, this);
+}
+
+void StreamSource::stop()
+{
+    m_stop.store(true);
+}
+
+void StreamSource::join()
+{
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+bool StreamSource::finished()
+{
+    return m_done.load(std::memory_order_acquire) && m_ring.front() == nullptr;
+}
+
+// host[:port][/path], the part of a ws:// URL after the scheme. The path
+// defaults to /stream so a bare device address works.
+bool StreamSource::connect(const char* url)
+{
+    const char* slash = strchr(url, '/');
+    std::string authority = slash ? std::string(url, slash - url) : std::string(url);
+    std::string path = slash ? std::string(slash) : std::string("/stream");
+    size_t colon = authority.rfind(':');
+    std::string host = authority.substr(0, colon);
+    std::string port = colon != std::string::npos ? authority.substr(colon + 1) : std::string("80");
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+    if (error != 0)
+    {
+        fprintf(stderr, "%s: %s\n", m_location.c_str(), gai_strerror(error));
+        return false;
+    }
+    for (addrinfo* address = addresses; address && m_fd < 0; address = address->ai_next)
+    {
+        m_fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (m_fd >= 0 && ::connect(m_fd, address->ai_addr, address->ai_addrlen) != 0)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (m_fd < 0)
+    {
+        fprintf(stderr, "%s: cannot connect: %s\n", m_location.c_str(), strerror(errno));
+        return false;
+    }
+    int one = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    timeval timeout = { 0, RECEIVE_TIMEOUT_MS * 1000 };
+    setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t nonce[16];
+    std::random_device random;
+    for (uint8_t& byte : nonce)
+    {
+        byte = static_cast<uint8_t>(random());
+    }
+    std::string key;
+    base64(nonce, sizeof(nonce), key);
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + authority +
+                          "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: " + key +
+                          "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    if (!sendAll(m_fd, request.data(), request.size()))
+    {
+        fprintf(stderr, "%s: cannot send the handshake\n", m_location.c_str());
+        return false;
+    }
+
+    // Whatever follows the response headers is already WebSocket data
+    std::string response;
+    char chunk[1024];
+    size_t end = std::string::npos;
+    for (int timeouts = 0; end == std::string::npos && response.size() < MAX_HANDSHAKE_BYTES;)
+    {
+        ssize_t received = recv(m_fd, chunk, sizeof(chunk), 0);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) &&
+            ++timeouts < HANDSHAKE_TIMEOUTS)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            break;
+        }
+        response.append(chunk, static_cast<size_t>(received));
+        end = response.find("\r\n\r\n");
+    }
+    if (end == std::string::npos || response.compare(0, 12, "HTTP/1.1 101") != 0)
+    {
+        fprintf(stderr, "%s: not a WebSocket endpoint\n", m_location.c_str());
+        return false;
+    }
+    m_pending.assign(response.begin() + end + 4, response.end());
+    return true;
+}
+
+void StreamSource::run()
+{
+    if (live())
+    {
+        readWebSocket();
+    }
+    else
+    {
+        readFile();
+    }
+    m_timeline.finish(m_released);
+    deliver();
+    m_done.store(true, std::memory_order_release);
+}
+
+// A recording ends wherever it was stopped, so a cut-off last message is
+// expected; bytes that are not a message end the input
+void StreamSource::readFile()
+{
+    size_t carry = 0;
+    while (!m_stop.load(std::memory_order_relaxed))
+    {
+        m_pending.resize(carry + READ_CHUNK);
+        size_t read = fread(m_pending.data() + carry, 1, READ_CHUNK, m_file);
+        if (read == 0)
+        {
+            break;
+        }
+        m_bytes += read;
+        size_t available = carry + read;
+        size_t used = takeMessages(m_pending.data(), available);
+        if (used == SIZE_MAX)
+        {
+            return;
+        }
+        carry = available - used;
+        memmove(m_pending.data(), m_pending.data() + used, carry);
+        if (!deliver())
+        {
+            return;
+        }
+    }
+    if (carry > 0)
+    {
+        fprintf(stderr, "%s: last message cut off, %zu bytes ignored\n", m_location.c_str(), carry);
+    }
+}
+
+void StreamSource::readWebSocket()
+{
+    bool closed = false;
+    std::vector<uint8_t> chunk(READ_CHUNK);
+    while (!closed)
+    {
+        size_t used = takeWebSocketFrames(m_pending.data(), m_pending.size(), closed);
+        m_pending.erase(m_pending.begin(), m_pending.begin() + used);
+        if (closed || !deliver() || m_stop.load(std::memory_order_relaxed))
+        {
+            break;
+        }
+        ssize_t received = recv(m_fd, chunk.data(), chunk.size(), 0);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            fprintf(stderr, "%s: connection closed\n", m_location.c_str());
+            return;
+        }
+        m_bytes += static_cast<size_t>(received);
+        m_pending.insert(m_pending.end(), chunk.data(), chunk.data() + received);
+    }
+    if (!closed)
+    {
+        static const uint8_t NORMAL_CLOSURE[] = { 0x03, 0xE8 };
+        sendControl(OPCODE_CLOSE, NORMAL_CLOSURE, sizeof(NORMAL_CLOSURE));
+    }
+}
+
+// Splits data into stream messages and runs them through the timeline.
+// Returns the bytes used; a trailing partial message is left for the next
+// call. SIZE_MAX when the data is not a stream.
+size_t StreamSource::takeMessages(const uint8_t* data, size_t length)
+{
+    size_t offset = 0;
+    while (offset < length)
+    {
+        size_t size = FrameCodec::peekMessageBytes(data + offset, length - offset);
+        if (size == 0 && length - offset >= FrameCodec::HEADER_BYTES)
+        {
+            fprintf(stderr, "%s: not a stream message\n", m_location.c_str());
+            m_failed = true;
+            return SIZE_MAX;
+        }
+        if (size == 0 || size > length - offset)
+        {
+            break;
+        }
+        m_timeline.add(data + offset, size, m_released);
+        offset += size;
+    }
+    return offset;
+}
+
+// Parses complete WebSocket frames (RFC 6455) from the server and returns the
+// bytes used. Binary messages go to takeMessages, each holding whole stream
+// messages; pings are answered. A close frame or broken data sets closed.
+size_t StreamSource::takeWebSocketFrames(const uint8_t* data, size_t length, bool& closed)
+{
+    size_t offset = 0;
+    while (length - offset >= 2)
+    {
+        const uint8_t* frame = data + offset;
+        bool fin = (frame[0] & 0x80) != 0;
+        uint8_t opcode = frame[0] & 0x0F;
+        bool masked = (frame[1] & 0x80) != 0;
+        uint64_t payloadLength = frame[1] & 0x7F;
+        size_t header = 2;
+        if (payloadLength >= 126)
+        {
+            size_t lengthBytes = payloadLength == 126 ? 2 : 8;
+            if (length - offset < header + lengthBytes)
+            {
+                break;
+            }
+            payloadLength = 0;
+            for (size_t i = 0; i < lengthBytes; ++i)
+            {
+                payloadLength = (payloadLength << 8) | frame[header + i];
+            }
+            header += lengthBytes;
+        }
+        if (payloadLength > MAX_MESSAGE_BYTES || m_message.size() + payloadLength > MAX_MESSAGE_BYTES)
+        {
+            fprintf(stderr, "%s: oversized WebSocket message\n", m_location.c_str());
+            m_failed = true;
+            closed = true;
+            return offset;
+        }
+        const uint8_t* mask = frame + header;
+        header += masked ? 4 : 0;
+        if (length - offset < header + payloadLength)
+        {
+            break;
+        }
+        const uint8_t* payload = frame + header;
+        size_t size = static_cast<size_t>(payloadLength);
+        offset += header + size;
+
+        // Servers do not mask, but unmasking costs nothing where it is absent
+        std::vector<uint8_t> unmasked;
+        if (masked)
+        {
+            unmasked.resize(size);
+            for (size_t i = 0; i < size; ++i)
+            {
+                unmasked[i] = payload[i] ^ mask[i & 3];
+            }
+            payload = unmasked.data();
+        }
+
+        switch (opcode)
+        {
+        case OPCODE_BINARY:
+            if (fin && m_message.empty())
+            {
+                closed = takeMessages(payload, size) == SIZE_MAX;
+                if (closed)
+                {
+                    return offset;
+                }
+                break;
+            }
+            [[fallthrough]];    // The first fragment
+        case OPCODE_CONTINUATION:
+            m_message.insert(m_message.end(), payload, payload + size);
+            if (fin)
+            {
+                closed = takeMessages(m_message.data(), m_message.size()) == SIZE_MAX;
+                m_message.clear();
+                if (closed)
+                {
+                    return offset;
+                }
+            }
+            break;
+        case OPCODE_TEXT:
+            break;
+        case OPCODE_CLOSE:
+            sendControl(OPCODE_CLOSE, payload, size < 2 ? size : 2);
+            closed = true;
+            return offset;
+        case OPCODE_PING:
+            sendControl(OPCODE_PING + 1, payload, size);
+            break;
+        default:
+            break;
+        }
+    }
+    return offset;
+}
+
+// Hands the released frames to the consumer, waiting while the ring is
+// full. Gives up (and drops them) only once stop() was called, so a
+// consumer that went away cannot leave the reader stuck.
+bool StreamSource::deliver()
+{
+    for (const StreamTimeline::Frame& frame : m_released)
+    {
+        while (!m_ring.push(frame))
+        {
+            if (m_stop.load(std::memory_order_relaxed))
+            {
+                m_released.clear();
+                return false;
+            }
+            std::this_thread::yield();
+        }
+    }
+    m_released.clear();
+    return true;
+}
+
+// Client frames must be masked; a zero key is as valid as any other
+void StreamSource::sendControl(uint8_t opcode, const uint8_t* payload, size_t length)
+{
+    if (length > 125)
+    {
+        return;
+    }
+    uint8_t frame[2 + 4 + 125] = { static_cast<uint8_t>(0x80 | opcode), static_cast<uint8_t>(0x80 | length) };
+    memcpy(frame + 6, payload, length);
+    sendAll(m_fd, frame, 6 + length);
+}
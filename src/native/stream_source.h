@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spsc_ring.h"
+#include "stream_timeline.h"
+
+// One input of the merge pipeline: a recorded stream (a file of /stream
+// messages) or a live monitor (ws://host[:port][/path]). A reader thread
+// splits the bytes into messages, puts their frames on the reference clock
+// with StreamTimeline and hands them to the consumer through a ring. A full
+// ring holds the reader back, so a file is read as fast as the consumer
+// writes and a live connection backs up into its socket buffer.
+class StreamSource
+{
+public:
+    ~StreamSource();
+
+    // Connects or opens the file; false with a message on stderr
+    bool open(const char* location, uint32_t ringFrames);
+    void start();
+    // Asks the reader to finish; frames already in the ring stay readable
+    void stop();
+    // Waits for the reader; the statistics below are final afterwards
+    void join();
+
+    bool live() const { return m_fd >= 0; }
+    const char* location() const { return m_location.c_str(); }
+
+    // Consumer side: next frame in reference time order of this input
+    const StreamTimeline::Frame* front() { return m_ring.front(); }
+    void pop() { m_ring.pop(); }
+    // The reader has ended and every frame has been taken
+    bool finished();
+
+    const StreamTimeline& timeline() const { return m_timeline; }
+    uint64_t bytes() const { return m_bytes; }
+    // The input held something other than stream messages
+    bool failed() const { return m_failed; }
+
+private:
+    std::string m_location;
+    FILE* m_file = nullptr;
+    int m_fd = -1;
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_done{false};
+    SpscRing<StreamTimeline::Frame> m_ring;
+    StreamTimeline m_timeline;
+    std::vector<StreamTimeline::Frame> m_released;
+    std::vector<uint8_t> m_pending;     // Bytes of an incomplete message or WebSocket frame
+    std::vector<uint8_t> m_message;     // WebSocket message being reassembled
+    uint64_t m_bytes = 0;
+    bool m_failed = false;
+
+    bool connect(const char* url);
+    void run();
+    void readFile();
+    void readWebSocket();
+    size_t takeMessages(const uint8_t* data, size_t length);
+    size_t takeWebSocketFrames(const uint8_t* data, size_t length, bool& closed);
+    bool deliver();
+    void sendControl(uint8_t opcode, const uint8_t* payload, size_t length);
+};
@@ -0,0 +1,91 @@
+#include "stream_timeline.h"
+#include "time_sync.h"
+
+bool StreamTimeline::add(const uint8_t* message, size_t length, std::vector<Frame>& out)
+{
+    FrameCodec::Header header;
+    if (!FrameCodec::decodeHeader(message, length, header))
+    {
+        return false;
+    }
+    const uint8_t* record = message + FrameCodec::HEADER_BYTES;
+    switch (header.type)
+    {
+    case FrameCodec::MessageType::ClockSync:
+        for (uint16_t i = 0; i < header.count; ++i, record += FrameCodec::CLOCK_RECORD_BYTES)
+        {
+            FrameCodec::decodeClock(record, m_clock);
+        }
+        if (header.count == 0)
+        {
+            break;
+        }
+        m_lastLocalUs = m_clock.nowUs;
+        if (!m_hasClock)
+        {
+            m_hasClock = true;
+            for (const FrameCodec::FrameRecord& waiting : m_waiting)
+            {
+                release(waiting, out);
+            }
+            m_waiting.clear();
+        }
+        break;
+    case FrameCodec::MessageType::Frames:
+        for (uint16_t i = 0; i < header.count; ++i, record += FrameCodec::FRAME_RECORD_BYTES)
+        {
+            FrameCodec::FrameRecord frame;
+            FrameCodec::decodeFrame(record, frame);
+            if (m_haveSequence && frame.sequence != m_nextSequence)
+            {
+                m_lost += frame.sequence - m_nextSequence;
+            }
+            m_haveSequence = true;
+            m_nextSequence = frame.sequence + 1;
+            ++m_frames;
+            if (m_hasClock)
+            {
+                release(frame, out);
+            }
+            else
+            {
+                m_waiting.push_back(frame);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+void StreamTimeline::finish(std::vector<Frame>& out)
+{
+    for (const FrameCodec::FrameRecord& waiting : m_waiting)
+    {
+        Frame frame;
+        frame.referenceUs = waiting.timestampUs;
+        frame.record = waiting;
+        out.push_back(frame);
+    }
+    m_waiting.clear();
+}
+
+// Each frame unwraps against the latest clock message or frame before it,
+// so streams longer than the 71 minutes a 32-bit timestamp covers work too
+void StreamTimeline::release(const FrameCodec::FrameRecord& record, std::vector<Frame>& out)
+{
+    uint64_t localUs = FrameCodec::unwrapTimestamp(record.timestampUs, m_lastLocalUs);
+    m_lastLocalUs = localUs;
+
+    TimeSync::Estimate estimate;
+    estimate.state = m_clock.state;
+    estimate.localUs = m_clock.estimateUs;
+    estimate.offsetUs = m_clock.offsetUs;
+    estimate.driftPpb = m_clock.driftPpb;
+    Frame frame;
+    frame.referenceUs = m_clock.state == FrameCodec::ClockState::Synced ? TimeSync::referenceUs(estimate, localUs)
+                                                                         : static_cast<int64_t>(localUs);
+    frame.record = record;
+    out.push_back(frame);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "frame_codec.h"
+
+// Puts the frames of one device's /stream messages on the reference clock.
+// The 32-bit frame timestamps are unwrapped against the full clock reading
+// in the ClockSync messages, then moved by their offset and drift. Frames
+// that arrive before the first ClockSync wait for it, so a recording may
+// start with either. Shared by the merge command and anything else that
+// reads recorded or live streams.
+class StreamTimeline
+{
+public:
+    struct Frame
+    {
+        int64_t referenceUs = 0;
+        FrameCodec::FrameRecord record;
+    };
+
+    // Takes one complete message and appends the frames it releases. False
+    // when the message is malformed; messages without frames or clocks
+    // are ignored.
+    bool add(const uint8_t* message, size_t length, std::vector<Frame>& out);
+    // Releases frames still waiting for a clock on the device's own time
+    void finish(std::vector<Frame>& out);
+
+    bool hasClock() const { return m_hasClock; }
+    const FrameCodec::ClockRecord& clock() const { return m_clock; }
+    uint64_t frames() const { return m_frames; }
+    // Frames missing from the sequence numbers: dropped on the device
+    uint64_t lost() const { return m_lost; }
+
+private:
+    FrameCodec::ClockRecord m_clock;
+    bool m_hasClock = false;
+    bool m_haveSequence = false;
+    uint32_t m_nextSequence = 0;
+    uint64_t m_lastLocalUs = 0;
+    uint64_t m_frames = 0;
+    uint64_t m_lost = 0;
+    std::vector<FrameCodec::FrameRecord> m_waiting;
+
+    void release(const FrameCodec::FrameRecord& record, std::vector<Frame>& out);
+};
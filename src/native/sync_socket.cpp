@@ -0,0 +1,86 @@
+#include "sync_socket.h"
+#include "time_sync.h"
+#include "clock.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+SyncSocket::~SyncSocket()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+bool SyncSocket::open(const char* address, uint16_t port)
+{
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid address %s\n", address);
+        return false;
+    }
+
+    m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (m_fd < 0 || bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "Cannot bind time sync to %s:%u: %s\n", address, port, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void SyncSocket::poll()
+{
+    if (m_fd < 0)
+    {
+        return;
+    }
+    DeviceConfig::Sync sync = DeviceConfig::sync();
+    if (sync.peer != m_peer.peer || sync.port != m_peer.port)
+    {
+        m_peer = sync;
+        m_lastRequestUs = 0;
+        TimeSync::reset(sync.peer == 0);
+    }
+
+    uint8_t packet[TimeSync::PACKET_BYTES];
+    uint8_t reply[TimeSync::PACKET_BYTES];
+    sockaddr_in from;
+    socklen_t fromLength = sizeof(from);
+    ssize_t length;
+    while ((length = recvfrom(m_fd, packet, sizeof(packet), 0, reinterpret_cast<sockaddr*>(&from), &fromLength)) > 0)
+    {
+        uint64_t receivedUs = Clock::nowUs();
+        size_t replyLength = TimeSync::answer(packet, static_cast<size_t>(length), receivedUs, Clock::nowUs(), reply,
+                                              sizeof(reply));
+        if (replyLength > 0)
+        {
+            sendto(m_fd, reply, replyLength, 0, reinterpret_cast<sockaddr*>(&from), fromLength);
+        }
+        else
+        {
+            TimeSync::onResponse(packet, static_cast<size_t>(length), receivedUs);
+        }
+        fromLength = sizeof(from);
+    }
+
+    uint64_t nowUs = Clock::nowUs();
+    if (m_peer.peer != 0 && (m_lastRequestUs == 0 || nowUs - m_lastRequestUs >= TimeSync::INTERVAL_MS * 1000ull))
+    {
+        m_lastRequestUs = nowUs;
+        sockaddr_in to = {};
+        to.sin_family = AF_INET;
+        to.sin_port = htons(m_peer.port);
+        to.sin_addr.s_addr = htonl(m_peer.peer);
+        size_t requestLength = TimeSync::makeRequest(packet, sizeof(packet), nowUs);
+        sendto(m_fd, packet, requestLength, 0, reinterpret_cast<sockaddr*>(&to), sizeof(to));
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include "device_config.h"
+
+// Host side of TimeSync: a non-blocking UDP socket polled from the serve
+// loop. It does what serviceTimeSync() in main.cpp does with WiFiUDP, so two
+// host instances can sync with each other or with a device.
+class SyncSocket
+{
+public:
+    ~SyncSocket();
+    bool open(const char* address, uint16_t port);
+    // Answers requests, takes responses and asks the peer set in
+    // DeviceConfig::sync() once per TimeSync::INTERVAL_MS
+    void poll();
+
+private:
+    int m_fd = -1;
+    DeviceConfig::Sync m_peer;
+    uint64_t m_lastRequestUs = 0;
+};
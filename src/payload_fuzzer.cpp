@@ -0,0 +1,525 @@
+#include "payload_fuzzer.h"
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    constexpr uint32_t MAX_RATE = 100000;
+    const uint8_t BOUNDARY_VALUES[] = { 0x00, 0x01, 0x7F, 0x80, 0xFE, 0xFF };
+    constexpr uint32_t BOUNDARY_COUNT = sizeof(BOUNDARY_VALUES);
+
+    const char* const MODE_NAMES[] = { "random", "bitwalk", "boundary" };
+    const char* const STATE_NAMES[] = { "idle", "running", "draining", "finished", "stopped", "busoff" };
+    const char* const ERROR_STATE_NAMES[] = { "active", "warning", "passive", "busoff", "recovering" };
+
+    // Copies one "key=value" item out of a comma-separated plan
+    const char* nextItem(const char* cursor, char* key, size_t keySize, char* value, size_t valueSize)
+    {
+        const char* end = strchr(cursor, ',');
+        size_t length = end ? static_cast<size_t>(end - cursor) : strlen(cursor);
+        const char* equals = static_cast<const char*>(memchr(cursor, '=', length));
+        size_t keyLength = equals ? static_cast<size_t>(equals - cursor) : length;
+        size_t valueLength = equals ? length - keyLength - 1 : 0;
+        keyLength = keyLength < keySize - 1 ? keyLength : keySize - 1;
+        valueLength = valueLength < valueSize - 1 ? valueLength : valueSize - 1;
+        memcpy(key, cursor, keyLength);
+        key[keyLength] = '\0';
+        if (equals)
+        {
+            memcpy(value, equals + 1, valueLength);
+        }
+        value[valueLength] = '\0';
+        return end ? end + 1 : nullptr;
+    }
+
+    bool parseU32(const char* text, uint32_t& out)
+    {
+        char* end = nullptr;
+        unsigned long value = strtoul(text, &end, 0);
+        if (end == text || *end != '\0')
+        {
+            return false;
+        }
+        out = static_cast<uint32_t>(value);
+        return true;
+    }
+
+    // SplitMix64: every frame's bytes come from its own index, with no
+    // state carried from frame to frame
+    uint64_t mix(uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    void fill(uint8_t* data, uint64_t bits)
+    {
+        for (uint8_t i = 0; i < 8; ++i)
+        {
+            data[i] = static_cast<uint8_t>(bits >> (i * 8));
+        }
+    }
+}
+
+PayloadFuzzer::Event* PayloadFuzzer::s_log = nullptr;
+uint16_t PayloadFuzzer::s_logCapacity = 0;
+std::atomic<uint32_t> PayloadFuzzer::s_eventCount(0);
+PayloadFuzzer::Request PayloadFuzzer::s_requests[2];
+volatile uint8_t PayloadFuzzer::s_requestPublished = 0;
+volatile uint32_t PayloadFuzzer::s_requestRevision = 0;
+uint32_t PayloadFuzzer::s_appliedRevision = 0;
+PayloadFuzzer::Plan PayloadFuzzer::s_plans[2];
+volatile uint8_t PayloadFuzzer::s_planPublished = 0;
+volatile PayloadFuzzer::State PayloadFuzzer::s_state = PayloadFuzzer::State::Idle;
+volatile uint32_t PayloadFuzzer::s_sent = 0;
+uint32_t PayloadFuzzer::s_lastPollUs = 0;
+uint64_t PayloadFuzzer::s_elapsedUs = 0;
+volatile uint32_t PayloadFuzzer::s_elapsedMs = 0;
+uint64_t PayloadFuzzer::s_lastSentUs = 0;
+PayloadFuzzer::ErrorState PayloadFuzzer::s_errorState = PayloadFuzzer::ErrorState::Active;
+uint32_t PayloadFuzzer::s_busErrors = 0;
+bool PayloadFuzzer::s_busErrorsKnown = false;
+const char* PayloadFuzzer::s_error = "";
+
+bool PayloadFuzzer::begin(uint16_t logCapacity)
+{
+    delete[] s_log;
+    s_log = new (std::nothrow) Event[logCapacity];
+    s_logCapacity = s_log ? logCapacity : 0;
+    s_eventCount = 0;
+    return s_log != nullptr;
+}
+
+bool PayloadFuzzer::parsePlan(const char* text, Plan& plan)
+{
+    plan = Plan();
+    plan.mode = Mode::Random;
+    plan.length = 8;
+    plan.seed = 1;
+
+    if (strlen(text) > MAX_PLAN_LENGTH)
+    {
+        s_error = "plan too long";
+        return false;
+    }
+    char key[16];
+    char value[MAX_PLAN_LENGTH + 1];
+    for (const char* cursor = text; cursor && *cursor;)
+    {
+        cursor = nextItem(cursor, key, sizeof(key), value, sizeof(value));
+        if (!applySetting(plan, key, value))
+        {
+            return false;
+        }
+    }
+
+    if (plan.idCount == 0)
+    {
+        s_error = "no IDs to fuzz (set ids=)";
+        return false;
+    }
+    uint32_t maxId = plan.extended ? 0x1FFFFFFF : 0x7FF;
+    for (uint8_t i = 0; i < plan.idCount; ++i)
+    {
+        if (plan.ids[i] > maxId)
+        {
+            s_error = "IDs exceed the 11-bit range (use ext=1)";
+            return false;
+        }
+    }
+    s_error = "";
+    return true;
+}
+
+bool PayloadFuzzer::applySetting(Plan& plan, const char* key, const char* value)
+{
+    if (strcmp(key, "ids") == 0)
+    {
+        return parseIds(value, plan.ids, plan.idCount);
+    }
+    if (strcmp(key, "responses") == 0)
+    {
+        return parseIds(value, plan.responses, plan.responseCount);
+    }
+    if (strcmp(key, "mode") == 0)
+    {
+        for (uint8_t m = 0; m < sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]); ++m)
+        {
+            if (strcmp(value, MODE_NAMES[m]) == 0)
+            {
+                plan.mode = static_cast<Mode>(m);
+                return true;
+            }
+        }
+        s_error = "mode must be random, bitwalk or boundary";
+        return false;
+    }
+
+    uint32_t number = 0;
+    if (!parseU32(value, number))
+    {
+        s_error = "expected key=number";
+        return false;
+    }
+    if (strcmp(key, "ext") == 0 && number <= 1)
+    {
+        plan.extended = number != 0;
+    }
+    else if (strcmp(key, "len") == 0 && number <= 8)
+    {
+        plan.length = static_cast<uint8_t>(number);
+    }
+    else if (strcmp(key, "rate") == 0 && number <= MAX_RATE)
+    {
+        plan.rate = number;
+    }
+    else if (strcmp(key, "count") == 0)
+    {
+        plan.count = number;
+    }
+    else if (strcmp(key, "seed") == 0)
+    {
+        plan.seed = number;
+    }
+    else
+    {
+        s_error = "unknown key or value out of range";
+        return false;
+    }
+    return true;
+}
+
+// Hex IDs joined with '+'
+bool PayloadFuzzer::parseIds(const char* text, uint32_t* ids, uint8_t& count)
+{
+    count = 0;
+    const char* cursor = text;
+    while (*cursor)
+    {
+        char* end = nullptr;
+        unsigned long id = strtoul(cursor, &end, 16);
+        if (end == cursor || (*end != '+' && *end != '\0') || id > 0x1FFFFFFF)
+        {
+            s_error = "IDs must look like 7E0+7DF";
+            return false;
+        }
+        if (count == MAX_IDS)
+        {
+            s_error = "too many IDs";
+            return false;
+        }
+        ids[count++] = static_cast<uint32_t>(id);
+        cursor = *end == '+' ? end + 1 : end;
+    }
+    return true;
+}
+
+const char* PayloadFuzzer::lastError()
+{
+    return s_error;
+}
+
+void PayloadFuzzer::generate(const Plan& plan, uint32_t index, Frame& frame)
+{
+    frame.index = index;
+    frame.id = plan.ids[index % plan.idCount];
+    frame.extended = plan.extended;
+    frame.length = plan.length;
+    memset(frame.data, 0, sizeof(frame.data));
+    // Every ID goes through the same payload sequence
+    uint32_t step = index / plan.idCount;
+    uint64_t seed = static_cast<uint64_t>(plan.seed) << 32;
+    uint32_t bits = plan.length * 8u;
+
+    switch (plan.mode)
+    {
+    case Mode::Random:
+        fill(frame.data, mix(seed | step));
+        break;
+    case Mode::BitWalk:
+    {
+        if (bits == 0)
+        {
+            break;
+        }
+        uint32_t pass = step / bits;
+        uint32_t bit = step % bits;
+        fill(frame.data, pass == 0 ? 0 : pass == 1 ? ~0ull : mix(seed | pass));
+        frame.data[bit / 8] ^= static_cast<uint8_t>(0x80 >> (bit % 8));     // Most significant bit first
+        break;
+    }
+    case Mode::Boundary:
+    {
+        uint32_t k = step % (BOUNDARY_COUNT + 2 * plan.length * BOUNDARY_COUNT);
+        if (k < BOUNDARY_COUNT)
+        {
+            memset(frame.data, BOUNDARY_VALUES[k], plan.length);
+            break;
+        }
+        k -= BOUNDARY_COUNT;
+        uint32_t perFiller = plan.length * BOUNDARY_COUNT;
+        memset(frame.data, k < perFiller ? 0x00 : 0xFF, plan.length);
+        k %= perFiller;
+        frame.data[k / BOUNDARY_COUNT] = BOUNDARY_VALUES[k % BOUNDARY_COUNT];
+        break;
+    }
+    }
+    memset(frame.data + plan.length, 0, 8 - plan.length);
+}
+
+const char* PayloadFuzzer::modeName(Mode mode)
+{
+    return MODE_NAMES[static_cast<uint8_t>(mode)];
+}
+
+const char* PayloadFuzzer::stateName(State state)
+{
+    return STATE_NAMES[static_cast<uint8_t>(state)];
+}
+
+const char* PayloadFuzzer::errorStateName(ErrorState state)
+{
+    return ERROR_STATE_NAMES[static_cast<uint8_t>(state)];
+}
+
+void PayloadFuzzer::start(const Plan& plan)
+{
+    uint8_t next = s_requestPublished ^ 1;
+    s_requests[next].start = true;
+    s_requests[next].plan = plan;
+    s_requestPublished = next;
+    s_requestRevision = s_requestRevision + 1;
+}
+
+void PayloadFuzzer::stop()
+{
+    uint8_t next = s_requestPublished ^ 1;
+    s_requests[next].start = false;
+    s_requestPublished = next;
+    s_requestRevision = s_requestRevision + 1;
+}
+
+void PayloadFuzzer::service(uint32_t nowUs)
+{
+    if (s_requestRevision != s_appliedRevision)
+    {
+        s_appliedRevision = s_requestRevision;
+        const Request& request = s_requests[s_requestPublished];
+        if (request.start)
+        {
+            uint8_t next = s_planPublished ^ 1;
+            s_plans[next] = request.plan;
+            s_planPublished = next;
+            s_sent = 0;
+            s_elapsedUs = 0;
+            s_elapsedMs = 0;
+            s_lastPollUs = nowUs;
+            s_lastSentUs = 0;
+            s_busErrorsKnown = false;
+            s_eventCount.store(0, std::memory_order_release);
+            s_state = State::Running;
+        }
+        else if (active())
+        {
+            s_state = State::Stopped;
+        }
+    }
+    if (!active())
+    {
+        return;
+    }
+    advance(nowUs);
+    const Plan& plan = s_plans[s_planPublished];
+    if (s_state == State::Running && plan.count != 0 && s_sent >= plan.count)
+    {
+        s_state = State::Draining;
+    }
+    if (s_state == State::Draining && s_elapsedUs - s_lastSentUs >= TAIL_US)
+    {
+        s_state = State::Finished;
+    }
+}
+
+bool PayloadFuzzer::active()
+{
+    State state = s_state;
+    return state == State::Running || state == State::Draining;
+}
+
+bool PayloadFuzzer::poll(uint32_t nowUs, Frame& frame)
+{
+    if (s_state != State::Running)
+    {
+        return false;
+    }
+    const Plan& plan = s_plans[s_planPublished];
+    if (plan.count != 0 && s_sent >= plan.count)
+    {
+        return false;
+    }
+    // Frame n is due n / rate seconds into the run; a run that fell behind
+    // catches up as fast as the queue takes frames, none are skipped
+    advance(nowUs);
+    if (plan.rate != 0 && s_elapsedUs * plan.rate < static_cast<uint64_t>(s_sent) * 1000000)
+    {
+        return false;
+    }
+    generate(plan, s_sent, frame);
+    return true;
+}
+
+void PayloadFuzzer::sent()
+{
+    s_sent = s_sent + 1;
+    s_lastSentUs = s_elapsedUs;
+}
+
+uint32_t PayloadFuzzer::idleUs(uint32_t nowUs)
+{
+    if (s_state != State::Running)
+    {
+        return UINT32_MAX;
+    }
+    const Plan& plan = s_plans[s_planPublished];
+    if (plan.rate == 0)
+    {
+        return 0;
+    }
+    uint64_t elapsedUs = s_elapsedUs + (nowUs - s_lastPollUs);
+    uint64_t dueUs = (static_cast<uint64_t>(s_sent) * 1000000 + plan.rate - 1) / plan.rate;
+    if (dueUs <= elapsedUs)
+    {
+        return 0;
+    }
+    return dueUs - elapsedUs > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(dueUs - elapsedUs);
+}
+
+void PayloadFuzzer::onReceive(const CANMessage& msg, bool extended, uint32_t nowUs, uint32_t inFlight)
+{
+    if (!active())
+    {
+        return;
+    }
+    const Plan& plan = s_plans[s_planPublished];
+    bool response = plan.responseCount == 0;
+    for (uint8_t i = 0; i < plan.responseCount && !response; ++i)
+    {
+        response = plan.responses[i] == msg.id;
+    }
+    if (!response)
+    {
+        return;
+    }
+    Event event = Event();
+    event.kind = EventKind::Response;
+    event.received = msg;
+    event.receivedExtended = extended;
+    event.state = s_errorState;
+    event.busErrors = s_busErrors;
+    log(event, nowUs, inFlight);
+}
+
+void PayloadFuzzer::onErrorState(ErrorState state, uint8_t txErrors, uint8_t rxErrors, uint32_t busErrors,
+                                 uint32_t nowUs, uint32_t inFlight)
+{
+    // The first report after start only sets the baseline for bus errors
+    bool changed = state != s_errorState;
+    bool newBusErrors = s_busErrorsKnown && busErrors != s_busErrors;
+    s_errorState = state;
+    s_busErrors = busErrors;
+    s_busErrorsKnown = true;
+    if (!active() || (!changed && !newBusErrors))
+    {
+        return;
+    }
+    Event event = Event();
+    event.kind = changed ? EventKind::ErrorState : EventKind::BusErrors;
+    event.state = state;
+    event.txErrors = txErrors;
+    event.rxErrors = rxErrors;
+    event.busErrors = busErrors;
+    log(event, nowUs, inFlight);
+    if (state == ErrorState::BusOff)
+    {
+        s_state = State::BusOff;
+    }
+}
+
+// The newest fuzz frame the controller had finished is the one before the
+// frames still in flight; with other transmissions mixed in it may be off
+// by those
+void PayloadFuzzer::log(Event& event, uint32_t nowUs, uint32_t inFlight)
+{
+    if (!s_log)
+    {
+        return;
+    }
+    event.timeUs = nowUs;
+    event.hasPreceding = s_sent > inFlight;
+    if (event.hasPreceding)
+    {
+        generate(s_plans[s_planPublished], s_sent - 1 - inFlight, event.preceding);
+    }
+    else
+    {
+        memset(&event.preceding, 0, sizeof(event.preceding));
+    }
+    uint32_t count = s_eventCount.load(std::memory_order_relaxed);
+    s_log[count % s_logCapacity] = event;
+    s_eventCount.store(count + 1, std::memory_order_release);
+}
+
+void PayloadFuzzer::advance(uint32_t nowUs)
+{
+    s_elapsedUs += nowUs - s_lastPollUs;
+    s_lastPollUs = nowUs;
+    s_elapsedMs = static_cast<uint32_t>(s_elapsedUs / 1000);
+}
+
+PayloadFuzzer::State PayloadFuzzer::state()
+{
+    return s_state;
+}
+
+PayloadFuzzer::Plan PayloadFuzzer::plan()
+{
+    return s_plans[s_planPublished];
+}
+
+uint32_t PayloadFuzzer::framesSent()
+{
+    return s_sent;
+}
+
+uint32_t PayloadFuzzer::elapsedMs()
+{
+    return s_elapsedMs;
+}
+
+uint32_t PayloadFuzzer::eventCount()
+{
+    return s_eventCount.load(std::memory_order_acquire);
+}
+
+// The slot after the newest is the next to be written, and may be already
+uint32_t PayloadFuzzer::oldestEvent()
+{
+    uint32_t count = s_eventCount.load(std::memory_order_acquire);
+    return s_logCapacity && count >= s_logCapacity ? count - s_logCapacity + 1 : 0;
+}
+
+// The slot is copied first and checked after: if the CAN task could have
+// started overwriting it meanwhile, the copy is thrown away
+bool PayloadFuzzer::event(uint32_t number, Event& out)
+{
+    if (!s_log || number >= s_eventCount.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    out = s_log[number % s_logCapacity];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s_eventCount.load(std::memory_order_relaxed) - number < s_logCapacity;
+}
@@ -0,0 +1,186 @@
+#include "payload_search.h"
+#include "state_table.h"
+#include "trace.h"
+#include <string.h>
+
+namespace
+{
+    // -1 for anything but a hex digit; -2 for the ? wildcard
+    int nibbleValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return c == '?' ? -2 : -1;
+    }
+
+    bool isSeparator(char c)
+    {
+        return c == ' ' || c == '\t' || c == ',';
+    }
+
+    // Payload bytes as a little-endian word: byte i in bits 8i..8i+7
+    uint64_t payloadWord(const CANMessage& msg)
+    {
+        uint64_t word = 0;
+        for (uint8_t i = 0; i < 8; ++i)
+        {
+            word |= static_cast<uint64_t>(msg.data[i]) << (8 * i);
+        }
+        return word;
+    }
+
+    uint32_t fieldAt(uint64_t word, uint8_t start, uint8_t width, bool littleEndian)
+    {
+        uint64_t widthMask = (static_cast<uint64_t>(1) << (8 * width)) - 1;
+        if (littleEndian)
+        {
+            return static_cast<uint32_t>((word >> (8 * start)) & widthMask);
+        }
+        // Big endian: byte start is the most significant
+        return static_cast<uint32_t>((__builtin_bswap64(word) >> (8 * (8 - start - width))) & widthMask);
+    }
+}
+
+bool PayloadSearch::parsePattern(const char* text, size_t length, Query& query)
+{
+    uint64_t mask = 0;
+    uint64_t value = 0;
+    uint8_t bytes = 0;
+    size_t pos = 0;
+    while (true)
+    {
+        while (pos < length && isSeparator(text[pos]))
+        {
+            ++pos;
+        }
+        if (pos == length)
+        {
+            break;
+        }
+        size_t end = pos;
+        while (end < length && !isSeparator(text[end]))
+        {
+            ++end;
+        }
+        if (bytes == 8)
+        {
+            return false;
+        }
+
+        size_t tokenLength = end - pos;
+        const char* token = text + pos;
+        if (tokenLength > 2 && token[0] == '0' && (token[1] == 'x' || token[1] == 'X'))
+        {
+            token += 2;
+            tokenLength -= 2;
+        }
+        uint8_t shift = 8 * bytes;
+        if (tokenLength == 1 && (token[0] == '?' || token[0] == '*'))
+        {
+            // Any byte
+        }
+        else if (tokenLength == 2)
+        {
+            int high = nibbleValue(token[0]);
+            int low = nibbleValue(token[1]);
+            if (high == -1 || low == -1)
+            {
+                return false;
+            }
+            if (high >= 0)
+            {
+                mask |= static_cast<uint64_t>(0xF0) << shift;
+                value |= static_cast<uint64_t>(high << 4) << shift;
+            }
+            if (low >= 0)
+            {
+                mask |= static_cast<uint64_t>(0x0F) << shift;
+                value |= static_cast<uint64_t>(low) << shift;
+            }
+        }
+        else
+        {
+            return false;
+        }
+        ++bytes;
+        pos = end;
+    }
+    if (bytes == 0)
+    {
+        return false;
+    }
+
+    query.mask = mask;
+    query.value = value;
+    query.minLength = bytes;
+    return true;
+}
+
+bool PayloadSearch::setRange(Query& query, uint8_t start, uint8_t width, bool littleEndian, uint32_t min, uint32_t max)
+{
+    if (width == 0 || width > MAX_RANGE_WIDTH || (start != ANY_POSITION && start + width > 8))
+    {
+        return false;
+    }
+    query.hasRange = true;
+    query.rangeStart = start;
+    query.rangeWidth = width;
+    query.littleEndian = littleEndian;
+    query.rangeMin = min;
+    query.rangeMax = max;
+    return true;
+}
+
+bool PayloadSearch::matches(const Query& query, const CANMessage& msg)
+{
+    uint8_t length = msg.length < 8 ? msg.length : 8;
+    if (length < query.minLength)
+    {
+        return false;
+    }
+    uint64_t word = payloadWord(msg);
+    if ((word & query.mask) != query.value)
+    {
+        return false;
+    }
+    if (!query.hasRange)
+    {
+        return true;
+    }
+
+    // A fixed position tests one field; any position tests every field that
+    // fits inside the payload
+    uint8_t first = query.rangeStart == ANY_POSITION ? 0 : query.rangeStart;
+    uint8_t last = query.rangeStart == ANY_POSITION ? length - query.rangeWidth : query.rangeStart;
+    if (length < query.rangeWidth || last + query.rangeWidth > length)
+    {
+        return false;
+    }
+    for (uint8_t start = first; start <= last; ++start)
+    {
+        uint32_t field = fieldAt(word, start, query.rangeWidth, query.littleEndian);
+        if (field >= query.rangeMin && field <= query.rangeMax)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint16_t PayloadSearch::run(const Query& query, uint16_t* slots, uint16_t maxSlots)
+{
+    TRACE_SCOPE("search");
+    uint16_t size = 0;
+    const uint16_t* order = StateTable::slotsById(size);
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < size && count < maxSlots; ++i)
+    {
+        const StateTable::Entry& entry = StateTable::entry(order[i]);
+        if (entry.hasLatest && matches(query, entry.latest))
+        {
+            slots[count++] = order[i];
+        }
+    }
+    return count;
+}
@@ -0,0 +1,356 @@
+#include "rate_history.h"
+#include "can_stats.h"
+#include "state_table.h"
+#include "render_buffer.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+namespace
+{
+    constexpr uint8_t TOTAL_TRACKS = 2;                 // Frame rate and bus load
+    constexpr uint32_t MAX_CATCH_UP_SECONDS = 86400;    // Bounds the work after a long stall
+    constexpr uint8_t VALUES_PER_ROW = 16;
+
+    const char* const SERIES_NAMES[] = { "frameRate", "busLoad", "idRate" };
+
+    uint32_t pointsPerTrack()
+    {
+        uint32_t points = 0;
+        for (uint16_t levelPoints : RateHistory::POINTS)
+        {
+            points += levelPoints;
+        }
+        return points;
+    }
+
+    uint16_t clampValue(uint32_t value)
+    {
+        return value > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(value);
+    }
+}
+
+constexpr uint32_t RateHistory::STEP_SECONDS[LEVELS];
+constexpr uint16_t RateHistory::POINTS[LEVELS];
+
+uint16_t* RateHistory::s_storage = nullptr;
+RateHistory::Track* RateHistory::s_tracks = nullptr;
+uint32_t* RateHistory::s_watchedIds = nullptr;
+uint8_t RateHistory::s_watchCapacity = 0;
+uint32_t RateHistory::s_seconds = 0;
+uint32_t RateHistory::s_carryMs = 0;
+
+bool RateHistory::begin(uint8_t watchCapacity)
+{
+    if (s_storage)
+    {
+        return true;
+    }
+
+    watchCapacity = std::min<uint8_t>(watchCapacity, HISTORY_WATCH_IDS);
+    uint8_t trackCount = TOTAL_TRACKS + watchCapacity;
+    s_storage = new (std::nothrow) uint16_t[pointsPerTrack() * trackCount];
+    s_tracks = new (std::nothrow) Track[trackCount];
+    s_watchedIds = new (std::nothrow) uint32_t[watchCapacity ? watchCapacity : 1];
+    if (!s_storage || !s_tracks || !s_watchedIds)
+    {
+        return false;
+    }
+
+    uint16_t* values = s_storage;
+    for (uint8_t t = 0; t < trackCount; ++t)
+    {
+        for (uint8_t level = 0; level < LEVELS; ++level)
+        {
+            s_tracks[t].rings[level].values = values;
+            values += POINTS[level];
+        }
+        resetTrack(s_tracks[t]);
+    }
+    for (uint8_t i = 0; i < watchCapacity; ++i)
+    {
+        s_watchedIds[i] = NO_ID;
+    }
+    s_watchCapacity = watchCapacity;
+    s_seconds = 0;
+    s_carryMs = 0;
+    return true;
+}
+
+void RateHistory::resetTrack(Track& track)
+{
+    for (Ring& ring : track.rings)
+    {
+        ring.head = 0;
+        ring.count = 0;
+        ring.rollupSum = 0;
+        ring.rollupCount = 0;
+    }
+}
+
+// Stores a point and averages each full group of points into the next level
+void RateHistory::push(Track& track, uint8_t level, uint32_t value)
+{
+    Ring& ring = track.rings[level];
+    ring.values[ring.head] = clampValue(value);
+    ring.head = (ring.head + 1) % POINTS[level];
+    if (ring.count < POINTS[level])
+    {
+        ++ring.count;
+    }
+
+    if (level + 1 == LEVELS)
+    {
+        return;
+    }
+    ring.rollupSum += value;
+    if (++ring.rollupCount == STEP_SECONDS[level + 1] / STEP_SECONDS[level])
+    {
+        uint32_t average = (ring.rollupSum + ring.rollupCount / 2) / ring.rollupCount;
+        ring.rollupSum = 0;
+        ring.rollupCount = 0;
+        push(track, level + 1, average);
+    }
+}
+
+void RateHistory::record(uint32_t windowMs)
+{
+    if (!s_storage)
+    {
+        return;
+    }
+
+    uint32_t frameRate = CanStatistics::frameRate();
+    uint32_t busLoad = CanStatistics::busLoadPermille();
+    uint32_t idRates[HISTORY_WATCH_IDS > 0 ? HISTORY_WATCH_IDS : 1] = {};
+    for (uint8_t i = 0; i < s_watchCapacity && s_watchedIds[i] != NO_ID; ++i)
+    {
+        uint16_t slot = StateTable::find(s_watchedIds[i]);
+        idRates[i] = slot != StateTable::NO_SLOT ? CanStatistics::counters(slot).rate : 0;
+    }
+
+    // A window longer than a second (a late tick) fills each second it
+    // covered with its average. The first window reaches back to whenever
+    // the statistics started and only counts as one point.
+    s_carryMs = s_seconds == 0 ? 1000 : s_carryMs + windowMs;
+    uint32_t seconds = std::min(s_carryMs / 1000, MAX_CATCH_UP_SECONDS);
+    s_carryMs %= 1000;
+    for (uint32_t s = 0; s < seconds; ++s)
+    {
+        push(s_tracks[0], 0, frameRate);
+        push(s_tracks[1], 0, busLoad);
+        for (uint8_t i = 0; i < s_watchCapacity && s_watchedIds[i] != NO_ID; ++i)
+        {
+            push(s_tracks[TOTAL_TRACKS + i], 0, idRates[i]);
+        }
+        ++s_seconds;
+    }
+}
+
+bool RateHistory::watch(uint32_t id)
+{
+    uint8_t count = watchedCount();
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        if (s_watchedIds[i] == id)
+        {
+            return true;
+        }
+    }
+    if (count == s_watchCapacity)
+    {
+        return false;
+    }
+    s_watchedIds[count] = id;
+    resetTrack(s_tracks[TOTAL_TRACKS + count]);
+    return true;
+}
+
+// Watched IDs stay packed at the front; the last one takes the freed place
+bool RateHistory::unwatch(uint32_t id)
+{
+    uint8_t count = watchedCount();
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        if (s_watchedIds[i] == id)
+        {
+            uint8_t last = count - 1;
+            s_watchedIds[i] = s_watchedIds[last];
+            std::swap(s_tracks[TOTAL_TRACKS + i], s_tracks[TOTAL_TRACKS + last]);
+            s_watchedIds[last] = NO_ID;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t RateHistory::watchedCount()
+{
+    uint8_t count = 0;
+    while (count < s_watchCapacity && s_watchedIds[count] != NO_ID)
+    {
+        ++count;
+    }
+    return count;
+}
+
+uint32_t RateHistory::watchedId(uint8_t index)
+{
+    return index < s_watchCapacity ? s_watchedIds[index] : NO_ID;
+}
+
+uint32_t RateHistory::recordedSeconds()
+{
+    return s_seconds;
+}
+
+const char* RateHistory::seriesName(Series series)
+{
+    return SERIES_NAMES[static_cast<size_t>(series)];
+}
+
+bool RateHistory::parseSeries(const char* name, Series& series)
+{
+    for (size_t i = 0; i < sizeof(SERIES_NAMES) / sizeof(SERIES_NAMES[0]); ++i)
+    {
+        if (strcmp(name, SERIES_NAMES[i]) == 0)
+        {
+            series = static_cast<Series>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+int8_t RateHistory::levelForStep(uint32_t stepSeconds)
+{
+    for (uint8_t level = 0; level < LEVELS; ++level)
+    {
+        if (STEP_SECONDS[level] == stepSeconds)
+        {
+            return static_cast<int8_t>(level);
+        }
+    }
+    return -1;
+}
+
+int8_t RateHistory::trackFor(Series series, uint32_t id)
+{
+    switch (series)
+    {
+    case Series::FrameRate:
+        return 0;
+    case Series::BusLoad:
+        return 1;
+    case Series::IdRate:
+        for (uint8_t i = 0; i < watchedCount(); ++i)
+        {
+            if (s_watchedIds[i] == id)
+            {
+                return static_cast<int8_t>(TOTAL_TRACKS + i);
+            }
+        }
+        break;
+    }
+    return -1;
+}
+
+bool RateHistory::beginExport(Export& exp, Series series, uint8_t level, uint32_t id)
+{
+    int8_t track = s_storage && level < LEVELS ? trackFor(series, id) : -1;
+    if (track < 0)
+    {
+        return false;
+    }
+    const Ring& ring = s_tracks[track].rings[level];
+    exp = Export();
+    exp.series = series;
+    exp.level = level;
+    exp.track = track;
+    exp.id = id;
+    exp.count = ring.count;
+    exp.first = (ring.head + POINTS[level] - ring.count) % POINTS[level];
+    // Time of the newest point at this level, in seconds since recording started
+    exp.endSeconds = s_seconds / STEP_SECONDS[level] * STEP_SECONDS[level];
+    return true;
+}
+
+size_t RateHistory::fill(Export& exp, uint8_t* buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (exp.rowSent == exp.rowLength)
+        {
+            if (!renderNext(exp))
+            {
+                break;
+            }
+            continue;
+        }
+        size_t count = std::min(maxLen - written, exp.rowLength - exp.rowSent);
+        memcpy(buffer + written, exp.row + exp.rowSent, count);
+        exp.rowSent += count;
+        written += count;
+    }
+    return written;
+}
+
+// Renders the next piece of JSON into exp.row; false once finished
+bool RateHistory::renderNext(Export& exp)
+{
+    RenderBuffer out(exp.row, sizeof(exp.row));
+    switch (exp.stage)
+    {
+    case ExportStage::Prefix:
+        out.append("{\"series\":\"");
+        out.append(seriesName(exp.series));
+        if (exp.series == Series::IdRate)
+        {
+            out.append("\",\"id\":\"0x");
+            out.appendHex(exp.id);
+        }
+        out.append("\",\"stepSeconds\":");
+        out.appendDec(STEP_SECONDS[exp.level]);
+        out.append(",\"endSeconds\":");
+        out.appendDec(exp.endSeconds);
+        out.append(",\"values\":[");
+        exp.stage = ExportStage::Values;
+        break;
+    case ExportStage::Values:
+    {
+        if (exp.next == exp.count)
+        {
+            exp.stage = ExportStage::Suffix;
+            return renderNext(exp);
+        }
+        // Oldest first; the ring is read live, see Export
+        const Ring& ring = s_tracks[exp.track].rings[exp.level];
+        for (uint8_t i = 0; i < VALUES_PER_ROW && exp.next < exp.count; ++i, ++exp.next)
+        {
+            if (exp.next > 0)
+            {
+                out.appendChar(',');
+            }
+            out.appendDec(ring.values[(exp.first + exp.next) % POINTS[exp.level]]);
+        }
+        break;
+    }
+    case ExportStage::Suffix:
+        out.append("]}");
+        exp.stage = ExportStage::Done;
+        break;
+    case ExportStage::Done:
+        return false;
+    }
+    exp.rowLength = out.length();
+    exp.rowSent = 0;
+    return true;
+}
+
+size_t RateHistory::memoryBytes()
+{
+    return s_storage ? pointsPerTrack() * (TOTAL_TRACKS + s_watchCapacity) * sizeof(uint16_t) +
+                       (TOTAL_TRACKS + s_watchCapacity) * sizeof(Track) + s_watchCapacity * sizeof(uint32_t)
+                     : 0;
+}
@@ -0,0 +1,140 @@
+#include "render_buffer.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    // Two characters per entry: "000102...feff" and "0001...99"
+    struct DigitTables
+    {
+        char hex[256 * 2];
+        char dec[100 * 2];
+
+        constexpr DigitTables() : hex(), dec()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                hex[i * 2] = "0123456789abcdef"[i >> 4];
+                hex[i * 2 + 1] = "0123456789abcdef"[i & 0xF];
+            }
+            for (int i = 0; i < 100; ++i)
+            {
+                dec[i * 2] = static_cast<char>('0' + i / 10);
+                dec[i * 2 + 1] = static_cast<char>('0' + i % 10);
+            }
+        }
+    };
+
+    constexpr DigitTables DIGITS;
+}
+
+RenderBuffer::RenderBuffer(char* storage, size_t capacity)
+    : m_storage(storage), m_capacity(capacity), m_length(0), m_overflowed(false)
+{
+    if (m_capacity)
+    {
+        m_storage[0] = '\0';
+    }
+}
+
+void RenderBuffer::clear()
+{
+    m_length = 0;
+    m_overflowed = false;
+    if (m_capacity)
+    {
+        m_storage[0] = '\0';
+    }
+}
+
+bool RenderBuffer::append(const char* text)
+{
+    return append(text, strlen(text));
+}
+
+bool RenderBuffer::append(const char* text, size_t length)
+{
+    // One byte is always kept for the terminator
+    if (m_overflowed || m_length + length >= m_capacity)
+    {
+        m_overflowed = true;
+        return false;
+    }
+    memcpy(m_storage + m_length, text, length);
+    m_length += length;
+    m_storage[m_length] = '\0';
+    return true;
+}
+
+bool RenderBuffer::appendChar(char c)
+{
+    return append(&c, 1);
+}
+
+bool RenderBuffer::appendf(const char* format, ...)
+{
+    if (m_overflowed)
+    {
+        return false;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(m_storage + m_length, m_capacity - m_length, format, args);
+    va_end(args);
+
+    if (written < 0 || m_length + static_cast<size_t>(written) >= m_capacity)
+    {
+        m_storage[m_length] = '\0';
+        m_overflowed = true;
+        return false;
+    }
+    m_length += static_cast<size_t>(written);
+    return true;
+}
+
+bool RenderBuffer::appendHexByte(uint8_t value)
+{
+    return append(&DIGITS.hex[value * 2], 2);
+}
+
+bool RenderBuffer::appendHex(uint32_t value)
+{
+    // Filled from the end, one table lookup per byte
+    char digits[8];
+    char* p = digits + sizeof(digits);
+    do
+    {
+        p -= 2;
+        memcpy(p, &DIGITS.hex[(value & 0xFF) * 2], 2);
+        value >>= 8;
+    } while (value);
+    if (*p == '0' && p + 1 < digits + sizeof(digits))
+    {
+        ++p;
+    }
+    return append(p, digits + sizeof(digits) - p);
+}
+
+bool RenderBuffer::appendDec(uint32_t value)
+{
+    char digits[10];
+    char* p = digits + sizeof(digits);
+    while (value >= 100)
+    {
+        p -= 2;
+        memcpy(p, &DIGITS.dec[(value % 100) * 2], 2);
+        value /= 100;
+    }
+    if (value >= 10)
+    {
+        p -= 2;
+        memcpy(p, &DIGITS.dec[value * 2], 2);
+    }
+    else
+    {
+        *--p = static_cast<char>('0' + value);
+    }
+    return append(p, digits + sizeof(digits) - p);
+}
@@ -0,0 +1,499 @@
+#include "request_parser.h"
+#include "state_table.h"
+#include <algorithm>
+#include <iterator>
+#include <string.h>
+
+namespace
+{
+    constexpr uint8_t MAX_HEX_DIGITS = 8;
+
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    const char* skipSpace(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+        {
+            ++p;
+        }
+        return p;
+    }
+
+    // Leading hex digits at p, after an optional 0x; stops at the first other
+    // character. False when there are no digits or the value exceeds 32 bits.
+    bool parseHex(const char*& p, const char* end, uint32_t& value)
+    {
+        if (end - p >= 3 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && hexValue(p[2]) >= 0)
+        {
+            p += 2;
+        }
+        value = 0;
+        uint8_t significant = 0;
+        const char* start = p;
+        int digit;
+        while (p < end && (digit = hexValue(*p)) >= 0)
+        {
+            if (value != 0 || digit != 0)
+            {
+                if (++significant > MAX_HEX_DIGITS)
+                {
+                    return false;
+                }
+            }
+            value = (value << 4) | static_cast<uint32_t>(digit);
+            ++p;
+        }
+        return p != start;
+    }
+
+    // Leading decimal digits at p; false when there are none or the value exceeds max
+    bool parseDecimal(const char*& p, const char* end, uint32_t max, uint32_t& value)
+    {
+        value = 0;
+        const char* start = p;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            uint64_t next = static_cast<uint64_t>(value) * 10 + static_cast<uint32_t>(*p - '0');
+            if (next > max)
+            {
+                return false;
+            }
+            value = static_cast<uint32_t>(next);
+            ++p;
+        }
+        return p != start;
+    }
+
+    // A whole parameter as a number: decimal, or hex with a 0x prefix
+    bool parseNumber(const RequestParser::Param& param, uint32_t max, uint32_t& value)
+    {
+        const char* p = param.data;
+        const char* end = param.data + param.length;
+        bool hex = param.length > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X');
+        if (hex ? !parseHex(p, end, value) : !parseDecimal(p, end, max, value))
+        {
+            return false;
+        }
+        return p == end && value <= max;
+    }
+
+    bool paramIs(const RequestParser::Param& param, const char* text)
+    {
+        return param.length == strlen(text) && memcmp(param.data, text, param.length) == 0;
+    }
+
+    // Dotted IPv4 address with an optional port, e.g. "192.168.4.1:3190"
+    bool parseEndpoint(const RequestParser::Param& param, uint32_t& address, uint16_t& port)
+    {
+        const char* p = param.data;
+        const char* end = param.data + param.length;
+        address = 0;
+        for (uint8_t octet = 0; octet < 4; ++octet)
+        {
+            uint32_t value;
+            if ((octet > 0 && (p == end || *p++ != '.')) || !parseDecimal(p, end, 255, value))
+            {
+                return false;
+            }
+            address = (address << 8) | value;
+        }
+        if (p < end)
+        {
+            uint32_t value;
+            if (*p++ != ':' || !parseDecimal(p, end, 0xFFFF, value) || p != end || value == 0)
+            {
+                return false;
+            }
+            port = static_cast<uint16_t>(value);
+        }
+        return address != 0;
+    }
+
+    // A whole token as hex, with or without 0x, surrounding spaces allowed
+    bool parseHexToken(const char* p, const char* end, uint32_t& value)
+    {
+        p = skipSpace(p, end);
+        if (p == end || !parseHex(p, end, value))
+        {
+            return false;
+        }
+        return skipSpace(p, end) == end;
+    }
+
+    // Comma-separated hex IDs; false on a malformed ID or more than capacity
+    bool parseHexList(const RequestParser::Param& param, uint32_t* ids, uint8_t capacity, uint8_t& count)
+    {
+        const char* p = param.data;
+        const char* end = param.data + param.length;
+        count = 0;
+        if (skipSpace(p, end) == end)
+        {
+            return true;
+        }
+        while (true)
+        {
+            const char* tokenEnd = static_cast<const char*>(memchr(p, ',', end - p));
+            if (!tokenEnd)
+            {
+                tokenEnd = end;
+            }
+            if (count == capacity || !parseHexToken(p, tokenEnd, ids[count]))
+            {
+                return false;
+            }
+            ++count;
+            if (tokenEnd == end)
+            {
+                return true;
+            }
+            p = tokenEnd + 1;
+        }
+    }
+
+    // Start of the value of "key": in the body, after whitespace; nullptr when absent
+    const char* findValue(const char* body, const char* end, const char* key)
+    {
+        size_t keyLength = strlen(key);
+        for (const char* p = body; end - p >= static_cast<ptrdiff_t>(keyLength + 3); ++p)
+        {
+            if (p[0] != '"' || memcmp(p + 1, key, keyLength) != 0 || p[keyLength + 1] != '"')
+            {
+                continue;
+            }
+            const char* value = skipSpace(p + keyLength + 2, end);
+            if (value < end && *value == ':')
+            {
+                return skipSpace(value + 1, end);
+            }
+        }
+        return nullptr;
+    }
+}
+
+uint16_t RequestParser::parseIdList(const char* text, size_t length, uint16_t* slots, uint16_t maxSlots)
+{
+    uint16_t count = 0;
+    const char* p = text;
+    const char* end = text + length;
+    while (length > 0)
+    {
+        const char* tokenEnd = static_cast<const char*>(memchr(p, ',', end - p));
+        if (!tokenEnd)
+        {
+            tokenEnd = end;
+        }
+
+        // Trailing junk after the digits is ignored, as strtoul would
+        const char* q = skipSpace(p, tokenEnd);
+        uint32_t value;
+        if (q < tokenEnd && parseHex(q, tokenEnd, value) && count < maxSlots)
+        {
+            uint16_t slot = StateTable::find(value);
+            if (slot != StateTable::NO_SLOT)
+            {
+                slots[count++] = slot;
+            }
+        }
+        if (tokenEnd == end)
+        {
+            break;
+        }
+        p = tokenEnd + 1;
+    }
+
+    // Rows are emitted in ID order, each ID once
+    std::sort(slots, slots + count, [](uint16_t a, uint16_t b)
+    {
+        return StateTable::entry(a).latest.id < StateTable::entry(b).latest.id;
+    });
+    return static_cast<uint16_t>(std::unique(slots, slots + count) - slots);
+}
+
+bool RequestParser::parseTransmitBody(const char* body, size_t length, TransmitRequest& request)
+{
+    const char* end = body + length;
+    request = TransmitRequest();
+
+    const char* p = findValue(body, end, "id");
+    if (!p || p == end || *p++ != '"')
+    {
+        return false;
+    }
+    p = skipSpace(p, end);
+    if (!parseHex(p, end, request.id))
+    {
+        return false;
+    }
+    p = skipSpace(p, end);
+    if (p == end || *p != '"')
+    {
+        return false;
+    }
+
+    uint32_t value;
+    p = findValue(body, end, "length");
+    if (!p || !parseDecimal(p, end, 8, value))
+    {
+        return false;
+    }
+    request.length = static_cast<uint8_t>(value);
+
+    p = findValue(body, end, "data");
+    if (!p || p == end || *p++ != '[')
+    {
+        return false;
+    }
+    p = skipSpace(p, end);
+    if (p < end && *p == ']')
+    {
+        return request.length == 0;
+    }
+    while (p < end)
+    {
+        if (request.byteCount == sizeof(request.data))
+        {
+            return false;
+        }
+        bool hex = end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X');
+        if (hex ? !parseHex(p, end, value) || value > 0xFF : !parseDecimal(p, end, 0xFF, value))
+        {
+            return false;
+        }
+        request.data[request.byteCount++] = static_cast<uint8_t>(value);
+
+        p = skipSpace(p, end);
+        if (p < end && *p == ']')
+        {
+            return request.byteCount >= request.length;
+        }
+        if (p == end || *p++ != ',')
+        {
+            return false;
+        }
+        p = skipSpace(p, end);
+    }
+    return false;
+}
+
+bool RequestParser::parseSearchQuery(const SearchParams& params, PayloadSearch::Query& query)
+{
+    PayloadSearch::Query parsed;
+    if (params.pattern.data && !PayloadSearch::parsePattern(params.pattern.data, params.pattern.length, parsed))
+    {
+        return false;
+    }
+
+    if (params.min.data || params.max.data)
+    {
+        uint32_t width = 1;
+        uint32_t start = PayloadSearch::ANY_POSITION;
+        bool littleEndian = false;
+        if (params.width.data && !parseNumber(params.width, PayloadSearch::MAX_RANGE_WIDTH, width))
+        {
+            return false;
+        }
+        if (params.at.data && !paramIs(params.at, "any") && !parseNumber(params.at, 7, start))
+        {
+            return false;
+        }
+        if (params.endian.data)
+        {
+            if (!paramIs(params.endian, "le") && !paramIs(params.endian, "be"))
+            {
+                return false;
+            }
+            littleEndian = paramIs(params.endian, "le");
+        }
+
+        uint32_t widest = width >= 4 ? 0xFFFFFFFFu : (1u << (8 * width)) - 1;
+        uint32_t min = 0;
+        uint32_t max = widest;
+        if ((params.min.data && !parseNumber(params.min, widest, min)) ||
+            (params.max.data && !parseNumber(params.max, widest, max)) ||
+            !PayloadSearch::setRange(parsed, static_cast<uint8_t>(start), static_cast<uint8_t>(width), littleEndian,
+                                     min, max))
+        {
+            return false;
+        }
+    }
+    else if (!params.pattern.data)
+    {
+        return false;
+    }
+
+    query = parsed;
+    return true;
+}
+
+bool RequestParser::parseBytePair(const char* text, size_t length, uint8_t& first, uint8_t& second)
+{
+    if (length != 3 || text[1] != ',' || text[0] < '0' || text[0] > '7' || text[2] < '0' || text[2] > '7' ||
+        text[0] == text[2])
+    {
+        return false;
+    }
+    first = static_cast<uint8_t>(text[0] - '0');
+    second = static_cast<uint8_t>(text[2] - '0');
+    return true;
+}
+
+bool RequestParser::parseConfigForm(const ConfigParams& params, DeviceConfig::Settings& settings)
+{
+    uint32_t value;
+    if (params.bitrate.data)
+    {
+        if (!parseNumber(params.bitrate, 0xFFFFFFFFu, value))
+        {
+            return false;
+        }
+        settings.can.bitrate = value;
+    }
+    if (params.mode.data && !DeviceConfig::parseCanMode(params.mode.data, params.mode.length, settings.can.mode))
+    {
+        return false;
+    }
+    if (params.filterId.data)
+    {
+        if (!parseHexToken(params.filterId.data, params.filterId.data + params.filterId.length, value))
+        {
+            return false;
+        }
+        settings.can.filterId = value;
+    }
+    if (params.filterMask.data)
+    {
+        if (!parseHexToken(params.filterMask.data, params.filterMask.data + params.filterMask.length, value))
+        {
+            return false;
+        }
+        settings.can.filterMask = value;
+    }
+    if (params.filterExtended.data)
+    {
+        if (!paramIs(params.filterExtended, "0") && !paramIs(params.filterExtended, "1"))
+        {
+            return false;
+        }
+        settings.can.filterExtended = paramIs(params.filterExtended, "1");
+    }
+
+    if (params.sampling.data)
+    {
+        const ViewSampler::Mode modes[] = { ViewSampler::Mode::Off, ViewSampler::Mode::OneInN,
+                                            ViewSampler::Mode::Interval };
+        const ViewSampler::Mode* mode = std::find_if(std::begin(modes), std::end(modes), [&](ViewSampler::Mode m)
+        {
+            return paramIs(params.sampling, ViewSampler::modeName(m));
+        });
+        if (mode == std::end(modes))
+        {
+            return false;
+        }
+        settings.samplingMode = *mode;
+    }
+    if (params.samplingValue.data)
+    {
+        if (!parseNumber(params.samplingValue, 0xFFFFFFFFu, value))
+        {
+            return false;
+        }
+        settings.samplingValue = value;
+    }
+
+    if ((params.history.data &&
+         !parseHexList(params.history, settings.historyIds, HISTORY_WATCH_IDS, settings.historyCount)) ||
+        (params.histograms.data &&
+         !parseHexList(params.histograms, settings.histogramIds, HISTOGRAM_IDS, settings.histogramCount)))
+    {
+        return false;
+    }
+
+    if (params.pairs.data)
+    {
+        const char* p = params.pairs.data;
+        const char* end = params.pairs.data + params.pairs.length;
+        settings.pairCount = 0;
+        while (skipSpace(p, end) < end)
+        {
+            const char* entryEnd = static_cast<const char*>(memchr(p, ';', end - p));
+            if (!entryEnd)
+            {
+                entryEnd = end;
+            }
+            // ID, a colon, then the byte pair as /histogram takes it
+            const char* colon = static_cast<const char*>(memchr(p, ':', entryEnd - p));
+            if (!colon || settings.pairCount == HISTOGRAM_PAIRS)
+            {
+                return false;
+            }
+            DeviceConfig::Pair& pair = settings.pairs[settings.pairCount];
+            const char* bytes = skipSpace(colon + 1, entryEnd);
+            const char* bytesEnd = entryEnd;
+            while (bytesEnd > bytes && isSpace(bytesEnd[-1]))
+            {
+                --bytesEnd;
+            }
+            if (!parseHexToken(p, colon, pair.id) ||
+                !parseBytePair(bytes, static_cast<size_t>(bytesEnd - bytes), pair.first, pair.second))
+            {
+                return false;
+            }
+            ++settings.pairCount;
+            if (entryEnd == end)
+            {
+                break;
+            }
+            p = entryEnd + 1;
+        }
+    }
+
+    if (params.syncPeer.data)
+    {
+        settings.sync = DeviceConfig::Sync();
+        if (params.syncPeer.length > 0 && !parseEndpoint(params.syncPeer, settings.sync.peer, settings.sync.port))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RequestParser::copyConfigField(const char* value, size_t length, char* out, size_t outSize)
+{
+    if (length >= outSize || memchr(value, '\0', length))
+    {
+        return false;
+    }
+    memcpy(out, value, length);
+    out[length] = '\0';
+    return true;
+}
+
+uint32_t RequestParser::leadingNumber(const Param& param, uint8_t base)
+{
+    const char* p = skipSpace(param.data, param.data + param.length);
+    const char* end = param.data + param.length;
+    if (base == 16 && end - p >= 3 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && hexValue(p[2]) >= 0)
+    {
+        p += 2;
+    }
+    uint64_t value = 0;
+    int digit;
+    while (p < end && (digit = hexValue(*p)) >= 0 && digit < base)
+    {
+        value = std::min<uint64_t>(value * base + static_cast<uint32_t>(digit), UINT32_MAX);
+        ++p;
+    }
+    return static_cast<uint32_t>(value);
+}
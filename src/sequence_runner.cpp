@@ -0,0 +1,630 @@
+#include "sequence_runner.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    constexpr size_t MAX_STEP_LENGTH = 96;
+
+    const char* const STATE_NAMES[] = { "idle", "running", "done", "failed", "stopped" };
+    const char* const FAILURE_NAMES[] = { "none", "timeout", "transmit_failed" };
+    const char* const KIND_NAMES[] = { "send", "wait", "delay" };
+
+    // Splits off the next space-separated word; nullptr at the end
+    char* nextWord(char*& cursor)
+    {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+        {
+            ++cursor;
+        }
+        if (*cursor == '\0')
+        {
+            return nullptr;
+        }
+        char* word = cursor;
+        while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r')
+        {
+            ++cursor;
+        }
+        if (*cursor != '\0')
+        {
+            *cursor++ = '\0';
+        }
+        return word;
+    }
+
+    bool parseHex(const char* text, size_t length, uint32_t& out)
+    {
+        if (length == 0 || length > 8)
+        {
+            return false;
+        }
+        out = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            char c = text[i];
+            uint32_t digit = c >= '0' && c <= '9' ? c - '0'
+                           : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                           : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                                                  : 16;
+            if (digit == 16)
+            {
+                return false;
+            }
+            out = out << 4 | digit;
+        }
+        return true;
+    }
+
+    // As in candump logs: up to 3 hex digits is an 11-bit ID
+    bool parseId(const char* text, size_t length, uint32_t& id, bool& extended)
+    {
+        extended = length > 3;
+        return parseHex(text, length, id) && id <= (extended ? 0x1FFFFFFFu : 0x7FFu);
+    }
+
+    bool parseU32(const char* text, uint32_t& out)
+    {
+        char* end = nullptr;
+        unsigned long value = strtoul(text, &end, 10);
+        if (end == text || *end != '\0' || *text == '-')
+        {
+            return false;
+        }
+        out = static_cast<uint32_t>(value);
+        return true;
+    }
+
+    // Milliseconds, or microseconds with a "us" suffix
+    bool parseTime(const char* text, uint32_t& us)
+    {
+        char* end = nullptr;
+        unsigned long value = strtoul(text, &end, 10);
+        if (end == text || *text == '-' || value > SequenceRunner::MAX_TIME_MS * 1000ul)
+        {
+            return false;
+        }
+        if (strcmp(end, "us") == 0)
+        {
+            us = static_cast<uint32_t>(value);
+            return true;
+        }
+        if ((*end != '\0' && strcmp(end, "ms") != 0) || value > SequenceRunner::MAX_TIME_MS)
+        {
+            return false;
+        }
+        us = static_cast<uint32_t>(value) * 1000;
+        return true;
+    }
+}
+
+SequenceRunner::Request SequenceRunner::s_requests[2];
+volatile uint8_t SequenceRunner::s_requestPublished = 0;
+volatile uint32_t SequenceRunner::s_requestRevision = 0;
+uint32_t SequenceRunner::s_appliedRevision = 0;
+SequenceRunner::Script SequenceRunner::s_script;
+volatile SequenceRunner::State SequenceRunner::s_state = SequenceRunner::State::Idle;
+volatile uint32_t SequenceRunner::s_iteration = 0;
+volatile uint8_t SequenceRunner::s_step = 0;
+volatile SequenceRunner::Failure SequenceRunner::s_failure = SequenceRunner::Failure::None;
+uint32_t SequenceRunner::s_lastUs = 0;
+uint64_t SequenceRunner::s_elapsedUs = 0;
+volatile uint32_t SequenceRunner::s_elapsedMs = 0;
+uint32_t SequenceRunner::s_anchorUs = 0;
+bool SequenceRunner::s_armedHere = false;
+SequenceRunner::Armed SequenceRunner::s_armed;
+std::atomic<uint32_t> SequenceRunner::s_armedGeneration(0);
+uint32_t SequenceRunner::s_nextGeneration = 0;
+std::atomic<bool> SequenceRunner::s_matched(false);
+uint32_t SequenceRunner::s_matchUs = 0;
+CANMessage SequenceRunner::s_matchFrame;
+bool SequenceRunner::s_matchExtended = false;
+SequenceRunner::StepResult SequenceRunner::s_results[MAX_STEPS];
+std::atomic<uint32_t> SequenceRunner::s_resultRevision(0);
+const char* SequenceRunner::s_error = "";
+uint8_t SequenceRunner::s_errorStep = 0;
+
+bool SequenceRunner::parse(const char* text, Script& script)
+{
+    script.stepCount = 0;
+    script.repeat = 1;
+    s_errorStep = 0;
+    if (strlen(text) > MAX_SCRIPT_LENGTH)
+    {
+        s_error = "script too long";
+        return false;
+    }
+
+    bool repeated = false;
+    char line[MAX_STEP_LENGTH + 1];
+    for (const char* cursor = text; *cursor;)
+    {
+        size_t length = strcspn(cursor, ";\n");
+        const char* end = cursor + length;
+        s_errorStep = script.stepCount;
+        if (length > MAX_STEP_LENGTH)
+        {
+            s_error = "step too long";
+            return false;
+        }
+        memcpy(line, cursor, length);
+        line[length] = '\0';
+        cursor = *end ? end + 1 : end;
+        if (strspn(line, " \t\r") == length)
+        {
+            continue;   // Blank
+        }
+        if (repeated)
+        {
+            s_error = "repeat must come last";
+            return false;
+        }
+        if (script.stepCount == MAX_STEPS)
+        {
+            s_error = "too many steps";
+            return false;
+        }
+        if (!parseStep(line, script.steps[script.stepCount], script.repeat, repeated))
+        {
+            return false;
+        }
+        if (!repeated)
+        {
+            ++script.stepCount;
+        }
+    }
+    if (script.stepCount == 0)
+    {
+        s_error = "no steps";
+        return false;
+    }
+    // Sends and waits block the sequence task; delays alone would keep it
+    // busy-waiting, and a repeating script would never let the CPU go
+    bool blocks = false;
+    for (uint8_t i = 0; i < script.stepCount; ++i)
+    {
+        blocks |= script.steps[i].kind != StepKind::Delay;
+    }
+    if (!blocks)
+    {
+        s_errorStep = 0;
+        s_error = "a script needs a send or wait step";
+        return false;
+    }
+    s_error = "";
+    return true;
+}
+
+bool SequenceRunner::parseStep(char* text, Step& step, uint32_t& repeat, bool& isRepeat)
+{
+    step = Step();
+    char* cursor = text;
+    const char* verb = nextWord(cursor);
+    const char* argument = nextWord(cursor);
+    if (!argument)
+    {
+        s_error = "step without an argument";
+        return false;
+    }
+
+    if (strcmp(verb, "send") == 0)
+    {
+        step.kind = StepKind::Send;
+        const char* hash = strchr(argument, '#');
+        size_t digits = hash ? strlen(hash + 1) : 0;
+        if (!hash || !parseId(argument, hash - argument, step.id, step.extended) || digits % 2 != 0 ||
+            digits > 16)
+        {
+            s_error = "send needs a frame like 7E0#0210";
+            return false;
+        }
+        step.length = static_cast<uint8_t>(digits / 2);
+        for (uint8_t i = 0; i < step.length; ++i)
+        {
+            uint32_t byte = 0;
+            if (!parseHex(hash + 1 + i * 2, 2, byte))
+            {
+                s_error = "send needs a frame like 7E0#0210";
+                return false;
+            }
+            step.data[i] = static_cast<uint8_t>(byte);
+        }
+    }
+    else if (strcmp(verb, "wait") == 0)
+    {
+        step.kind = StepKind::Wait;
+        step.us = DEFAULT_TIMEOUT_MS * 1000;
+        if (!parseId(argument, strlen(argument), step.id, step.extended))
+        {
+            s_error = "wait needs an ID like 7E8";
+            return false;
+        }
+        while (const char* word = nextWord(cursor))
+        {
+            if (strncmp(word, "timeout=", 8) == 0)
+            {
+                if (!parseTime(word + 8, step.us) || step.us == 0)
+                {
+                    s_error = "timeout must be 1 to 60000 ms";
+                    return false;
+                }
+                continue;
+            }
+            // N=VV or N=VV/MM
+            const char* slash = strchr(word, '/');
+            size_t valueLength = slash ? static_cast<size_t>(slash - word) - 2 : strlen(word) - 2;
+            uint32_t value = 0;
+            uint32_t mask = 0xFF;
+            if (strlen(word) < 3 || word[0] < '0' || word[0] > '7' || word[1] != '=' || valueLength > 2 ||
+                !parseHex(word + 2, valueLength, value) || (slash && (strlen(slash + 1) > 2 ||
+                !parseHex(slash + 1, strlen(slash + 1), mask))))
+            {
+                s_error = "conditions look like 0=10 or 2=40/F0";
+                return false;
+            }
+            if (step.conditionCount == MAX_CONDITIONS)
+            {
+                s_error = "too many conditions";
+                return false;
+            }
+            Condition& condition = step.conditions[step.conditionCount++];
+            condition.index = static_cast<uint8_t>(word[0] - '0');
+            condition.mask = static_cast<uint8_t>(mask);
+            condition.value = static_cast<uint8_t>(value & mask);
+        }
+    }
+    else if (strcmp(verb, "delay") == 0)
+    {
+        step.kind = StepKind::Delay;
+        if (!parseTime(argument, step.us))
+        {
+            s_error = "delay must be up to 60000 ms, or N us";
+            return false;
+        }
+    }
+    else if (strcmp(verb, "repeat") == 0)
+    {
+        if (!parseU32(argument, repeat))
+        {
+            s_error = "repeat needs a count";
+            return false;
+        }
+        isRepeat = true;
+    }
+    else
+    {
+        s_error = "steps are send, wait, delay or repeat";
+        return false;
+    }
+
+    if (step.kind != StepKind::Wait && nextWord(cursor))
+    {
+        s_error = "unexpected text after the step";
+        return false;
+    }
+    return true;
+}
+
+const char* SequenceRunner::lastError()
+{
+    return s_error;
+}
+
+uint8_t SequenceRunner::errorStep()
+{
+    return s_errorStep;
+}
+
+const char* SequenceRunner::stateName(State state)
+{
+    return STATE_NAMES[static_cast<uint8_t>(state)];
+}
+
+const char* SequenceRunner::failureName(Failure failure)
+{
+    return FAILURE_NAMES[static_cast<uint8_t>(failure)];
+}
+
+const char* SequenceRunner::kindName(StepKind kind)
+{
+    return KIND_NAMES[static_cast<uint8_t>(kind)];
+}
+
+void SequenceRunner::start(const Script& script)
+{
+    uint8_t next = s_requestPublished ^ 1;
+    s_requests[next].start = true;
+    s_requests[next].script = script;
+    s_requestPublished = next;
+    s_requestRevision = s_requestRevision + 1;
+}
+
+void SequenceRunner::stop()
+{
+    uint8_t next = s_requestPublished ^ 1;
+    s_requests[next].start = false;
+    s_requestPublished = next;
+    s_requestRevision = s_requestRevision + 1;
+}
+
+SequenceRunner::Action SequenceRunner::next(uint32_t nowUs, Step& frame, uint32_t& untilUs)
+{
+    apply(nowUs);
+    while (s_state == State::Running)
+    {
+        s_elapsedUs += nowUs - s_lastUs;
+        s_lastUs = nowUs;
+        s_elapsedMs = static_cast<uint32_t>(s_elapsedUs / 1000);
+
+        const Step& step = s_script.steps[s_step];
+        switch (step.kind)
+        {
+        case StepKind::Delay:
+        {
+            // Anchored to when it was due, so delays do not add up the
+            // task's wakeup latency
+            uint32_t dueUs = s_anchorUs + step.us;
+            if (static_cast<int32_t>(dueUs - nowUs) > 0)
+            {
+                untilUs = dueUs;
+                return Action::Sleep;
+            }
+            record(nowUs - dueUs, false, nullptr, false);
+            s_anchorUs = dueUs;
+            advance();
+            break;
+        }
+        case StepKind::Send:
+        {
+            uint8_t following = s_step + 1;
+            bool wraps = following == s_script.stepCount;
+            following = wraps ? 0 : following;
+            bool more = !wraps || s_script.repeat == 0 || s_iteration + 1 < s_script.repeat;
+            if (more && s_script.steps[following].kind == StepKind::Wait && !s_armedHere)
+            {
+                arm(s_script.steps[following]);
+            }
+            frame = step;
+            return Action::Send;
+        }
+        case StepKind::Wait:
+        {
+            if (!s_armedHere)
+            {
+                arm(step);
+            }
+            if (s_matched.load(std::memory_order_acquire))
+            {
+                s_matched.store(false, std::memory_order_relaxed);
+                s_armedHere = false;
+                // A frame that matched between arming and the send being
+                // queued counts as immediate
+                int32_t tookUs = static_cast<int32_t>(s_matchUs - s_anchorUs);
+                record(tookUs > 0 ? static_cast<uint32_t>(tookUs) : 0, false, &s_matchFrame, s_matchExtended);
+                s_anchorUs = s_matchUs;
+                advance();
+                break;
+            }
+            uint32_t deadlineUs = s_anchorUs + step.us;
+            if (static_cast<int32_t>(deadlineUs - nowUs) > 0)
+            {
+                untilUs = deadlineUs;
+                return Action::Wait;
+            }
+            if (!disarm())
+            {
+                // The CAN task matched it just now and is storing the frame
+                while (!s_matched.load(std::memory_order_acquire))
+                {
+                }
+                continue;
+            }
+            s_armedHere = false;
+            record(0, true, nullptr, false);
+            fail(Failure::Timeout);
+            break;
+        }
+        }
+    }
+    return Action::Idle;
+}
+
+void SequenceRunner::sent(bool queued, uint32_t queuedUs)
+{
+    if (s_state != State::Running)
+    {
+        return;
+    }
+    int32_t lateUs = static_cast<int32_t>(queuedUs - s_anchorUs);
+    record(lateUs > 0 ? static_cast<uint32_t>(lateUs) : 0, !queued, nullptr, false);
+    if (!queued)
+    {
+        if (s_armedHere)
+        {
+            disarm();
+            s_armedHere = false;
+            s_matched.store(false, std::memory_order_relaxed);
+        }
+        fail(Failure::TransmitFailed);
+        return;
+    }
+    s_anchorUs = queuedUs;
+    advance();
+}
+
+bool SequenceRunner::onReceive(const CANMessage& msg, bool extended, uint32_t rxUs)
+{
+    uint32_t generation = s_armedGeneration.load(std::memory_order_acquire);
+    if (generation == 0 || msg.id != s_armed.id || extended != s_armed.extended)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < s_armed.conditionCount; ++i)
+    {
+        const Condition& condition = s_armed.conditions[i];
+        if (condition.index >= msg.length || (msg.data[condition.index] & condition.mask) != condition.value)
+        {
+            return false;
+        }
+    }
+    // Re-armed or timed out while this frame was checked
+    if (!s_armedGeneration.compare_exchange_strong(generation, 0, std::memory_order_acq_rel))
+    {
+        return false;
+    }
+    s_matchUs = rxUs;
+    s_matchFrame = msg;
+    s_matchExtended = extended;
+    s_matched.store(true, std::memory_order_release);
+    return true;
+}
+
+SequenceRunner::Status SequenceRunner::status()
+{
+    Status status;
+    status.state = s_state;
+    status.iteration = s_iteration;
+    status.repeat = s_script.repeat;
+    status.step = s_step;
+    status.stepCount = s_script.stepCount;
+    status.failure = s_failure;
+    status.elapsedMs = s_elapsedMs;
+    return status;
+}
+
+bool SequenceRunner::results(StepResult* out, uint8_t& count)
+{
+    for (uint8_t attempt = 0; attempt < 4; ++attempt)
+    {
+        uint32_t revision = s_resultRevision.load(std::memory_order_acquire);
+        if (revision & 1)
+        {
+            continue;
+        }
+        count = s_script.stepCount;
+        memcpy(out, s_results, count * sizeof(StepResult));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s_resultRevision.load(std::memory_order_relaxed) == revision)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SequenceRunner::apply(uint32_t nowUs)
+{
+    if (s_requestRevision == s_appliedRevision)
+    {
+        return;
+    }
+    s_appliedRevision = s_requestRevision;
+    if (s_armedHere)
+    {
+        disarm();
+        s_armedHere = false;
+    }
+    s_matched.store(false, std::memory_order_relaxed);
+
+    const Request& request = s_requests[s_requestPublished];
+    if (!request.start)
+    {
+        if (s_state == State::Running)
+        {
+            s_state = State::Stopped;
+        }
+        return;
+    }
+    uint32_t revision = s_resultRevision.load(std::memory_order_relaxed);
+    s_resultRevision.store(revision + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s_script = request.script;
+    for (uint8_t i = 0; i < s_script.stepCount; ++i)
+    {
+        StepResult& result = s_results[i];
+        result = StepResult();
+        result.kind = s_script.steps[i].kind;
+        result.id = s_script.steps[i].id;
+        result.extended = s_script.steps[i].extended;
+        result.minUs = UINT32_MAX;
+    }
+    s_resultRevision.store(revision + 2, std::memory_order_release);
+
+    s_iteration = 0;
+    s_step = 0;
+    s_failure = Failure::None;
+    s_lastUs = nowUs;
+    s_elapsedUs = 0;
+    s_elapsedMs = 0;
+    s_anchorUs = nowUs;
+    s_state = State::Running;
+}
+
+void SequenceRunner::arm(const Step& step)
+{
+    s_armed.id = step.id;
+    s_armed.extended = step.extended;
+    memcpy(s_armed.conditions, step.conditions, sizeof(s_armed.conditions));
+    s_armed.conditionCount = step.conditionCount;
+    s_matched.store(false, std::memory_order_relaxed);
+    if (++s_nextGeneration == 0)
+    {
+        ++s_nextGeneration;
+    }
+    s_armedGeneration.store(s_nextGeneration, std::memory_order_release);
+    s_armedHere = true;
+}
+
+// False when the CAN task already took the armed wait
+bool SequenceRunner::disarm()
+{
+    uint32_t generation = s_armedGeneration.load(std::memory_order_relaxed);
+    return generation != 0 && s_armedGeneration.compare_exchange_strong(generation, 0, std::memory_order_acq_rel);
+}
+
+void SequenceRunner::record(uint32_t us, bool failed, const CANMessage* frame, bool extended)
+{
+    uint32_t revision = s_resultRevision.load(std::memory_order_relaxed);
+    s_resultRevision.store(revision + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    StepResult& result = s_results[s_step];
+    ++result.runs;
+    if (failed)
+    {
+        ++result.failures;
+    }
+    else
+    {
+        result.minUs = us < result.minUs ? us : result.minUs;
+        result.maxUs = us > result.maxUs ? us : result.maxUs;
+        result.totalUs += us;
+    }
+    if (frame)
+    {
+        result.hasFrame = true;
+        result.frame = *frame;
+        result.frameExtended = extended;
+    }
+    s_resultRevision.store(revision + 2, std::memory_order_release);
+}
+
+void SequenceRunner::advance()
+{
+    if (s_step + 1 < s_script.stepCount)
+    {
+        s_step = s_step + 1;
+        return;
+    }
+    s_step = 0;
+    s_iteration = s_iteration + 1;
+    if (s_script.repeat != 0 && s_iteration >= s_script.repeat)
+    {
+        s_state = State::Done;
+    }
+}
+
+void SequenceRunner::fail(Failure failure)
+{
+    s_failure = failure;
+    s_state = State::Failed;
+}
@@ -1,9 +1,27 @@
 #include "softap_config.h"
+#include "request_parser.h"
 
 AsyncWebServer SoftAPConfig::server(80);
 DNSServer SoftAPConfig::dnsServer;
+bool SoftAPConfig::dnsRunning = false;
+volatile bool SoftAPConfig::portalSaved = false;
+SoftAPConfig::Config SoftAPConfig::pendingConfig;
+volatile bool SoftAPConfig::switchPending = false;
+volatile bool SoftAPConfig::switchRunning = false;
+SoftAPConfig::SwitchReport SoftAPConfig::report;
 Preferences SoftAPConfig::preferences;
 
+namespace
+{
+    // Time for the response that requested a switch to reach the client
+    // before its connection is torn down
+    constexpr uint32_t SWITCH_DELAY_MS = 500;
+
+    portMUX_TYPE switchLock = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t switchRequestedMs = 0;
+    uint32_t portalSavedMs = 0;     // Set before portalSaved
+}
+
 String generateUniqueSSID() {
     uint8_t mac[6];
     WiFi.macAddress(mac);
@@ -36,15 +54,10 @@ bool SoftAPConfig::checkConfigMode()
 
 bool SoftAPConfig::startConfigPortal()
 {
-    // Start SoftAP
-    WiFi.mode(WIFI_AP);
-    WiFi.softAP(AP_SSID, AP_PASSWORD);
-    
-    Serial.print("AP IP address: ");
-    Serial.println(WiFi.softAPIP());
-    
-    // Start DNS server for captive portal
-    startDNSServer();
+    if (!startAccessPoint())
+    {
+        return false;
+    }
     
     // Setup web server
     setupConfigPage();
@@ -52,20 +65,145 @@ bool SoftAPConfig::startConfigPortal()
     server.begin();
     Serial.println("Configuration portal started");
     
-    // Stay in config mode until reboot
-    while (true)
+    // Stay in config mode until a configuration is saved
+    while (!portalSaved || millis() - portalSavedMs < SWITCH_DELAY_MS)
     {
-        dnsServer.processNextRequest();
+        processDns();
         delay(10);
     }
+
+    // The monitor takes over port 80 and brings up the saved network
+    server.end();
+    stopNetwork();
+    Serial.println("Configuration portal closed");
+    return true;
+}
+
+bool SoftAPConfig::startAccessPoint(bool keepStation)
+{
+    // Start SoftAP
+    WiFi.mode(keepStation ? WIFI_AP_STA : WIFI_AP);
+    if (!WiFi.softAP(AP_SSID, AP_PASSWORD))
+    {
+        Serial.println("Failed to start access point");
+        return false;
+    }
+    
+    Serial.print("AP ");
+    Serial.print(AP_SSID);
+    Serial.print(", IP address: ");
+    Serial.println(WiFi.softAPIP());
     
-    return true; // Never reached
+    // Start DNS server for captive portal
+    startDNSServer();
+    return true;
+}
+
+void SoftAPConfig::stopNetwork()
+{
+    if (dnsRunning)
+    {
+        dnsServer.stop();
+        dnsRunning = false;
+    }
+    WiFi.softAPdisconnect(false);
+    WiFi.disconnect(false);
+    WiFi.mode(WIFI_OFF);
+}
+
+void SoftAPConfig::processDns()
+{
+    if (dnsRunning)
+    {
+        dnsServer.processNextRequest();
+    }
+}
+
+const char* SoftAPConfig::modeName(NetworkMode mode)
+{
+    switch (mode)
+    {
+    case NetworkMode::AccessPoint:
+        return "ap";
+    case NetworkMode::AccessPointStation:
+        return "apsta";
+    default:
+        return "station";
+    }
+}
+
+bool SoftAPConfig::parseMode(const char* name, NetworkMode& mode)
+{
+    for (NetworkMode candidate : {NetworkMode::Station, NetworkMode::AccessPoint, NetworkMode::AccessPointStation})
+    {
+        if (strcmp(name, modeName(candidate)) == 0)
+        {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SoftAPConfig::needsStation(NetworkMode mode)
+{
+    return mode != NetworkMode::AccessPoint;
+}
+
+void SoftAPConfig::requestSwitch(const Config& config)
+{
+    portENTER_CRITICAL(&switchLock);
+    pendingConfig = config;
+    switchRequestedMs = millis();
+    switchPending = true;
+    switchRunning = true;
+    portEXIT_CRITICAL(&switchLock);
+}
+
+bool SoftAPConfig::takeSwitch(Config& config)
+{
+    bool taken = false;
+    portENTER_CRITICAL(&switchLock);
+    if (switchPending && millis() - switchRequestedMs >= SWITCH_DELAY_MS)
+    {
+        config = pendingConfig;
+        switchPending = false;
+        taken = true;
+    }
+    portEXIT_CRITICAL(&switchLock);
+    return taken;
+}
+
+// From the request until the new network is up; the stream keeps its
+// queued frames meanwhile instead of discarding them
+bool SoftAPConfig::switching()
+{
+    return switchRunning;
+}
+
+void SoftAPConfig::finishSwitch(const SwitchReport& result)
+{
+    portENTER_CRITICAL(&switchLock);
+    uint32_t count = report.count + 1;
+    report = result;
+    report.count = count;
+    // A request that arrived during the switch is still to be carried out
+    switchRunning = switchPending;
+    portEXIT_CRITICAL(&switchLock);
+}
+
+SoftAPConfig::SwitchReport SoftAPConfig::lastSwitch()
+{
+    portENTER_CRITICAL(&switchLock);
+    SwitchReport result = report;
+    portEXIT_CRITICAL(&switchLock);
+    return result;
 }
 
 void SoftAPConfig::startDNSServer()
 {
     // Route all DNS requests to the AP IP
-    dnsServer.start(53, "*", WiFi.softAPIP());
+    dnsRunning = dnsServer.start(53, "*", WiFi.softAPIP());
 }
 
 void SoftAPConfig::setupConfigPage()
@@ -91,9 +229,17 @@ void SoftAPConfig::setupConfigPage()
 void SoftAPConfig::handleConfigSave(AsyncWebServerRequest* request)
 {
     Config config;
+    loadConfig(config);  // Stored credentials stay when only the mode changes
     bool valid = false;
+
+    if (!request->hasParam("mode", true) || !parseMode(request->getParam("mode", true)->value().c_str(), config.mode))
+    {
+        config.mode = NetworkMode::Station;
+    }
+    bool accessPoint = !needsStation(config.mode);
     
-    if (request->hasParam("ssid", true) && request->hasParam("password", true))
+    if (request->hasParam("ssid", true) && request->hasParam("password", true) &&
+        request->getParam("ssid", true)->value().length() > 0)
     {
         const AsyncWebParameter* ssidParam = request->getParam("ssid", true);
         const AsyncWebParameter* passParam = request->getParam("password", true);
@@ -103,21 +249,29 @@ void SoftAPConfig::handleConfigSave(AsyncWebServerRequest* request)
         Serial.print("Password: ");
         Serial.println(passParam->value());
         
-        if (ssidParam->value().length() < 33 && passParam->value().length() < 65)
+        const String& ssid = ssidParam->value();
+        const String& password = passParam->value();
+        if (RequestParser::copyConfigField(ssid.c_str(), ssid.length(), config.ssid, sizeof(config.ssid)) &&
+            RequestParser::copyConfigField(password.c_str(), password.length(), config.password, sizeof(config.password)))
         {
-            strncpy(config.ssid, ssidParam->value().c_str(), sizeof(config.ssid) - 1);
-            strncpy(config.password, passParam->value().c_str(), sizeof(config.password) - 1);
-            config.ssid[sizeof(config.ssid) - 1] = '\0';
-            config.password[sizeof(config.password) - 1] = '\0';
             valid = true;
             Serial.println("Received valid configuration");
         }
     }
+    else
+    {
+        // Standalone mode needs no network to join
+        valid = accessPoint;
+    }
     
     String response;
     if (valid && saveConfig(config))
     {
-        response = "Configuration saved successfully! Please power cycle the device.";
+        response = "Configuration saved. The monitor starts in a moment; reconnect to ";
+        response += accessPoint ? String(AP_SSID) : String(config.ssid);
+        response += ".";
+        portalSavedMs = millis();
+        portalSaved = true;
     }
     else
     {
@@ -146,7 +300,8 @@ String SoftAPConfig::generateHTML()
         .form-group { margin-bottom: 15px; }
         label { display: block; margin-bottom: 5px; }
         input[type="text"],
-        input[type="password"] {
+        input[type="password"],
+        select {
             width: 100%;
             padding: 8px;
             border: 1px solid #ddd;
@@ -216,25 +371,39 @@ String SoftAPConfig::generateHTML()
     html += String(AP_SSID);
     html += R"html( Configuration</h2>
         <form action="/save" method="POST">
+            <div class="form-group">
+                <label for="mode">Network:</label>
+                <select id="mode" name="mode">
+                    <option value="station">Join a WiFi network</option>
+                    <option value="ap")html";
+    html += currentConfig.mode == NetworkMode::AccessPoint ? " selected" : "";
+    html += R"html(>Standalone access point ()html";
+    html += String(AP_SSID);
+    html += R"html()</option>
+                    <option value="apsta")html";
+    html += currentConfig.mode == NetworkMode::AccessPointStation ? " selected" : "";
+    html += R"html(>Both</option>
+                </select>
+            </div>
             <div class="form-group">
                 <label for="ssid">WiFi Network Name (SSID):</label>
                 <input type="text" id="ssid" name="ssid" value=")html";
     html += String(currentConfig.ssid);
-    html += R"html(" required>
+    html += R"html(">
             </div>
             <div class="form-group">
                 <label for="password">WiFi Password:</label>
                 <div class="password-container">
                     <input type="password" id="password" name="password" value=")html";
     html += String(currentConfig.password);
-    html += R"html(" required>
+    html += R"html(">
                     <button type="button" onclick="togglePassword()" class="show-pwd">Show</button>
                 </div>
             </div>
             <button type="submit">Save Configuration</button>
         </form>
         <div class="note">
-            <strong>Note:</strong> After saving, the device will need to be power cycled to apply the new configuration.
+            <strong>Note:</strong> After saving, the portal closes and the monitor starts on the chosen network. The network can be changed later from the monitor without a restart.
         </div>
     </div>
 </body>
@@ -247,12 +416,18 @@ bool SoftAPConfig::loadConfig(Config& config)
 {
     preferences.begin("vcmaster", true); // Read-only mode
     
+    config.ssid[0] = '\0';
+    config.password[0] = '\0';
     size_t ssidLen = preferences.getString("wifi_ssid", config.ssid, sizeof(config.ssid));
     size_t passLen = preferences.getString("wifi_pass", config.password, sizeof(config.password));
+    uint8_t mode = preferences.getUChar("wifi_mode", static_cast<uint8_t>(NetworkMode::Station));
+    config.mode = mode <= static_cast<uint8_t>(NetworkMode::AccessPointStation) ? static_cast<NetworkMode>(mode)
+                                                                                 : NetworkMode::Station;
     
     preferences.end();
     
-    return (ssidLen > 0 && passLen > 0);
+    // Standalone mode runs without credentials
+    return !needsStation(config.mode) || (ssidLen > 0 && passLen > 0);
 }
 
 bool SoftAPConfig::saveConfig(const Config& config)
@@ -262,8 +437,37 @@ bool SoftAPConfig::saveConfig(const Config& config)
     bool success = true;
     success &= preferences.putString("wifi_ssid", config.ssid);
     success &= preferences.putString("wifi_pass", config.password);
+    success &= preferences.putUChar("wifi_mode", static_cast<uint8_t>(config.mode)) > 0;
     
     preferences.end();
     
     return true;
-}
\ No newline at end of file
+}
+
+bool SoftAPConfig::loadDeviceConfig(DeviceConfig::Settings& settings)
+{
+    uint8_t blob[DeviceConfig::MAX_BLOB_BYTES * 2];  // Room for records newer firmware added
+    preferences.begin("vcmaster", true);
+    size_t length = preferences.isKey("device_cfg") ? preferences.getBytes("device_cfg", blob, sizeof(blob)) : 0;
+    preferences.end();
+
+    return length > 0 && DeviceConfig::decode(blob, length, settings);
+}
+
+bool SoftAPConfig::saveDeviceConfig(const DeviceConfig::Settings& settings)
+{
+    uint8_t blob[DeviceConfig::MAX_BLOB_BYTES];
+    size_t length = DeviceConfig::encode(settings, blob, sizeof(blob));
+    if (length == 0)
+    {
+        return false;
+    }
+
+    // NVS replaces the whole value in one write, so a reset leaves either
+    // the old blob or the new one
+    preferences.begin("vcmaster", false);
+    bool success = preferences.putBytes("device_cfg", blob, length) == length;
+    preferences.end();
+
+    return success;
+}
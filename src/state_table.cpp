@@ -0,0 +1,313 @@
+#include "state_table.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+StateTable::Entry* StateTable::s_entries = nullptr;
+uint32_t* StateTable::s_ids = nullptr;
+uint16_t* StateTable::s_buckets = nullptr;
+uint16_t* StateTable::s_order[2] = {};
+uint16_t StateTable::s_orderCount[2] = {};
+volatile uint8_t StateTable::s_orderPublished = 0;
+uint32_t StateTable::s_membership = 0;
+uint32_t StateTable::s_orderedMembership = 0;
+uint32_t StateTable::s_orderMs = 0;
+bool StateTable::s_orderBuilt = false;
+uint16_t StateTable::s_capacity = 0;
+uint32_t StateTable::s_bucketMask = 0;
+uint8_t StateTable::s_bucketShift = 32;
+uint16_t StateTable::s_size = 0;
+uint16_t StateTable::s_lruHead = StateTable::NO_SLOT;
+uint16_t StateTable::s_lruTail = StateTable::NO_SLOT;
+uint16_t StateTable::s_freeHead = StateTable::NO_SLOT;
+uint32_t StateTable::s_evictions = 0;
+
+bool StateTable::begin(uint16_t capacity)
+{
+    if (capacity == 0 || capacity == NO_SLOT)
+    {
+        return false;
+    }
+
+    // Keep the hash index at most half full so probe sequences stay short
+    uint32_t buckets = 1;
+    uint8_t bits = 0;
+    while (buckets < 2u * capacity)
+    {
+        buckets <<= 1;
+        ++bits;
+    }
+
+    delete[] s_entries;
+    delete[] s_ids;
+    delete[] s_buckets;
+    delete[] s_order[0];
+    delete[] s_order[1];
+    s_entries = new (std::nothrow) Entry[capacity];
+    s_ids = new (std::nothrow) uint32_t[capacity];
+    s_buckets = new (std::nothrow) uint16_t[buckets];
+    s_order[0] = new (std::nothrow) uint16_t[capacity];
+    s_order[1] = new (std::nothrow) uint16_t[capacity];
+    if (!s_entries || !s_ids || !s_buckets || !s_order[0] || !s_order[1])
+    {
+        s_capacity = 0;
+        return false;
+    }
+
+    s_capacity = capacity;
+    s_bucketMask = buckets - 1;
+    s_bucketShift = 32 - bits;
+    s_size = 0;
+    s_evictions = 0;
+    s_membership = 0;
+    s_orderedMembership = 0;
+    s_orderCount[0] = 0;
+    s_orderCount[1] = 0;
+    s_orderPublished = 0;
+    s_orderBuilt = false;
+    s_lruHead = NO_SLOT;
+    s_lruTail = NO_SLOT;
+    for (uint32_t i = 0; i < buckets; ++i)
+    {
+        s_buckets[i] = NO_SLOT;
+    }
+
+    // Unused slots are chained through lruNext
+    for (uint16_t i = 0; i < capacity; ++i)
+    {
+        s_entries[i].lruNext = (i + 1 < capacity) ? i + 1 : NO_SLOT;
+    }
+    s_freeHead = 0;
+    return true;
+}
+
+StateTable::TouchResult StateTable::touch(uint32_t id)
+{
+    TouchResult result;
+    uint16_t slot = find(id);
+    if (slot != NO_SLOT)
+    {
+        if (slot != s_lruHead)
+        {
+            lruUnlink(slot);
+            lruPushFront(slot);
+        }
+        result.slot = slot;
+        return result;
+    }
+
+    if (s_capacity == 0)
+    {
+        return result;
+    }
+
+    if (s_freeHead != NO_SLOT)
+    {
+        slot = s_freeHead;
+        s_freeHead = s_entries[slot].lruNext;
+    }
+    else
+    {
+        slot = s_lruTail;
+        result.evicted = true;
+        result.evictedId = s_ids[slot];
+        lruUnlink(slot);
+        indexRemove(s_ids[slot]);
+        --s_size;
+        ++s_evictions;
+    }
+
+    s_entries[slot] = Entry();
+    s_ids[slot] = id;
+    indexInsert(id, slot);
+    lruPushFront(slot);
+    ++s_size;
+    s_membership = s_membership + 1;
+
+    result.slot = slot;
+    result.inserted = true;
+    return result;
+}
+
+const CANMessage* StateTable::store(uint16_t slot, const CANMessage& msg)
+{
+    Entry& e = s_entries[slot];
+    e.hasPrevious = e.hasLatest;
+    if (e.hasLatest)
+    {
+        e.previous = e.latest;
+    }
+    e.latest = msg;
+    e.hasLatest = true;
+    return e.hasPrevious ? &e.previous : nullptr;
+}
+
+uint16_t StateTable::find(uint32_t id)
+{
+    if (s_capacity == 0)
+    {
+        return NO_SLOT;
+    }
+
+    uint32_t bucket = bucketFor(id);
+    while (s_buckets[bucket] != NO_SLOT)
+    {
+        if (s_ids[s_buckets[bucket]] == id)
+        {
+            return s_buckets[bucket];
+        }
+        bucket = (bucket + 1) & s_bucketMask;
+    }
+    return NO_SLOT;
+}
+
+const StateTable::Entry& StateTable::entry(uint16_t slot)
+{
+    return s_entries[slot];
+}
+
+void StateTable::publishOrder(uint32_t now)
+{
+    if (s_membership == s_orderedMembership || (s_orderBuilt && now - s_orderMs < ORDER_INTERVAL_MS))
+    {
+        return;
+    }
+    // Free slots are handed out in order and a slot is only reused by
+    // eviction, so the occupied ones are 0 to size() - 1
+    uint8_t next = s_orderPublished ^ 1;
+    uint16_t* order = s_order[next];
+    for (uint16_t slot = 0; slot < s_size; ++slot)
+    {
+        order[slot] = slot;
+    }
+    std::sort(order, order + s_size, [](uint16_t a, uint16_t b)
+    {
+        return s_ids[a] < s_ids[b];
+    });
+    s_orderCount[next] = s_size;
+    s_orderPublished = next;
+    s_orderedMembership = s_membership;
+    s_orderMs = now;
+    s_orderBuilt = true;
+}
+
+const uint16_t* StateTable::slotsById(uint16_t& count)
+{
+    uint8_t published = s_orderPublished;
+    count = s_orderCount[published];
+    return s_order[published];
+}
+
+uint16_t StateTable::mostRecent()
+{
+    return s_lruHead;
+}
+
+uint16_t StateTable::size()
+{
+    return s_size;
+}
+
+uint16_t StateTable::capacity()
+{
+    return s_capacity;
+}
+
+uint32_t StateTable::evictions()
+{
+    return s_evictions;
+}
+
+size_t StateTable::memoryBytes()
+{
+    return s_capacity * (sizeof(Entry) + sizeof(uint32_t) + 2 * sizeof(uint16_t)) +
+           (s_capacity ? (s_bucketMask + 1) * sizeof(uint16_t) : 0);
+}
+
+uint32_t StateTable::bucketFor(uint32_t id)
+{
+    // Fibonacci hashing: take the top bits of the product
+    return s_bucketShift >= 32 ? 0 : (id * 2654435761u) >> s_bucketShift;
+}
+
+void StateTable::indexInsert(uint32_t id, uint16_t slot)
+{
+    uint32_t bucket = bucketFor(id);
+    while (s_buckets[bucket] != NO_SLOT)
+    {
+        bucket = (bucket + 1) & s_bucketMask;
+    }
+    s_buckets[bucket] = slot;
+}
+
+void StateTable::indexRemove(uint32_t id)
+{
+    uint32_t hole = bucketFor(id);
+    while (s_buckets[hole] != NO_SLOT && s_ids[s_buckets[hole]] != id)
+    {
+        hole = (hole + 1) & s_bucketMask;
+    }
+    if (s_buckets[hole] == NO_SLOT)
+    {
+        return;
+    }
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    uint32_t next = hole;
+    while (true)
+    {
+        next = (next + 1) & s_bucketMask;
+        if (s_buckets[next] == NO_SLOT)
+        {
+            break;
+        }
+        uint32_t home = bucketFor(s_ids[s_buckets[next]]);
+        bool homeBetween = (hole <= next) ? (hole < home && home <= next)
+                                          : (hole < home || home <= next);
+        if (!homeBetween)
+        {
+            s_buckets[hole] = s_buckets[next];
+            hole = next;
+        }
+    }
+    s_buckets[hole] = NO_SLOT;
+}
+
+void StateTable::lruUnlink(uint16_t slot)
+{
+    Entry& e = s_entries[slot];
+    if (e.lruPrev != NO_SLOT)
+    {
+        s_entries[e.lruPrev].lruNext = e.lruNext;
+    }
+    else
+    {
+        s_lruHead = e.lruNext;
+    }
+    if (e.lruNext != NO_SLOT)
+    {
+        s_entries[e.lruNext].lruPrev = e.lruPrev;
+    }
+    else
+    {
+        s_lruTail = e.lruPrev;
+    }
+    e.lruPrev = NO_SLOT;
+    e.lruNext = NO_SLOT;
+}
+
+void StateTable::lruPushFront(uint16_t slot)
+{
+    Entry& e = s_entries[slot];
+    e.lruPrev = NO_SLOT;
+    e.lruNext = s_lruHead;
+    if (s_lruHead != NO_SLOT)
+    {
+        s_entries[s_lruHead].lruPrev = slot;
+    }
+    s_lruHead = slot;
+    if (s_lruTail == NO_SLOT)
+    {
+        s_lruTail = slot;
+    }
+}
@@ -0,0 +1,238 @@
+#include "time_sync.h"
+#include <string.h>
+
+namespace
+{
+    constexpr uint8_t MAGIC_0 = 'T';
+    constexpr uint8_t MAGIC_1 = 'S';
+    constexpr uint8_t VERSION = 1;
+    constexpr uint8_t TYPE_REQUEST = 1;
+    constexpr uint8_t TYPE_RESPONSE = 2;
+    // Drift is left at zero until the points span this long; over a shorter
+    // span the delay jitter outweighs what a crystal drifts
+    constexpr uint64_t MIN_DRIFT_SPAN_US = 30000000;
+
+    void putU32(uint8_t* out, uint32_t value)
+    {
+        for (uint8_t i = 0; i < 4; ++i)
+        {
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    void putU64(uint8_t* out, uint64_t value)
+    {
+        putU32(out, static_cast<uint32_t>(value));
+        putU32(out + 4, static_cast<uint32_t>(value >> 32));
+    }
+
+    uint32_t getU32(const uint8_t* in)
+    {
+        return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+               (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    }
+
+    uint64_t getU64(const uint8_t* in)
+    {
+        return static_cast<uint64_t>(getU32(in)) | (static_cast<uint64_t>(getU32(in + 4)) << 32);
+    }
+
+    size_t encodePacket(uint8_t* out, size_t size, uint8_t type, uint32_t sequence, uint64_t t1, uint64_t t2,
+                        uint64_t t3)
+    {
+        if (size < TimeSync::PACKET_BYTES)
+        {
+            return 0;
+        }
+        out[0] = MAGIC_0;
+        out[1] = MAGIC_1;
+        out[2] = VERSION;
+        out[3] = type;
+        putU32(out + 4, sequence);
+        putU64(out + 8, t1);
+        putU64(out + 16, t2);
+        putU64(out + 24, t3);
+        return TimeSync::PACKET_BYTES;
+    }
+
+    bool isPacket(const uint8_t* in, size_t length, uint8_t type)
+    {
+        return length >= TimeSync::PACKET_BYTES && in[0] == MAGIC_0 && in[1] == MAGIC_1 && in[2] == VERSION &&
+               in[3] == type;
+    }
+}
+
+TimeSync::Sample TimeSync::s_filter[FILTER_SAMPLES] = {};
+uint8_t TimeSync::s_filterCount = 0;
+TimeSync::Sample TimeSync::s_points[DRIFT_POINTS] = {};
+uint8_t TimeSync::s_pointCount = 0;
+uint8_t TimeSync::s_pointNext = 0;
+uint32_t TimeSync::s_sequence = 0;
+uint64_t TimeSync::s_requestUs = 0;
+bool TimeSync::s_waiting = false;
+uint32_t TimeSync::s_samples = 0;
+TimeSync::Estimate TimeSync::s_estimates[2];
+volatile uint8_t TimeSync::s_published = 0;
+
+int64_t TimeSync::referenceUs(const Estimate& estimate, uint64_t localUs)
+{
+    double elapsedUs = static_cast<double>(static_cast<int64_t>(localUs - estimate.localUs));
+    return static_cast<int64_t>(localUs) + estimate.offsetUs +
+           static_cast<int64_t>(elapsedUs * estimate.driftPpb / 1e9);
+}
+
+size_t TimeSync::makeRequest(uint8_t* out, size_t size, uint64_t nowUs)
+{
+    size_t length = encodePacket(out, size, TYPE_REQUEST, s_sequence + 1, nowUs, 0, 0);
+    if (length > 0)
+    {
+        ++s_sequence;
+        s_requestUs = nowUs;
+        s_waiting = true;
+    }
+    return length;
+}
+
+bool TimeSync::onResponse(const uint8_t* in, size_t length, uint64_t receivedUs)
+{
+    if (!s_waiting || !isPacket(in, length, TYPE_RESPONSE) || getU32(in + 4) != s_sequence ||
+        getU64(in + 8) != s_requestUs)
+    {
+        return false;
+    }
+    s_waiting = false;
+
+    uint64_t t1 = s_requestUs;
+    uint64_t t2 = getU64(in + 16);
+    uint64_t t3 = getU64(in + 24);
+    uint64_t t4 = receivedUs;
+    int64_t roundTrip = static_cast<int64_t>(t4 - t1);
+    int64_t held = static_cast<int64_t>(t3 - t2);
+    int64_t delay = roundTrip - held;
+    if (held < 0 || delay < 0 || delay > MAX_DELAY_US)
+    {
+        return false;
+    }
+
+    Sample sample;
+    sample.localUs = t1 + static_cast<uint64_t>(roundTrip / 2);
+    sample.offsetUs = (static_cast<int64_t>(t2 - t1) + static_cast<int64_t>(t3 - t4)) / 2;
+    sample.delayUs = static_cast<uint32_t>(delay);
+    addSample(sample);
+    return true;
+}
+
+size_t TimeSync::answer(const uint8_t* in, size_t length, uint64_t receivedUs, uint64_t nowUs, uint8_t* out,
+                        size_t size)
+{
+    if (!isPacket(in, length, TYPE_REQUEST))
+    {
+        return 0;
+    }
+    return encodePacket(out, size, TYPE_RESPONSE, getU32(in + 4), getU64(in + 8), receivedUs, nowUs);
+}
+
+void TimeSync::reset(bool reference)
+{
+    s_filterCount = 0;
+    s_pointCount = 0;
+    s_pointNext = 0;
+    s_waiting = false;
+    s_samples = 0;
+    Estimate estimate;
+    estimate.state = reference ? State::Reference : State::Unsynced;
+    publish(estimate);
+}
+
+TimeSync::Estimate TimeSync::estimate()
+{
+    return s_estimates[s_published];
+}
+
+// The filter is a ring of the latest samples; whenever it has been refilled
+// completely its best sample becomes a drift point
+void TimeSync::addSample(const Sample& sample)
+{
+    s_filter[s_samples % FILTER_SAMPLES] = sample;
+    ++s_samples;
+    if (s_filterCount < FILTER_SAMPLES)
+    {
+        ++s_filterCount;
+    }
+
+    const Sample* best = &s_filter[0];
+    for (uint8_t i = 1; i < s_filterCount; ++i)
+    {
+        if (s_filter[i].delayUs < best->delayUs)
+        {
+            best = &s_filter[i];
+        }
+    }
+    if (s_samples % FILTER_SAMPLES == 0)
+    {
+        s_points[s_pointNext] = *best;
+        s_pointNext = (s_pointNext + 1) % DRIFT_POINTS;
+        if (s_pointCount < DRIFT_POINTS)
+        {
+            ++s_pointCount;
+        }
+    }
+
+    Estimate estimate;
+    estimate.state = State::Synced;
+    estimate.localUs = best->localUs;
+    estimate.offsetUs = best->offsetUs;
+    estimate.driftPpb = fitDriftPpb();
+    estimate.delayUs = best->delayUs;
+    estimate.samples = s_samples;
+    publish(estimate);
+}
+
+// Least-squares slope of offset over local time; times are taken relative
+// to the oldest point so the sums stay well inside double precision
+int32_t TimeSync::fitDriftPpb()
+{
+    if (s_pointCount < 2)
+    {
+        return 0;
+    }
+    const Sample& oldest = s_points[s_pointCount < DRIFT_POINTS ? 0 : s_pointNext];
+    double sumX = 0;
+    double sumY = 0;
+    double sumXX = 0;
+    double sumXY = 0;
+    uint64_t span = 0;
+    for (uint8_t i = 0; i < s_pointCount; ++i)
+    {
+        const Sample& point = s_points[i];
+        uint64_t sinceOldest = point.localUs - oldest.localUs;
+        span = sinceOldest > span ? sinceOldest : span;
+        double x = static_cast<double>(sinceOldest);
+        double y = static_cast<double>(point.offsetUs - oldest.offsetUs);
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+    }
+    double n = s_pointCount;
+    double denominator = n * sumXX - sumX * sumX;
+    if (span < MIN_DRIFT_SPAN_US || denominator <= 0)
+    {
+        return 0;
+    }
+    double ppb = (n * sumXY - sumX * sumY) / denominator * 1e9;
+    if (ppb > INT32_MAX || ppb < INT32_MIN)
+    {
+        return 0;
+    }
+    return static_cast<int32_t>(ppb);
+}
+
+// Same double buffer as DeviceConfig's CAN settings: the reader always sees
+// a complete estimate, updates come once a second at most
+void TimeSync::publish(const Estimate& estimate)
+{
+    uint8_t next = s_published ^ 1;
+    s_estimates[next] = estimate;
+    s_published = next;
+}
@@ -0,0 +1,212 @@
+#include "top_ids.h"
+#include "can_stats.h"
+#include "state_table.h"
+#include "render_buffer.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+namespace
+{
+    const char* const METRIC_NAMES[] = { "frameRate", "changeRate", "bytesChanged" };
+
+    // Higher value first; equal values in ID order so rankings are stable
+    bool ranksAbove(const TopIds::Item& a, const TopIds::Item& b)
+    {
+        return a.value > b.value || (a.value == b.value && a.id < b.id);
+    }
+
+    uint32_t perSecond(uint32_t count, uint32_t windowMs)
+    {
+        return static_cast<uint32_t>((static_cast<uint64_t>(count) * 1000) / windowMs);
+    }
+}
+
+TopIds::Counters* TopIds::s_slots = nullptr;
+uint16_t TopIds::s_capacity = 0;
+TopIds::Ranking TopIds::s_rankings[2][METRIC_COUNT] = {};
+volatile uint8_t TopIds::s_published = 0;
+uint32_t TopIds::s_windowMs = 0;
+
+bool TopIds::begin(uint16_t capacity)
+{
+    delete[] s_slots;
+    s_slots = new (std::nothrow) Counters[capacity];
+    if (!s_slots)
+    {
+        s_capacity = 0;
+        return false;
+    }
+    s_capacity = capacity;
+    memset(s_slots, 0, sizeof(Counters) * capacity);
+    memset(s_rankings, 0, sizeof(s_rankings));
+    s_windowMs = 0;
+    return true;
+}
+
+void TopIds::resetSlot(uint16_t slot)
+{
+    if (slot < s_capacity)
+    {
+        s_slots[slot] = Counters();
+    }
+}
+
+// The ranking is a min-heap on ranksAbove while it is being built: its front
+// is the weakest entry and the only one a new candidate has to beat
+void TopIds::offer(Ranking& ranking, uint32_t id, uint32_t value)
+{
+    if (value == 0)
+    {
+        return;
+    }
+    Item candidate = { id, value };
+    if (ranking.count < TOP_IDS_COUNT)
+    {
+        ranking.items[ranking.count++] = candidate;
+        std::push_heap(ranking.items, ranking.items + ranking.count, ranksAbove);
+    }
+    else if (ranksAbove(candidate, ranking.items[0]))
+    {
+        std::pop_heap(ranking.items, ranking.items + ranking.count, ranksAbove);
+        ranking.items[ranking.count - 1] = candidate;
+        std::push_heap(ranking.items, ranking.items + ranking.count, ranksAbove);
+    }
+}
+
+void TopIds::update(uint32_t windowMs)
+{
+    if (!s_slots || windowMs == 0)
+    {
+        return;
+    }
+
+    Ranking* rankings = s_rankings[s_published ^ 1];
+    for (size_t m = 0; m < METRIC_COUNT; ++m)
+    {
+        rankings[m].count = 0;
+    }
+
+    for (uint16_t slot = 0; slot < s_capacity; ++slot)
+    {
+        Counters& counters = s_slots[slot];
+        const StateTable::Entry& entry = StateTable::entry(slot);
+        if (entry.hasLatest)
+        {
+            uint32_t id = entry.latest.id;
+            offer(rankings[0], id, CanStatistics::counters(slot).rate);
+            offer(rankings[1], id, perSecond(counters.changes, windowMs));
+            offer(rankings[2], id, perSecond(counters.changedBytes, windowMs));
+        }
+        counters.changes = 0;
+        counters.changedBytes = 0;
+    }
+
+    // Best first
+    for (size_t m = 0; m < METRIC_COUNT; ++m)
+    {
+        std::sort_heap(rankings[m].items, rankings[m].items + rankings[m].count, ranksAbove);
+    }
+    s_windowMs = windowMs;
+    s_published ^= 1;
+}
+
+const char* TopIds::metricName(Metric metric)
+{
+    return METRIC_NAMES[static_cast<size_t>(metric)];
+}
+
+const TopIds::Ranking& TopIds::ranking(Metric metric)
+{
+    return s_rankings[s_published][static_cast<size_t>(metric)];
+}
+
+void TopIds::beginExport(Export& exp, uint8_t limit)
+{
+    exp = Export();
+    memcpy(exp.rankings, s_rankings[s_published], sizeof(exp.rankings));
+    exp.windowMs = s_windowMs;
+    exp.limit = std::min<uint8_t>(limit, TOP_IDS_COUNT);
+}
+
+size_t TopIds::fill(Export& exp, uint8_t* buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (exp.rowSent == exp.rowLength)
+        {
+            if (!renderNext(exp))
+            {
+                break;
+            }
+            continue;
+        }
+        size_t count = std::min(maxLen - written, exp.rowLength - exp.rowSent);
+        memcpy(buffer + written, exp.row + exp.rowSent, count);
+        exp.rowSent += count;
+        written += count;
+    }
+    return written;
+}
+
+// Renders the next piece of JSON into exp.row; false once finished.
+// {"windowMs":1000,"frameRate":[{"id":"0x1a0","value":50},...],...}
+bool TopIds::renderNext(Export& exp)
+{
+    RenderBuffer out(exp.row, sizeof(exp.row));
+    switch (exp.stage)
+    {
+    case ExportStage::Prefix:
+        out.append("{\"windowMs\":");
+        out.appendDec(exp.windowMs);
+        exp.stage = ExportStage::Metrics;
+        break;
+    case ExportStage::Metrics:
+    {
+        if (exp.metric == METRIC_COUNT)
+        {
+            exp.stage = ExportStage::Suffix;
+            return renderNext(exp);
+        }
+        const Ranking& ranking = exp.rankings[exp.metric];
+        uint8_t count = std::min(ranking.count, exp.limit);
+        if (exp.next == 0)
+        {
+            out.append(",\"");
+            out.append(METRIC_NAMES[exp.metric]);
+            out.append("\":[");
+        }
+        if (exp.next < count)
+        {
+            out.append(exp.next > 0 ? ",{\"id\":\"0x" : "{\"id\":\"0x");
+            out.appendHex(ranking.items[exp.next].id);
+            out.append("\",\"value\":");
+            out.appendDec(ranking.items[exp.next].value);
+            out.appendChar('}');
+            ++exp.next;
+        }
+        if (exp.next == count)
+        {
+            out.appendChar(']');
+            ++exp.metric;
+            exp.next = 0;
+        }
+        break;
+    }
+    case ExportStage::Suffix:
+        out.appendChar('}');
+        exp.stage = ExportStage::Done;
+        break;
+    case ExportStage::Done:
+        return false;
+    }
+    exp.rowLength = out.length();
+    exp.rowSent = 0;
+    return true;
+}
+
+size_t TopIds::memoryBytes()
+{
+    return s_capacity * sizeof(Counters) + sizeof(s_rankings);
+}
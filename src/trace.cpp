@@ -0,0 +1,190 @@
+#include "trace.h"
+#include "render_buffer.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#include <functional>
+#include <thread>
+#endif
+
+Trace::Event* Trace::s_events = nullptr;
+uint32_t Trace::s_capacity = 0;
+std::atomic<uint32_t> Trace::s_head(0);
+volatile bool Trace::s_paused = false;
+Trace::Export Trace::s_export;
+
+bool Trace::begin(uint32_t capacity)
+{
+    if (s_events)
+    {
+        return true;
+    }
+    s_events = new (std::nothrow) Event[capacity];
+    if (!s_events)
+    {
+        return false;
+    }
+    s_capacity = capacity;
+    s_head = 0;
+    return true;
+}
+
+void Trace::record(const char* name, char phase)
+{
+    if (!s_events || s_paused)
+    {
+        return;
+    }
+    uint32_t now = ticks();
+    Event& event = s_events[s_head.fetch_add(1, std::memory_order_relaxed) % s_capacity];
+    event.name = name;
+    event.ticks = now;
+    event.thread = threadId();
+    event.phase = phase;
+}
+
+void Trace::clear()
+{
+    s_head = 0;
+}
+
+uint32_t Trace::recorded()
+{
+    return s_head;
+}
+
+uint32_t Trace::capacity()
+{
+    return s_capacity;
+}
+
+#ifdef ARDUINO
+uint32_t Trace::ticks()
+{
+    return ESP.getCycleCount();
+}
+
+uint32_t Trace::ticksPerMicrosecond()
+{
+    return ESP.getCpuFreqMHz();
+}
+
+uint32_t Trace::threadId()
+{
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(xTaskGetCurrentTaskHandle()));
+}
+#else
+uint32_t Trace::ticks()
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint32_t Trace::ticksPerMicrosecond()
+{
+    return 1;
+}
+
+uint32_t Trace::threadId()
+{
+    return static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+}
+#endif
+
+Trace::Export* Trace::beginExport()
+{
+    if (!s_events || s_export.busy)
+    {
+        return nullptr;
+    }
+    s_paused = true;
+
+    uint32_t head = s_head;
+    s_export = Export();
+    s_export.busy = true;
+    s_export.count = std::min(head, s_capacity);
+    s_export.first = head - s_export.count;
+    return &s_export;
+}
+
+void Trace::endExport(Export* exp)
+{
+    if (exp)
+    {
+        exp->busy = false;
+        s_paused = false;
+    }
+}
+
+size_t Trace::fill(Export& exp, uint8_t* buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (exp.rowSent == exp.rowLength)
+        {
+            if (!renderNext(exp))
+            {
+                break;
+            }
+            continue;
+        }
+        size_t count = std::min(maxLen - written, exp.rowLength - exp.rowSent);
+        memcpy(buffer + written, exp.row + exp.rowSent, count);
+        exp.rowSent += count;
+        written += count;
+    }
+    return written;
+}
+
+// Renders the next piece of JSON into exp.row; false once finished
+bool Trace::renderNext(Export& exp)
+{
+    RenderBuffer out(exp.row, sizeof(exp.row));
+    switch (exp.stage)
+    {
+    case ExportStage::Prefix:
+        out.append("{\"traceEvents\":[");
+        exp.stage = ExportStage::Events;
+        break;
+    case ExportStage::Events:
+    {
+        if (exp.next == exp.count)
+        {
+            exp.stage = ExportStage::Suffix;
+            return renderNext(exp);
+        }
+        const Event& event = s_events[(exp.first + exp.next) % s_capacity];
+        // The 32-bit counter wraps (every ~27 s at 160 MHz), so times are
+        // rebuilt from signed deltas between consecutive events. Events from
+        // different tasks can be a few ticks out of order, hence signed.
+        if (exp.next > 0)
+        {
+            int32_t delta = static_cast<int32_t>(event.ticks - exp.lastTicks);
+            exp.elapsedNs += static_cast<int64_t>(delta) * 1000 / ticksPerMicrosecond();
+        }
+        exp.lastTicks = event.ticks;
+        uint64_t ns = exp.elapsedNs > 0 ? static_cast<uint64_t>(exp.elapsedNs) : 0;
+        out.appendf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%lu}",
+                    exp.next > 0 ? ",\n" : "\n", event.name, event.phase,
+                    static_cast<unsigned long long>(ns / 1000), static_cast<unsigned>(ns % 1000),
+                    static_cast<unsigned long>(event.thread));
+        ++exp.next;
+        break;
+    }
+    case ExportStage::Suffix:
+        out.appendf("\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"recorded\":%lu,\"capacity\":%lu}}\n",
+                    static_cast<unsigned long>(s_head.load()), static_cast<unsigned long>(s_capacity));
+        exp.stage = ExportStage::Done;
+        break;
+    case ExportStage::Done:
+        return false;
+    }
+    exp.rowLength = out.length();
+    exp.rowSent = 0;
+    return true;
+}
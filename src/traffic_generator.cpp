@@ -0,0 +1,427 @@
+#include "traffic_generator.h"
+#include "can_stats.h"
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    struct Preset
+    {
+        const char* name;
+        const char* profile;
+    };
+
+    const Preset PRESETS[] =
+    {
+        { "steady",   "groups=10x10+40x100+50x1000,churn=20" },
+        { "churn",    "groups=100x50,churn=1000" },
+        { "burst",    "groups=20x100,burst=50,burstms=500,churn=100" },
+        { "extended", "groups=100x50,ext=1,base=0x18DA0000,churn=50" },
+        { "load",     "groups=100x10,churn=50,load=50" },
+    };
+
+    constexpr size_t MAX_PROFILE_LENGTH = 160;
+
+    // Copies one "key=value" item out of a comma-separated profile
+    const char* nextItem(const char* cursor, char* key, size_t keySize, char* value, size_t valueSize)
+    {
+        const char* end = strchr(cursor, ',');
+        size_t length = end ? static_cast<size_t>(end - cursor) : strlen(cursor);
+        const char* equals = static_cast<const char*>(memchr(cursor, '=', length));
+        size_t keyLength = equals ? static_cast<size_t>(equals - cursor) : length;
+        size_t valueLength = equals ? length - keyLength - 1 : 0;
+        keyLength = keyLength < keySize - 1 ? keyLength : keySize - 1;
+        valueLength = valueLength < valueSize - 1 ? valueLength : valueSize - 1;
+        memcpy(key, cursor, keyLength);
+        key[keyLength] = '\0';
+        if (equals)
+        {
+            memcpy(value, equals + 1, valueLength);
+        }
+        value[valueLength] = '\0';
+        return end ? end + 1 : nullptr;
+    }
+
+    bool parseU32(const char* text, uint32_t& out)
+    {
+        char* end = nullptr;
+        unsigned long value = strtoul(text, &end, 0);
+        if (end == text || *end != '\0')
+        {
+            return false;
+        }
+        out = static_cast<uint32_t>(value);
+        return true;
+    }
+}
+
+uint8_t (*TrafficGenerator::s_payloads)[8] = nullptr;
+uint16_t TrafficGenerator::s_capacity = 0;
+TrafficGenerator::Settings TrafficGenerator::s_settings;
+uint16_t TrafficGenerator::s_idCount = 0;
+uint32_t TrafficGenerator::s_random = 1;
+uint64_t TrafficGenerator::s_nowUs = 0;
+uint32_t TrafficGenerator::s_lastPollUs = 0;
+bool TrafficGenerator::s_started = false;
+uint64_t TrafficGenerator::s_burstQ8 = 0;
+uint16_t TrafficGenerator::s_burstLeft = 0;
+uint16_t TrafficGenerator::s_burstNext = 0;
+uint64_t TrafficGenerator::s_generated = 0;
+uint64_t TrafficGenerator::s_skipped = 0;
+uint32_t TrafficGenerator::s_expectedLoad = 0;
+const char* TrafficGenerator::s_error = "";
+
+bool TrafficGenerator::begin(uint16_t maxIds)
+{
+    delete[] s_payloads;
+    s_payloads = new (std::nothrow) uint8_t[maxIds][8];
+    s_capacity = s_payloads ? maxIds : 0;
+    s_idCount = 0;
+    return s_payloads != nullptr;
+}
+
+bool TrafficGenerator::configure(const char* profile, uint32_t bitrate)
+{
+    Settings settings = {};
+    settings.length = 8;
+    settings.baseId = 0x100;
+    settings.burstIntervalUs = 1000000;
+    settings.seed = 1;
+
+    if (strlen(profile) > MAX_PROFILE_LENGTH)
+    {
+        s_error = "profile too long";
+        return false;
+    }
+    char key[16];
+    char value[MAX_PROFILE_LENGTH + 1];
+    for (const char* cursor = profile; cursor && *cursor;)
+    {
+        cursor = nextItem(cursor, key, sizeof(key), value, sizeof(value));
+        if (!applySetting(settings, key, value))
+        {
+            return false;
+        }
+    }
+
+    uint32_t ids = 0;
+    for (uint8_t g = 0; g < settings.groupCount; ++g)
+    {
+        settings.groups[g].firstIndex = static_cast<uint16_t>(ids);
+        ids += settings.groups[g].count;
+    }
+    if (ids == 0)
+    {
+        s_error = "no IDs configured (set groups= or preset=)";
+        return false;
+    }
+    if (ids > s_capacity)
+    {
+        s_error = "more IDs than begin() allocated";
+        return false;
+    }
+    uint32_t maxId = settings.extended ? 0x1FFFFFFF : 0x7FF;
+    if (settings.baseId > maxId || ids - 1 > maxId - settings.baseId)
+    {
+        s_error = "IDs exceed the 11-bit range (use ext=1 or a lower base)";
+        return false;
+    }
+
+    // Nominal load of the profile as written, then optionally scaled
+    uint32_t bits = CanStatistics::frameBits(settings.length, settings.extended);
+    double framesPerSecond = 0;
+    for (uint8_t g = 0; g < settings.groupCount; ++g)
+    {
+        framesPerSecond += settings.groups[g].count * 1e6 / settings.groups[g].periodUs;
+    }
+    if (settings.burstFrames)
+    {
+        framesPerSecond += settings.burstFrames * 1e6 / settings.burstIntervalUs;
+    }
+    double load = framesPerSecond * bits / (bitrate ? bitrate : 1);
+    if (settings.loadPercent)
+    {
+        double scale = load * 100.0 / settings.loadPercent;
+        for (uint8_t g = 0; g < settings.groupCount; ++g)
+        {
+            double period = settings.groups[g].periodUs * scale;
+            settings.groups[g].periodUs = period < 1 ? 1 : static_cast<uint32_t>(period);
+        }
+        double burstInterval = settings.burstIntervalUs * scale;
+        settings.burstIntervalUs = burstInterval < 1 ? 1 : static_cast<uint32_t>(burstInterval);
+        load = settings.loadPercent / 100.0;
+    }
+    s_expectedLoad = static_cast<uint32_t>(load * 1000);
+
+    for (uint8_t g = 0; g < settings.groupCount; ++g)
+    {
+        Group& group = settings.groups[g];
+        group.stepQ8 = (static_cast<uint64_t>(group.periodUs) << 8) / group.count;
+        if (group.stepQ8 == 0)
+        {
+            group.stepQ8 = 1;
+        }
+        group.nextQ8 = 0;
+        group.next = 0;
+    }
+
+    s_settings = settings;
+    s_idCount = static_cast<uint16_t>(ids);
+    s_random = settings.seed ? settings.seed : 1;
+    for (uint16_t i = 0; i < s_idCount; ++i)
+    {
+        uint32_t a = nextRandom();
+        uint32_t b = nextRandom();
+        memcpy(s_payloads[i], &a, 4);
+        memcpy(s_payloads[i] + 4, &b, 4);
+    }
+    s_nowUs = 0;
+    s_started = false;
+    s_burstQ8 = static_cast<uint64_t>(settings.burstIntervalUs) << 8;
+    s_burstLeft = 0;
+    s_burstNext = 0;
+    s_generated = 0;
+    s_skipped = 0;
+    s_error = "";
+    return true;
+}
+
+bool TrafficGenerator::applySetting(Settings& settings, const char* key, const char* value)
+{
+    if (strcmp(key, "preset") == 0)
+    {
+        return applyPreset(settings, value);
+    }
+    if (strcmp(key, "groups") == 0)
+    {
+        return parseGroups(settings, value);
+    }
+
+    uint32_t number = 0;
+    if (!parseU32(value, number))
+    {
+        s_error = "expected key=number";
+        return false;
+    }
+    if (strcmp(key, "len") == 0 && number <= 8)
+    {
+        settings.length = static_cast<uint8_t>(number);
+    }
+    else if (strcmp(key, "ext") == 0 && number <= 1)
+    {
+        settings.extended = number != 0;
+        if (settings.extended && settings.baseId == 0x100)
+        {
+            settings.baseId = 0x18000000;
+        }
+    }
+    else if (strcmp(key, "base") == 0)
+    {
+        settings.baseId = number;
+    }
+    else if (strcmp(key, "churn") == 0 && number <= 1000)
+    {
+        settings.churnPermille = static_cast<uint16_t>(number);
+    }
+    else if (strcmp(key, "burst") == 0 && number <= 0xFFFF)
+    {
+        settings.burstFrames = static_cast<uint16_t>(number);
+    }
+    else if (strcmp(key, "burstms") == 0 && number > 0 && number <= 3600000)
+    {
+        settings.burstIntervalUs = number * 1000;
+    }
+    else if (strcmp(key, "load") == 0 && number <= 100)
+    {
+        settings.loadPercent = static_cast<uint16_t>(number);
+    }
+    else if (strcmp(key, "seed") == 0)
+    {
+        settings.seed = number;
+    }
+    else
+    {
+        s_error = "unknown key or value out of range";
+        return false;
+    }
+    return true;
+}
+
+bool TrafficGenerator::applyPreset(Settings& settings, const char* name)
+{
+    for (const Preset& preset : PRESETS)
+    {
+        if (strcmp(preset.name, name) != 0)
+        {
+            continue;
+        }
+        char key[16];
+        char value[MAX_PROFILE_LENGTH + 1];
+        for (const char* cursor = preset.profile; cursor && *cursor;)
+        {
+            cursor = nextItem(cursor, key, sizeof(key), value, sizeof(value));
+            if (!applySetting(settings, key, value))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    s_error = "unknown preset";
+    return false;
+}
+
+bool TrafficGenerator::parseGroups(Settings& settings, const char* value)
+{
+    // COUNTxPERIOD_MS, joined with '+'
+    settings.groupCount = 0;
+    const char* cursor = value;
+    while (*cursor)
+    {
+        if (settings.groupCount == MAX_GROUPS)
+        {
+            s_error = "too many groups";
+            return false;
+        }
+        char* end = nullptr;
+        unsigned long count = strtoul(cursor, &end, 10);
+        if (end == cursor || *end != 'x')
+        {
+            s_error = "groups must look like 20x10+50x100";
+            return false;
+        }
+        cursor = end + 1;
+        unsigned long periodMs = strtoul(cursor, &end, 10);
+        if (end == cursor || (*end != '+' && *end != '\0') || count == 0 || count > 0xFFFF ||
+            periodMs == 0 || periodMs > 3600000)
+        {
+            s_error = "groups must look like 20x10+50x100";
+            return false;
+        }
+        Group& group = settings.groups[settings.groupCount++];
+        group.count = static_cast<uint16_t>(count);
+        group.periodUs = static_cast<uint32_t>(periodMs * 1000);
+        cursor = *end == '+' ? end + 1 : end;
+    }
+    return true;
+}
+
+const char* TrafficGenerator::lastError()
+{
+    return s_error;
+}
+
+uint16_t TrafficGenerator::poll(uint32_t nowUs, Frame* out, uint16_t max)
+{
+    if (s_idCount == 0)
+    {
+        return 0;
+    }
+
+    // Extend the wrapping clock onto the 64-bit timeline
+    if (!s_started)
+    {
+        s_started = true;
+        s_lastPollUs = nowUs;
+    }
+    s_nowUs += nowUs - s_lastPollUs;
+    s_lastPollUs = nowUs;
+    uint64_t nowQ8 = s_nowUs << 8;
+    uint64_t lagQ8 = static_cast<uint64_t>(MAX_LAG_US) << 8;
+
+    uint16_t emitted = 0;
+    while (emitted < max)
+    {
+        // Burst frames first, then the group that is due soonest
+        if (s_settings.burstFrames && s_burstLeft == 0 && s_burstQ8 <= nowQ8)
+        {
+            s_burstLeft = s_settings.burstFrames;
+        }
+        if (s_burstLeft)
+        {
+            makeFrame(s_burstNext, s_burstQ8 >> 8, out[emitted++]);
+            s_burstNext = static_cast<uint16_t>((s_burstNext + 1) % s_idCount);
+            if (--s_burstLeft == 0)
+            {
+                s_burstQ8 += static_cast<uint64_t>(s_settings.burstIntervalUs) << 8;
+            }
+            continue;
+        }
+
+        Group* due = nullptr;
+        for (uint8_t g = 0; g < s_settings.groupCount; ++g)
+        {
+            Group& group = s_settings.groups[g];
+            if (nowQ8 > group.nextQ8 + lagQ8)
+            {
+                // Fell too far behind (e.g. the caller stalled); skip ahead
+                uint64_t missed = (nowQ8 - group.nextQ8) / group.stepQ8;
+                s_skipped += missed;
+                group.nextQ8 += missed * group.stepQ8;
+                group.next = static_cast<uint16_t>((group.next + missed) % group.count);
+            }
+            if (group.nextQ8 <= nowQ8 && (!due || group.nextQ8 < due->nextQ8))
+            {
+                due = &group;
+            }
+        }
+        if (!due)
+        {
+            break;
+        }
+        makeFrame(static_cast<uint16_t>(due->firstIndex + due->next), due->nextQ8 >> 8, out[emitted++]);
+        due->next = static_cast<uint16_t>((due->next + 1) % due->count);
+        due->nextQ8 += due->stepQ8;
+    }
+    return emitted;
+}
+
+void TrafficGenerator::makeFrame(uint16_t index, uint64_t dueUs, Frame& frame)
+{
+    uint8_t* payload = s_payloads[index];
+    if (s_settings.churnPermille && s_settings.length)
+    {
+        uint32_t r = nextRandom();
+        if (r % 1000 < s_settings.churnPermille)
+        {
+            payload[(r >> 10) % s_settings.length] = static_cast<uint8_t>(r >> 24);
+        }
+    }
+
+    frame.msg.timestamp = static_cast<uint32_t>(dueUs / 1000);
+    frame.msg.id = s_settings.baseId + index;
+    frame.msg.length = s_settings.length;
+    memcpy(frame.msg.data, payload, 8);
+    frame.extended = s_settings.extended;
+    frame.dueUs = dueUs;
+    ++s_generated;
+}
+
+uint32_t TrafficGenerator::nextRandom()
+{
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+    return s_random;
+}
+
+uint16_t TrafficGenerator::idCount()
+{
+    return s_idCount;
+}
+
+uint64_t TrafficGenerator::generated()
+{
+    return s_generated;
+}
+
+uint64_t TrafficGenerator::skipped()
+{
+    return s_skipped;
+}
+
+uint32_t TrafficGenerator::expectedLoadPermille()
+{
+    return s_expectedLoad;
+}
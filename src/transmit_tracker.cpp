@@ -0,0 +1,145 @@
+#include "transmit_tracker.h"
+#include "latency_stats.h"
+#include <new>
+
+TransmitTracker::Pending* TransmitTracker::s_pending = nullptr;
+TransmitTracker::Ack* TransmitTracker::s_acks = nullptr;
+uint8_t TransmitTracker::s_capacity = 0;
+std::atomic<uint32_t> TransmitTracker::s_pendingHead(0);
+std::atomic<uint32_t> TransmitTracker::s_pendingTail(0);
+std::atomic<uint32_t> TransmitTracker::s_ackHead(0);
+std::atomic<uint32_t> TransmitTracker::s_ackTail(0);
+uint32_t TransmitTracker::s_lastFailedTotal = 0;
+uint32_t TransmitTracker::s_completed = 0;
+uint32_t TransmitTracker::s_failed = 0;
+uint32_t TransmitTracker::s_untracked = 0;
+
+bool TransmitTracker::begin(uint8_t capacity)
+{
+    delete[] s_pending;
+    delete[] s_acks;
+    s_pending = new (std::nothrow) Pending[capacity];
+    s_acks = new (std::nothrow) Ack[capacity];
+    if (!s_pending || !s_acks)
+    {
+        delete[] s_pending;
+        delete[] s_acks;
+        s_pending = nullptr;
+        s_acks = nullptr;
+    }
+    s_capacity = s_pending ? capacity : 0;
+    s_pendingHead = 0;
+    s_pendingTail = 0;
+    s_ackHead = 0;
+    s_ackTail = 0;
+    s_lastFailedTotal = 0;
+    return s_pending != nullptr;
+}
+
+void TransmitTracker::queued(uint32_t token, uint32_t client, uint32_t receivedUs, uint32_t queuedUs)
+{
+    uint32_t head = s_pendingHead.load(std::memory_order_relaxed);
+    if (!s_pending || head - s_pendingTail.load(std::memory_order_acquire) >= s_capacity)
+    {
+        // Only when the capacity is below the driver's queue length; the
+        // frame still goes out, its sender just hears nothing
+        ++s_untracked;
+        return;
+    }
+    Pending& slot = s_pending[head % s_capacity];
+    slot.token = token;
+    slot.client = client;
+    slot.receivedUs = receivedUs;
+    slot.queuedUs = queuedUs;
+    s_pendingHead.store(head + 1, std::memory_order_release);
+}
+
+uint32_t TransmitTracker::inFlight()
+{
+    return s_pendingHead.load(std::memory_order_acquire) - s_pendingTail.load(std::memory_order_relaxed);
+}
+
+// Which of several frames finishing together failed cannot be told apart;
+// the oldest are marked. With the usual one frame at a time it is exact.
+void TransmitTracker::settle(uint32_t trackedBefore, uint32_t driverInFlight, uint32_t failedTotal, uint32_t doneUs)
+{
+    uint32_t done = trackedBefore > driverInFlight ? trackedBefore - driverInFlight : 0;
+    uint32_t failures = failedTotal - s_lastFailedTotal;
+    s_lastFailedTotal = failedTotal;
+    for (uint32_t i = 0; i < done; ++i)
+    {
+        finish(i < failures ? FrameCodec::TransmitStatus::Failed : FrameCodec::TransmitStatus::Sent, doneUs);
+    }
+}
+
+void TransmitTracker::abandon(uint32_t doneUs, uint32_t failedTotal)
+{
+    uint32_t pending = inFlight();
+    for (uint32_t i = 0; i < pending; ++i)
+    {
+        finish(FrameCodec::TransmitStatus::Failed, doneUs);
+    }
+    s_lastFailedTotal = failedTotal;
+}
+
+bool TransmitTracker::takeAck(Ack& ack)
+{
+    uint32_t tail = s_ackTail.load(std::memory_order_relaxed);
+    if (s_ackHead.load(std::memory_order_acquire) == tail)
+    {
+        return false;
+    }
+    ack = s_acks[tail % s_capacity];
+    s_ackTail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void TransmitTracker::finish(FrameCodec::TransmitStatus status, uint32_t doneUs)
+{
+    uint32_t tail = s_pendingTail.load(std::memory_order_relaxed);
+    const Pending& pending = s_pending[tail % s_capacity];
+    if (status == FrameCodec::TransmitStatus::Sent)
+    {
+        ++s_completed;
+        LatencyStats::record(LatencyStats::Stage::Transmit, doneUs - pending.receivedUs);
+    }
+    else
+    {
+        ++s_failed;
+    }
+
+    uint32_t head = s_ackHead.load(std::memory_order_relaxed);
+    // A full ack ring means the stream task is stuck; the sender times out
+    if (pending.client != 0 && head - s_ackTail.load(std::memory_order_acquire) < s_capacity)
+    {
+        Ack& slot = s_acks[head % s_capacity];
+        slot.client = pending.client;
+        slot.ack.token = pending.token;
+        slot.ack.status = status;
+        slot.ack.receivedUs = pending.receivedUs;
+        slot.ack.queuedUs = pending.queuedUs;
+        slot.ack.doneUs = doneUs;
+        s_ackHead.store(head + 1, std::memory_order_release);
+    }
+    s_pendingTail.store(tail + 1, std::memory_order_release);
+}
+
+uint32_t TransmitTracker::completed()
+{
+    return s_completed;
+}
+
+uint32_t TransmitTracker::failed()
+{
+    return s_failed;
+}
+
+uint32_t TransmitTracker::untracked()
+{
+    return s_untracked;
+}
+
+size_t TransmitTracker::memoryBytes()
+{
+    return s_capacity * (sizeof(Pending) + sizeof(Ack));
+}
@@ -0,0 +1,303 @@
+#include "view_order.h"
+#include "state_table.h"
+#include "can_stats.h"
+#include <new>
+#include <string.h>
+
+namespace
+{
+    constexpr uint16_t NO_SLOT = StateTable::NO_SLOT;
+    constexpr uint8_t LENGTHS = 9;      // DLC 0 to 8
+
+    const char* const ORDER_NAMES[] = { "id", "update", "change", "rate", "dlc" };
+
+    bool rateAbove(uint16_t a, uint16_t b)
+    {
+        uint32_t rateA = CanStatistics::counters(a).rate;
+        uint32_t rateB = CanStatistics::counters(b).rate;
+        return rateA > rateB ||
+               (rateA == rateB && StateTable::entry(a).latest.id < StateTable::entry(b).latest.id);
+    }
+
+    // Copies the part of a walk that falls inside the page
+    struct PageWriter
+    {
+        uint16_t offset;
+        uint16_t limit;
+        uint16_t* slots;
+        uint16_t position;
+        uint16_t count;
+
+        PageWriter(uint16_t pageOffset, uint16_t pageLimit, uint16_t* out)
+            : offset(pageOffset), limit(pageLimit), slots(out), position(0), count(0)
+        {
+        }
+
+        // False once the page is full
+        bool add(uint16_t slot)
+        {
+            if (position++ >= offset)
+            {
+                slots[count++] = slot;
+            }
+            return count < limit;
+        }
+    };
+}
+
+uint16_t* ViewOrder::s_changePrev = nullptr;
+uint16_t* ViewOrder::s_changeNext = nullptr;
+uint16_t ViewOrder::s_changeHead = NO_SLOT;
+uint16_t ViewOrder::s_changeTail = NO_SLOT;
+uint16_t* ViewOrder::s_rateOrder[2] = { nullptr, nullptr };
+uint16_t ViewOrder::s_rateCount[2] = { 0, 0 };
+volatile uint8_t ViewOrder::s_ratePublished = 0;
+uint16_t ViewOrder::s_rateResume = 1;
+uint16_t ViewOrder::s_capacity = 0;
+
+bool ViewOrder::begin(uint16_t capacity)
+{
+    if (s_changePrev)
+    {
+        return true;
+    }
+
+    s_changePrev = new (std::nothrow) uint16_t[capacity];
+    s_changeNext = new (std::nothrow) uint16_t[capacity];
+    s_rateOrder[0] = new (std::nothrow) uint16_t[capacity];
+    s_rateOrder[1] = new (std::nothrow) uint16_t[capacity];
+    if (!s_changePrev || !s_changeNext || !s_rateOrder[0] || !s_rateOrder[1])
+    {
+        return false;
+    }
+    for (uint16_t i = 0; i < capacity; ++i)
+    {
+        s_changePrev[i] = NO_SLOT;
+        s_changeNext[i] = NO_SLOT;
+    }
+    s_capacity = capacity;
+    return true;
+}
+
+void ViewOrder::changeUnlink(uint16_t slot)
+{
+    if (s_changePrev[slot] == NO_SLOT && s_changeHead != slot)
+    {
+        return;
+    }
+    uint16_t prev = s_changePrev[slot];
+    uint16_t next = s_changeNext[slot];
+    if (prev != NO_SLOT)
+    {
+        s_changeNext[prev] = next;
+    }
+    else
+    {
+        s_changeHead = next;
+    }
+    if (next != NO_SLOT)
+    {
+        s_changePrev[next] = prev;
+    }
+    else
+    {
+        s_changeTail = prev;
+    }
+    s_changePrev[slot] = NO_SLOT;
+    s_changeNext[slot] = NO_SLOT;
+}
+
+void ViewOrder::changeLink(uint16_t slot, bool front)
+{
+    if (front)
+    {
+        s_changeNext[slot] = s_changeHead;
+        if (s_changeHead != NO_SLOT)
+        {
+            s_changePrev[s_changeHead] = slot;
+        }
+        s_changeHead = slot;
+        if (s_changeTail == NO_SLOT)
+        {
+            s_changeTail = slot;
+        }
+    }
+    else
+    {
+        s_changePrev[slot] = s_changeTail;
+        if (s_changeTail != NO_SLOT)
+        {
+            s_changeNext[s_changeTail] = slot;
+        }
+        s_changeTail = slot;
+        if (s_changeHead == NO_SLOT)
+        {
+            s_changeHead = slot;
+        }
+    }
+}
+
+void ViewOrder::resetSlot(uint16_t slot)
+{
+    if (slot < s_capacity)
+    {
+        changeUnlink(slot);
+        changeLink(slot, false);
+    }
+}
+
+void ViewOrder::recordChange(uint16_t slot)
+{
+    if (slot < s_capacity && slot != s_changeHead)
+    {
+        changeUnlink(slot);
+        changeLink(slot, true);
+    }
+}
+
+void ViewOrder::update()
+{
+    if (!s_changePrev)
+    {
+        return;
+    }
+
+    // Slots are handed out in order and only reused after eviction, so the
+    // slots in use are always 0 to size() - 1 and new ones join at the end
+    uint8_t published = s_ratePublished;
+    uint16_t* order = s_rateOrder[published ^ 1];
+    uint16_t count = s_rateCount[published];
+    memcpy(order, s_rateOrder[published], count * sizeof(uint16_t));
+    for (uint16_t slot = count; slot < StateTable::size(); ++slot)
+    {
+        order[count++] = slot;
+    }
+
+    // The slot being placed when the budget runs out is still placed, so a
+    // pass makes at most RATE_REPAIR_MOVES + count moves
+    uint32_t moves = 0;
+    uint16_t i = s_rateResume < count ? s_rateResume : 1;
+    for (; i < count && moves < RATE_REPAIR_MOVES; ++i)
+    {
+        uint16_t slot = order[i];
+        uint16_t j = i;
+        while (j > 0 && rateAbove(slot, order[j - 1]))
+        {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = slot;
+        moves += i - j;
+    }
+    s_rateResume = i < count ? i : 1;
+    s_rateCount[published ^ 1] = count;
+    s_ratePublished = published ^ 1;
+}
+
+uint16_t ViewOrder::page(Order order, uint16_t offset, uint16_t limit, uint16_t* slots)
+{
+    PageWriter writer(offset, limit, slots);
+    if (!s_changePrev || limit == 0)
+    {
+        return 0;
+    }
+
+    switch (order)
+    {
+    case Order::Id:
+    {
+        uint16_t size = 0;
+        const uint16_t* byId = StateTable::slotsById(size);
+        for (uint16_t i = offset; i < size && writer.count < limit; ++i)
+        {
+            slots[writer.count++] = byId[i];
+        }
+        break;
+    }
+    case Order::LastUpdate:
+    {
+        uint16_t slot = StateTable::mostRecent();
+        for (uint16_t steps = 0; slot != NO_SLOT && steps < s_capacity && writer.add(slot); ++steps)
+        {
+            slot = StateTable::entry(slot).lruNext;
+        }
+        break;
+    }
+    case Order::LastChange:
+    {
+        uint16_t slot = s_changeHead;
+        for (uint16_t steps = 0; slot != NO_SLOT && steps < s_capacity && writer.add(slot); ++steps)
+        {
+            slot = s_changeNext[slot];
+        }
+        break;
+    }
+    case Order::Rate:
+    {
+        uint8_t published = s_ratePublished;
+        const uint16_t* rateOrder = s_rateOrder[published];
+        uint16_t count = s_rateCount[published];
+        for (uint16_t i = offset; i < count && writer.count < limit; ++i)
+        {
+            slots[writer.count++] = rateOrder[i];
+        }
+        break;
+    }
+    case Order::Length:
+    {
+        // Stable counting pass: the first pass finds where each DLC starts,
+        // the second places the IDs that land on the page
+        uint16_t size = 0;
+        const uint16_t* byId = StateTable::slotsById(size);
+        uint16_t start[LENGTHS] = {};
+        for (uint16_t i = 0; i < size; ++i)
+        {
+            uint8_t length = StateTable::entry(byId[i]).latest.length;
+            if (length + 1 < LENGTHS)
+            {
+                ++start[length + 1];
+            }
+        }
+        for (uint8_t length = 1; length < LENGTHS; ++length)
+        {
+            start[length] += start[length - 1];
+        }
+        uint32_t end = static_cast<uint32_t>(offset) + limit;
+        for (uint16_t i = 0; i < size; ++i)
+        {
+            uint8_t length = StateTable::entry(byId[i]).latest.length;
+            uint16_t position = start[length < LENGTHS ? length : LENGTHS - 1]++;
+            if (position >= offset && position < end)
+            {
+                slots[position - offset] = byId[i];
+                ++writer.count;
+            }
+        }
+        break;
+    }
+    }
+    return writer.count;
+}
+
+const char* ViewOrder::orderName(Order order)
+{
+    return ORDER_NAMES[static_cast<size_t>(order)];
+}
+
+bool ViewOrder::parseOrder(const char* name, Order& order)
+{
+    for (size_t i = 0; i < sizeof(ORDER_NAMES) / sizeof(ORDER_NAMES[0]); ++i)
+    {
+        if (strcmp(name, ORDER_NAMES[i]) == 0)
+        {
+            order = static_cast<Order>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ViewOrder::memoryBytes()
+{
+    return s_capacity * 4 * sizeof(uint16_t);
+}
@@ -0,0 +1,357 @@
+#include "view_render.h"
+#include "state_table.h"
+#include "change_tracker.h"
+#include "can_stats.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+namespace
+{
+    constexpr const char* LATEST_PLACEHOLDER = "%LATEST_MESSAGES%";
+
+    const char* ageClassFor(uint32_t age)
+    {
+        if (age < 1000) return "age-fresh";          // Less than 1 second
+        if (age < 5000) return "age-medium";         // Less than 5 seconds
+        return "age-old";                            // More than 5 seconds
+    }
+
+    // "<tr data-id='{id}'><td>0x{id}</td><td>{length}</td><td>"; the page
+    // looks the row's frame up by data-id when it is clicked
+    void renderRowStart(RenderBuffer& out, const CANMessage& msg)
+    {
+        out.append("<tr data-id='", 13);
+        out.appendHex(msg.id);
+        out.append("'><td>0x", 8);
+        out.appendHex(msg.id);
+        out.append("</td><td>", 9);
+        out.appendDec(msg.length);
+        out.append("</td><td>", 9);
+    }
+
+    // "</td><td>{timestamp}</td><td class='{age class}'>{age}" after the data bytes
+    void renderTimes(RenderBuffer& out, uint32_t timestamp, uint32_t age)
+    {
+        out.append("</td><td>", 9);
+        out.appendDec(timestamp);
+        out.append("</td><td class='", 16);
+        out.append(ageClassFor(age));
+        out.append("'>", 2);
+        out.appendDec(age);
+    }
+}
+
+ViewRenderer::Context* ViewRenderer::s_contexts = nullptr;
+const char* ViewRenderer::s_pageTemplate = "";
+size_t ViewRenderer::s_placeholderOffset = 0;
+size_t ViewRenderer::s_templateLength = 0;
+
+bool ViewRenderer::begin(const char* pageTemplate, uint16_t maxIds)
+{
+    if (s_contexts)
+    {
+        return true;
+    }
+
+    s_pageTemplate = pageTemplate;
+    s_templateLength = strlen(pageTemplate);
+    const char* placeholder = strstr(pageTemplate, LATEST_PLACEHOLDER);
+    s_placeholderOffset = placeholder ? placeholder - pageTemplate : s_templateLength;
+
+    Context* contexts = new (std::nothrow) Context[CONTEXT_COUNT];
+    if (!contexts)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < CONTEXT_COUNT; ++i)
+    {
+        contexts[i].row = new (std::nothrow) char[ROW_BUFFER_BYTES];
+        contexts[i].slots = new (std::nothrow) uint16_t[maxIds];
+        if (!contexts[i].row || !contexts[i].slots)
+        {
+            return false;
+        }
+    }
+    s_contexts = contexts;
+    return true;
+}
+
+ViewRenderer::Context* ViewRenderer::claim(View view, HeapGuard::Scope scope, uint32_t now)
+{
+    if (!s_contexts)
+    {
+        return nullptr;
+    }
+    for (size_t i = 0; i < CONTEXT_COUNT; ++i)
+    {
+        Context& ctx = s_contexts[i];
+        if (!ctx.busy)
+        {
+            ctx.busy = true;
+            ctx.view = view;
+            ctx.scope = scope;
+            ctx.stage = Stage::Prefix;
+            ctx.next = 0;
+            ctx.rowsEmitted = 0;
+            ctx.idsRequested = false;
+            // The ID-ordered views take a copy of the published order, so a
+            // publish while they stream does not move rows under them
+            ctx.slotCount = 0;
+            if (view == View::Page || view == View::LatestRows || view == View::IdListJson)
+            {
+                const uint16_t* order = StateTable::slotsById(ctx.slotCount);
+                memcpy(ctx.slots, order, ctx.slotCount * sizeof(uint16_t));
+            }
+            ctx.now = now;
+            ctx.chunk = nullptr;
+            ctx.chunkLength = 0;
+            ctx.chunkSent = 0;
+            return &ctx;
+        }
+    }
+    return nullptr;
+}
+
+void ViewRenderer::release(Context* ctx)
+{
+    if (ctx)
+    {
+        ctx->busy = false;
+    }
+}
+
+size_t ViewRenderer::fill(Context& ctx, uint8_t* buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (ctx.chunkSent == ctx.chunkLength)
+        {
+            if (!renderNext(ctx))
+            {
+                break;
+            }
+            continue;
+        }
+        size_t count = std::min(maxLen - written, ctx.chunkLength - ctx.chunkSent);
+        memcpy(buffer + written, ctx.chunk + ctx.chunkSent, count);
+        ctx.chunkSent += count;
+        written += count;
+    }
+    return written;
+}
+
+void ViewRenderer::formatByte(RenderBuffer& out, uint8_t byte, bool highlight)
+{
+    ALLOC_SCOPE(FormatByte);
+    out.append(highlight ? "<span class='byte highlight'>" : "<span class='byte'>");
+    out.appendHexByte(byte);
+    out.append("</span> ", 8);
+}
+
+void ViewRenderer::renderBytes(RenderBuffer& out, uint16_t slot, uint8_t highlightMask)
+{
+    const StateTable::Entry& entry = StateTable::entry(slot);
+    const CANMessage& msg = entry.latest;
+    for (int i = 0; i < msg.length; i++)
+    {
+        bool highlight = (highlightMask >> i) & 1;
+        if (!highlight && entry.hasPrevious)
+        {
+            highlight = i >= entry.previous.length ||
+                        msg.data[i] != entry.previous.data[i];
+        }
+        formatByte(out, msg.data[i], highlight);
+    }
+}
+
+bool ViewRenderer::renderLatestRow(RenderBuffer& out, uint16_t slot, uint32_t now)
+{
+    const StateTable::Entry& entry = StateTable::entry(slot);
+    if (!entry.hasLatest)
+    {
+        return false;
+    }
+    const CANMessage& msg = entry.latest;
+
+    uint32_t lastChangeTimestamp = 0;
+    uint8_t highlightMask = ChangeTracker::highlightMask(slot, now, lastChangeTimestamp);
+
+    renderRowStart(out, msg);
+    renderBytes(out, slot, highlightMask);
+
+    uint32_t age = now - msg.timestamp;
+    const CanStatistics::IdCounters& counters = CanStatistics::counters(slot);
+    renderTimes(out, msg.timestamp, age);
+    out.append("</td><td>", 9);
+    out.appendDec(counters.frames);
+    out.append("</td><td>", 9);
+    out.appendDec(counters.rate);
+    out.append("</td></tr>\n", 11);
+    return true;
+}
+
+bool ViewRenderer::renderFilteredRow(RenderBuffer& out, uint16_t slot, uint32_t now)
+{
+    const StateTable::Entry& entry = StateTable::entry(slot);
+    if (!entry.hasLatest)
+    {
+        return false;
+    }
+    const CANMessage& msg = entry.latest;
+
+    uint32_t lastChangeTimestamp = 0;
+    uint8_t highlightMask = ChangeTracker::highlightMask(slot, now, lastChangeTimestamp);
+    if (lastChangeTimestamp == 0)
+    {
+        return false;
+    }
+
+    uint32_t age = now - lastChangeTimestamp;
+    if (age > ChangeTracker::CHANGE_EXPIRATION_MS)
+    {
+        return false;
+    }
+
+    renderRowStart(out, msg);
+    renderBytes(out, slot, highlightMask);
+    renderTimes(out, msg.timestamp, age);
+    out.append("</td></tr>\n", 11);
+    return true;
+}
+
+bool ViewRenderer::renderIdListItem(RenderBuffer& out, uint16_t slot, bool first)
+{
+    const StateTable::Entry& entry = StateTable::entry(slot);
+    if (!entry.hasLatest)
+    {
+        return false;
+    }
+    out.append(first ? "\"0x" : ",\"0x");
+    out.appendHex(entry.latest.id);
+    out.appendChar('"');
+    return true;
+}
+
+// Renders the next row of the view into ctx.row; false when none are left.
+// Rows are read live from the state table in the ID order copied when the
+// response started. IDs inserted while it streams are left out and a slot
+// evicted meanwhile shows the ID that replaced it.
+bool ViewRenderer::renderRow(Context& ctx, RenderBuffer& out)
+{
+    while (true)
+    {
+        out.clear();
+        bool rendered = false;
+        switch (ctx.view)
+        {
+        case View::Page:
+        case View::LatestRows:
+            if (ctx.next >= ctx.slotCount)
+            {
+                return false;
+            }
+            rendered = renderLatestRow(out, ctx.slots[ctx.next++], ctx.now);
+            break;
+        case View::FilteredRows:
+            if (ctx.next >= ctx.slotCount)
+            {
+                return false;
+            }
+            rendered = renderFilteredRow(out, ctx.slots[ctx.next++], ctx.now);
+            break;
+        case View::IdListJson:
+            if (ctx.next >= ctx.slotCount)
+            {
+                return false;
+            }
+            rendered = renderIdListItem(out, ctx.slots[ctx.next++], ctx.rowsEmitted == 0);
+            break;
+        case View::LatestPage:
+            if (ctx.next >= ctx.slotCount)
+            {
+                return false;
+            }
+            rendered = renderLatestRow(out, ctx.slots[ctx.next++], ctx.now);
+            break;
+        case View::SlotListJson:
+            if (ctx.next >= ctx.slotCount)
+            {
+                return false;
+            }
+            rendered = renderIdListItem(out, ctx.slots[ctx.next++], ctx.rowsEmitted == 0);
+            break;
+        }
+        if (rendered)
+        {
+            ++ctx.rowsEmitted;
+            return true;
+        }
+    }
+}
+
+// Produces the next piece of output into ctx.chunk; false once finished
+bool ViewRenderer::renderNext(Context& ctx)
+{
+    RenderBuffer out(ctx.row, ROW_BUFFER_BYTES);
+    while (ctx.stage != Stage::Done)
+    {
+        switch (ctx.stage)
+        {
+        case Stage::Prefix:
+            ctx.stage = Stage::Rows;
+            if (ctx.view == View::Page)
+            {
+                setChunk(ctx, s_pageTemplate, s_placeholderOffset);
+                return true;
+            }
+            if (ctx.view == View::IdListJson || ctx.view == View::SlotListJson)
+            {
+                setChunk(ctx, "[", 1);
+                return true;
+            }
+            break;
+        case Stage::Rows:
+            if (renderRow(ctx, out))
+            {
+                setChunk(ctx, out.data(), out.length());
+                return true;
+            }
+            ctx.stage = Stage::Suffix;
+            break;
+        case Stage::Suffix:
+            ctx.stage = Stage::Done;
+            if (ctx.view == View::Page)
+            {
+                size_t rest = std::min(s_placeholderOffset + strlen(LATEST_PLACEHOLDER), s_templateLength);
+                setChunk(ctx, s_pageTemplate + rest, s_templateLength - rest);
+                return true;
+            }
+            if (ctx.view == View::IdListJson || ctx.view == View::SlotListJson)
+            {
+                setChunk(ctx, "]", 1);
+                return true;
+            }
+            if (ctx.view == View::FilteredRows && ctx.rowsEmitted == 0)
+            {
+                const char* text = ctx.idsRequested
+                    ? "<tr><td colspan='5'>No matching IDs found or messages have expired</td></tr>"
+                    : "<tr><td colspan='5'>No IDs selected</td></tr>";
+                setChunk(ctx, text, strlen(text));
+                return true;
+            }
+            break;
+        case Stage::Done:
+            break;
+        }
+    }
+    return false;
+}
+
+void ViewRenderer::setChunk(Context& ctx, const char* text, size_t length)
+{
+    ctx.chunk = text;
+    ctx.chunkLength = length;
+    ctx.chunkSent = 0;
+}
@@ -0,0 +1,102 @@
+#include "view_sampler.h"
+#include <string.h>
+
+ViewSampler::Mode ViewSampler::s_mode = ViewSampler::Mode::Off;
+uint32_t ViewSampler::s_value = 1;
+uint32_t ViewSampler::s_sampled = 0;
+uint32_t ViewSampler::s_skipped = 0;
+
+void ViewSampler::configure(Mode mode, uint32_t value)
+{
+    if (mode != Mode::Off && value == 0)
+    {
+        mode = Mode::Off;
+    }
+    s_mode = mode;
+    s_value = (mode == Mode::Off) ? 1 : value;
+    s_sampled = 0;
+    s_skipped = 0;
+}
+
+bool ViewSampler::accept(CanStatistics::IdCounters& counters, uint32_t now)
+{
+    bool take = true;
+    switch (s_mode)
+    {
+    case Mode::Off:
+        break;
+    case Mode::OneInN:
+        // frames is already incremented, so the first frame of an ID is always taken
+        take = ((counters.frames - 1) % s_value) == 0;
+        break;
+    case Mode::Interval:
+        take = !counters.everSampled || (now - counters.lastSampledAt) >= s_value;
+        break;
+    }
+
+    if (take)
+    {
+        counters.lastSampledAt = now;
+        counters.everSampled = true;
+        ++s_sampled;
+    }
+    else
+    {
+        ++s_skipped;
+    }
+    return take;
+}
+
+ViewSampler::Mode ViewSampler::mode()
+{
+    return s_mode;
+}
+
+uint32_t ViewSampler::value()
+{
+    return s_value;
+}
+
+uint32_t ViewSampler::sampledFrames()
+{
+    return s_sampled;
+}
+
+uint32_t ViewSampler::skippedFrames()
+{
+    return s_skipped;
+}
+
+const char* ViewSampler::modeName(Mode mode)
+{
+    switch (mode)
+    {
+    case Mode::OneInN:
+        return "ratio";
+    case Mode::Interval:
+        return "interval";
+    default:
+        return "off";
+    }
+}
+
+bool ViewSampler::parseMode(const char* name, Mode& mode)
+{
+    if (strcmp(name, "off") == 0)
+    {
+        mode = Mode::Off;
+    }
+    else if (strcmp(name, "ratio") == 0)
+    {
+        mode = Mode::OneInN;
+    }
+    else if (strcmp(name, "interval") == 0)
+    {
+        mode = Mode::Interval;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
@@ -1,631 +1,137 @@
 #include "web_interface.h"
+#include "can_stats.h"
+#include "view_sampler.h"
+#include "state_table.h"
+#include "change_tracker.h"
+#include "view_render.h"
+#include "heap_guard.h"
+#include "trace.h"
+#include "frame_codec.h"
+#include "frame_stream.h"
+#include "transmit_tracker.h"
+#include "payload_fuzzer.h"
+#include "sequence_runner.h"
+#include "latency_stats.h"
+#include "clock.h"
+#include "rate_history.h"
+#include "top_ids.h"
+#include "view_order.h"
+#include "byte_histogram.h"
+#include "device_config.h"
+#include "softap_config.h"
+#include "request_parser.h"
+#include "web_routes.h"
+#include "web_page.h"
 #include <Arduino.h>
 #include <algorithm>
-#include <array>
-#include <set>
+#include <new>
 #include <stdlib.h>
 #include <cstring>
-#include <vector>
-#include <unordered_map>
 
 namespace
 {
-    constexpr uint32_t CHANGE_EXPIRATION_MS = 10000;
-
-    struct ChangeRecord
+    // The stream sender wakes this often and sends at most
+    // STREAM_MAX_BATCHES messages of STREAM_BATCH_FRAMES frames each time
+    constexpr uint32_t STREAM_INTERVAL_MS = 50;
+    constexpr uint16_t STREAM_BATCH_FRAMES = 64;
+    constexpr uint8_t STREAM_MAX_BATCHES = 4;
+    constexpr uint16_t STREAM_MAX_CLIENTS = 2;
+    constexpr uint32_t STREAM_CLOCK_INTERVAL_MS = 1000;
+
+    // Fuzz log events sent per GET /fuzz; more=true says to ask again
+    constexpr uint32_t FUZZ_EVENTS_PER_REQUEST = 16;
+
+    // Names this device in the ClockSync messages of its stream
+    uint32_t deviceId()
     {
-        uint32_t timestamp = 0;
-        uint8_t byteIndex = 0;
-        uint8_t oldValue = 0;
-        uint8_t newValue = 0;
-    };
-
-    std::unordered_map<uint32_t, std::vector<ChangeRecord>> s_changeHistory;
+        uint8_t mac[6];
+        WiFi.macAddress(mac);
+        return static_cast<uint32_t>(mac[2]) << 24 | static_cast<uint32_t>(mac[3]) << 16 |
+               static_cast<uint32_t>(mac[4]) << 8 | mac[5];
+    }
 
-    void pruneHistoryForId(uint32_t id, uint32_t now)
+    void sendView(AsyncWebServerRequest* request, ViewRenderer::Context* ctx, const char* contentType)
     {
-        auto it = s_changeHistory.find(id);
-        if (it == s_changeHistory.end())
+        if (!ctx)
         {
+            request->send(503, "text/plain", "Busy, try again");
             return;
         }
 
-        auto &history = it->second;
-        history.erase(std::remove_if(history.begin(), history.end(), [now](const ChangeRecord &record)
+        // The context is returned to the pool once the connection is gone,
+        // whether or not the response completed
+        request->onDisconnect([ctx]()
         {
-            return now - record.timestamp > CHANGE_EXPIRATION_MS;
-        }), history.end());
-
-        if (history.empty())
+            ViewRenderer::release(ctx);
+        });
+        request->send(request->beginChunkedResponse(contentType, [ctx](uint8_t* buffer, size_t maxLen, size_t index)
         {
-            s_changeHistory.erase(it);
-        }
+#ifdef ALLOC_TRACKING
+            HeapGuard::ScopeGuard allocScope(ctx->scope, false);
+#endif
+            TRACE_SCOPE("fill");
+            return ViewRenderer::fill(*ctx, buffer, maxLen);
+        }));
     }
 
-    void pruneAllHistory(uint32_t now)
+    ViewRenderer::Context* claimView(ViewRenderer::View view, HeapGuard::Scope scope)
     {
-        for (auto it = s_changeHistory.begin(); it != s_changeHistory.end(); )
-        {
-            auto &history = it->second;
-            history.erase(std::remove_if(history.begin(), history.end(), [now](const ChangeRecord &record)
-            {
-                return now - record.timestamp > CHANGE_EXPIRATION_MS;
-            }), history.end());
-
-            if (history.empty())
-            {
-                it = s_changeHistory.erase(it);
-            }
-            else
-            {
-                ++it;
-            }
-        }
+        return ViewRenderer::claim(view, scope, Clock::millis());
     }
 
-    std::array<bool, 8> collectHighlightMask(uint32_t id, uint32_t now, uint32_t &lastChangeTimestamp)
+    // WebRoutes reads the query of a GET and the form fields of a POST
+    bool lookupParam(void* source, const char* name, RequestParser::Param& value)
     {
-        std::array<bool, 8> mask{};
-        mask.fill(false);
-        lastChangeTimestamp = 0;
-
-        auto it = s_changeHistory.find(id);
-        if (it == s_changeHistory.end())
+        AsyncWebServerRequest* request = static_cast<AsyncWebServerRequest*>(source);
+        bool post = request->method() == HTTP_POST;
+        if (!request->hasParam(name, post))
         {
-            return mask;
+            return false;
         }
+        const String& text = request->getParam(name, post)->value();
+        value.data = text.c_str();
+        value.length = text.length();
+        return true;
+    }
 
-        auto &history = it->second;
-        history.erase(std::remove_if(history.begin(), history.end(), [now](const ChangeRecord &record)
-        {
-            return now - record.timestamp > CHANGE_EXPIRATION_MS;
-        }), history.end());
+    WebRoutes::Request routeRequest(AsyncWebServerRequest* request)
+    {
+        WebRoutes::Request routed;
+        routed.lookup = lookupParam;
+        routed.source = request;
+        return routed;
+    }
 
-        if (history.empty())
-        {
-            s_changeHistory.erase(it);
-            return mask;
-        }
+    void sendReply(AsyncWebServerRequest* request, const WebRoutes::Reply& reply)
+    {
+        request->send(reply.status, reply.contentType, reinterpret_cast<const uint8_t*>(reply.body), reply.length);
+    }
 
-        for (const auto &record : history)
+    void appendFrame(String& json, uint32_t id, const uint8_t* data, uint8_t length)
+    {
+        char hex[17];
+        uint8_t used = length < 8 ? length : 8;
+        for (uint8_t i = 0; i < used; ++i)
         {
-            if (record.byteIndex < mask.size())
-            {
-                mask[record.byteIndex] = true;
-            }
-            if (record.timestamp > lastChangeTimestamp)
-            {
-                lastChangeTimestamp = record.timestamp;
-            }
+            snprintf(hex + i * 2, 3, "%02X", data[i]);
         }
-
-        return mask;
+        hex[used * 2] = '\0';
+        json += "\"id\":\"0x";
+        json += String(id, HEX);
+        json += "\",\"data\":\"";
+        json += hex;
+        json += "\"";
     }
 }
 
 AsyncWebServer WebInterface::server(80);
-const std::map<uint32_t, CANMessage>* WebInterface::latestMessages = nullptr;
-const std::map<uint32_t, CANMessage>* WebInterface::previousMessages = nullptr;
+AsyncWebSocket WebInterface::stream("/stream");
 bool (*WebInterface::transmitCallback)(uint32_t id, uint8_t length, const uint8_t* data) = nullptr;
+FrameCodec::TransmitStatus (*WebInterface::streamTransmitCallback)(const FrameCodec::TransmitRequest& request,
+                                                                   uint32_t client, uint32_t receivedUs) = nullptr;
 
-// HTML template moved from main.cpp
-// Note: the page loads once and client-side JavaScript fetches table fragments
-// so only the table bodies are updated (smoother UI than full page reload)
-const char* WebInterface::HTML_TEMPLATE = R"html(
-<!DOCTYPE html>
-<html>
-<head>
-    <title>CAN Bus Monitor</title>
-    <meta name="viewport" content="width=device-width,initial-scale=1">
-    <style>
-        * { box-sizing: border-box; }
-        body { font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, sans-serif; padding: 0; margin: 0; background-color: #fafafa; color: #333; }
-        
-        /* Header and Navigation */
-        header { background-color: #1a1a1a; color: white; padding: 0; box-shadow: 0 2px 4px rgba(0,0,0,0.1); }
-        .header-content { max-width: 1400px; margin: 0 auto; padding: 16px; }
-        .app-title { font-size: 24px; font-weight: 700; margin: 0; color: white; }
-        nav { background-color: #2d2d2d; }
-        nav ul { list-style: none; margin: 0; padding: 0; display: flex; }
-        nav li { margin: 0; }
-        nav a { display: block; padding: 12px 20px; color: white; text-decoration: none; transition: background-color 200ms; border-bottom: 3px solid transparent; }
-        nav a:hover { background-color: #3d3d3d; }
-        nav a.active { background-color: #4caf50; border-bottom-color: #4caf50; }
-        
-        /* Main content */
-        main { max-width: 1400px; margin: 0 auto; padding: 20px 16px; }
-        .page { display: none; }
-        .page.active { display: block; }
-        
-        h2 { margin: 20px 0 16px 0; color: #1a1a1a; }
-        p { margin: 0 0 12px 0; }
-        a { color: #1976d2; text-decoration: none; }
-        a:hover { text-decoration: underline; }
-        
-        /* Sections */
-        .section { margin: 20px 0; }
-        
-        /* Tables */
-        table { border-collapse: collapse; width: 100%; background-color: white; border: 1px solid #ddd; border-radius: 4px; overflow: hidden; }
-        th, td { border: 1px solid #ddd; padding: 12px; text-align: left; }
-        th { background-color: #f5f5f5; font-weight: 600; }
-        tbody { transition: opacity 120ms ease-in-out; }
-        tbody tr { cursor: pointer; }
-        tbody tr:hover { background-color: #f9f9f9; }
-        
-        /* Data highlighting */
-        .highlight { background-color: #ffeb3b; }
-        .byte { display: inline-block; min-width: 25px; font-family: monospace; }
-        .age-fresh { color: #4caf50; font-weight: 500; }
-        .age-medium { color: #ff9800; font-weight: 500; }
-        .age-old { color: #f44336; font-weight: 500; }
-        
-        /* Forms */
-        .transmit-section { background-color: white; border: 1px solid #ddd; padding: 20px; border-radius: 4px; margin-top: 20px; }
-        .transmit-field { display: flex; flex-direction: column; }
-        .transmit-field label { font-weight: 600; margin-bottom: 6px; font-size: 0.95em; color: #1a1a1a; }
-        .transmit-field input { padding: 8px; border: 1px solid #ccc; border-radius: 3px; font-family: monospace; font-size: 14px; }
-        .transmit-field input[type="number"] { width: 100px; }
-        .transmit-field input[type="text"] { width: 150px; }
-        .byte-input { width: 60px !important; text-align: center; text-transform: uppercase; letter-spacing: 1px; }
-        
-        /* Buttons */
-        button { padding: 10px 16px; cursor: pointer; background-color: #4caf50; color: white; border: none; border-radius: 3px; font-weight: 600; font-size: 14px; transition: background-color 200ms; }
-        button:hover { background-color: #45a049; }
-        button:active { transform: scale(0.98); }
-        
-        /* Status messages */
-        .status-message { margin-top: 12px; padding: 12px; border-radius: 3px; display: none; border-left: 4px solid; }
-        .status-message.success { background-color: #d4edda; color: #155724; border-left-color: #28a745; }
-        .status-message.error { background-color: #f8d7da; color: #721c24; border-left-color: #dc3545; }
-        
-        /* Filters section */
-        .filters { background-color: white; border: 1px solid #ddd; padding: 16px; border-radius: 4px; margin-bottom: 20px; }
-        .filter-actions { margin-bottom: 16px; display: flex; gap: 8px; align-items: center; flex-wrap: wrap; }
-        .status { font-size: 0.95em; color: #666; }
-        #id_list { display: flex; flex-wrap: wrap; gap: 16px; margin-top: 12px; }
-        .id-option { display: flex; align-items: center; gap: 6px; }
-        .id-option input { cursor: pointer; }
-        .id-option span { cursor: pointer; user-select: none; }
-    </style>
-    <script>
-        const POLL_MS = 1000; // refresh interval for the latest table (1000ms = 1 update per second)
-
-        async function updateLatest()
-        {
-            try
-            {
-                const res = await fetch('/latest_messages', {cache: 'no-store'});
-                if (!res.ok)
-                {
-                    console.error('Fetch failed', '/latest_messages', res.status);
-                    return;
-                }
-                const text = await res.text();
-                const el = document.getElementById('latest_body');
-                if (!el) return;
-                el.style.opacity = 0.2;
-                requestAnimationFrame(() => {
-                    el.innerHTML = text;
-                    el.style.opacity = 1.0;
-                    // Re-attach row click handlers after table update
-                    attachRowClickHandlers();
-                });
-            }
-            catch (e)
-            {
-                console.error('Error fetching latest messages', e);
-            }
-        }
-
-        function attachRowClickHandlers()
-        {
-            const rows = document.querySelectorAll('#latest_body tr');
-            rows.forEach(row => {
-                row.addEventListener('click', () => {
-                    const cells = row.querySelectorAll('td');
-                    if (cells.length >= 3) {
-                        const idCell = cells[0].textContent.trim(); // "0x..."
-                        const lengthCell = parseInt(cells[1].textContent.trim());
-                        const dataCell = cells[2].textContent.trim(); // "01 02 03 ..."
-                        
-                        // Parse ID (remove 0x)
-                        const id = idCell.startsWith('0x') ? idCell.substring(2) : idCell;
-                        
-                        // Parse data bytes
-                        const byteStrings = dataCell.split(/\s+/).filter(b => b.length > 0);
-                        
-                        // Populate transmit form
-                        document.getElementById('tx_id').value = id;
-                        document.getElementById('tx_length').value = lengthCell;
-                        
-                        // Clear all byte inputs first
-                        for (let i = 0; i < 8; i++) {
-                            document.getElementById('tx_byte_' + i).value = '';
-                        }
-                        
-                        // Fill in the bytes
-                        byteStrings.forEach((byte, index) => {
-                            if (index < 8) {
-                                document.getElementById('tx_byte_' + index).value = byte;
-                            }
-                        });
-                        
-                        // Update byte input active/inactive state based on loaded length
-                        updateByteInputs();
-                    }
-                });
-            });
-        }
-
-        function updateByteInputs()
-        {
-            const length = parseInt(document.getElementById('tx_length').value) || 0;
-            const constrainedLength = Math.min(Math.max(length, 0), 8);
-            document.getElementById('tx_length').value = constrainedLength;
-            
-            // All byte inputs are always visible, just update disabled state for clarity
-            for (let i = 0; i < 8; i++) {
-                const input = document.getElementById('tx_byte_' + i);
-                if (i < constrainedLength) {
-                    input.style.opacity = '1.0';
-                    input.disabled = false;
-                } else {
-                    input.style.opacity = '0.5';
-                    input.disabled = true;
-                    input.value = '';
-                }
-            }
-        }
-
-        async function transmitMessage()
-        {
-            const id = document.getElementById('tx_id').value.trim();
-            const length = parseInt(document.getElementById('tx_length').value) || 0;
-            const statusEl = document.getElementById('transmit_status');
-            
-            if (!id) {
-                statusEl.textContent = 'Error: ID is required';
-                statusEl.className = 'status-message error';
-                statusEl.style.display = 'block';
-                return;
-            }
-            
-            if (length < 0 || length > 8) {
-                statusEl.textContent = 'Error: Length must be 0-8';
-                statusEl.className = 'status-message error';
-                statusEl.style.display = 'block';
-                return;
-            }
-            
-            const data = [];
-            for (let i = 0; i < length; i++) {
-                const byteVal = document.getElementById('tx_byte_' + i).value.trim();
-                if (!byteVal) {
-                    statusEl.textContent = 'Error: Byte ' + i + ' is required';
-                    statusEl.className = 'status-message error';
-                    statusEl.style.display = 'block';
-                    return;
-                }
-                const parsed = parseInt(byteVal, 16);
-                if (isNaN(parsed) || parsed < 0 || parsed > 255) {
-                    statusEl.textContent = 'Error: Byte ' + i + ' must be valid hex (0-FF)';
-                    statusEl.className = 'status-message error';
-                    statusEl.style.display = 'block';
-                    return;
-                }
-                data.push(parsed);
-            }
-            
-            try {
-                const res = await fetch('/transmit_message', {
-                    method: 'POST',
-                    headers: { 'Content-Type': 'application/json' },
-                    body: JSON.stringify({ id: id, length: length, data: data })
-                });
-                
-                if (res.ok) {
-                    statusEl.textContent = 'Message transmitted: ID=0x' + id + ', Length=' + length;
-                    statusEl.className = 'status-message success';
-                    statusEl.style.display = 'block';
-                } else {
-                    statusEl.textContent = 'Error: Transmit failed (HTTP ' + res.status + ')';
-                    statusEl.className = 'status-message error';
-                    statusEl.style.display = 'block';
-                }
-            } catch (e) {
-                statusEl.textContent = 'Error: ' + e.message;
-                statusEl.className = 'status-message error';
-                statusEl.style.display = 'block';
-            }
-        }
-
-        function switchPage(page)
-        {
-            // Hide all pages
-            document.querySelectorAll('.page').forEach(p => p.classList.remove('active'));
-            document.querySelectorAll('.nav-link').forEach(link => link.classList.remove('active'));
-            
-            // Show the selected page and update nav
-            if (page === 'home') {
-                document.getElementById('home-page').classList.add('active');
-                document.getElementById('nav-home').classList.add('active');
-            } else if (page === 'filter') {
-                document.getElementById('filter-page').classList.add('active');
-                document.getElementById('nav-filter').classList.add('active');
-                // Initialize filter page if needed
-                if (typeof startFilteredPage === 'function') {
-                    startFilteredPage();
-                }
-            }
-        }
-
-        function startPolling()
-        {
-            updateLatest();
-            setInterval(updateLatest, POLL_MS);
-            // Initialize byte input display
-            updateByteInputs();
-        }
-
-        window.addEventListener('load', () => {
-            startPolling();
-            // Pre-initialize the filter page data but keep it hidden
-            if (typeof startFilteredPage === 'function') {
-                startFilteredPage();
-            }
-        });
-    </script>
-</head>
-<body>
-    <header>
-        <div class="header-content">
-            <h1 class="app-title">RCLS CAN Bus Monitor</h1>
-        </div>
-    </header>
-    <nav>
-        <ul>
-            <li><a href="#" onclick="switchPage('home'); return false;" class="nav-link active" id="nav-home">Home</a></li>
-            <li><a href="#" onclick="switchPage('filter'); return false;" class="nav-link" id="nav-filter">Filter</a></li>
-        </ul>
-    </nav>
-    <main>
-        <div id="home-page" class="page active">
-            <h2>Latest State</h2>
-            <div class="section">
-                <table>
-                    <thead>
-                        <tr>
-                            <th>ID</th>
-                            <th>Length</th>
-                            <th>Data</th>
-                            <th>Last Update</th>
-                            <th>Age (ms)</th>
-                        </tr>
-                    </thead>
-                    <tbody id="latest_body">
-                        %LATEST_MESSAGES%
-                    </tbody>
-                </table>
-            </div>
-
-            <div class="transmit-section">
-                <h2>Transmit Message</h2>
-                <p style="font-size: 0.95em; color: #666;">Click a row above to copy its data, or enter values manually</p>
-                <div style="display: flex; gap: 24px; margin-bottom: 20px; flex-wrap: wrap;">
-                    <div class="transmit-field">
-                        <label for="tx_id">ID (hex)</label>
-                        <input type="text" id="tx_id" placeholder="123" />
-                    </div>
-                    <div class="transmit-field">
-                        <label for="tx_length">Length (bytes)</label>
-                        <input type="number" id="tx_length" min="0" max="8" value="1" onchange="updateByteInputs()" />
-                    </div>
-                </div>
-                <div style="margin-bottom: 16px;">
-                    <label style="font-weight: 600; display: block; margin-bottom: 12px; color: #1a1a1a;">Data (hex bytes)</label>
-                    <div style="display: flex; gap: 12px; flex-wrap: wrap;">
-                        <div class="transmit-field" style="margin: 0;">
-                            <label style="font-weight: normal; font-size: 0.85em;">Byte 0</label>
-                            <input type="text" id="tx_byte_0" class="byte-input" placeholder="00" />
-                        </div>
-                        <div class="transmit-field" style="margin: 0;">
-                            <label style="font-weight: normal; font-size: 0.85em;">Byte 1</label>
-                            <input type="text" id="tx_byte_1" class="byte-input" placeholder="00" />
-                        </div>
-                        <div class="transmit-field" style="margin: 0;">
-                            <label style="font-weight: normal; font-size: 0.85em;">Byte 2</label>
-                            <input type="text" id="tx_byte_2" class="byte-input" placeholder="00" />
-                        </div>
-                        <div class="transmit-field" style="margin: 0;">
-                            <label style="font-weight: normal; font-size: 0.85em;">Byte 3</label>
-                            <input type="text" id="tx_byte_3" class="byte-input" placeholder="00" />
-                        </div>
-                        <div class="transmit-field" style="margin: 0;">
-                            <label style="font-weight: normal; font-size: 0.85em;">Byte 4</label>
-                            <input type="text" id="tx_byte_4" class="byte-input" placeholder="00" />
-                        </div>
-                        <div class="transmit-field" style="margin: 0;">
-                            <label style="font-weight: normal; font-size: 0.85em;">Byte 5</label>
-                            <input type="text" id="tx_byte_5" class="byte-input" placeholder="00" />
-                        </div>
-                        <div class="transmit-field" style="margin: 0;">
-                            <label style="font-weight: normal; font-size: 0.85em;">Byte 6</label>
-                            <input type="text" id="tx_byte_6" class="byte-input" placeholder="00" />
-                        </div>
-                        <div class="transmit-field" style="margin: 0;">
-                            <label style="font-weight: normal; font-size: 0.85em;">Byte 7</label>
-                            <input type="text" id="tx_byte_7" class="byte-input" placeholder="00" />
-                        </div>
-                    </div>
-                </div>
-                <button onclick="transmitMessage()">Transmit</button>
-                <div id="transmit_status" class="status-message"></div>
-            </div>
-        </div>
-
-        <div id="filter-page" class="page">
-            <h2>Filtered Recent Messages</h2>
-            <div class="filters">
-                <div class="filter-actions">
-                    <button onclick="setAll(true)">Select All</button>
-                    <button onclick="setAll(false)">Clear All</button>
-                    <span class="status">Tracking <span id="id_count">0</span> IDs</span>
-                </div>
-                <div id="id_list"></div>
-            </div>
-            <table>
-                <thead>
-                    <tr>
-                        <th>ID</th>
-                        <th>Length</th>
-                        <th>Data</th>
-                        <th>RX Time (ms)</th>
-                        <th>Age (ms)</th>
-                    </tr>
-                </thead>
-                <tbody id="filtered_body"></tbody>
-            </table>
-        </div>
-    </main>
-    <script>
-        const GRID_POLL_MS = 1000; // refresh interval for filtered table (1000ms = 1 update per second)
-        const ID_REFRESH_MS = 3000; // refresh interval for ID list (3000ms = every 3 seconds)
-        let selectedIds = new Set();
-        let lastIdRefresh = 0;
-        let filteredPageIntervals = { gridInterval: null, idInterval: null };
-        let filteredPageInitialized = false;
-
-        async function fetchIds()
-        {
-            const now = Date.now();
-            if (now - lastIdRefresh < ID_REFRESH_MS) {
-                return;
-            }
-            lastIdRefresh = now;
-            try
-            {
-                const res = await fetch('/filtered_ids', {cache: 'no-store'});
-                if (!res.ok) return;
-                const ids = await res.json();
-                renderIdList(ids);
-            }
-            catch (e)
-            {
-                console.error('Failed to fetch IDs', e);
-            }
-        }
-
-        function renderIdList(ids)
-        {
-            const container = document.getElementById('id_list');
-            const previousSelection = new Set(selectedIds);
-            const hadManualSelection = previousSelection.size > 0;
-            container.innerHTML = '';
-            ids.forEach(id => {
-                const label = document.createElement('label');
-                label.className = 'id-option';
-                const checkbox = document.createElement('input');
-                checkbox.type = 'checkbox';
-                checkbox.value = id;
-                const shouldCheck = !hadManualSelection || previousSelection.has(id);
-                checkbox.checked = shouldCheck;
-                if (shouldCheck) {
-                    selectedIds.add(id);
-                } else {
-                    selectedIds.delete(id);
-                }
-                checkbox.addEventListener('change', () => {
-                    if (checkbox.checked) {
-                        selectedIds.add(id);
-                    } else {
-                        selectedIds.delete(id);
-                    }
-                    fetchFilteredMessages();
-                });
-                const text = document.createElement('span');
-                text.textContent = id;
-                label.appendChild(checkbox);
-                label.appendChild(text);
-                container.appendChild(label);
-            });
-            if (!hadManualSelection && ids.length)
-            {
-                selectedIds = new Set(ids);
-                document.querySelectorAll('#id_list input[type=checkbox]').forEach(cb => cb.checked = true);
-            }
-            document.getElementById('id_count').textContent = ids.length;
-        }
-
-        function setAll(state)
-        {
-            selectedIds = state ? new Set(Array.from(document.querySelectorAll('#id_list input')).map(cb => cb.value))
-                                : new Set();
-            document.querySelectorAll('#id_list input').forEach(cb => cb.checked = state);
-            fetchFilteredMessages();
-        }
-
-        function getSelectedIdsParam()
-        {
-            if (selectedIds.size === 0) {
-                return '';
-            }
-            return Array.from(selectedIds).join(',');
-        }
-
-        async function fetchFilteredMessages()
-        {
-            try
-            {
-                const idsParam = getSelectedIdsParam();
-                const url = '/filtered_messages?ids=' + encodeURIComponent(idsParam);
-                const res = await fetch(url, {cache: 'no-store'});
-                if (!res.ok) return;
-                const html = await res.text();
-                const body = document.getElementById('filtered_body');
-                body.style.opacity = 0.2;
-                requestAnimationFrame(() => {
-                    body.innerHTML = html;
-                    body.style.opacity = 1.0;
-                });
-            }
-            catch (e)
-            {
-                console.error('Failed to fetch filtered messages', e);
-            }
-        }
-
-        function startFilteredPage()
-        {
-            // Prevent multiple initializations
-            if (filteredPageInitialized) {
-                return;
-            }
-            filteredPageInitialized = true;
-            
-            // Clear any existing intervals first
-            if (filteredPageIntervals.gridInterval !== null) {
-                clearInterval(filteredPageIntervals.gridInterval);
-            }
-            if (filteredPageIntervals.idInterval !== null) {
-                clearInterval(filteredPageIntervals.idInterval);
-            }
-            
-            // Fetch initial data
-            fetchIds().then(fetchFilteredMessages);
-            
-            // Set up new intervals
-            filteredPageIntervals.gridInterval = setInterval(fetchFilteredMessages, GRID_POLL_MS);
-            filteredPageIntervals.idInterval = setInterval(fetchIds, ID_REFRESH_MS);
-        }
-
-        window.addEventListener('load', startFilteredPage);
-    </script>
-</head>
-<body>
-</body>
-</html>
-)html";
+// The page itself lives in web_page.cpp so the host tool can serve it too
+const char* WebInterface::HTML_TEMPLATE = WEB_PAGE_HTML;
 
 
 /*
@@ -655,10 +161,10 @@ const char* WebInterface::HTML_TEMPLATE = R"html(
 */
 
 // FILTERED_TEMPLATE is now part of HTML_TEMPLATE with client-side navigation
-// This constant is kept for backward compatibility with generateFilteredPage()
+// This constant is kept for backward compatibility; /filtered serves the same page
 const char* WebInterface::FILTERED_TEMPLATE = WebInterface::HTML_TEMPLATE;
 
-bool WebInterface::initialize(const char* ssid, const char* password)
+bool WebInterface::connectStation(const char* ssid, const char* password)
 {
     // Connect to WiFi
     WiFi.setHostname("RCLS-CAN");
@@ -683,37 +189,78 @@ bool WebInterface::initialize(const char* ssid, const char* password)
     Serial.println("WiFi connected");
     Serial.println("IP address: ");
     Serial.println(WiFi.localIP());
+    return true;
+}
+
+bool WebInterface::initialize()
+{
+    if (!ViewRenderer::begin(HTML_TEMPLATE, MAX_TRACKED_IDS))
+    {
+        Serial.println("Failed to allocate render buffers");
+        return false;
+    }
+    WebRoutes::setSaveCallback(SoftAPConfig::saveDeviceConfig);
 
     // Setup web server
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
     {
-        request->send(200, "text/html", generateHtml());
+        ALLOC_SCOPE(HttpRoot);
+        TRACE_SCOPE("GET /");
+        sendView(request, claimView(ViewRenderer::View::Page, HeapGuard::Scope::HttpRoot), "text/html");
     });
 
-    server.on("/latest_messages", HTTP_GET, [](AsyncWebServerRequest *request)
-    {
-        request->send(200, "text/html", generateLatestRows());
-    });
+    server.on("/latest_messages", HTTP_GET, handleLatestMessages);
     server.on("/filtered", HTTP_GET, [](AsyncWebServerRequest *request)
     {
-        request->send(200, "text/html", generateFilteredPage());
+        ALLOC_SCOPE(HttpRoot);
+        TRACE_SCOPE("GET /filtered");
+        sendView(request, claimView(ViewRenderer::View::Page, HeapGuard::Scope::HttpRoot), "text/html");
     });
     server.on("/filtered_ids", HTTP_GET, [](AsyncWebServerRequest *request)
     {
-        request->send(200, "application/json", generateIdListJson());
+        ALLOC_SCOPE(HttpFilteredIds);
+        TRACE_SCOPE("GET /filtered_ids");
+        sendView(request, claimView(ViewRenderer::View::IdListJson, HeapGuard::Scope::HttpFilteredIds), "application/json");
     });
     server.on("/filtered_messages", HTTP_GET, [](AsyncWebServerRequest *request)
     {
-        String rawIds;
-        if (request->hasParam("ids"))
-        {
-            rawIds = request->getParam("ids")->value();
-        }
-        auto ids = parseIdList(rawIds);
-        request->send(200, "text/html", generateFilteredRows(ids));
+        ALLOC_SCOPE(HttpFilteredMessages);
+        TRACE_SCOPE("GET /filtered_messages");
+        ViewRenderer::Context* ctx = nullptr;
+        WebRoutes::Reply reply;
+        WebRoutes::filtered(routeRequest(request), HeapGuard::Scope::HttpFilteredMessages, Clock::millis(), ctx, reply);
+        sendView(request, ctx, "text/html");
+    });
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        ALLOC_SCOPE(HttpMetrics);
+        TRACE_SCOPE("GET /metrics");
+        request->send(200, "application/json", generateMetricsJson());
+    });
+    server.on("/sampling", HTTP_POST, handleSampling);
+    server.on("/trace", HTTP_GET, handleTrace);
+    server.on("/latency", HTTP_GET, [](AsyncWebServerRequest *request)
+    {
+        ALLOC_SCOPE(HttpLatency);
+        TRACE_SCOPE("GET /latency");
+        request->send(200, "application/json", generateLatencyJson());
     });
+    server.on("/history", HTTP_GET, handleHistory);
+    server.on("/history_watch", HTTP_POST, handleHistoryWatch);
+    server.on("/top", HTTP_GET, handleTop);
+    server.on("/search", HTTP_GET, handleSearch);
+    server.on("/histogram", HTTP_GET, handleHistogram);
+    server.on("/histogram_watch", HTTP_POST, handleHistogramWatch);
+    server.on("/config", HTTP_GET, handleConfig);
+    server.on("/config", HTTP_POST, handleConfigSave);
+    server.on("/network", HTTP_POST, handleNetwork);
+    server.on("/fuzz", HTTP_GET, handleFuzz);
+    server.on("/fuzz", HTTP_POST, handleFuzzControl);
+    server.on("/sequence", HTTP_GET, handleSequence);
+    server.on("/sequence", HTTP_POST, handleSequenceControl);
     server.on("/transmit_message", HTTP_POST, [](AsyncWebServerRequest *request)
     {
+        TRACE_SCOPE("POST /transmit_message");
         if (request->hasParam("body", true))
         {
             // This will be handled in onBody
@@ -721,81 +268,53 @@ bool WebInterface::initialize(const char* ssid, const char* password)
         request->send(400, "application/json", "{\"error\":\"Invalid request\"}");
     }, nullptr, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
     {
-        // onBody handler for JSON parsing
-        static String jsonBody;
-        
-        // Accumulate body data
-        jsonBody = String((char *)data);
-        
-        // Simple JSON parsing (since we don't have a JSON library readily available)
-        // Expected format: {"id":"123","length":2,"data":[0x12,0x34]}
-        // Extract id
-        int idStart = jsonBody.indexOf("\"id\":\"") + 6;
-        int idEnd = jsonBody.indexOf("\"", idStart);
-        String idStr = jsonBody.substring(idStart, idEnd);
-        
-        // Extract length
-        int lenStart = jsonBody.indexOf("\"length\":") + 9;
-        int lenEnd = jsonBody.indexOf(",", lenStart);
-        if (lenEnd == -1) lenEnd = jsonBody.indexOf("}", lenStart);
-        String lenStr = jsonBody.substring(lenStart, lenEnd);
-        
-        // Extract data array
-        int dataStart = jsonBody.indexOf("\"data\":[") + 8;
-        int dataEnd = jsonBody.indexOf("]", dataStart);
-        String dataStr = jsonBody.substring(dataStart, dataEnd);
-        
-        // Parse ID
-        uint32_t id = strtoul(idStr.c_str(), nullptr, 16);
-        uint8_t length = atoi(lenStr.c_str());
-        
-        // Parse data bytes
-        uint8_t dataBytes[8];
-        int byteCount = 0;
-        int pos = 0;
-        while (pos < dataStr.length() && byteCount < 8)
+        ALLOC_SCOPE(HttpTransmit);
+        TRACE_SCOPE("POST /transmit_message");
+        // Bodies of this size arrive in one piece; anything split is not a valid request
+        RequestParser::TransmitRequest tx;
+        if (index != 0 || len != total || !RequestParser::parseTransmitBody(reinterpret_cast<const char*>(data), len, tx))
         {
-            int commaPos = dataStr.indexOf(',', pos);
-            if (commaPos == -1) commaPos = dataStr.length();
-            
-            String byteStr = dataStr.substring(pos, commaPos);
-            byteStr.trim();
-            dataBytes[byteCount] = strtoul(byteStr.c_str(), nullptr, 0);
-            byteCount++;
-            pos = commaPos + 1;
+            request->send(400, "application/json", "{\"error\":\"Invalid parameters\"}");
+            return;
         }
-        
+
         // Call transmit callback if set
-        if (transmitCallback && byteCount >= length)
+        if (transmitCallback && transmitCallback(tx.id, tx.length, tx.data))
         {
-            if (transmitCallback(id, length, dataBytes))
-            {
-                request->send(200, "application/json", "{\"status\":\"transmitted\"}");
-            }
-            else
-            {
-                request->send(500, "application/json", "{\"error\":\"Transmit failed\"}");
-            }
+            request->send(200, "application/json", "{\"status\":\"transmitted\"}");
         }
         else
         {
-            request->send(400, "application/json", "{\"error\":\"Invalid parameters\"}");
+            request->send(500, "application/json", "{\"error\":\"Transmit failed\"}");
         }
-        
-        jsonBody = "";
     });
 
+    // Live frame stream; the sender runs in its own task so a slow client
+    // never holds up CAN reception
+    stream.onEvent(onStreamEvent);
+    server.addHandler(&stream);
+    if (xTaskCreate(streamTask, "stream", 4096, nullptr, 1, nullptr) != pdPASS)
+    {
+        Serial.println("Failed to start stream task");
+        return false;
+    }
+
     server.begin();
     Serial.println("Web server started");
     return true;
 }
 
-void WebInterface::setMessageMaps(
-    const std::map<uint32_t, CANMessage>* latest,
-    const std::map<uint32_t, CANMessage>* previous)
+void WebInterface::stop()
+{
+    stream.closeAll();
+    server.end();
+    Serial.println("Web server stopped");
+}
+
+void WebInterface::start()
 {
-    latestMessages = latest;
-    previousMessages = previous;
+    server.begin();
+    Serial.println("Web server started");
 }
 
 void WebInterface::setTransmitCallback(bool (*callback)(uint32_t id, uint8_t length, const uint8_t* data))
@@ -803,267 +322,780 @@ void WebInterface::setTransmitCallback(bool (*callback)(uint32_t id, uint8_t len
     transmitCallback = callback;
 }
 
-void WebInterface::recordChange(const CANMessage& current, const CANMessage* previous)
+void WebInterface::setStreamTransmitCallback(FrameCodec::TransmitStatus (*callback)(
+    const FrameCodec::TransmitRequest& request, uint32_t client, uint32_t receivedUs))
 {
-    uint32_t now = millis();
-    pruneHistoryForId(current.id, now);
-
-    std::vector<ChangeRecord> newRecords;
-    newRecords.reserve(current.length);
-
-    bool lengthChanged = !previous || previous->length != current.length;
+    streamTransmitCallback = callback;
+}
 
-    for (uint8_t i = 0; i < current.length; ++i)
+String WebInterface::generateMetricsJson()
+{
+    String json = "{\"frames\":";
+    json += String(CanStatistics::totalFrames());
+    json += ",\"frameRate\":";
+    json += String(CanStatistics::frameRate());
+    json += ",\"busLoadPermille\":";
+    json += String(CanStatistics::busLoadPermille());
+    json += ",\"ids\":";
+    json += String(StateTable::size());
+    json += ",\"maxIds\":";
+    json += String(StateTable::capacity());
+    json += ",\"evictions\":";
+    json += String(StateTable::evictions());
+    wifi_mode_t wifiMode = WiFi.getMode();
+    bool accessPoint = wifiMode == WIFI_AP || wifiMode == WIFI_AP_STA;
+    bool station = wifiMode == WIFI_STA || wifiMode == WIFI_AP_STA;
+    SoftAPConfig::NetworkMode mode = !accessPoint ? SoftAPConfig::NetworkMode::Station
+                                     : station    ? SoftAPConfig::NetworkMode::AccessPointStation
+                                                  : SoftAPConfig::NetworkMode::AccessPoint;
+    json += ",\"network\":{\"mode\":\"";
+    json += SoftAPConfig::modeName(mode);
+    json += "\",\"ip\":\"";
+    json += (station ? WiFi.localIP() : WiFi.softAPIP()).toString();
+    if (accessPoint && station)
+    {
+        json += "\",\"apIp\":\"";
+        json += WiFi.softAPIP().toString();
+    }
+    json += "\",\"stations\":";
+    json += String(accessPoint ? WiFi.softAPgetStationNum() : 0);
+    SoftAPConfig::SwitchReport lastSwitch = SoftAPConfig::lastSwitch();
+    json += ",\"switches\":";
+    json += String(lastSwitch.count);
+    json += ",\"lastSwitch\":{\"ms\":";
+    json += String(lastSwitch.durationMs);
+    json += ",\"frames\":";
+    json += String(lastSwitch.frames);
+    json += ",\"missed\":";
+    json += String(lastSwitch.missed);
+    json += ",\"streamDropped\":";
+    json += String(lastSwitch.streamDropped);
+    json += "}}";
+    json += ",\"memory\":{\"stateTable\":";
+    json += String(static_cast<uint32_t>(StateTable::memoryBytes()));
+    json += ",\"changeTracking\":";
+    json += String(static_cast<uint32_t>(ChangeTracker::memoryBytes()));
+    json += ",\"statistics\":";
+    json += String(static_cast<uint32_t>(CanStatistics::memoryBytes()));
+    json += ",\"history\":";
+    json += String(static_cast<uint32_t>(RateHistory::memoryBytes()));
+    json += ",\"topIds\":";
+    json += String(static_cast<uint32_t>(TopIds::memoryBytes()));
+    json += ",\"sortOrders\":";
+    json += String(static_cast<uint32_t>(ViewOrder::memoryBytes()));
+    json += ",\"histograms\":";
+    json += String(static_cast<uint32_t>(ByteHistogram::memoryBytes()));
+    json += "}";
+
+    HeapGuard::Counters heap = HeapGuard::counters();
+    json += ",\"heap\":{\"free\":";
+    json += String(ESP.getFreeHeap());
+    json += ",\"minFree\":";
+    json += String(ESP.getMinFreeHeap());
+    json += ",\"largestBlock\":";
+    json += String(ESP.getMaxAllocHeap());
+    json += ",\"guardArmed\":";
+    json += HeapGuard::armed() ? "true" : "false";
+    json += ",\"allocations\":";
+    json += String(heap.allocations);
+    json += ",\"hotPathAllocations\":";
+    json += String(heap.hotPathAllocations);
+    json += ",\"hotPathBytes\":";
+    json += String(heap.hotPathBytes);
+    json += "}";
+
+#ifdef ALLOC_TRACKING
+    // Per-scope counts; allocations / entries gives per-frame or per-request cost
+    json += ",\"allocationScopes\":[";
+    for (size_t i = 1; i < static_cast<size_t>(HeapGuard::Scope::Count); ++i)
     {
-        bool valueChanged = !previous || i >= previous->length || current.data[i] != previous->data[i];
-        if (lengthChanged || valueChanged)
+        HeapGuard::Scope scope = static_cast<HeapGuard::Scope>(i);
+        HeapGuard::ScopeCounters counters = HeapGuard::scopeCounters(scope);
+        if (i > 1)
         {
-            ChangeRecord record;
-            record.timestamp = now;
-            record.byteIndex = i;
-            record.newValue = current.data[i];
-            record.oldValue = (previous && i < previous->length) ? previous->data[i] : current.data[i];
-            newRecords.push_back(record);
+            json += ",";
         }
+        json += "{\"scope\":\"";
+        json += HeapGuard::scopeName(scope);
+        json += "\",\"entries\":";
+        json += String(counters.entries);
+        json += ",\"allocations\":";
+        json += String(counters.allocations);
+        json += ",\"bytes\":";
+        json += String(counters.bytes);
+        json += "}";
     }
+    json += "]";
+#endif
+    json += ",\"sampling\":{\"mode\":\"";
+    json += ViewSampler::modeName(ViewSampler::mode());
+    json += "\",\"value\":";
+    json += String(ViewSampler::value());
+    json += ",\"sampled\":";
+    json += String(ViewSampler::sampledFrames());
+    json += ",\"skipped\":";
+    json += String(ViewSampler::skippedFrames());
+    json += ",\"stages\":";
+    json += WebRoutes::SAMPLED_STAGES_JSON;
+    json += "}}";
+    return json;
+}
 
-    if (!newRecords.empty())
+String WebInterface::generateLatencyJson()
+{
+    String json = "{\"stages\":[";
+    for (size_t i = 0; i < static_cast<size_t>(LatencyStats::Stage::Count); ++i)
     {
-        auto &history = s_changeHistory[current.id];
-        history.insert(history.end(), newRecords.begin(), newRecords.end());
+        LatencyStats::Stage stage = static_cast<LatencyStats::Stage>(i);
+        if (i > 0)
+        {
+            json += ",";
+        }
+        json += "{\"stage\":\"";
+        json += LatencyStats::stageName(stage);
+        json += "\",\"count\":";
+        json += String(LatencyStats::count(stage));
+        json += ",\"p50\":";
+        json += String(LatencyStats::percentileUs(stage, 50));
+        json += ",\"p90\":";
+        json += String(LatencyStats::percentileUs(stage, 90));
+        json += ",\"p99\":";
+        json += String(LatencyStats::percentileUs(stage, 99));
+        json += ",\"max\":";
+        json += String(LatencyStats::maxUs(stage));
+
+        // Trailing empty buckets are left out
+        const uint32_t* buckets = LatencyStats::buckets(stage);
+        size_t used = LatencyStats::BUCKETS;
+        while (used > 0 && buckets[used - 1] == 0)
+        {
+            --used;
+        }
+        json += ",\"buckets\":[";
+        for (size_t b = 0; b < used; ++b)
+        {
+            if (b > 0)
+            {
+                json += ",";
+            }
+            json += String(buckets[b]);
+        }
+        json += "]}";
     }
+    json += "],\"stream\":{\"clients\":";
+    json += String(static_cast<uint32_t>(stream.count()));
+    json += ",\"sequence\":";
+    json += String(FrameStream::sequence());
+    json += ",\"dropped\":";
+    json += String(FrameStream::dropped());
+    json += ",\"pending\":";
+    json += String(FrameStream::pending());
+    json += "}}";
+    return json;
 }
 
-String WebInterface::formatByte(uint8_t byte, bool highlight)
+void WebInterface::onStreamEvent(AsyncWebSocket* socket, AsyncWebSocketClient* client, AwsEventType type,
+                                 void* arg, uint8_t* data, size_t len)
 {
-    String result = "<span class='byte";
-    if (highlight)
+    if (type != WS_EVT_DATA)
     {
-        result += " highlight";
+        return;
     }
-    result += "'>";
-    if (byte < 0x10)
+
+    // Echoes and transmit requests are small enough to always arrive as one frame
+    AwsFrameInfo* info = static_cast<AwsFrameInfo*>(arg);
+    if (!info->final || info->index != 0 || info->len != len || info->opcode != WS_BINARY)
     {
-        result += "0";
+        return;
+    }
+
+    FrameCodec::Header header;
+    if (!FrameCodec::decodeHeader(data, len, header))
+    {
+        return;
+    }
+    switch (header.type)
+    {
+    case FrameCodec::MessageType::LatencyEcho:
+        onLatencyEcho(data + FrameCodec::HEADER_BYTES, header.count);
+        break;
+    case FrameCodec::MessageType::Transmit:
+        onTransmit(client, data + FrameCodec::HEADER_BYTES, header.count);
+        break;
+    default:
+        break;
     }
-    result += String(byte, HEX);
-    result += "</span> ";
-    return result;
 }
 
-String WebInterface::generateHtml()
+void WebInterface::onLatencyEcho(const uint8_t* records, uint16_t count)
 {
-    if (!latestMessages)
+    uint32_t now = Clock::micros();
+    const uint8_t* record = records;
+    for (uint16_t i = 0; i < count; ++i, record += FrameCodec::ECHO_RECORD_BYTES)
     {
-        return "Error: Message maps not initialized";
+        FrameCodec::LatencyEcho echo;
+        FrameCodec::decodeEcho(record, echo);
+        uint32_t roundTrip = now - echo.sentUs;
+        if (roundTrip < echo.clientUs)
+        {
+            continue;
+        }
+        LatencyStats::record(LatencyStats::Stage::Network, (roundTrip - echo.clientUs) / 2);
+        LatencyStats::record(LatencyStats::Stage::Client, echo.clientUs);
     }
-
-    String html = HTML_TEMPLATE;
-    html.replace("%LATEST_MESSAGES%", generateLatestRows());
-    return html;
 }
 
-String WebInterface::generateLatestRows()
+// Queued frames are acknowledged from the stream task once the controller
+// has finished them; refusals are answered here
+void WebInterface::onTransmit(AsyncWebSocketClient* client, const uint8_t* records, uint16_t count)
 {
-    if (!latestMessages)
+    ALLOC_SCOPE(Stream);
+    TRACE_SCOPE("stream transmit");
+    uint32_t receivedUs = Clock::micros();
+    const uint8_t* record = records;
+    for (uint16_t i = 0; i < count; ++i, record += FrameCodec::TRANSMIT_RECORD_BYTES)
     {
-        return "";
+        FrameCodec::TransmitRequest request;
+        FrameCodec::TransmitAck ack;
+        ack.status = !FrameCodec::decodeTransmit(record, request) ? FrameCodec::TransmitStatus::Invalid
+                     : streamTransmitCallback ? streamTransmitCallback(request, client->id(), receivedUs)
+                                              : FrameCodec::TransmitStatus::Rejected;
+        if (ack.status == FrameCodec::TransmitStatus::Sent)
+        {
+            continue;
+        }
+        ack.token = request.token;
+        ack.receivedUs = receivedUs;
+        ack.queuedUs = receivedUs;
+        ack.doneUs = receivedUs;
+        uint8_t message[FrameCodec::HEADER_BYTES + FrameCodec::TRANSMIT_ACK_RECORD_BYTES];
+        FrameCodec::Header header;
+        header.type = FrameCodec::MessageType::TransmitAck;
+        header.count = 1;
+        header.sentUs = Clock::micros();
+        FrameCodec::encodeHeader(message, header);
+        FrameCodec::encodeTransmitAck(message + FrameCodec::HEADER_BYTES, ack);
+        client->binary(message, sizeof(message));
     }
+}
 
-    uint32_t currentTime = millis();
-    String latestRows;
-    for (const auto& pair : *latestMessages)
+void WebInterface::streamTask(void* parameter)
+{
+    static uint8_t batch[FrameCodec::HEADER_BYTES + STREAM_BATCH_FRAMES * FrameCodec::FRAME_RECORD_BYTES];
+    static uint8_t clock[FrameCodec::HEADER_BYTES + FrameCodec::CLOCK_RECORD_BYTES];
+    static uint8_t acks[FrameCodec::HEADER_BYTES + FrameCodec::TRANSMIT_ACK_RECORD_BYTES];
+    const uint32_t id = deviceId();
+    size_t clients = 0;
+    uint32_t lastClockMs = 0;
+    while (true)
     {
-        uint32_t lastChangeTimestamp = 0;
-        auto highlightMask = collectHighlightMask(pair.first, currentTime, lastChangeTimestamp);
-
-        bool hasPrev = false;
-        std::map<uint32_t, CANMessage>::const_iterator prevIt;
-        if (previousMessages)
+        vTaskDelay(pdMS_TO_TICKS(STREAM_INTERVAL_MS));
+        ALLOC_SCOPE(Stream);
+        TRACE_SCOPE("stream");
+
+        stream.cleanupClients(STREAM_MAX_CLIENTS);
+        // Acknowledgements go first, their senders are waiting on them; one
+        // for a client that has gone is dropped by the server
+        TransmitTracker::Ack ack;
+        while (TransmitTracker::takeAck(ack))
         {
-            prevIt = previousMessages->find(pair.first);
-            hasPrev = prevIt != previousMessages->end();
+            FrameCodec::Header header;
+            header.type = FrameCodec::MessageType::TransmitAck;
+            header.count = 1;
+            header.sentUs = Clock::micros();
+            FrameCodec::encodeHeader(acks, header);
+            FrameCodec::encodeTransmitAck(acks + FrameCodec::HEADER_BYTES, ack.ack);
+            stream.binary(ack.client, acks, sizeof(acks));
         }
-
-        String row = "<tr><td>0x" + String(pair.first, HEX) + "</td>";
-        row += "<td>" + String(pair.second.length) + "</td><td>";
-
-        for (int i = 0; i < pair.second.length; i++)
+        if (stream.count() == 0)
         {
-            bool highlight = (i < static_cast<int>(highlightMask.size())) ? highlightMask[i] : false;
-            if (!highlight && previousMessages && hasPrev)
+            // During a network switch the queued frames wait for the
+            // clients to reconnect, so their sequence numbers continue
+            if (!SoftAPConfig::switching())
             {
-                highlight = i >= prevIt->second.length ||
-                            pair.second.data[i] != prevIt->second.data[i];
+                FrameStream::discard();
             }
+            clients = 0;
+            continue;
+        }
 
-            row += formatByte(pair.second.data[i], highlight);
+        // Recordings get the clock estimate as soon as a client connects and
+        // once a second after that, so they can be merged with other devices'
+        uint32_t nowMs = Clock::millis();
+        if (stream.count() > clients || nowMs - lastClockMs >= STREAM_CLOCK_INTERVAL_MS)
+        {
+            stream.binaryAll(clock, FrameStream::encodeClock(clock, sizeof(clock), id, Clock::nowUs()));
+            lastClockMs = nowMs;
         }
+        clients = stream.count();
 
-        uint32_t age = currentTime - pair.second.timestamp;
-        String ageClass;
-        if (age < 1000) ageClass = "age-fresh";          // Less than 1 second
-        else if (age < 5000) ageClass = "age-medium";    // Less than 5 seconds
-        else ageClass = "age-old";                       // More than 5 seconds
+        // Frames wait in the ring while the clients' send queues are full;
+        // once the ring fills, reception drops frames and counts them
+        for (uint8_t i = 0; i < STREAM_MAX_BATCHES && stream.availableForWriteAll(); ++i)
+        {
+            size_t length = FrameStream::encodeBatch(batch, sizeof(batch), STREAM_BATCH_FRAMES, Clock::micros());
+            if (length == 0)
+            {
+                break;
+            }
+            stream.binaryAll(batch, length);
+        }
+    }
+}
 
-        row += "</td><td>" + String(pair.second.timestamp) +
-               "</td><td class='" + ageClass + "'>" + String(age) + "</td></tr>\n";
-        latestRows += row;
+void WebInterface::handleTrace(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpTrace);
+    Trace::Export* exp = Trace::beginExport();
+    if (!exp)
+    {
+        request->send(Trace::capacity() ? 503 : 404, "text/plain",
+                      Trace::capacity() ? "Export already running" : "Tracing is not enabled in this build");
+        return;
     }
 
-    return latestRows;
+    // Recording resumes once the download finishes or is abandoned
+    request->onDisconnect([exp]()
+    {
+        Trace::endExport(exp);
+    });
+    AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+        [exp](uint8_t* buffer, size_t maxLen, size_t index)
+    {
+        return Trace::fill(*exp, buffer, maxLen);
+    });
+    response->addHeader("Content-Disposition", "attachment; filename=\"can-monitor-trace.json\"");
+    request->send(response);
+}
+
+// The request handling itself is in WebRoutes, shared with the host tool;
+// these only carry it over the async web server
+
+void WebInterface::handleHistory(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpHistory);
+    TRACE_SCOPE("GET /history");
+    RateHistory::Export exp;
+    WebRoutes::Reply reply;
+    if (!WebRoutes::history(routeRequest(request), exp, reply))
+    {
+        sendReply(request, reply);
+        return;
+    }
+    // The export state travels with the response and is freed with it
+    request->send(request->beginChunkedResponse("application/json",
+        [exp](uint8_t* buffer, size_t maxLen, size_t index) mutable
+    {
+        return RateHistory::fill(exp, buffer, maxLen);
+    }));
 }
 
-String WebInterface::generateFilteredPage()
+void WebInterface::handleHistoryWatch(AsyncWebServerRequest* request)
 {
-    return FILTERED_TEMPLATE;
+    ALLOC_SCOPE(HttpHistory);
+    TRACE_SCOPE("POST /history_watch");
+    WebRoutes::Reply reply;
+    WebRoutes::historyWatch(routeRequest(request), reply);
+    sendReply(request, reply);
 }
 
-String WebInterface::generateIdListJson()
+void WebInterface::handleLatestMessages(AsyncWebServerRequest* request)
 {
-    if (!latestMessages)
+    ALLOC_SCOPE(HttpLatestMessages);
+    TRACE_SCOPE("GET /latest_messages");
+    ViewRenderer::Context* ctx = nullptr;
+    WebRoutes::Reply reply;
+    if (!WebRoutes::latest(routeRequest(request), HeapGuard::Scope::HttpLatestMessages, Clock::millis(), ctx, reply))
     {
-        return "[]";
+        sendReply(request, reply);
+        return;
     }
+    sendView(request, ctx, "text/html");
+}
 
-    uint32_t now = millis();
-    pruneAllHistory(now);
+void WebInterface::handleTop(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpTop);
+    TRACE_SCOPE("GET /top");
+    TopIds::Export exp;
+    WebRoutes::top(routeRequest(request), exp);
+    request->send(request->beginChunkedResponse("application/json",
+        [exp](uint8_t* buffer, size_t maxLen, size_t index) mutable
+    {
+        return TopIds::fill(exp, buffer, maxLen);
+    }));
+}
 
-    std::vector<uint32_t> ids;
-    ids.reserve(s_changeHistory.size());
-    // Build the ID list from the overall latestMessages map so the
-    // filtered page shows all known IDs regardless of change age.
-    ids.reserve(latestMessages->size());
-    for (const auto& entry : *latestMessages)
+void WebInterface::handleSearch(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpSearch);
+    TRACE_SCOPE("GET /search");
+    ViewRenderer::Context* ctx = nullptr;
+    WebRoutes::Reply reply;
+    if (!WebRoutes::search(routeRequest(request), HeapGuard::Scope::HttpSearch, Clock::millis(), ctx, reply))
     {
-        ids.push_back(entry.first);
+        sendReply(request, reply);
+        return;
     }
+    sendView(request, ctx, "application/json");
+}
 
-    std::sort(ids.begin(), ids.end());
-
-    String json = "[";
-    for (size_t i = 0; i < ids.size(); ++i)
+void WebInterface::handleHistogram(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpHistogram);
+    TRACE_SCOPE("GET /histogram");
+    ByteHistogram::Export exp;
+    WebRoutes::Reply reply;
+    if (!WebRoutes::histogram(routeRequest(request), exp, reply))
     {
-        if (i != 0)
-        {
-            json += ",";
-        }
-        json += "\"0x";
-        json += String(ids[i], HEX);
-        json += "\"";
+        sendReply(request, reply);
+        return;
     }
-    json += "]";
-    return json;
+    request->send(request->beginChunkedResponse("application/json",
+        [exp](uint8_t* buffer, size_t maxLen, size_t index) mutable
+    {
+        return ByteHistogram::fill(exp, buffer, maxLen);
+    }));
+}
+
+void WebInterface::handleHistogramWatch(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpHistogram);
+    TRACE_SCOPE("POST /histogram_watch");
+    WebRoutes::Reply reply;
+    WebRoutes::histogramWatch(routeRequest(request), reply);
+    sendReply(request, reply);
+}
+
+void WebInterface::handleConfig(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpConfig);
+    TRACE_SCOPE("GET /config");
+    WebRoutes::Reply reply;
+    WebRoutes::config(reply);
+    sendReply(request, reply);
+}
+
+void WebInterface::handleConfigSave(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpConfig);
+    TRACE_SCOPE("POST /config");
+    WebRoutes::Reply reply;
+    WebRoutes::configSave(routeRequest(request), reply);
+    sendReply(request, reply);
+}
+
+void WebInterface::handleSampling(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpSampling);
+    TRACE_SCOPE("POST /sampling");
+    WebRoutes::Reply reply;
+    WebRoutes::sampling(routeRequest(request), reply);
+    sendReply(request, reply);
 }
 
-std::vector<uint32_t> WebInterface::parseIdList(const String& rawIds)
+// POST /network with mode=station|ap|apsta and, for a network to join,
+// ssid and password. Saved first, then switched shortly after the response
+// has gone out; the switch drops every connection, including this one.
+void WebInterface::handleNetwork(AsyncWebServerRequest* request)
 {
-    std::vector<uint32_t> ids;
-    if (!rawIds.length())
+    ALLOC_SCOPE(HttpConfig);
+    TRACE_SCOPE("POST /network");
+    SoftAPConfig::Config config;
+    bool haveCredentials = SoftAPConfig::loadConfig(config) && config.ssid[0] != '\0';
+    if (!request->hasParam("mode", true) ||
+        !SoftAPConfig::parseMode(request->getParam("mode", true)->value().c_str(), config.mode))
+    {
+        request->send(400, "application/json", "{\"error\":\"Mode must be station, ap or apsta\"}");
+        return;
+    }
+    if (request->hasParam("ssid", true))
+    {
+        const String& ssid = request->getParam("ssid", true)->value();
+        const String& password = request->hasParam("password", true) ? request->getParam("password", true)->value()
+                                                                      : String();
+        haveCredentials = ssid.length() > 0 &&
+            RequestParser::copyConfigField(ssid.c_str(), ssid.length(), config.ssid, sizeof(config.ssid)) &&
+            RequestParser::copyConfigField(password.c_str(), password.length(), config.password, sizeof(config.password));
+    }
+    if (SoftAPConfig::needsStation(config.mode) && !haveCredentials)
     {
-        return ids;
+        request->send(400, "application/json", "{\"error\":\"A network to join needs an SSID\"}");
+        return;
+    }
+    if (!SoftAPConfig::saveConfig(config))
+    {
+        request->send(500, "application/json", "{\"error\":\"Saving failed\"}");
+        return;
     }
 
-    int start = 0;
-    while (start <= rawIds.length())
+    SoftAPConfig::requestSwitch(config);
+    String json = "{\"status\":\"switching\",\"mode\":\"";
+    json += SoftAPConfig::modeName(config.mode);
+    json += "\"}";
+    request->send(202, "application/json", json);
+}
+
+// GET /fuzz[?since=N]: the run's progress and its log from event N on. The
+// log keeps only the newest events; "first" is the oldest one still there,
+// and "events" going down means a new run started.
+void WebInterface::handleFuzz(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpFuzz);
+    TRACE_SCOPE("GET /fuzz");
+    uint32_t since = request->hasParam("since") ? strtoul(request->getParam("since")->value().c_str(), nullptr, 10) : 0;
+    request->send(200, "application/json", generateFuzzJson(since, true));
+}
+
+// POST /fuzz with plan=ids=7E0,mode=bitwalk,... starts a run in place of
+// any other; stop=1 stops it. Frames only go out in normal or no-ack mode.
+void WebInterface::handleFuzzControl(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpFuzz);
+    TRACE_SCOPE("POST /fuzz");
+    if (request->hasParam("stop", true))
+    {
+        PayloadFuzzer::stop();
+    }
+    else if (request->hasParam("plan", true))
     {
-        int end = rawIds.indexOf(',', start);
-        if (end == -1)
+        PayloadFuzzer::Plan plan;
+        if (!PayloadFuzzer::parsePlan(request->getParam("plan", true)->value().c_str(), plan))
         {
-            end = rawIds.length();
+            String json = "{\"error\":\"";
+            json += PayloadFuzzer::lastError();
+            json += "\"}";
+            request->send(400, "application/json", json);
+            return;
         }
-        String token = rawIds.substring(start, end);
-        token.trim();
-        if (token.length() > 0)
+        if (DeviceConfig::can().mode == DeviceConfig::CanMode::ListenOnly)
         {
-            token.toUpperCase();
-            if (token.startsWith("0X"))
-            {
-                token = token.substring(2);
-            }
-            char* endPtr = nullptr;
-            uint32_t value = strtoul(token.c_str(), &endPtr, 16);
-            if (endPtr != token.c_str())
-            {
-                ids.push_back(value);
-            }
+            request->send(409, "application/json", "{\"error\":\"The bus is in listen-only mode\"}");
+            return;
         }
-        start = end + 1;
+        PayloadFuzzer::start(plan);
     }
-    return ids;
+    else
+    {
+        request->send(400, "application/json", "{\"error\":\"Missing plan or stop\"}");
+        return;
+    }
+    // The CAN task takes the request over on its next wakeup
+    request->send(202, "application/json", generateFuzzJson(0, false));
 }
 
-String WebInterface::generateFilteredRows(const std::vector<uint32_t>& ids)
+String WebInterface::generateFuzzJson(uint32_t since, bool withLog)
 {
-    if (!latestMessages)
+    PayloadFuzzer::Plan plan = PayloadFuzzer::plan();
+    String json = "{\"state\":\"";
+    json += PayloadFuzzer::stateName(PayloadFuzzer::state());
+    json += "\",\"mode\":\"";
+    json += PayloadFuzzer::modeName(plan.mode);
+    json += "\",\"ids\":[";
+    for (uint8_t i = 0; i < plan.idCount; ++i)
     {
-        return "<tr><td colspan='5'>Waiting for CAN data...</td></tr>";
+        json += i > 0 ? ",\"0x" : "\"0x";
+        json += String(plan.ids[i], HEX);
+        json += "\"";
     }
-
-    if (ids.empty())
+    json += "],\"len\":";
+    json += String(plan.length);
+    json += ",\"rate\":";
+    json += String(plan.rate);
+    json += ",\"count\":";
+    json += String(plan.count);
+    json += ",\"seed\":";
+    json += String(plan.seed);
+    json += ",\"sent\":";
+    json += String(PayloadFuzzer::framesSent());
+    json += ",\"elapsed_ms\":";
+    json += String(PayloadFuzzer::elapsedMs());
+    uint32_t events = PayloadFuzzer::eventCount();
+    json += ",\"events\":";
+    json += String(events);
+    if (!withLog)
     {
-        return "<tr><td colspan='5'>No IDs selected</td></tr>";
+        json += "}";
+        return json;
     }
 
-    std::set<uint32_t> filter(ids.begin(), ids.end());
-    String rows;
-    uint32_t currentTime = millis();
-
-    for (const auto& pair : *latestMessages)
+    uint32_t first = PayloadFuzzer::oldestEvent();
+    json += ",\"first\":";
+    json += String(first);
+    json += ",\"log\":[";
+    // A since past the end belongs to an earlier run
+    uint32_t number = since > events ? events : since > first ? since : first;
+    uint32_t end = events - number > FUZZ_EVENTS_PER_REQUEST ? number + FUZZ_EVENTS_PER_REQUEST : events;
+    bool separator = false;
+    for (; number < end; ++number)
     {
-        if (filter.find(pair.first) == filter.end())
+        PayloadFuzzer::Event event;
+        if (!PayloadFuzzer::event(number, event))
         {
-            continue;
+            continue;   // Overwritten while this response was built
         }
-
-        uint32_t lastChangeTimestamp = 0;
-        auto highlightMask = collectHighlightMask(pair.first, currentTime, lastChangeTimestamp);
-        if (lastChangeTimestamp == 0)
+        json += separator ? ",{\"n\":" : "{\"n\":";
+        separator = true;
+        json += String(number);
+        json += ",\"us\":";
+        json += String(event.timeUs);
+        if (event.kind == PayloadFuzzer::EventKind::Response)
         {
-            continue;
+            json += ",\"kind\":\"response\",";
+            appendFrame(json, event.received.id, event.received.data, event.received.length);
+            json += event.receivedExtended ? ",\"ext\":true" : ",\"ext\":false";
         }
-
-        uint32_t age = currentTime - lastChangeTimestamp;
-        if (age > CHANGE_EXPIRATION_MS)
+        else
         {
-            continue;
+            json += event.kind == PayloadFuzzer::EventKind::ErrorState ? ",\"kind\":\"error_state\""
+                                                                       : ",\"kind\":\"bus_errors\"";
+            json += ",\"state\":\"";
+            json += PayloadFuzzer::errorStateName(event.state);
+            json += "\",\"tec\":";
+            json += String(event.txErrors);
+            json += ",\"rec\":";
+            json += String(event.rxErrors);
+            json += ",\"bus_errors\":";
+            json += String(event.busErrors);
         }
-
-        bool hasPrev = false;
-        std::map<uint32_t, CANMessage>::const_iterator prevIt;
-        if (previousMessages)
+        if (event.hasPreceding)
         {
-            prevIt = previousMessages->find(pair.first);
-            hasPrev = prevIt != previousMessages->end();
+            json += ",\"after\":{\"index\":";
+            json += String(event.preceding.index);
+            json += ",";
+            appendFrame(json, event.preceding.id, event.preceding.data, event.preceding.length);
+            json += "}";
         }
-
-        rows += "<tr><td>0x" + String(pair.first, HEX) + "</td>";
-        rows += "<td>" + String(pair.second.length) + "</td><td>";
-
-        for (int i = 0; i < pair.second.length; i++)
+        else
         {
-            bool highlight = (i < static_cast<int>(highlightMask.size())) ? highlightMask[i] : false;
-            if (!highlight && previousMessages && hasPrev)
-            {
-                highlight = i >= prevIt->second.length ||
-                            pair.second.data[i] != prevIt->second.data[i];
-            }
-            rows += formatByte(pair.second.data[i], highlight);
+            json += ",\"after\":null";
         }
+        json += "}";
+    }
+    json += end < events ? "],\"more\":true}" : "],\"more\":false}";
+    return json;
+}
 
-        String ageClass;
-        if (age < 1000) ageClass = "age-fresh";
-        else if (age < 5000) ageClass = "age-medium";
-        else ageClass = "age-old";
-
-        rows += "</td><td>" + String(pair.second.timestamp) +
-                "</td><td class='" + ageClass + "'>" + String(age) + "</td></tr>\n";
+// GET /sequence: the run's state and the results of every step so far
+void WebInterface::handleSequence(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpSequence);
+    TRACE_SCOPE("GET /sequence");
+    String json = generateSequenceJson();
+    if (json.length() == 0)
+    {
+        request->send(503, "application/json", "{\"error\":\"Busy, try again\"}");
+        return;
     }
+    request->send(200, "application/json", json);
+}
 
-    if (!rows.length())
+// POST /sequence with script=<steps> starts a script in place of any other;
+// stop=1 stops it. Answers at once; GET /sequence follows the run.
+void WebInterface::handleSequenceControl(AsyncWebServerRequest* request)
+{
+    ALLOC_SCOPE(HttpSequence);
+    TRACE_SCOPE("POST /sequence");
+    if (request->hasParam("stop", true))
+    {
+        SequenceRunner::stop();
+    }
+    else if (request->hasParam("script", true))
+    {
+        // Too large for the server task's stack; only this task uses it
+        static SequenceRunner::Script script;
+        if (!SequenceRunner::parse(request->getParam("script", true)->value().c_str(), script))
+        {
+            String json = "{\"error\":\"";
+            json += SequenceRunner::lastError();
+            json += "\",\"step\":";
+            json += String(SequenceRunner::errorStep());
+            json += "}";
+            request->send(400, "application/json", json);
+            return;
+        }
+        bool sends = false;
+        for (uint8_t i = 0; i < script.stepCount; ++i)
+        {
+            sends = sends || script.steps[i].kind == SequenceRunner::StepKind::Send;
+        }
+        if (sends && DeviceConfig::can().mode == DeviceConfig::CanMode::ListenOnly)
+        {
+            request->send(409, "application/json", "{\"error\":\"The bus is in listen-only mode\"}");
+            return;
+        }
+        SequenceRunner::start(script);
+    }
+    else
     {
-        rows = "<tr><td colspan='5'>No matching IDs found or messages have expired</td></tr>";
+        request->send(400, "application/json", "{\"error\":\"Missing script or stop\"}");
+        return;
     }
+    // The sequence task takes the request over within 10 ms
+    String json = "{\"status\":\"accepted\",\"state\":\"";
+    json += SequenceRunner::stateName(SequenceRunner::status().state);
+    json += "\"}";
+    request->send(202, "application/json", json);
+}
 
-    return rows;
+// Times per step: how late a send was queued or a delay ended, and how long
+// a wait took. Empty when the results kept changing while copied.
+String WebInterface::generateSequenceJson()
+{
+    static SequenceRunner::StepResult results[SequenceRunner::MAX_STEPS];
+    uint8_t count = 0;
+    if (!SequenceRunner::results(results, count))
+    {
+        return String();
+    }
+    SequenceRunner::Status status = SequenceRunner::status();
+    String json = "{\"state\":\"";
+    json += SequenceRunner::stateName(status.state);
+    json += "\",\"iteration\":";
+    json += String(status.iteration);
+    json += ",\"repeat\":";
+    json += String(status.repeat);
+    json += ",\"step\":";
+    json += String(status.step);
+    json += ",\"failure\":\"";
+    json += SequenceRunner::failureName(status.failure);
+    json += "\",\"elapsed_ms\":";
+    json += String(status.elapsedMs);
+    json += ",\"steps\":[";
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        const SequenceRunner::StepResult& result = results[i];
+        json += i > 0 ? ",{\"kind\":\"" : "{\"kind\":\"";
+        json += SequenceRunner::kindName(result.kind);
+        json += "\"";
+        if (result.kind != SequenceRunner::StepKind::Delay)
+        {
+            json += ",\"id\":\"0x";
+            json += String(result.id, HEX);
+            json += "\"";
+        }
+        json += ",\"runs\":";
+        json += String(result.runs);
+        json += ",\"failures\":";
+        json += String(result.failures);
+        uint32_t succeeded = result.runs - result.failures;
+        if (succeeded > 0)
+        {
+            json += ",\"min_us\":";
+            json += String(result.minUs);
+            json += ",\"mean_us\":";
+            json += String(static_cast<uint32_t>(result.totalUs / succeeded));
+            json += ",\"max_us\":";
+            json += String(result.maxUs);
+        }
+        if (result.hasFrame)
+        {
+            json += ",\"frame\":{";
+            appendFrame(json, result.frame.id, result.frame.data, result.frame.length);
+            json += "}";
+        }
+        json += "}";
+    }
+    json += "]}";
+    return json;
 }
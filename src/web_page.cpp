@@ -0,0 +1,974 @@
+#include "web_page.h"
+
+// HTML template moved from main.cpp
+// Note: the page loads once and client-side JavaScript fetches table fragments
+// so only the table bodies are updated (smoother UI than full page reload)
+const char* const WEB_PAGE_HTML = R"html(
+<!DOCTYPE html>
+<html>
+<head>
+    <title>CAN Bus Monitor</title>
+    <meta name="viewport" content="width=device-width,initial-scale=1">
+    <style>
+        * { box-sizing: border-box; }
+        body { font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, sans-serif; padding: 0; margin: 0; background-color: #fafafa; color: #333; }
+        
+        /* Header and Navigation */
+        header { background-color: #1a1a1a; color: white; padding: 0; box-shadow: 0 2px 4px rgba(0,0,0,0.1); }
+        .header-content { max-width: 1400px; margin: 0 auto; padding: 16px; }
+        .app-title { font-size: 24px; font-weight: 700; margin: 0; color: white; }
+        nav { background-color: #2d2d2d; }
+        nav ul { list-style: none; margin: 0; padding: 0; display: flex; }
+        nav li { margin: 0; }
+        nav a { display: block; padding: 12px 20px; color: white; text-decoration: none; transition: background-color 200ms; border-bottom: 3px solid transparent; }
+        nav a:hover { background-color: #3d3d3d; }
+        nav a.active { background-color: #4caf50; border-bottom-color: #4caf50; }
+        
+        /* Main content */
+        main { max-width: 1400px; margin: 0 auto; padding: 20px 16px; }
+        .page { display: none; }
+        .page.active { display: block; }
+        
+        h2 { margin: 20px 0 16px 0; color: #1a1a1a; }
+        p { margin: 0 0 12px 0; }
+        a { color: #1976d2; text-decoration: none; }
+        a:hover { text-decoration: underline; }
+        
+        /* Sections */
+        .section { margin: 20px 0; }
+        
+        /* Tables */
+        table { border-collapse: collapse; width: 100%; background-color: white; border: 1px solid #ddd; border-radius: 4px; overflow: hidden; }
+        th, td { border: 1px solid #ddd; padding: 12px; text-align: left; }
+        th { background-color: #f5f5f5; font-weight: 600; }
+        tbody { transition: opacity 120ms ease-in-out; }
+        tbody tr { cursor: pointer; }
+        tbody tr:hover { background-color: #f9f9f9; }
+        
+        /* Data highlighting */
+        .highlight { background-color: #ffeb3b; }
+        .byte { display: inline-block; min-width: 25px; font-family: monospace; }
+        .age-fresh { color: #4caf50; font-weight: 500; }
+        .age-medium { color: #ff9800; font-weight: 500; }
+        .age-old { color: #f44336; font-weight: 500; }
+        
+        /* Forms */
+        .transmit-section { background-color: white; border: 1px solid #ddd; padding: 20px; border-radius: 4px; margin-top: 20px; }
+        .transmit-field { display: flex; flex-direction: column; }
+        .transmit-field label { font-weight: 600; margin-bottom: 6px; font-size: 0.95em; color: #1a1a1a; }
+        .transmit-field input { padding: 8px; border: 1px solid #ccc; border-radius: 3px; font-family: monospace; font-size: 14px; }
+        .transmit-field input[type="number"] { width: 100px; }
+        .transmit-field input[type="text"] { width: 150px; }
+        .byte-input { width: 60px !important; text-align: center; text-transform: uppercase; letter-spacing: 1px; }
+        
+        /* Buttons */
+        button { padding: 10px 16px; cursor: pointer; background-color: #4caf50; color: white; border: none; border-radius: 3px; font-weight: 600; font-size: 14px; transition: background-color 200ms; }
+        button:hover { background-color: #45a049; }
+        button:active { transform: scale(0.98); }
+        
+        /* Status messages */
+        .status-message { margin-top: 12px; padding: 12px; border-radius: 3px; display: none; border-left: 4px solid; }
+        .status-message.success { background-color: #d4edda; color: #155724; border-left-color: #28a745; }
+        .status-message.error { background-color: #f8d7da; color: #721c24; border-left-color: #dc3545; }
+        
+        /* Filters section */
+        .filters { background-color: white; border: 1px solid #ddd; padding: 16px; border-radius: 4px; margin-bottom: 20px; }
+        .filter-actions { margin-bottom: 16px; display: flex; gap: 8px; align-items: center; flex-wrap: wrap; }
+        .status { font-size: 0.95em; color: #666; }
+        #id_list { display: flex; flex-wrap: wrap; gap: 16px; margin-top: 12px; }
+        .id-option { display: flex; align-items: center; gap: 6px; }
+        .id-option input { cursor: pointer; }
+        .id-option span { cursor: pointer; user-select: none; }
+        #search_pattern { padding: 8px; border: 1px solid #ccc; border-radius: 3px; font-family: monospace; width: 220px; }
+
+        /* Statistics and sampling bar */
+        .stats-bar { background-color: white; border: 1px solid #ddd; padding: 12px 16px; border-radius: 4px; margin-bottom: 16px; display: flex; gap: 24px; align-items: center; flex-wrap: wrap; }
+        .stats-bar .stat { font-size: 0.95em; }
+        .stats-bar .stat b { font-family: monospace; }
+        .sampling-state { padding: 4px 8px; border-radius: 3px; font-size: 0.9em; }
+        .sampling-state.exact { background-color: #d4edda; color: #155724; }
+        .sampling-state.sampled { background-color: #fff3cd; color: #856404; }
+        .sampling-controls { display: flex; gap: 8px; align-items: center; }
+        .sampling-controls select, .sampling-controls input { padding: 6px; border: 1px solid #ccc; border-radius: 3px; }
+        .sampling-controls input { width: 80px; }
+        .latency-bar { font-size: 0.9em; color: #555; margin: -8px 0 16px 0; }
+        .latency-bar b { font-family: monospace; color: #333; }
+
+        /* Top IDs panel */
+        .top-panel { display: flex; gap: 16px; flex-wrap: wrap; margin-top: 20px; }
+        .top-panel .top-list { flex: 1; min-width: 220px; }
+        .top-panel h3 { margin: 0 0 8px 0; font-size: 1em; }
+        .top-panel td { padding: 4px 8px; font-family: monospace; }
+        .top-panel td.value { text-align: right; }
+
+        /* Sorting and paging of the latest table */
+        .table-controls { display: flex; gap: 8px; align-items: center; margin-bottom: 8px; flex-wrap: wrap; }
+        .table-controls select { padding: 6px; border: 1px solid #ccc; border-radius: 3px; }
+        .table-controls button { padding: 6px 12px; }
+    </style>
+    <script>
+        const POLL_MS = 1000; // refresh interval for the latest table (1000ms = 1 update per second)
+        const PAGE_SIZE = 50;
+
+        // The device keeps each sort order and sends only the page shown
+        let latestPage = 0;
+        let latestTotal = 0;
+
+        function latestUrl()
+        {
+            const sort = document.getElementById('latest_sort').value;
+            return '/latest_messages?sort=' + sort + '&offset=' + latestPage * PAGE_SIZE + '&limit=' + PAGE_SIZE;
+        }
+
+        function changeLatestPage(delta)
+        {
+            const pages = Math.max(1, Math.ceil(latestTotal / PAGE_SIZE));
+            latestPage = Math.min(Math.max(latestPage + delta, 0), pages - 1);
+            renderLatestPager();
+            updateLatest();
+        }
+
+        function changeLatestSort()
+        {
+            latestPage = 0;
+            renderLatestPager();
+            updateLatest();
+        }
+
+        function renderLatestPager()
+        {
+            const pages = Math.max(1, Math.ceil(latestTotal / PAGE_SIZE));
+            document.getElementById('latest_page').textContent = 'Page ' + (latestPage + 1) + ' of ' + pages;
+        }
+
+        async function updateLatest()
+        {
+            try
+            {
+                const res = await fetch(latestUrl(), {cache: 'no-store'});
+                if (!res.ok)
+                {
+                    console.error('Fetch failed', '/latest_messages', res.status);
+                    return;
+                }
+                const text = await res.text();
+                const el = document.getElementById('latest_body');
+                if (!el) return;
+                el.style.opacity = 0.2;
+                requestAnimationFrame(() => {
+                    el.innerHTML = text;
+                    el.style.opacity = 1.0;
+                });
+            }
+            catch (e)
+            {
+                console.error('Error fetching latest messages', e);
+            }
+        }
+
+        // Rows are replaced on every poll, so clicks are handled once on the
+        // table body. A click loads the row's frame into the transmit form,
+        // a double click also sends it.
+        function attachRowClickHandlers()
+        {
+            const body = document.getElementById('latest_body');
+            body.addEventListener('click', (ev) => {
+                const row = ev.target.closest('tr[data-id]');
+                if (row) loadTransmitForm(row);
+            });
+            body.addEventListener('dblclick', (ev) => {
+                if (ev.target.closest('tr[data-id]')) sendTransmit(ev);
+            });
+        }
+
+        // The newest streamed frame of the ID carries the exact bytes and
+        // the ID format; the row's own cells are the fallback for IDs not
+        // seen since the stream connected
+        function loadTransmitForm(row)
+        {
+            const id = parseInt(row.dataset.id, 16);
+            const latest = streamLatest.get(id) || streamLatest.get((id | 0x80000000) >>> 0);
+            let extended = id > 0x7FF;
+            const bytes = [];
+            if (latest) {
+                extended = latest.extended;
+                bytes.push(...latest.data);
+            } else {
+                const cells = row.querySelectorAll('td');
+                const length = cells.length >= 3 ? Math.min(parseInt(cells[1].textContent) || 0, 8) : 0;
+                const text = length > 0 ? cells[2].textContent.trim().split(/\s+/) : [];
+                for (let i = 0; i < length && i < text.length; i++) {
+                    bytes.push(parseInt(text[i], 16) || 0);
+                }
+            }
+
+            document.getElementById('tx_id').value = id.toString(16);
+            document.getElementById('tx_extended').checked = extended;
+            document.getElementById('tx_length').value = bytes.length;
+            for (let i = 0; i < 8; i++) {
+                document.getElementById('tx_byte_' + i).value =
+                    i < bytes.length ? bytes[i].toString(16).padStart(2, '0') : '';
+            }
+            updateByteInputs();
+        }
+
+        async function updateMetrics()
+        {
+            try
+            {
+                const res = await fetch('/metrics', {cache: 'no-store'});
+                if (!res.ok) return;
+                const m = await res.json();
+                document.getElementById('stat_frames').textContent = m.frames;
+                document.getElementById('stat_rate').textContent = m.frameRate;
+                document.getElementById('stat_load').textContent = (m.busLoadPermille / 10).toFixed(1) + '%';
+                document.getElementById('stat_ids').textContent = m.ids;
+                latestTotal = m.ids;
+                renderLatestPager();
+                renderSamplingState(m.sampling);
+            }
+            catch (e)
+            {
+                console.error('Error fetching metrics', e);
+            }
+        }
+
+        // Live frame stream (binary, see frame_codec.h). The latest frame is
+        // shown in the stats bar; probe frames are echoed back once painted
+        // so the device can split end-to-end latency into stages.
+        const LATENCY_POLL_MS = 2000;
+        let streamSocket = null;
+        const streamLatest = new Map();     // Stream ID (bit 31 for extended) -> newest frame
+
+        function startStream()
+        {
+            const ws = new WebSocket('ws://' + location.host + '/stream');
+            ws.binaryType = 'arraybuffer';
+            ws.onmessage = (ev) => onStreamMessage(ev.data, performance.now());
+            ws.onclose = () => { streamSocket = null; setTimeout(startStream, 2000); };
+            streamSocket = ws;
+        }
+
+        function onStreamMessage(buffer, receivedAt)
+        {
+            const view = new DataView(buffer);
+            if (buffer.byteLength < 12 || view.getUint8(0) !== 0x43 || view.getUint8(1) !== 0x4D ||
+                view.getUint8(2) !== 1) return;
+            if (view.getUint8(3) === 5) {
+                onTransmitAck(view, receivedAt);
+                return;
+            }
+            if (view.getUint8(3) !== 1) return;
+            const count = view.getUint16(4, true);
+            const sentUs = view.getUint32(8, true);
+            if (count === 0 || buffer.byteLength < 12 + count * 24) return;
+
+            let probe = -1;
+            for (let i = 0; i < count; i++) {
+                const record = 12 + i * 24;
+                if (view.getUint8(record + 13) & 1) probe = record;
+                const streamId = view.getUint32(record + 8, true);
+                const data = [];
+                for (let b = 0; b < Math.min(view.getUint8(record + 12), 8); b++) {
+                    data.push(view.getUint8(record + 16 + b));
+                }
+                streamLatest.set(streamId, { extended: (streamId & 0x80000000) !== 0, data: data });
+            }
+            const last = 12 + (count - 1) * 24;
+            const id = view.getUint32(last + 8, true);
+            const length = Math.min(view.getUint8(last + 12), 8);
+            let text = '0x' + (id & 0x7FFFFFFF).toString(16);
+            for (let b = 0; b < length; b++) {
+                text += ' ' + view.getUint8(last + 16 + b).toString(16).padStart(2, '0');
+            }
+
+            requestAnimationFrame(() => {
+                document.getElementById('stat_live').textContent = text;
+                if (probe >= 0) {
+                    // Runs after the frame containing the update has been painted
+                    const sequence = view.getUint32(probe, true);
+                    setTimeout(() => sendLatencyEcho(sequence, sentUs, performance.now() - receivedAt), 0);
+                }
+            });
+        }
+
+        function sendLatencyEcho(sequence, sentUs, clientMs)
+        {
+            if (!streamSocket || streamSocket.readyState !== WebSocket.OPEN) return;
+            const buffer = new ArrayBuffer(24);
+            const view = new DataView(buffer);
+            view.setUint8(0, 0x43);
+            view.setUint8(1, 0x4D);
+            view.setUint8(2, 1);
+            view.setUint8(3, 2);
+            view.setUint16(4, 1, true);
+            view.setUint32(12, sequence, true);
+            view.setUint32(16, sentUs, true);
+            view.setUint32(20, Math.round(clientMs * 1000), true);
+            streamSocket.send(buffer);
+        }
+
+        async function updateLatency()
+        {
+            try
+            {
+                const res = await fetch('/latency', {cache: 'no-store'});
+                if (!res.ok) return;
+                const l = await res.json();
+                const ms = (us) => (us / 1000).toFixed(us < 10000 ? 2 : 0);
+                document.getElementById('stat_latency').textContent = l.stages
+                    .map(s => s.stage + ' ' + (s.count ? ms(s.p50) + '/' + ms(s.p99) : '-'))
+                    .join(' \u00b7 ');
+                document.getElementById('stat_dropped').textContent = l.stream.dropped;
+            }
+            catch (e)
+            {
+                console.error('Error fetching latency', e);
+            }
+        }
+
+        // Rankings are kept by the device; each refresh only copies them
+        const TOP_METRICS = ['frameRate', 'changeRate', 'bytesChanged'];
+
+        async function updateTop()
+        {
+            try
+            {
+                const res = await fetch('/top', {cache: 'no-store'});
+                if (!res.ok) return;
+                const top = await res.json();
+                for (const metric of TOP_METRICS) {
+                    const rows = top[metric].map(e => '<tr><td>' + e.id + '</td><td class="value">' + e.value + '</td></tr>');
+                    document.getElementById('top_' + metric).innerHTML =
+                        rows.length ? rows.join('') : '<tr><td colspan="2">-</td></tr>';
+                }
+            }
+            catch (e)
+            {
+                console.error('Error fetching top IDs', e);
+            }
+        }
+
+        function renderSamplingState(sampling)
+        {
+            const el = document.getElementById('sampling_state');
+            if (sampling.mode === 'off') {
+                el.textContent = 'All stages exact';
+                el.className = 'sampling-state exact';
+            } else {
+                const how = sampling.mode === 'ratio' ? ('1-in-' + sampling.value + ' per ID')
+                                                      : ('1 per ' + sampling.value + ' ms per ID');
+                el.textContent = 'Sampled (' + how + '): ' + sampling.stages.join(', ') +
+                                 ' | exact: statistics';
+                el.className = 'sampling-state sampled';
+            }
+            const modeEl = document.getElementById('sampling_mode');
+            if (document.activeElement !== modeEl && document.activeElement !== document.getElementById('sampling_value')) {
+                modeEl.value = sampling.mode;
+                document.getElementById('sampling_value').value = sampling.value;
+            }
+        }
+
+        async function applySampling()
+        {
+            const mode = document.getElementById('sampling_mode').value;
+            const value = document.getElementById('sampling_value').value;
+            try
+            {
+                const res = await fetch('/sampling', {
+                    method: 'POST',
+                    body: new URLSearchParams({ mode: mode, value: value })
+                });
+                if (res.ok) {
+                    renderSamplingState(await res.json());
+                }
+            }
+            catch (e)
+            {
+                console.error('Error applying sampling', e);
+            }
+        }
+
+        function updateByteInputs()
+        {
+            const length = parseInt(document.getElementById('tx_length').value) || 0;
+            const constrainedLength = Math.min(Math.max(length, 0), 8);
+            document.getElementById('tx_length').value = constrainedLength;
+            
+            // All byte inputs are always visible, just update disabled state for clarity
+            for (let i = 0; i < 8; i++) {
+                const input = document.getElementById('tx_byte_' + i);
+                if (i < constrainedLength) {
+                    input.style.opacity = '1.0';
+                    input.disabled = false;
+                } else {
+                    input.style.opacity = '0.5';
+                    input.disabled = true;
+                    input.value = '';
+                }
+            }
+        }
+
+        // Frames go out over the stream connection with a token; the device
+        // acknowledges each once the controller has finished it (see
+        // TransmitTracker). Without the stream they are POSTed instead.
+        const TX_ACK_TIMEOUT_MS = 2000;
+        const TX_LATENCY_SAMPLES = 32;
+        const TX_STATUS = ['sent', 'TX queue full', 'rejected by the driver', 'not acknowledged on the bus',
+                           'invalid frame'];
+        const txPending = new Map();        // Token -> send in flight
+        const txLatencies = [];
+        let txToken = 0;
+
+        function showTransmitStatus(text, ok)
+        {
+            const statusEl = document.getElementById('transmit_status');
+            statusEl.textContent = text;
+            statusEl.className = 'status-message ' + (ok ? 'success' : 'error');
+            statusEl.style.display = 'block';
+        }
+
+        // The form as a frame, or null after reporting what is wrong with it
+        function readTransmitForm()
+        {
+            const idText = document.getElementById('tx_id').value.trim();
+            const length = parseInt(document.getElementById('tx_length').value) || 0;
+            const id = parseInt(idText, 16);
+            if (!idText || isNaN(id)) {
+                showTransmitStatus('Error: ID is required', false);
+                return null;
+            }
+            const extended = document.getElementById('tx_extended').checked || id > 0x7FF;
+            if (id > (extended ? 0x1FFFFFFF : 0x7FF)) {
+                showTransmitStatus('Error: ID must be at most 1FFFFFFF', false);
+                return null;
+            }
+            if (length < 0 || length > 8) {
+                showTransmitStatus('Error: Length must be 0-8', false);
+                return null;
+            }
+
+            const data = [];
+            for (let i = 0; i < length; i++) {
+                const byteVal = document.getElementById('tx_byte_' + i).value.trim();
+                if (!byteVal) {
+                    showTransmitStatus('Error: Byte ' + i + ' is required', false);
+                    return null;
+                }
+                const parsed = parseInt(byteVal, 16);
+                if (isNaN(parsed) || parsed < 0 || parsed > 255) {
+                    showTransmitStatus('Error: Byte ' + i + ' must be valid hex (0-FF)', false);
+                    return null;
+                }
+                data.push(parsed);
+            }
+            return { id: id, extended: extended, data: data };
+        }
+
+        function describeFrame(frame)
+        {
+            return 'ID=0x' + frame.id.toString(16) + (frame.extended ? ' (extended)' : '') +
+                   ', Length=' + frame.data.length;
+        }
+
+        // ev.timeStamp is when the click or key press happened, so the time
+        // the page took before sending counts too
+        function sendTransmit(ev)
+        {
+            const clickAt = ev && ev.timeStamp ? ev.timeStamp : performance.now();
+            const frame = readTransmitForm();
+            if (!frame) return;
+            if (!streamSocket || streamSocket.readyState !== WebSocket.OPEN) {
+                postTransmit(frame);
+                return;
+            }
+
+            const token = txToken = (txToken + 1) >>> 0;
+            const buffer = new ArrayBuffer(12 + 20);
+            const view = new DataView(buffer);
+            view.setUint8(0, 0x43);
+            view.setUint8(1, 0x4D);
+            view.setUint8(2, 1);
+            view.setUint8(3, 4);
+            view.setUint16(4, 1, true);
+            view.setUint32(12, token, true);
+            view.setUint32(16, (frame.id | (frame.extended ? 0x80000000 : 0)) >>> 0, true);
+            view.setUint8(20, frame.data.length);
+            frame.data.forEach((byte, i) => view.setUint8(24 + i, byte));
+            const sentAt = performance.now();
+            streamSocket.send(buffer);
+            txPending.set(token, {
+                frame: frame, clickAt: clickAt, sentAt: sentAt,
+                timer: setTimeout(() => {
+                    txPending.delete(token);
+                    showTransmitStatus('Error: no acknowledgement for ' + describeFrame(frame), false);
+                }, TX_ACK_TIMEOUT_MS)
+            });
+        }
+
+        // Click to wire is the page's share (click to send), half the round
+        // trip less the time the device held the request and the ack (the
+        // network), and the device's share (request received to the
+        // controller finishing the frame)
+        function onTransmitAck(view, receivedAt)
+        {
+            const count = view.getUint16(4, true);
+            const ackSentUs = view.getUint32(8, true);
+            if (view.byteLength < 12 + count * 20) return;
+            for (let i = 0; i < count; i++) {
+                const record = 12 + i * 20;
+                const token = view.getUint32(record, true);
+                const pending = txPending.get(token);
+                if (!pending) continue;
+                clearTimeout(pending.timer);
+                txPending.delete(token);
+                const status = view.getUint8(record + 4);
+                if (status !== 0) {
+                    showTransmitStatus('Error: ' + describeFrame(pending.frame) + ' ' +
+                                       (TX_STATUS[status] || 'failed'), false);
+                    continue;
+                }
+
+                const receivedUs = view.getUint32(record + 8, true);
+                const doneUs = view.getUint32(record + 16, true);
+                const deviceMs = ((doneUs - receivedUs) >>> 0) / 1000;
+                const heldMs = ((ackSentUs - receivedUs) >>> 0) / 1000;
+                const networkMs = Math.max(0, (receivedAt - pending.sentAt - heldMs) / 2);
+                const pageMs = pending.sentAt - pending.clickAt;
+                const totalMs = pageMs + networkMs + deviceMs;
+                txLatencies.push(totalMs);
+                if (txLatencies.length > TX_LATENCY_SAMPLES) txLatencies.shift();
+                const sorted = txLatencies.slice().sort((a, b) => a - b);
+                const median = sorted[Math.floor(sorted.length / 2)];
+                showTransmitStatus(describeFrame(pending.frame) + ' on the wire ' + totalMs.toFixed(1) +
+                                   ' ms after the click (page ' + pageMs.toFixed(1) + ', network ' +
+                                   networkMs.toFixed(1) + ', device ' + deviceMs.toFixed(1) + '); median ' +
+                                   median.toFixed(1) + ' ms over ' + sorted.length, true);
+            }
+        }
+
+        async function postTransmit(frame)
+        {
+            if (frame.extended) {
+                showTransmitStatus('Error: extended IDs need the live stream connection', false);
+                return;
+            }
+            try {
+                const res = await fetch('/transmit_message', {
+                    method: 'POST',
+                    headers: { 'Content-Type': 'application/json' },
+                    body: JSON.stringify({ id: frame.id.toString(16), length: frame.data.length, data: frame.data })
+                });
+                
+                if (res.ok) {
+                    showTransmitStatus('Message transmitted: ' + describeFrame(frame), true);
+                } else {
+                    showTransmitStatus('Error: Transmit failed (HTTP ' + res.status + ')', false);
+                }
+            } catch (e) {
+                showTransmitStatus('Error: ' + e.message, false);
+            }
+        }
+
+        function switchPage(page)
+        {
+            // Hide all pages
+            document.querySelectorAll('.page').forEach(p => p.classList.remove('active'));
+            document.querySelectorAll('.nav-link').forEach(link => link.classList.remove('active'));
+            
+            // Show the selected page and update nav
+            if (page === 'home') {
+                document.getElementById('home-page').classList.add('active');
+                document.getElementById('nav-home').classList.add('active');
+            } else if (page === 'filter') {
+                document.getElementById('filter-page').classList.add('active');
+                document.getElementById('nav-filter').classList.add('active');
+                // Initialize filter page if needed
+                if (typeof startFilteredPage === 'function') {
+                    startFilteredPage();
+                }
+            }
+        }
+
+        function startPolling()
+        {
+            updateLatest();
+            updateMetrics();
+            setInterval(updateLatest, POLL_MS);
+            setInterval(updateMetrics, POLL_MS);
+            updateTop();
+            setInterval(updateTop, POLL_MS);
+            startStream();
+            updateLatency();
+            setInterval(updateLatency, LATENCY_POLL_MS);
+            // Initialize byte input display
+            updateByteInputs();
+            attachRowClickHandlers();
+            document.querySelectorAll('.transmit-section input').forEach(input => {
+                input.addEventListener('keydown', (ev) => {
+                    if (ev.key === 'Enter') sendTransmit(ev);
+                });
+            });
+        }
+
+        window.addEventListener('load', () => {
+            startPolling();
+            // Pre-initialize the filter page data but keep it hidden
+            if (typeof startFilteredPage === 'function') {
+                startFilteredPage();
+            }
+        });
+    </script>
+</head>
+<body>
+    <header>
+        <div class="header-content">
+            <h1 class="app-title">RCLS CAN Bus Monitor</h1>
+        </div>
+    </header>
+    <nav>
+        <ul>
+            <li><a href="#" onclick="switchPage('home'); return false;" class="nav-link active" id="nav-home">Home</a></li>
+            <li><a href="#" onclick="switchPage('filter'); return false;" class="nav-link" id="nav-filter">Filter</a></li>
+        </ul>
+    </nav>
+    <main>
+        <div id="home-page" class="page active">
+            <h2>Latest State</h2>
+            <div class="stats-bar">
+                <span class="stat">Frames: <b id="stat_frames">0</b></span>
+                <span class="stat">Rate: <b id="stat_rate">0</b>/s</span>
+                <span class="stat">Bus load: <b id="stat_load">0.0%</b></span>
+                <span class="stat">IDs: <b id="stat_ids">0</b></span>
+                <span id="sampling_state" class="sampling-state exact">All stages exact</span>
+                <span class="sampling-controls">
+                    <select id="sampling_mode">
+                        <option value="off">No sampling</option>
+                        <option value="ratio">1-in-N</option>
+                        <option value="interval">Every N ms</option>
+                    </select>
+                    <input type="number" id="sampling_value" min="1" value="1" />
+                    <button onclick="applySampling()">Apply</button>
+                </span>
+            </div>
+            <div class="latency-bar">
+                Live: <b id="stat_live">-</b> &nbsp;
+                Latency p50/p99 (ms): <b id="stat_latency">-</b> &nbsp;
+                Stream drops: <b id="stat_dropped">0</b>
+            </div>
+            <div class="section">
+                <div class="table-controls">
+                    <label for="latest_sort">Sort by</label>
+                    <select id="latest_sort" onchange="changeLatestSort()">
+                        <option value="id">ID</option>
+                        <option value="update">Last update</option>
+                        <option value="change">Last change</option>
+                        <option value="rate">Rate</option>
+                        <option value="dlc">Length</option>
+                    </select>
+                    <button onclick="changeLatestPage(-1)">&lt;</button>
+                    <span id="latest_page">Page 1 of 1</span>
+                    <button onclick="changeLatestPage(1)">&gt;</button>
+                </div>
+                <table>
+                    <thead>
+                        <tr>
+                            <th>ID</th>
+                            <th>Length</th>
+                            <th>Data</th>
+                            <th>Last Update</th>
+                            <th>Age (ms)</th>
+                            <th>Frames</th>
+                            <th>Rate (/s)</th>
+                        </tr>
+                    </thead>
+                    <tbody id="latest_body">
+                        %LATEST_MESSAGES%
+                    </tbody>
+                </table>
+            </div>
+
+            <div class="top-panel">
+                <div class="top-list">
+                    <h3>Busiest (frames/s)</h3>
+                    <table><tbody id="top_frameRate"></tbody></table>
+                </div>
+                <div class="top-list">
+                    <h3>Most changing (changes/s)</h3>
+                    <table><tbody id="top_changeRate"></tbody></table>
+                </div>
+                <div class="top-list">
+                    <h3>Bytes changed (/s)</h3>
+                    <table><tbody id="top_bytesChanged"></tbody></table>
+                </div>
+            </div>
+
+            <div class="transmit-section">
+                <h2>Transmit Message</h2>
+                <p style="font-size: 0.95em; color: #666;">Click a row above to copy its data, or enter values manually. Enter sends, and so does double-clicking a row.</p>
+                <div style="display: flex; gap: 24px; margin-bottom: 20px; flex-wrap: wrap;">
+                    <div class="transmit-field">
+                        <label for="tx_id">ID (hex)</label>
+                        <input type="text" id="tx_id" placeholder="123" />
+                    </div>
+                    <div class="transmit-field">
+                        <label for="tx_extended">Extended (29-bit)</label>
+                        <input type="checkbox" id="tx_extended" />
+                    </div>
+                    <div class="transmit-field">
+                        <label for="tx_length">Length (bytes)</label>
+                        <input type="number" id="tx_length" min="0" max="8" value="1" onchange="updateByteInputs()" />
+                    </div>
+                </div>
+                <div style="margin-bottom: 16px;">
+                    <label style="font-weight: 600; display: block; margin-bottom: 12px; color: #1a1a1a;">Data (hex bytes)</label>
+                    <div style="display: flex; gap: 12px; flex-wrap: wrap;">
+                        <div class="transmit-field" style="margin: 0;">
+                            <label style="font-weight: normal; font-size: 0.85em;">Byte 0</label>
+                            <input type="text" id="tx_byte_0" class="byte-input" placeholder="00" />
+                        </div>
+                        <div class="transmit-field" style="margin: 0;">
+                            <label style="font-weight: normal; font-size: 0.85em;">Byte 1</label>
+                            <input type="text" id="tx_byte_1" class="byte-input" placeholder="00" />
+                        </div>
+                        <div class="transmit-field" style="margin: 0;">
+                            <label style="font-weight: normal; font-size: 0.85em;">Byte 2</label>
+                            <input type="text" id="tx_byte_2" class="byte-input" placeholder="00" />
+                        </div>
+                        <div class="transmit-field" style="margin: 0;">
+                            <label style="font-weight: normal; font-size: 0.85em;">Byte 3</label>
+                            <input type="text" id="tx_byte_3" class="byte-input" placeholder="00" />
+                        </div>
+                        <div class="transmit-field" style="margin: 0;">
+                            <label style="font-weight: normal; font-size: 0.85em;">Byte 4</label>
+                            <input type="text" id="tx_byte_4" class="byte-input" placeholder="00" />
+                        </div>
+                        <div class="transmit-field" style="margin: 0;">
+                            <label style="font-weight: normal; font-size: 0.85em;">Byte 5</label>
+                            <input type="text" id="tx_byte_5" class="byte-input" placeholder="00" />
+                        </div>
+                        <div class="transmit-field" style="margin: 0;">
+                            <label style="font-weight: normal; font-size: 0.85em;">Byte 6</label>
+                            <input type="text" id="tx_byte_6" class="byte-input" placeholder="00" />
+                        </div>
+                        <div class="transmit-field" style="margin: 0;">
+                            <label style="font-weight: normal; font-size: 0.85em;">Byte 7</label>
+                            <input type="text" id="tx_byte_7" class="byte-input" placeholder="00" />
+                        </div>
+                    </div>
+                </div>
+                <button onclick="sendTransmit(event)">Transmit</button>
+                <div id="transmit_status" class="status-message"></div>
+            </div>
+        </div>
+
+        <div id="filter-page" class="page">
+            <h2>Filtered Recent Messages</h2>
+            <div class="filters">
+                <div class="filter-actions">
+                    <button onclick="setAll(true)">Select All</button>
+                    <button onclick="setAll(false)">Clear All</button>
+                    <span class="status">Tracking <span id="id_count">0</span> IDs</span>
+                </div>
+                <div class="filter-actions">
+                    <input type="text" id="search_pattern" placeholder="?? 3C ?? ?? 0x?F" />
+                    <button onclick="searchAndFetch()">Select matching</button>
+                    <label><input type="checkbox" id="search_live" /> Live</label>
+                    <span class="status" id="search_status"></span>
+                </div>
+                <div id="id_list"></div>
+            </div>
+            <table>
+                <thead>
+                    <tr>
+                        <th>ID</th>
+                        <th>Length</th>
+                        <th>Data</th>
+                        <th>RX Time (ms)</th>
+                        <th>Age (ms)</th>
+                    </tr>
+                </thead>
+                <tbody id="filtered_body"></tbody>
+            </table>
+        </div>
+    </main>
+    <script>
+        const GRID_POLL_MS = 1000; // refresh interval for filtered table (1000ms = 1 update per second)
+        const ID_REFRESH_MS = 3000; // refresh interval for ID list (3000ms = every 3 seconds)
+        let selectedIds = new Set();
+        let lastIdRefresh = 0;
+        let filteredPageIntervals = { gridInterval: null, idInterval: null };
+        let filteredPageInitialized = false;
+
+        async function fetchIds()
+        {
+            const now = Date.now();
+            if (now - lastIdRefresh < ID_REFRESH_MS) {
+                return;
+            }
+            lastIdRefresh = now;
+            try
+            {
+                const res = await fetch('/filtered_ids', {cache: 'no-store'});
+                if (!res.ok) return;
+                const ids = await res.json();
+                renderIdList(ids);
+            }
+            catch (e)
+            {
+                console.error('Failed to fetch IDs', e);
+            }
+        }
+
+        function renderIdList(ids)
+        {
+            const container = document.getElementById('id_list');
+            const previousSelection = new Set(selectedIds);
+            const hadManualSelection = previousSelection.size > 0;
+            container.innerHTML = '';
+            ids.forEach(id => {
+                const label = document.createElement('label');
+                label.className = 'id-option';
+                const checkbox = document.createElement('input');
+                checkbox.type = 'checkbox';
+                checkbox.value = id;
+                const shouldCheck = !hadManualSelection || previousSelection.has(id);
+                checkbox.checked = shouldCheck;
+                if (shouldCheck) {
+                    selectedIds.add(id);
+                } else {
+                    selectedIds.delete(id);
+                }
+                checkbox.addEventListener('change', () => {
+                    if (checkbox.checked) {
+                        selectedIds.add(id);
+                    } else {
+                        selectedIds.delete(id);
+                    }
+                    fetchFilteredMessages();
+                });
+                const text = document.createElement('span');
+                text.textContent = id;
+                label.appendChild(checkbox);
+                label.appendChild(text);
+                container.appendChild(label);
+            });
+            if (!hadManualSelection && ids.length)
+            {
+                selectedIds = new Set(ids);
+                document.querySelectorAll('#id_list input[type=checkbox]').forEach(cb => cb.checked = true);
+            }
+            document.getElementById('id_count').textContent = ids.length;
+        }
+
+        function setAll(state)
+        {
+            selectedIds = state ? new Set(Array.from(document.querySelectorAll('#id_list input')).map(cb => cb.value))
+                                : new Set();
+            document.querySelectorAll('#id_list input').forEach(cb => cb.checked = state);
+            fetchFilteredMessages();
+        }
+
+        function getSelectedIdsParam()
+        {
+            if (selectedIds.size === 0) {
+                return '';
+            }
+            return Array.from(selectedIds).join(',');
+        }
+
+        async function fetchFilteredMessages()
+        {
+            try
+            {
+                const idsParam = getSelectedIdsParam();
+                const url = '/filtered_messages?ids=' + encodeURIComponent(idsParam);
+                const res = await fetch(url, {cache: 'no-store'});
+                if (!res.ok) return;
+                const html = await res.text();
+                const body = document.getElementById('filtered_body');
+                body.style.opacity = 0.2;
+                requestAnimationFrame(() => {
+                    body.innerHTML = html;
+                    body.style.opacity = 1.0;
+                });
+            }
+            catch (e)
+            {
+                console.error('Failed to fetch filtered messages', e);
+            }
+        }
+
+        // Selects the IDs whose latest payload matches the pattern (see
+        // /search); with Live checked the search repeats on every refresh
+        async function applySearch()
+        {
+            const pattern = document.getElementById('search_pattern').value.trim();
+            const status = document.getElementById('search_status');
+            if (!pattern) {
+                status.textContent = '';
+                return;
+            }
+            try
+            {
+                const res = await fetch('/search?pattern=' + encodeURIComponent(pattern), {cache: 'no-store'});
+                if (!res.ok) {
+                    status.textContent = 'Invalid pattern';
+                    return;
+                }
+                const ids = await res.json();
+                selectedIds = new Set(ids);
+                document.querySelectorAll('#id_list input').forEach(cb => cb.checked = selectedIds.has(cb.value));
+                status.textContent = ids.length + ' matching';
+            }
+            catch (e)
+            {
+                console.error('Search failed', e);
+            }
+        }
+
+        async function searchAndFetch()
+        {
+            await applySearch();
+            fetchFilteredMessages();
+        }
+
+        async function refreshFiltered()
+        {
+            if (document.getElementById('search_live').checked) {
+                await applySearch();
+            }
+            fetchFilteredMessages();
+        }
+
+        function startFilteredPage()
+        {
+            // Prevent multiple initializations
+            if (filteredPageInitialized) {
+                return;
+            }
+            filteredPageInitialized = true;
+            
+            // Clear any existing intervals first
+            if (filteredPageIntervals.gridInterval !== null) {
+                clearInterval(filteredPageIntervals.gridInterval);
+            }
+            if (filteredPageIntervals.idInterval !== null) {
+                clearInterval(filteredPageIntervals.idInterval);
+            }
+            
+            // Fetch initial data
+            fetchIds().then(fetchFilteredMessages);
+            
+            // Set up new intervals
+            filteredPageIntervals.gridInterval = setInterval(refreshFiltered, GRID_POLL_MS);
+            filteredPageIntervals.idInterval = setInterval(fetchIds, ID_REFRESH_MS);
+        }
+
+        window.addEventListener('load', startFilteredPage);
+    </script>
+</head>
+<body>
+</body>
+</html>
+)html";
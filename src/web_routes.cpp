@@ -0,0 +1,376 @@
+#include "web_routes.h"
+#include "state_table.h"
+#include "view_order.h"
+#include "view_sampler.h"
+#include "payload_search.h"
+#include "render_buffer.h"
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+    constexpr size_t MAX_NAME_BYTES = 16;     // Longest sort, series or mode name, with its NUL
+
+    // Copies a name parameter for the parsers that take a C string; false
+    // when it cannot be one of the names
+    bool copyName(const RequestParser::Param& param, char* out)
+    {
+        return RequestParser::copyConfigField(param.data, param.length, out, MAX_NAME_BYTES);
+    }
+
+    bool isOne(const RequestParser::Param& param)
+    {
+        return param.length == 1 && param.data[0] == '1';
+    }
+}
+
+bool (*WebRoutes::s_save)(const DeviceConfig::Settings& settings) = nullptr;
+
+RequestParser::Param WebRoutes::Request::param(const char* name) const
+{
+    RequestParser::Param value;
+    if (!lookup || !lookup(source, name, value))
+    {
+        value = RequestParser::Param();
+    }
+    return value;
+}
+
+void WebRoutes::Reply::set(uint16_t code, const char* text)
+{
+    status = code;
+    length = std::min(strlen(text), sizeof(body));
+    memcpy(body, text, length);
+}
+
+void WebRoutes::setSaveCallback(bool (*save)(const DeviceConfig::Settings& settings))
+{
+    s_save = save;
+}
+
+// GET /latest_messages[?sort=id|update|change|rate|dlc&offset=0&limit=50].
+// Without parameters every row is sent in ID order.
+bool WebRoutes::latest(const Request& request, HeapGuard::Scope scope, uint32_t now, ViewRenderer::Context*& ctx,
+                       Reply& reply)
+{
+    RequestParser::Param sort = request.param("sort");
+    RequestParser::Param offset = request.param("offset");
+    RequestParser::Param limit = request.param("limit");
+    if (!sort.data && !offset.data && !limit.data)
+    {
+        ctx = ViewRenderer::claim(ViewRenderer::View::LatestRows, scope, now);
+        return true;
+    }
+
+    ViewOrder::Order order = ViewOrder::Order::Id;
+    char name[MAX_NAME_BYTES];
+    if (sort.data && (!copyName(sort, name) || !ViewOrder::parseOrder(name, order)))
+    {
+        reply.contentType = "text/plain";
+        reply.set(400, "Unknown sort order");
+        return false;
+    }
+    uint32_t capacity = StateTable::capacity();
+    uint32_t first = offset.data ? RequestParser::leadingNumber(offset, 10) : 0;
+    uint32_t count = limit.data ? RequestParser::leadingNumber(limit, 10) : capacity;
+    ctx = ViewRenderer::claim(ViewRenderer::View::LatestPage, scope, now);
+    if (ctx)
+    {
+        ctx->slotCount = ViewOrder::page(order, static_cast<uint16_t>(std::min(first, capacity)),
+                                         static_cast<uint16_t>(std::min(count, capacity)), ctx->slots);
+    }
+    return true;
+}
+
+// GET /filtered_messages?ids=0x1A0,0x2B0
+bool WebRoutes::filtered(const Request& request, HeapGuard::Scope scope, uint32_t now, ViewRenderer::Context*& ctx,
+                         Reply& reply)
+{
+    ctx = ViewRenderer::claim(ViewRenderer::View::FilteredRows, scope, now);
+    RequestParser::Param ids = request.param("ids");
+    if (ctx && ids.data)
+    {
+        ctx->idsRequested = ids.length > 0;
+        ctx->slotCount = RequestParser::parseIdList(ids.data, ids.length, ctx->slots, StateTable::capacity());
+    }
+    return true;
+}
+
+// GET /search?pattern=??+3C&min=0x100&max=0x1FF&width=2: IDs whose latest
+// payload matches, as a JSON list like /filtered_ids
+bool WebRoutes::search(const Request& request, HeapGuard::Scope scope, uint32_t now, ViewRenderer::Context*& ctx,
+                       Reply& reply)
+{
+    RequestParser::SearchParams params;
+    params.pattern = request.param("pattern");
+    params.at = request.param("at");
+    params.width = request.param("width");
+    params.min = request.param("min");
+    params.max = request.param("max");
+    params.endian = request.param("endian");
+
+    PayloadSearch::Query query;
+    if (!RequestParser::parseSearchQuery(params, query))
+    {
+        reply.set(400, "{\"error\":\"Invalid pattern or range\"}");
+        return false;
+    }
+    ctx = ViewRenderer::claim(ViewRenderer::View::SlotListJson, scope, now);
+    if (ctx)
+    {
+        ctx->slotCount = PayloadSearch::run(query, ctx->slots, StateTable::capacity());
+    }
+    return true;
+}
+
+// GET /history?series=frameRate|busLoad|idRate&step=1|10|60[&id=0x1A0]
+bool WebRoutes::history(const Request& request, RateHistory::Export& exp, Reply& reply)
+{
+    RequestParser::Param value = request.param("series");
+    RateHistory::Series series = RateHistory::Series::FrameRate;
+    char name[MAX_NAME_BYTES];
+    if (value.data && (!copyName(value, name) || !RateHistory::parseSeries(name, series)))
+    {
+        reply.set(400, "{\"error\":\"Unknown series\"}");
+        return false;
+    }
+    value = request.param("step");
+    int8_t level = RateHistory::levelForStep(value.data ? RequestParser::leadingNumber(value, 10) : 1);
+    if (level < 0)
+    {
+        reply.set(400, "{\"error\":\"Step must be 1, 10 or 60\"}");
+        return false;
+    }
+    value = request.param("id");
+    uint32_t id = value.data ? RequestParser::leadingNumber(value, 16) : RateHistory::NO_ID;
+    if (!RateHistory::beginExport(exp, series, static_cast<uint8_t>(level), id))
+    {
+        reply.set(404, "{\"error\":\"ID is not watched\"}");
+        return false;
+    }
+    return true;
+}
+
+// GET /top[?n=10]: the busiest and most-changing IDs of the last window
+void WebRoutes::top(const Request& request, TopIds::Export& exp)
+{
+    RequestParser::Param value = request.param("n");
+    uint32_t limit = value.data ? RequestParser::leadingNumber(value, 10) : TOP_IDS_COUNT;
+    TopIds::beginExport(exp, static_cast<uint8_t>(std::min<uint32_t>(limit, TOP_IDS_COUNT)));
+}
+
+// GET /histogram?id=0x1A0[&pair=2,3]
+bool WebRoutes::histogram(const Request& request, ByteHistogram::Export& exp, Reply& reply)
+{
+    RequestParser::Param value = request.param("id");
+    if (!value.data)
+    {
+        reply.set(400, "{\"error\":\"Missing id\"}");
+        return false;
+    }
+    uint32_t id = RequestParser::leadingNumber(value, 16);
+    uint8_t first = 0;
+    uint8_t second = 0;
+    value = request.param("pair");
+    bool pair = value.data != nullptr;
+    if (pair && !RequestParser::parseBytePair(value.data, value.length, first, second))
+    {
+        reply.set(400, "{\"error\":\"Pair must be two distinct bytes 0-7\"}");
+        return false;
+    }
+
+    if (pair ? !ByteHistogram::beginPairExport(exp, id, first, second) : !ByteHistogram::beginExport(exp, id))
+    {
+        reply.set(404, "{\"error\":\"Not selected\"}");
+        return false;
+    }
+    return true;
+}
+
+// POST /sampling with mode=off|ratio|interval[&value=N]
+void WebRoutes::sampling(const Request& request, Reply& reply)
+{
+    RequestParser::Param value = request.param("mode");
+    if (!value.data)
+    {
+        reply.set(400, "{\"error\":\"Missing mode\"}");
+        return;
+    }
+    ViewSampler::Mode mode;
+    char name[MAX_NAME_BYTES];
+    if (!copyName(value, name) || !ViewSampler::parseMode(name, mode))
+    {
+        reply.set(400, "{\"error\":\"Unknown mode\"}");
+        return;
+    }
+    value = request.param("value");
+    uint32_t samplingValue = value.data ? RequestParser::leadingNumber(value, 10) : 1;
+    if (mode != ViewSampler::Mode::Off && samplingValue == 0)
+    {
+        reply.set(400, "{\"error\":\"Value must be at least 1\"}");
+        return;
+    }
+
+    DeviceConfig::Settings settings;
+    DeviceConfig::capture(settings);
+    settings.samplingMode = mode;
+    settings.samplingValue = samplingValue;
+    if (!DeviceConfig::validate(settings))
+    {
+        reply.set(400, "{\"error\":\"Invalid configuration\"}");
+        return;
+    }
+    if (!commit(settings, reply))
+    {
+        return;
+    }
+    RenderBuffer out(reply.body, sizeof(reply.body));
+    out.append("{\"mode\":\"");
+    out.append(ViewSampler::modeName(settings.samplingMode));
+    out.append("\",\"value\":");
+    out.appendDec(settings.samplingValue);
+    out.append(",\"stages\":");
+    out.append(SAMPLED_STAGES_JSON);
+    out.appendChar('}');
+    reply.status = 200;
+    reply.length = out.length();
+}
+
+// POST /history_watch with id=0x1A0 starts per-ID history; remove=1 stops it
+void WebRoutes::historyWatch(const Request& request, Reply& reply)
+{
+    RequestParser::Param value = request.param("id");
+    if (!value.data)
+    {
+        reply.set(400, "{\"error\":\"Missing id\"}");
+        return;
+    }
+    uint32_t id = RequestParser::leadingNumber(value, 16);
+    bool remove = isOne(request.param("remove"));
+    DeviceConfig::Settings settings;
+    DeviceConfig::capture(settings);
+    if (!DeviceConfig::watchHistory(settings, id, remove) || !DeviceConfig::validate(settings))
+    {
+        reply.set(remove ? 404 : 409,
+                  remove ? "{\"error\":\"ID is not watched\"}" : "{\"error\":\"All watch slots are in use\"}");
+        return;
+    }
+    if (commit(settings, reply))
+    {
+        renderIds(reply, "watched", settings.historyIds, settings.historyCount);
+    }
+}
+
+// POST /histogram_watch with id=0x1A0[&pair=2,3] selects an ID (or a pair);
+// remove=1 drops it again
+void WebRoutes::histogramWatch(const Request& request, Reply& reply)
+{
+    RequestParser::Param value = request.param("id");
+    if (!value.data)
+    {
+        reply.set(400, "{\"error\":\"Missing id\"}");
+        return;
+    }
+    DeviceConfig::Pair selection;
+    selection.id = RequestParser::leadingNumber(value, 16);
+    bool remove = isOne(request.param("remove"));
+    value = request.param("pair");
+    bool pair = value.data != nullptr;
+    if (pair && !RequestParser::parseBytePair(value.data, value.length, selection.first, selection.second))
+    {
+        reply.set(400, "{\"error\":\"Pair must be two distinct bytes 0-7\"}");
+        return;
+    }
+
+    DeviceConfig::Settings settings;
+    DeviceConfig::capture(settings);
+    bool done = pair ? DeviceConfig::selectPair(settings, selection, remove)
+                     : DeviceConfig::selectHistogram(settings, selection.id, remove);
+    if (!done || !DeviceConfig::validate(settings))
+    {
+        reply.set(remove ? 404 : 409,
+                  remove ? "{\"error\":\"Not selected\"}" : "{\"error\":\"Histogram pool is full\"}");
+        return;
+    }
+    if (commit(settings, reply))
+    {
+        renderIds(reply, "selected", settings.histogramIds, settings.histogramCount);
+    }
+}
+
+// GET /config: the settings as they are now
+void WebRoutes::config(Reply& reply)
+{
+    DeviceConfig::Settings settings;
+    DeviceConfig::capture(settings);
+    reply.length = DeviceConfig::renderJson(settings, reply.body, sizeof(reply.body));
+    if (reply.length == 0)
+    {
+        reply.set(500, "{\"error\":\"Configuration too large\"}");
+        return;
+    }
+    reply.status = 200;
+}
+
+// POST /config with any of bitrate, mode, filter_id, filter_mask, filter_ext,
+// sampling, sampling_value, history, histograms, pairs and sync_peer, applied
+// over the current settings
+void WebRoutes::configSave(const Request& request, Reply& reply)
+{
+    RequestParser::ConfigParams params;
+    params.bitrate = request.param("bitrate");
+    params.mode = request.param("mode");
+    params.filterId = request.param("filter_id");
+    params.filterMask = request.param("filter_mask");
+    params.filterExtended = request.param("filter_ext");
+    params.sampling = request.param("sampling");
+    params.samplingValue = request.param("sampling_value");
+    params.history = request.param("history");
+    params.histograms = request.param("histograms");
+    params.pairs = request.param("pairs");
+    params.syncPeer = request.param("sync_peer");
+
+    DeviceConfig::Settings settings;
+    DeviceConfig::capture(settings);
+    if (!RequestParser::parseConfigForm(params, settings) || !DeviceConfig::validate(settings))
+    {
+        reply.set(400, "{\"error\":\"Invalid configuration\"}");
+        return;
+    }
+    if (commit(settings, reply))
+    {
+        config(reply);
+    }
+}
+
+// Saves validated settings and applies them; false with a 500 reply when
+// saving failed, and nothing is applied then
+bool WebRoutes::commit(DeviceConfig::Settings& settings, Reply& reply)
+{
+    if (s_save && !s_save(settings))
+    {
+        reply.set(500, "{\"error\":\"Saving failed\"}");
+        return false;
+    }
+    DeviceConfig::apply(settings);
+    DeviceConfig::capture(settings);     // Pairs select their ID as well
+    return true;
+}
+
+// {"<name>":["0x1a0",...]}
+void WebRoutes::renderIds(Reply& reply, const char* name, const uint32_t* ids, uint8_t count)
+{
+    RenderBuffer out(reply.body, sizeof(reply.body));
+    out.append("{\"");
+    out.append(name);
+    out.append("\":[");
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        out.append(i > 0 ? ",\"0x" : "\"0x");
+        out.appendHex(ids[i]);
+        out.appendChar('"');
+    }
+    out.append("]}");
+    reply.status = 200;
+    reply.length = out.length();
+}
@@ -0,0 +1,37 @@
+// Runs the alloc workload, which fails when the frame ingest path allocates
+// once the state table is warm. Needs the allocator hooks of the native
+// build (--wrap=malloc and ALLOC_TRACKING); without them nothing is counted.
+#include <unity.h>
+#include "host_commands.h"
+#include "heap_guard.h"
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_hot_path_allocates_nothing()
+{
+#ifndef HEAP_GUARD_HOOKS
+    TEST_IGNORE_MESSAGE("built without allocator hooks");
+#endif
+    // More IDs than the table holds, so eviction is on the path as well
+    char command[] = "alloc";
+    char frames[] = "--frames";
+    char frameCount[] = "200000";
+    char ids[] = "--ids";
+    char idCount[] = "3000";
+    char* argv[] = { command, frames, frameCount, ids, idCount };
+    TEST_ASSERT_EQUAL_INT(0, runAllocCommand(5, argv));
+    TEST_ASSERT_EQUAL_UINT32(0, HeapGuard::counters().hotPathAllocations);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_hot_path_allocates_nothing);
+    return UNITY_END();
+}
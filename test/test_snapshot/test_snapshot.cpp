@@ -0,0 +1,40 @@
+// Renders the snapshot frame sequence and compares every view with the
+// hashes recorded in views.golden next to this file. After an intended
+// rendering change, record them again with
+//   .pio/build/native/program snapshot --record test/test_snapshot/views.golden
+#include <unity.h>
+#include "host_commands.h"
+#include <string>
+
+namespace
+{
+    std::string goldenPath()
+    {
+        std::string path = __FILE__;
+        return path.substr(0, path.find_last_of("/\\") + 1) + "views.golden";
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_views_match_golden()
+{
+    std::string golden = goldenPath();
+    char command[] = "snapshot";
+    char check[] = "--check";
+    char* argv[] = { command, check, &golden[0] };
+    TEST_ASSERT_EQUAL_INT(0, runSnapshotCommand(3, argv));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_views_match_golden);
+    return UNITY_END();
+}
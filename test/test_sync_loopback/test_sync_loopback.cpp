@@ -0,0 +1,172 @@
+// Two serve instances on loopback stand in for two monitors. The second has
+// a clock 1.5 s ahead that runs 50 ppm fast, and follows the first. Checks
+// that its estimate converges on the true clock, and that merging both
+// captures gives one log in time order with frames of both, the follower's
+// on the reference timeline. The servers run in child processes (POSIX
+// fork) on fixed loopback ports. The reference keeps the host's steady
+// clock, so the test can tell when on that timeline it stopped the follower.
+#include <unity.h>
+#include "host_commands.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    constexpr unsigned RUN_SECONDS = 8;
+    constexpr int MAX_ERROR_US = 2000;      // A few exchanges on loopback get well within this
+    // The follower captures until it is stopped; its last frame is at most
+    // a poll and a scheduling delay before that
+    constexpr unsigned long long LAST_FRAME_SLACK_US = 100000;
+
+    std::string g_directory;
+
+    unsigned long long steadyNowUs()
+    {
+        return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    std::string path(const char* name)
+    {
+        return g_directory + "/" + name;
+    }
+
+    // Runs a host command in a child process, its output going to a file
+    pid_t spawn(int (*run)(int, char**), std::vector<std::string> args, const std::string& outputPath)
+    {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            std::vector<char*> argv;
+            for (std::string& arg : args)
+            {
+                argv.push_back(&arg[0]);
+            }
+            _exit(freopen(outputPath.c_str(), "w", stdout) ? run(static_cast<int>(argv.size()), argv.data()) : 1);
+        }
+        return pid;
+    }
+
+    // Stops a server as Ctrl-C would, so it writes out its capture
+    int stop(pid_t pid)
+    {
+        int status = 0;
+        kill(pid, SIGINT);
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_offset_converges_and_merge_is_ordered()
+{
+    char directory[] = "/tmp/canmon_syncXXXXXX";
+    TEST_ASSERT_TRUE(mkdtemp(directory) != nullptr);
+    g_directory = directory;
+
+    unsigned long long startUs = steadyNowUs();
+    pid_t reference = spawn(runServeCommand, { "serve", "--port", "18093", "--sync-port", "13190",
+                                               "--capture", path("reference.cms"), "--report-s", "1" },
+                            path("reference.txt"));
+    pid_t follower = spawn(runServeCommand, { "serve", "--port", "18094", "--sync-port", "13191",
+                                              "--sync-peer", "127.0.0.1:13190", "--clock-offset-us", "1500000",
+                                              "--clock-drift-ppm", "50", "--capture", path("follower.cms"),
+                                              "--report-s", "1" },
+                           path("follower.txt"));
+    sleep(RUN_SECONDS);
+    unsigned long long stoppingUs = steadyNowUs();
+    TEST_ASSERT_EQUAL_INT(0, stop(follower));
+    unsigned long long stoppedUs = steadyNowUs();
+    TEST_ASSERT_EQUAL_INT(0, stop(reference));
+
+    // The last report of the follower says how far its estimate of the
+    // reference time is from the true clock
+    FILE* report = fopen(path("follower.txt").c_str(), "r");
+    TEST_ASSERT_TRUE(report != nullptr);
+    char line[512];
+    bool synced = false;
+    long long errorUs = 0;
+    while (fgets(line, sizeof(line), report))
+    {
+        const char* error = strstr(line, ", error ");
+        synced = synced || error;
+        if (error)
+        {
+            errorUs = strtoll(error + strlen(", error "), nullptr, 10);
+        }
+    }
+    fclose(report);
+    TEST_ASSERT_TRUE_MESSAGE(synced, "the follower never synced");
+    TEST_ASSERT_INT_WITHIN(MAX_ERROR_US, 0, static_cast<int>(errorUs));
+
+    std::string mergedPath = path("merged.log");
+    std::vector<std::string> args = { "merge", "--interfaces", "reference,follower", "--out", mergedPath,
+                                      path("reference.cms"), path("follower.cms") };
+    std::vector<char*> argv;
+    for (std::string& arg : args)
+    {
+        argv.push_back(&arg[0]);
+    }
+    TEST_ASSERT_EQUAL_INT(0, runMergeCommand(static_cast<int>(argv.size()), argv.data()));
+
+    // candump lines: (seconds.micros) interface id#data
+    FILE* merged = fopen(mergedPath.c_str(), "r");
+    TEST_ASSERT_TRUE(merged != nullptr);
+    unsigned long long previousUs = 0;
+    uint32_t outOfOrder = 0;
+    uint32_t frames[2] = {};
+    unsigned long long firstUs[2] = {};
+    unsigned long long lastUs[2] = {};
+    unsigned long long seconds;
+    unsigned long long micros;
+    char interface[32];
+    while (fscanf(merged, " (%llu.%llu) %31s %*s", &seconds, &micros, interface) == 3)
+    {
+        unsigned long long us = seconds * 1000000 + micros;
+        outOfOrder += us < previousUs;
+        previousUs = us;
+        int source = strcmp(interface, "reference") == 0 ? 0 : 1;
+        firstUs[source] = frames[source]++ == 0 ? us : firstUs[source];
+        lastUs[source] = us;
+    }
+    fclose(merged);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, frames[0]);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, frames[1]);
+    TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+
+    // Off by the 1.5 s offset or the drift, the follower's frames would
+    // fall before the servers started or after it was stopped
+    TEST_ASSERT_TRUE_MESSAGE(firstUs[1] + MAX_ERROR_US >= startUs, "follower frames before the start");
+    TEST_ASSERT_TRUE_MESSAGE(firstUs[1] + MAX_ERROR_US >= firstUs[0], "follower frames before the reference's");
+    TEST_ASSERT_TRUE_MESSAGE(lastUs[1] <= stoppedUs + MAX_ERROR_US, "follower frames after it was stopped");
+    TEST_ASSERT_TRUE_MESSAGE(lastUs[1] + LAST_FRAME_SLACK_US >= stoppingUs, "follower frames end too early");
+    TEST_ASSERT_TRUE_MESSAGE(lastUs[1] <= lastUs[0] + MAX_ERROR_US, "follower frames after the reference's");
+
+    for (const char* name : { "reference.cms", "reference.txt", "follower.cms", "follower.txt", "merged.log" })
+    {
+        remove(path(name).c_str());
+    }
+    rmdir(directory);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_offset_converges_and_merge_is_ordered);
+    return UNITY_END();
+}